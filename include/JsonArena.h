@@ -0,0 +1,110 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define COMMAND_MAX_LENGTH 256 // longer or fragmented websocket messages are refused
+
+// Parse space for one JSON command. ArduinoJson takes its first slot pool
+// in one block, about 1 KiB on the ESP32 but 4 KiB on a 64-bit host, so
+// the native build needs a bigger arena for the same commands. The worst
+// command is a subscription naming as many fields as fit in
+// COMMAND_MAX_LENGTH: the pool, 19 distinct strings and the one being
+// parsed. By ArduinoJson 7.2's block sizes, plus this arena's 8 byte
+// headers, that peaks at about 1650 bytes on the ESP32 and 4850 on a
+// 64-bit host, 80% of either size. test_json_arena prints the measured peak.
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#define JSON_ARENA_SIZE 6144
+#else
+#define JSON_ARENA_SIZE 2048
+#endif
+
+// ArduinoJson allocator over a fixed buffer, so parsing a command never
+// touches the heap. Blocks are carved off in order and only the newest
+// one can grow or be given back in place; everything else is reclaimed
+// by reset(), which the owner calls once the document is gone. A
+// document that does not fit fails with DeserializationError::NoMemory.
+template <size_t SIZE>
+class JsonArena : public ArduinoJson::Allocator
+{
+public:
+    void *allocate(size_t size) override
+    {
+        size_t total = HEADER + align(size);
+        if (total > SIZE - used)
+        {
+            return NULL;
+        }
+        memcpy(buffer + used, &size, sizeof(size));
+        last = used + HEADER;
+        used += total;
+        peak = used > peak ? used : peak;
+        return buffer + last;
+    }
+
+    void deallocate(void *ptr) override
+    {
+        if (ptr != NULL && ptr == buffer + last)
+        {
+            used = last - HEADER;
+            last = NONE;
+        }
+    }
+
+    void *reallocate(void *ptr, size_t size) override
+    {
+        if (ptr == NULL)
+        {
+            return allocate(size);
+        }
+        uint8_t *block = (uint8_t *)ptr;
+        size_t old;
+        memcpy(&old, block - HEADER, sizeof(old));
+        if (block == buffer + last)
+        {
+            if (align(size) > SIZE - last)
+            {
+                return NULL;
+            }
+            memcpy(block - HEADER, &size, sizeof(size));
+            used = last + align(size);
+            peak = used > peak ? used : peak;
+            return block;
+        }
+        if (size <= old)
+        {
+            memcpy(block - HEADER, &size, sizeof(size));
+            return block;
+        }
+        void *moved = allocate(size);
+        if (moved != NULL)
+        {
+            memcpy(moved, block, old);
+        }
+        return moved;
+    }
+
+    void reset()
+    {
+        used = 0;
+        last = NONE;
+    }
+
+    size_t highWater() const { return peak; }
+
+private:
+    static constexpr size_t HEADER = 8; // block size, keeps blocks 8 byte aligned
+    static constexpr size_t NONE = (size_t)-1;
+
+    static size_t align(size_t size) { return (size + 7) & ~(size_t)7; }
+
+    alignas(8) uint8_t buffer[SIZE];
+    size_t used = 0;
+    size_t last = NONE;
+    size_t peak = 0;
+};
+
+#endif
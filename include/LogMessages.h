@@ -0,0 +1,109 @@
+#ifndef LOG_MESSAGES_H
+#define LOG_MESSAGES_H
+
+#include <Arduino.h>
+#include <freertos/task.h>
+#include <DeferredLog.h>
+
+// Everything the task loops log, one line per message:
+//   X(name, level, category, format)
+// LOG(name, args...) stores the id, micros() and the arguments in the
+// deferred log (lib/DeferredLog), logTask formats them later. Arguments are
+// integers or pointers, %s ones must point at strings that live forever
+// (literals, task names). Messages below LOG_LEVEL or outside
+// LOG_CATEGORIES compile to nothing, arguments included.
+//
+// scripts/decode_log.py reads this table to decode binary captures, so add
+// new messages at the end and keep the formats on one line.
+#define LOG_MESSAGES(X)                                                                                \
+    X(DROPPED, LOG_WARN, LOG_CAT_SYSTEM, "Log overflow, %u records dropped")                           \
+    X(CLIENT_CONNECTED, LOG_INFO, LOG_CAT_NET, "Client %u connected.")                                 \
+    X(CLIENT_DISCONNECTED, LOG_INFO, LOG_CAT_NET, "Client %u disconnected.")                           \
+    X(JSON_INVALID, LOG_WARN, LOG_CAT_NET, "Failed to parse JSON: %s")                                 \
+    X(FRAME_INVALID, LOG_WARN, LOG_CAT_NET, "Bad binary frame: %s")                                    \
+    X(HEAP_ALLOCATION, LOG_WARN, LOG_CAT_SYSTEM, "Heap allocation in %s: %u bytes from %p, %u so far") \
+    X(SERVO_MOVE, LOG_DEBUG, LOG_CAT_MOTION, "Move servo %u to %u at speed %u")                        \
+    X(BUS_TX, LOG_DEBUG, LOG_CAT_BUS, "Bus tx %u bytes: %08x %08x %08x")                               \
+    X(CAMERA_MOVE, LOG_DEBUG, LOG_CAT_CAMERA, "CameraControlTask - Pan: %d, Tilt: %d")
+
+enum LogLevel : uint8_t
+{
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+};
+
+enum LogCategory : uint8_t
+{
+    LOG_CAT_SYSTEM,
+    LOG_CAT_NET,
+    LOG_CAT_MOTION,
+    LOG_CAT_BUS,
+    LOG_CAT_CAMERA
+};
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO // lowest level built in, -DLOG_LEVEL=0 for debug messages
+#endif
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES 0xFF // bit per LogCategory
+#endif
+#ifndef LOG_BINARY
+#define LOG_BINARY 0 // 1 - logTask writes binary frames for scripts/decode_log.py instead of text
+#endif
+
+enum LogMessageId : uint16_t
+{
+#define X(name, level, category, format) LOG_##name,
+    LOG_MESSAGES(X)
+#undef X
+    LOG_MESSAGE_COUNT
+};
+
+constexpr uint8_t LOG_MESSAGE_LEVELS[] = {
+#define X(name, level, category, format) level,
+    LOG_MESSAGES(X)
+#undef X
+};
+
+constexpr uint8_t LOG_MESSAGE_CATEGORIES[] = {
+#define X(name, level, category, format) category,
+    LOG_MESSAGES(X)
+#undef X
+};
+
+const char *const LOG_MESSAGE_FORMATS[] = {
+#define X(name, level, category, format) format,
+    LOG_MESSAGES(X)
+#undef X
+};
+
+constexpr bool logEnabled(LogMessageId id)
+{
+    return LOG_MESSAGE_LEVELS[id] >= LOG_LEVEL && (LOG_CATEGORIES & (1u << LOG_MESSAGE_CATEGORIES[id])) != 0;
+}
+
+inline uint32_t logClock()
+{
+    return micros();
+}
+
+template <typename... Args>
+inline void logMessage(LogMessageId id, Args... args)
+{
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+    uintptr_t values[sizeof...(Args) + 1] = {(uintptr_t)args...};
+    logWrite(xPortGetCoreID(), id, logClock, values, sizeof...(Args));
+}
+
+#define LOG(name, ...)                                  \
+    do                                                  \
+    {                                                   \
+        if constexpr (logEnabled(LOG_##name))           \
+        {                                               \
+            logMessage(LOG_##name, ##__VA_ARGS__);      \
+        }                                               \
+    } while (0)
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TASK_LAYOUT_H
+#define TASK_LAYOUT_H
+
+#include <stdint.h>
+
+// Task layout. The WiFi driver, lwIP and AsyncTCP run on core 0, so command
+// handling, telemetry and link management stay there next to them. Motion, fire and camera control get
+// core 1 to themselves at priorities above Arduino's loopTask (1), with the
+// bus task on top so a move goes out as soon as the servo loop queues it.
+// A period of 0 means the task sleeps until notified or until its own
+// deadline (fire state, bus poll, next telemetry subscriber). Log output
+// goes out from logTask at the bottom of core 0, the loops above only
+// queue records for it.
+//
+// The table is shared with the host tests, which check the layout rules
+// above; src/main.cpp builds its TASKS array and TaskId from it.
+
+#define NETWORK_CORE 0 // PRO_CPU, shared with the WiFi driver
+#define CONTROL_CORE 1 // APP_CPU
+#define LOOP_TASK_PRIORITY 1 // Arduino's loopTask, on CONTROL_CORE
+#define ASYNC_TCP_PRIORITY 3 // AsyncTCP's default, on NETWORK_CORE
+
+#define CONTROL_LOOP_HZ 100 // servo setpoint rate, 50-200, rounded to whole RTOS ticks
+#define CONTROL_PERIOD_TICKS (configTICK_RATE_HZ / CONTROL_LOOP_HZ)
+#define CONTROL_PERIOD_US (CONTROL_PERIOD_TICKS * (1000000UL / configTICK_RATE_HZ)) // the period the loop actually runs at
+#define CAMERA_PERIOD_MS 30 // camera servo update and sweep step
+#define LOG_DRAIN_MS 50 // logTask period, the rings hold LOG_RING_RECORDS per core in between
+
+// X(id, function, name, stack bytes, priority, core, period ms)
+#define TASK_TABLE(X)                                                                                    \
+    X(TASK_COMMAND, commandTask, "CommandTask", 4096, 4, NETWORK_CORE, 0)                                \
+    X(TASK_SERVO, servoControlTask, "ServoControlTask", 3072, 5, CONTROL_CORE, CONTROL_PERIOD_US / 1000) \
+    X(TASK_FLYWHEEL, flywheelControlTask, "FlywheelControlTask", 2048, 4, CONTROL_CORE, 0)               \
+    X(TASK_UART, uartCommunicationTask, "UARTCommunicationTask", 2048, 6, CONTROL_CORE, 0)               \
+    X(TASK_TELEMETRY, telemetryTask, "TelemetryTask", 3072, 1, NETWORK_CORE, 0)                          \
+    X(TASK_CAMERA, cameraControlTask, "CameraControlTask", 2048, 3, CONTROL_CORE, CAMERA_PERIOD_MS)      \
+    X(TASK_WIFI, wifiTask, "WiFiTask", 3072, 1, NETWORK_CORE, 0)                                         \
+    X(TASK_LOG, logTask, "LogTask", 2560, 1, NETWORK_CORE, LOG_DRAIN_MS)
+
+#define TASK_TABLE_ID(id, function, name, stack, priority, core, period) id,
+enum TaskId : uint8_t
+{
+    TASK_TABLE(TASK_TABLE_ID)
+    TASK_COUNT
+};
+#undef TASK_TABLE_ID
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TURRET_STATE_H
+#define TURRET_STATE_H
+
+#include <stdint.h>
+
+// Everything an operator or the tracker can command. The websocket handler
+// is the only writer; it publishes a whole new copy through a Snapshot so
+// the control tasks never see a new pan with an old tilt, or a mode change
+// without its coordinates.
+//
+// Fire and abort are edge triggered: each request bumps its counter and
+// the fire task acts once for every change it sees.
+struct TurretCommand
+{
+    uint16_t pan = 500;
+    uint16_t tilt = 400;
+    uint16_t motorSpeed = 1000; // pan/tilt cruise velocity, position units/s
+    uint8_t mode = 2; // 0 - manual, 1 - sweap, 2 - auto
+    uint8_t fireMode = 0; // 0 - semi, 1 - burst, 2 - auto
+    uint8_t flywheelSpeed = 60;
+    uint8_t warmIdleSpeed = 0; // flywheel speed held between shots, 0 - off
+    uint8_t cameraPan = 90;
+    uint8_t cameraTilt = 90;
+    uint8_t scanPattern = 0; // ScanPatternId, sweep mode
+    uint16_t scanDwellMs = 0;
+    uint32_t warmIdleTimeout = 10000; // ms at warm idle before spinning down
+    uint32_t fireRequests = 0;
+    uint32_t abortRequests = 0;
+    uint32_t publishedUs = 0; // micros() at publish, for the latency metrics
+    uint32_t fireArrivalMs = 0; // millis() when the latest fire request was received
+};
+
+#define SCAN_TARGET_TIMEOUT_MS 1000 // sweep holds while the tracker reported a target this recently
+
+// Latest target position reported by the tracker, published by the
+// websocket handler next to the command. count changes with every
+// observation so the servo task can tell a repeat from a new one.
+struct TrackObservation
+{
+    uint32_t count = 0;
+    uint16_t pan = 0;
+    uint16_t tilt = 0;
+    uint32_t sourceMs = 0; // tracker's capture stamp, when timed
+    uint32_t arrivalMs = 0;
+    bool timed = false;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "DShot.h"
+
+namespace
+{
+    // 4 bit nibble to 5 bit GCR symbol, and back (0xFF - not a symbol)
+    const uint8_t GCR_ENCODE[16] = {0x19, 0x1B, 0x12, 0x13, 0x1D, 0x15, 0x16, 0x17,
+                                    0x1A, 0x09, 0x0A, 0x0B, 0x1E, 0x0D, 0x0E, 0x0F};
+
+    uint8_t gcrDecode(uint8_t symbol)
+    {
+        for (uint8_t nibble = 0; nibble < 16; nibble++)
+        {
+            if (GCR_ENCODE[nibble] == symbol)
+            {
+                return nibble;
+            }
+        }
+        return 0xFF;
+    }
+
+    uint8_t checksum(uint16_t value)
+    {
+        return (value ^ (value >> 4) ^ (value >> 8)) & 0x0F;
+    }
+
+    const uint16_t REPLY_STOPPED = 0x0FFF; // largest exponent and mantissa
+}
+
+uint16_t dshotThrottle(uint8_t speed)
+{
+    if (speed == 0)
+    {
+        return 0;
+    }
+    if (speed > 180)
+    {
+        speed = 180;
+    }
+    return DSHOT_THROTTLE_MIN + (uint32_t)speed * (DSHOT_THROTTLE_MAX - DSHOT_THROTTLE_MIN) / 180;
+}
+
+uint16_t dshotFrame(uint16_t value, bool telemetry, bool bidirectional)
+{
+    uint16_t packet = (value & 0x07FF) << 1 | (telemetry ? 1 : 0);
+    uint8_t crc = checksum(packet);
+    if (bidirectional)
+    {
+        crc = ~crc & 0x0F;
+    }
+    return packet << 4 | crc;
+}
+
+bool dshotRunsToBits(const DShotRun *runs, uint8_t count, uint32_t bitTicks, uint32_t &bits)
+{
+    uint32_t value = 0;
+    uint8_t length = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint32_t n = (runs[i].ticks + bitTicks / 2) / bitTicks;
+        if (length == 0 && runs[i].level)
+        {
+            // Idle before the start bit
+            continue;
+        }
+        if (length + n > DSHOT_REPLY_BITS)
+        {
+            if (!runs[i].level)
+            {
+                return false;
+            }
+            // The last high bits run into the idle line
+            n = DSHOT_REPLY_BITS - length;
+        }
+        value = value << n | (runs[i].level ? (1UL << n) - 1 : 0);
+        length += n;
+    }
+    if (length == 0)
+    {
+        return false;
+    }
+    uint8_t missing = DSHOT_REPLY_BITS - length;
+    bits = value << missing | ((1UL << missing) - 1);
+    return true;
+}
+
+bool dshotDecodeReply(uint32_t bits, uint32_t &periodUs)
+{
+    uint32_t gcr = (bits ^ (bits >> 1)) & 0xFFFFF;
+    uint16_t reply = 0;
+    for (int8_t shift = 15; shift >= 0; shift -= 5)
+    {
+        uint8_t nibble = gcrDecode((gcr >> shift) & 0x1F);
+        if (nibble == 0xFF)
+        {
+            return false;
+        }
+        reply = reply << 4 | nibble;
+    }
+    if (((reply ^ (reply >> 4) ^ (reply >> 8) ^ (reply >> 12)) & 0x0F) != 0x0F)
+    {
+        return false;
+    }
+
+    uint16_t value = reply >> 4;
+    if (value == REPLY_STOPPED)
+    {
+        periodUs = DSHOT_PERIOD_STOPPED;
+    }
+    else
+    {
+        periodUs = (uint32_t)(value & 0x01FF) << (value >> 9);
+    }
+    return true;
+}
+
+uint32_t dshotEncodeReply(uint32_t periodUs)
+{
+    uint16_t value = REPLY_STOPPED;
+    if (periodUs < ((uint32_t)0x01FF << 7))
+    {
+        uint8_t exponent = 0;
+        while (periodUs >> exponent > 0x01FF)
+        {
+            exponent++;
+        }
+        value = exponent << 9 | periodUs >> exponent;
+    }
+    uint16_t reply = value << 4 | (~checksum(value) & 0x0F);
+
+    uint32_t gcr = 0;
+    for (int8_t shift = 12; shift >= 0; shift -= 4)
+    {
+        gcr = gcr << 5 | GCR_ENCODE[(reply >> shift) & 0x0F];
+    }
+    // Start bit low, then a 1 flips the line
+    uint32_t bits = 0;
+    uint8_t level = 0;
+    for (int8_t i = 19; i >= 0; i--)
+    {
+        level ^= (gcr >> i) & 1;
+        bits = bits << 1 | level;
+    }
+    return bits;
+}
+
+uint32_t dshotRpm(uint32_t periodUs, uint8_t poles)
+{
+    if (periodUs == 0 || periodUs == DSHOT_PERIOD_STOPPED || poles < 2)
+    {
+        return 0;
+    }
+    return 60000000UL / periodUs / (poles / 2);
+}
+
+uint16_t DShotTrim::apply(uint16_t throttle, uint32_t targetRpm, uint32_t rpm, bool fresh)
+{
+    if (targetRpm == 0 || throttle < DSHOT_THROTTLE_MIN)
+    {
+        accumulator = 0;
+        return throttle;
+    }
+    if (fresh)
+    {
+        accumulator += (int32_t)targetRpm - (int32_t)rpm;
+        if (accumulator > LIMIT * DIVISOR)
+        {
+            accumulator = LIMIT * DIVISOR;
+        }
+        else if (accumulator < -LIMIT * DIVISOR)
+        {
+            accumulator = -LIMIT * DIVISOR;
+        }
+    }
+    int32_t trimmed = (int32_t)throttle + accumulator / DIVISOR;
+    if (trimmed < DSHOT_THROTTLE_MIN)
+    {
+        return DSHOT_THROTTLE_MIN;
+    }
+    return trimmed > DSHOT_THROTTLE_MAX ? DSHOT_THROTTLE_MAX : trimmed;
+}
@@ -0,0 +1,71 @@
+#ifndef DSHOT_H
+#define DSHOT_H
+
+#include <stdint.h>
+
+// DShot framing, no hardware. A frame is 16 bits sent MSB first: an 11 bit
+// value (0 stop, 1-47 commands, 48-2047 throttle), a telemetry request bit
+// and a 4 bit checksum. Bidirectional DShot inverts the line and the
+// checksum, and after each frame the ESC answers on the same wire with its
+// electrical RPM period:
+//
+//   16 bit reply  eeem mmmm mmmm cccc   period = m << e microseconds
+//   GCR           each nibble as 5 bits, 20 bits
+//   on the wire   a low start bit, then every 1 in the GCR flips the line,
+//                 21 bits at 5/4 of the frame bit rate
+//
+// DShotEsc (DShotEsc.h) puts this on the ESP32's RMT peripheral.
+
+#define DSHOT_THROTTLE_MIN 48
+#define DSHOT_THROTTLE_MAX 2047
+#define DSHOT_REPLY_BITS 21
+#define DSHOT_PERIOD_STOPPED 0xFFFFFFFFUL // reply period of a motor at rest
+
+// Throttle value for a 0-180 speed, the range the PWM path writes with
+// Servo::write. 0 stops the motor.
+uint16_t dshotThrottle(uint8_t speed);
+
+// 16 bit frame for value with the checksum filled in
+uint16_t dshotFrame(uint16_t value, bool telemetry, bool bidirectional);
+
+// A run of constant line level in a captured reply, ticks long
+struct DShotRun
+{
+    uint8_t level;
+    uint16_t ticks;
+};
+
+// Turns the runs of one reply into its 21 line bits, high as 1. bitTicks is
+// the length of one reply bit in the same ticks. The line idles high, so a
+// reply whose last bits are high ends early; those are filled in. Returns
+// false if the runs add up to more than 21 bits.
+bool dshotRunsToBits(const DShotRun *runs, uint8_t count, uint32_t bitTicks, uint32_t &bits);
+
+// Period in microseconds from the 21 line bits, DSHOT_PERIOD_STOPPED for a
+// motor at rest. False if a GCR symbol or the checksum is bad.
+bool dshotDecodeReply(uint32_t bits, uint32_t &periodUs);
+
+// The other direction, what an ESC puts on the wire for periodUs. For
+// simulated ESCs and checking the decoder.
+uint32_t dshotEncodeReply(uint32_t periodUs);
+
+// Mechanical RPM of a motor with the given pole count, 0 at rest
+uint32_t dshotRpm(uint32_t periodUs, uint8_t poles);
+
+// Integral trim that holds one wheel at a target RPM on top of the open
+// loop throttle. Both flywheels chasing the same target is what keeps them
+// matched. Called once per frame with the latest reply.
+class DShotTrim
+{
+public:
+    uint16_t apply(uint16_t throttle, uint32_t targetRpm, uint32_t rpm, bool fresh);
+    void reset() { accumulator = 0; }
+    int16_t trim() const { return accumulator / DIVISOR; }
+
+private:
+    static constexpr int32_t DIVISOR = 1000; // RPM of error that moves the trim one step per frame
+    static constexpr int32_t LIMIT = 200;    // throttle steps either way
+    int32_t accumulator = 0;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#if defined(ESP32)
+
+#include "DShotEsc.h"
+#include <driver/gpio.h>
+#include <esp_rom_gpio.h>
+#include <esp_timer.h>
+#include <soc/gpio_sig_map.h>
+
+// RMT clock is the 80 MHz APB clock divided by this, 25 ns ticks
+#define DSHOT_RMT_CLOCK_DIV 2
+#define DSHOT_TICKS_PER_US (80 / DSHOT_RMT_CLOCK_DIV)
+#define DSHOT_REPLY_BUFFER 256
+
+namespace
+{
+    DShotEsc *const *frameEscs = NULL;
+    uint8_t frameEscCount = 0;
+    esp_timer_handle_t frameTimer = NULL;
+    // The driver has one end of transmission callback for all channels
+    DShotEsc *bidirectionalEscs[RMT_CHANNEL_MAX] = {};
+
+    void sendFrames(void *)
+    {
+        for (uint8_t i = 0; i < frameEscCount; i++)
+        {
+            frameEscs[i]->startFrame();
+        }
+    }
+
+    // RMT interrupt: a frame is out, the ESC answers about 30 us later
+    void onTxEnd(rmt_channel_t channel, void *)
+    {
+        if (bidirectionalEscs[channel] != NULL)
+        {
+            bidirectionalEscs[channel]->frameSent();
+        }
+    }
+
+    rmt_item32_t bitItem(uint16_t highTicks, uint16_t lowTicks, bool inverted)
+    {
+        rmt_item32_t item;
+        item.level0 = inverted ? 0 : 1;
+        item.duration0 = highTicks;
+        item.level1 = inverted ? 1 : 0;
+        item.duration1 = lowTicks;
+        return item;
+    }
+}
+
+bool DShotEsc::begin(uint8_t pin, rmt_channel_t txChannel, rmt_channel_t rxChannel, DShotRate rate, bool bidirectional, uint8_t poles)
+{
+    tx = txChannel;
+    rx = rxChannel;
+    inverted = bidirectional;
+    motorPoles = poles;
+
+    // A 1 is high for three quarters of the bit, a 0 for three eighths
+    uint16_t bitTicks = DSHOT_TICKS_PER_US * 1000 / rate;
+    one = bitItem(bitTicks * 3 / 4, bitTicks - bitTicks * 3 / 4, inverted);
+    zero = bitItem(bitTicks * 3 / 8, bitTicks - bitTicks * 3 / 8, inverted);
+    // Replies come back at 5/4 of the frame bit rate
+    replyBitTicks = bitTicks * 4 / 5;
+
+    rmt_config_t txConfig = RMT_DEFAULT_CONFIG_TX((gpio_num_t)pin, tx);
+    txConfig.clk_div = DSHOT_RMT_CLOCK_DIV;
+    txConfig.tx_config.idle_output_en = true;
+    txConfig.tx_config.idle_level = inverted ? RMT_IDLE_LEVEL_HIGH : RMT_IDLE_LEVEL_LOW;
+    if (rmt_config(&txConfig) != ESP_OK || rmt_driver_install(tx, 0, 0) != ESP_OK)
+    {
+        return false;
+    }
+    if (!inverted)
+    {
+        return true;
+    }
+
+    rmt_config_t rxConfig = RMT_DEFAULT_CONFIG_RX((gpio_num_t)pin, rx);
+    rxConfig.clk_div = DSHOT_RMT_CLOCK_DIV;
+    rxConfig.rx_config.filter_en = true;
+    rxConfig.rx_config.filter_ticks_thresh = 20; // APB cycles, drops glitches under 250 ns
+    // No run in a reply is longer than 3 bits, a gap of 6 ends it
+    rxConfig.rx_config.idle_threshold = replyBitTicks * 6;
+    if (rmt_config(&rxConfig) != ESP_OK || rmt_driver_install(rx, DSHOT_REPLY_BUFFER, 0) != ESP_OK ||
+        rmt_get_ringbuf_handle(rx, &replyBuffer) != ESP_OK)
+    {
+        return false;
+    }
+
+    // Both channels on one open drain pin: the transmitter releases the
+    // line between frames and the ESC pulls it low to answer
+    gpio_set_direction((gpio_num_t)pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_pullup_en((gpio_num_t)pin);
+    esp_rom_gpio_connect_out_signal(pin, RMT_SIG_OUT0_IDX + tx, false, false);
+    esp_rom_gpio_connect_in_signal(pin, RMT_SIG_IN0_IDX + rx, false);
+
+    // The listener is started from the interrupt the moment the frame is
+    // out, instead of the frame timer waiting for it
+    bidirectionalEscs[tx] = this;
+    rmt_register_tx_end_callback(onTxEnd, NULL);
+    return true;
+}
+
+void DShotEsc::startFrame()
+{
+    if (inverted)
+    {
+        collectReply();
+        rmt_rx_stop(rx);
+    }
+
+    uint16_t throttle = throttleValue.load(std::memory_order_relaxed);
+    uint32_t target = inverted ? targetRpmValue.load(std::memory_order_relaxed) : 0;
+    uint16_t value = trim.apply(throttle, target, rpmValue.load(std::memory_order_relaxed), fresh);
+    uint16_t frame = dshotFrame(value, false, inverted);
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        items[i] = (frame & (0x8000 >> i)) ? one : zero;
+    }
+    rmt_write_items(tx, items, 16, false);
+}
+
+void DShotEsc::frameSent()
+{
+    rmt_rx_start(rx, true);
+}
+
+void DShotEsc::collectReply()
+{
+    fresh = false;
+    size_t length = 0;
+    rmt_item32_t *received;
+    bool decoded = false;
+    // Normally one reply; older ones are stale
+    while ((received = (rmt_item32_t *)xRingbufferReceive(replyBuffer, &length, 0)) != NULL)
+    {
+        DShotRun runs[2 * DSHOT_REPLY_BITS];
+        uint8_t count = 0;
+        for (size_t i = 0; i < length / sizeof(rmt_item32_t) && count + 2u <= sizeof(runs) / sizeof(runs[0]); i++)
+        {
+            if (received[i].duration0 != 0)
+            {
+                runs[count++] = {(uint8_t)received[i].level0, (uint16_t)received[i].duration0};
+            }
+            if (received[i].duration1 != 0)
+            {
+                runs[count++] = {(uint8_t)received[i].level1, (uint16_t)received[i].duration1};
+            }
+        }
+        vRingbufferReturnItem(replyBuffer, received);
+
+        uint32_t bits;
+        uint32_t periodUs;
+        decoded = dshotRunsToBits(runs, count, replyBitTicks, bits) && dshotDecodeReply(bits, periodUs);
+        if (decoded)
+        {
+            rpmValue.store(dshotRpm(periodUs, motorPoles), std::memory_order_relaxed);
+        }
+    }
+    if (decoded)
+    {
+        fresh = true;
+        replyCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        errorCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool dshotStart(DShotEsc *const *escs, uint8_t count, uint32_t periodUs)
+{
+    frameEscs = escs;
+    frameEscCount = count;
+    esp_timer_create_args_t args = {};
+    args.callback = sendFrames;
+    args.name = "dshot";
+    return esp_timer_create(&args, &frameTimer) == ESP_OK && esp_timer_start_periodic(frameTimer, periodUs) == ESP_OK;
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef DSHOT_ESC_H
+#define DSHOT_ESC_H
+
+#include <atomic>
+#include <driver/rmt.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
+#include "DShot.h"
+
+// DShot ESC on the ESP32's RMT peripheral. Frames go out from an esp_timer
+// (dshotStart) so the ESCs see a steady stream whatever the flywheel task
+// is doing. Any task sets the throttle, the timer picks it up on the next
+// frame.
+//
+// Bidirectional ESCs (BLHeli_32, Bluejay) get an inverted line and answer
+// every frame with their eRPM period on the same pin, which is switched to
+// open drain with a second RMT channel listening on it. The listener is
+// started from the RMT end of transmission interrupt, so the frame timer
+// never waits on the line. With a target RPM
+// set, each reply nudges a DShotTrim so the wheel settles on the target
+// rather than wherever the open loop throttle puts it.
+
+enum DShotRate : uint16_t
+{
+    DSHOT300 = 300,
+    DSHOT600 = 600
+};
+
+class DShotEsc
+{
+public:
+    // rxChannel is only used when bidirectional. poles is the motor's
+    // magnet count, for turning eRPM into RPM.
+    bool begin(uint8_t pin, rmt_channel_t txChannel, rmt_channel_t rxChannel, DShotRate rate, bool bidirectional, uint8_t poles);
+
+    // Any task. targetRpm 0 runs open loop.
+    void setThrottle(uint16_t throttle, uint32_t targetRpm = 0)
+    {
+        targetRpmValue.store(targetRpm, std::memory_order_relaxed);
+        throttleValue.store(throttle, std::memory_order_relaxed);
+    }
+
+    bool bidirectional() const { return inverted; }
+    uint32_t rpm() const { return rpmValue.load(std::memory_order_relaxed); }
+    // Replies decoded, and frames whose reply was missing or corrupt
+    uint32_t replies() const { return replyCount.load(std::memory_order_relaxed); }
+    uint32_t replyErrors() const { return errorCount.load(std::memory_order_relaxed); }
+
+    // Frame timer side, see dshotStart
+    void startFrame();
+    // RMT interrupt side, once a bidirectional frame is on the wire
+    void frameSent();
+
+private:
+    void collectReply();
+
+    rmt_channel_t tx = RMT_CHANNEL_0;
+    rmt_channel_t rx = RMT_CHANNEL_1;
+    RingbufHandle_t replyBuffer = NULL;
+    bool inverted = false;
+    uint8_t motorPoles = 14;
+    uint16_t replyBitTicks = 0;
+    rmt_item32_t one;
+    rmt_item32_t zero;
+    rmt_item32_t items[16];
+    DShotTrim trim;
+    bool fresh = false; // a reply came in since the last frame
+
+    std::atomic<uint16_t> throttleValue{0};
+    std::atomic<uint32_t> targetRpmValue{0};
+    std::atomic<uint32_t> rpmValue{0};
+    std::atomic<uint32_t> replyCount{0};
+    std::atomic<uint32_t> errorCount{0};
+};
+
+// Sends a frame to every ESC each periodUs, from the esp_timer task. The
+// ESCs have to be begun and stay alive.
+bool dshotStart(DShotEsc *const *escs, uint8_t count, uint32_t periodUs);
+
+#endif
@@ -0,0 +1,147 @@
+#include "DeferredLog.h"
+
+namespace
+{
+    LogRing rings[LOG_CORES];
+}
+
+LogRing::LogRing()
+{
+    for (uint32_t i = 0; i < LOG_RING_RECORDS; i++)
+    {
+        cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool LogRing::push(uint16_t id, LogClock clock, const uintptr_t *args, uint8_t argCount, uint8_t core)
+{
+    uint32_t pos = writePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;)
+    {
+        cell = &cells[pos & (LOG_RING_RECORDS - 1)];
+        int32_t lag = (int32_t)(cell->seq.load(std::memory_order_acquire) - pos);
+        if (lag == 0)
+        {
+            // Free, claim it. On failure pos holds the new write position.
+            if (writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (lag < 0)
+        {
+            // The reader has not got to this cell's previous record yet
+            overflow.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            // Another writer claimed it first
+            pos = writePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Stamped after the claim, so a writer that claims later stamps later
+    // unless it preempted this one in between
+    LogRecord &record = cell->record;
+    record.timestampUs = clock();
+    record.id = id;
+    record.argCount = argCount;
+    record.core = core;
+    for (uint8_t i = 0; i < argCount; i++)
+    {
+        record.args[i] = args[i];
+    }
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool LogRing::peek(LogRecord &record) const
+{
+    const Cell &cell = cells[readPos & (LOG_RING_RECORDS - 1)];
+    if (cell.seq.load(std::memory_order_acquire) != readPos + 1)
+    {
+        return false;
+    }
+    record = cell.record;
+    return true;
+}
+
+void LogRing::pop()
+{
+    Cell &cell = cells[readPos & (LOG_RING_RECORDS - 1)];
+    cell.seq.store(readPos + LOG_RING_RECORDS, std::memory_order_release);
+    readPos++;
+}
+
+bool logWrite(uint8_t core, uint16_t id, LogClock clock, const uintptr_t *args, uint8_t argCount)
+{
+    if (core >= LOG_CORES)
+    {
+        core = 0;
+    }
+    return rings[core].push(id, clock, args, argCount > LOG_MAX_ARGS ? LOG_MAX_ARGS : argCount, core);
+}
+
+bool logNext(LogRecord &record)
+{
+    LogRecord candidate;
+    int8_t oldest = -1;
+    for (uint8_t core = 0; core < LOG_CORES; core++)
+    {
+        if (!rings[core].peek(candidate))
+        {
+            continue;
+        }
+        if (oldest < 0 || (int32_t)(candidate.timestampUs - record.timestampUs) < 0)
+        {
+            record = candidate;
+            oldest = core;
+        }
+    }
+    if (oldest < 0)
+    {
+        return false;
+    }
+    rings[oldest].pop();
+    return true;
+}
+
+uint32_t logDropped()
+{
+    uint32_t total = 0;
+    for (uint8_t core = 0; core < LOG_CORES; core++)
+    {
+        total += rings[core].dropped();
+    }
+    return total;
+}
+
+size_t logEncodeFrame(const LogRecord &record, uint8_t *out)
+{
+    size_t length = 0;
+    out[length++] = LOG_FRAME_SYNC;
+    out[length++] = record.id & 0xFF;
+    out[length++] = record.id >> 8;
+    out[length++] = (record.core << 4) | (record.argCount & 0x0F);
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        out[length++] = record.timestampUs >> (8 * i);
+    }
+    for (uint8_t a = 0; a < record.argCount; a++)
+    {
+        uint32_t value = (uint32_t)record.args[a];
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            out[length++] = value >> (8 * i);
+        }
+    }
+    uint8_t sum = 0;
+    for (size_t i = 1; i < length; i++)
+    {
+        sum += out[i];
+    }
+    out[length++] = sum;
+    return length;
+}
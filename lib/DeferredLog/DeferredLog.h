@@ -0,0 +1,97 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Deferred logging. A hot path stores a fixed size record (message id,
+// timestamp and up to LOG_MAX_ARGS integer or pointer arguments) in the
+// ring of the core it runs on and carries on; formatting and the serial
+// write happen later in a low priority task that drains the rings.
+//
+// Each ring is a bounded lock-free queue in the style of Vyukov's: a writer
+// claims a cell with one compare-and-swap on the ring's write position,
+// fills it and publishes it by bumping the cell's sequence number, so any
+// number of tasks (and ISRs) on the core can log concurrently and a writer
+// preempted halfway only holds up the reader, never another writer. A full
+// ring drops the record and counts it, logging never waits.
+//
+// A record is stamped by the clock the caller passes in, read right after
+// its cell is claimed, so within a ring timestamps follow cell order unless
+// a writer is preempted between the claim and the clock read. logNext()
+// merges the rings by timestamp; across cores the order is best effort, off
+// by at most such a preemption or a record still being filled.
+//
+// Nothing here knows the clock or the message table; see
+// include/LogMessages.h for both.
+
+#define LOG_MAX_ARGS 4
+#ifndef LOG_RING_RECORDS
+#define LOG_RING_RECORDS 64 // per core, a power of two
+#endif
+#define LOG_CORES 2
+
+typedef uint32_t (*LogClock)(); // microseconds
+
+struct LogRecord
+{
+    uint32_t timestampUs;
+    uint16_t id;
+    uint8_t argCount;
+    uint8_t core;
+    uintptr_t args[LOG_MAX_ARGS];
+};
+
+class LogRing
+{
+public:
+    LogRing();
+
+    // Any task or ISR. False if the ring was full and the record dropped.
+    bool push(uint16_t id, LogClock clock, const uintptr_t *args, uint8_t argCount, uint8_t core);
+
+    // Reader side, one task only. peek() copies the oldest published record
+    // without taking it, pop() takes it.
+    bool peek(LogRecord &record) const;
+    void pop();
+
+    uint32_t dropped() const { return overflow.load(std::memory_order_relaxed); }
+
+private:
+    static_assert((LOG_RING_RECORDS & (LOG_RING_RECORDS - 1)) == 0, "LOG_RING_RECORDS must be a power of two");
+
+    struct Cell
+    {
+        std::atomic<uint32_t> seq; // position it can be written at, +1 once written
+        LogRecord record;
+    };
+
+    Cell cells[LOG_RING_RECORDS];
+    std::atomic<uint32_t> writePos{0};
+    uint32_t readPos = 0;
+    std::atomic<uint32_t> overflow{0};
+};
+
+// Appends a record to the given core's ring
+bool logWrite(uint8_t core, uint16_t id, LogClock clock, const uintptr_t *args, uint8_t argCount);
+
+// Takes the oldest record at the head of any core's ring, by timestamp.
+// Drain task only.
+bool logNext(LogRecord &record);
+
+// Records dropped for a full ring since boot, all cores
+uint32_t logDropped();
+
+// Binary form of a record, for captures decoded on a PC by
+// scripts/decode_log.py:
+//   0xA5, id (2), core << 4 | argCount, timestampUs (4), args (4 each),
+//   checksum (sum of everything after the 0xA5)
+// Multi-byte fields are little endian and arguments are cut to 32 bits.
+// The sync byte and checksum let the decoder skip plain text that shares
+// the port. Returns the length, out needs LOG_FRAME_MAX bytes.
+#define LOG_FRAME_SYNC 0xA5
+#define LOG_FRAME_MAX (9 + 4 * LOG_MAX_ARGS)
+size_t logEncodeFrame(const LogRecord &record, uint8_t *out);
+
+#endif
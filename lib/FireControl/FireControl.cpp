@@ -0,0 +1,172 @@
+#include "FireControl.h"
+
+static uint8_t shotsForMode(uint8_t fireMode)
+{
+    switch (fireMode)
+    {
+    case 1:
+        return 3;
+    case 2:
+        return 7;
+    default:
+        return 1;
+    }
+}
+
+void FireControl::enter(FireState state, uint32_t now, uint32_t duration)
+{
+    current = state;
+    stateStart = now;
+    stateDuration = duration;
+}
+
+void FireControl::trigger(uint8_t fireMode, uint8_t flywheelSpeed, uint32_t now, uint32_t arrivedMs)
+{
+    remaining = shotsForMode(fireMode);
+    firingSpeed = flywheelSpeed;
+    bool burst = remaining > 1;
+    shotAngle = burst ? config.burstFeedAngle : config.feedAngle;
+    shotFeedMs = burst ? config.burstFeedMs : config.feedMs;
+    shotRetractMs = burst ? config.burstRetractMs : config.retractMs;
+    triggerAt = arrivedMs;
+    out.flywheelSpeed = firingSpeed;
+    out.loaderAttached = true;
+
+    switch (current)
+    {
+    case FIRE_IDLE:
+        // Gated, the wheels say when they are ready
+        enter(FIRE_SPIN_UP, now, config.speedGate ? 0 : config.spinUpMs);
+        break;
+    case FIRE_WARM:
+        enter(FIRE_SPIN_UP, now, firingSpeed > config.warmSpeed && !config.speedGate ? config.warmSpinUpMs : 0);
+        break;
+    default:
+        // Already spinning, the running sequence picks up the new count
+        break;
+    }
+}
+
+void FireControl::abort(uint32_t now)
+{
+    if (!busy())
+    {
+        return;
+    }
+    remaining = 0;
+    if (current == FIRE_FEED)
+    {
+        out.loaderAngle = config.restAngle;
+        enter(FIRE_RETRACT, now, shotRetractMs);
+    }
+    else if (current != FIRE_RETRACT)
+    {
+        finishSequence(now);
+    }
+}
+
+void FireControl::finishSequence(uint32_t now)
+{
+    out.loaderAngle = config.restAngle;
+    out.loaderAttached = false;
+    if (config.warmSpeed > 0 && config.warmTimeoutMs > 0)
+    {
+        out.flywheelSpeed = config.warmSpeed;
+        enter(FIRE_WARM, now, config.warmTimeoutMs);
+    }
+    else
+    {
+        out.flywheelSpeed = 0;
+        enter(FIRE_IDLE, now, 0);
+    }
+}
+
+// Holds a gated feed until the wheels are at speed. Returns true with the
+// time to the next check while waiting; gives up the sequence once the
+// wheels have had speedTimeoutMs.
+bool FireControl::waitForWheels(uint32_t now, uint32_t &wait)
+{
+    if (wheelsAtSpeed)
+    {
+        return false;
+    }
+    uint32_t waited = now - stateStart - stateDuration;
+    if (waited >= config.speedTimeoutMs)
+    {
+        faults++;
+        remaining = 0;
+        finishSequence(now);
+        return false;
+    }
+    uint32_t left = config.speedTimeoutMs - waited;
+    wait = left < config.speedPollMs ? left : config.speedPollMs;
+    return true;
+}
+
+uint32_t FireControl::tick(uint32_t now)
+{
+    // Loop so a zero length state (e.g. no warm spin-up needed) falls
+    // straight through to the next one within the same tick
+    for (;;)
+    {
+        if (current == FIRE_IDLE)
+        {
+            return FIRE_NO_DEADLINE;
+        }
+
+        uint32_t elapsed = now - stateStart;
+        if (elapsed < stateDuration)
+        {
+            return stateDuration - elapsed;
+        }
+
+        switch (current)
+        {
+        case FIRE_SPIN_UP:
+        case FIRE_COOLDOWN:
+            if (remaining == 0)
+            {
+                finishSequence(now);
+                break;
+            }
+            if (config.speedGate)
+            {
+                uint32_t wait;
+                if (waitForWheels(now, wait))
+                {
+                    return wait;
+                }
+                if (remaining == 0)
+                {
+                    break;
+                }
+            }
+            remaining--;
+            out.loaderAngle = shotAngle;
+            history[shots % FIRE_SHOT_HISTORY] = {triggerAt, now};
+            shots++;
+            enter(FIRE_FEED, now, shotFeedMs);
+            break;
+        case FIRE_FEED:
+            out.loaderAngle = config.restAngle;
+            enter(FIRE_RETRACT, now, shotRetractMs);
+            break;
+        case FIRE_RETRACT:
+            if (remaining == 0)
+            {
+                finishSequence(now);
+            }
+            else
+            {
+                enter(FIRE_COOLDOWN, now, config.cooldownMs);
+            }
+            break;
+        case FIRE_WARM:
+            out.flywheelSpeed = 0;
+            enter(FIRE_IDLE, now, 0);
+            break;
+        case FIRE_IDLE:
+            break;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef FIRE_CONTROL_H
+#define FIRE_CONTROL_H
+
+#include <stdint.h>
+
+// Tick driven fire sequencer. It owns no hardware: the flywheel task calls
+// tick() with the current time, writes outputs() to the ESCs and loader
+// servo, and sleeps until the returned deadline or the next trigger. All
+// times are in milliseconds from the same clock.
+//
+//   IDLE/WARM -> SPIN_UP -> FEED -> RETRACT -> COOLDOWN -> FEED ... -> WARM -> IDLE
+//
+// WARM keeps the flywheels at warmSpeed for warmTimeoutMs after the last
+// shot so a follow up trigger only needs warmSpinUpMs instead of a cold
+// spin-up.
+//
+// With speedGate set the spin-up times are not guessed: a dart is only fed
+// once the flywheel task has reported both wheels at speed through
+// setWheelsAtSpeed(), before the first shot and again after each cooldown.
+// Wheels that do not get there within speedTimeoutMs end the sequence
+// unfired and count a speed fault.
+
+#define FIRE_NO_DEADLINE 0xFFFFFFFFUL
+#define FIRE_SHOT_HISTORY 8
+
+enum FireState : uint8_t
+{
+    FIRE_IDLE = 0,
+    FIRE_SPIN_UP,
+    FIRE_FEED,
+    FIRE_RETRACT,
+    FIRE_COOLDOWN,
+    FIRE_WARM
+};
+
+// The loader defaults are the timings the turret always fired with: semi
+// pushes for 300 ms and settles for 400, burst and auto take a full second
+// per dart.
+struct FireConfig
+{
+    uint16_t spinUpMs = 1000;    // flywheels from rest to firing speed
+    uint16_t warmSpinUpMs = 150; // flywheels from warm idle to firing speed
+    uint16_t feedMs = 300;       // semi: loader pushing a dart
+    uint16_t retractMs = 400;    // semi: loader returning to rest
+    uint16_t burstFeedMs = 500;  // burst and auto
+    uint16_t burstRetractMs = 500;
+    uint16_t cooldownMs = 0;     // extra gap between shots of a burst
+    uint8_t feedAngle = 80;      // semi
+    uint8_t burstFeedAngle = 50; // burst and auto push less so the next dart is not dragged along
+    uint8_t restAngle = 0;
+    uint8_t warmSpeed = 0;       // 0 disables warm idle
+    uint32_t warmTimeoutMs = 10000;
+    bool speedGate = false;        // needs RPM feedback, see setWheelsAtSpeed
+    uint16_t speedTimeoutMs = 2000; // gated wait for the wheels on top of the state's own time
+    uint16_t speedPollMs = 5;       // tick period while waiting for the wheels
+};
+
+struct FireOutputs
+{
+    uint8_t flywheelSpeed;
+    uint8_t loaderAngle;
+    bool loaderAttached;
+};
+
+struct FireShot
+{
+    uint32_t triggerMs; // when the trigger that produced this shot arrived
+    uint32_t feedMs;    // when the loader started pushing the dart
+};
+
+class FireControl
+{
+public:
+    FireConfig config;
+
+    // Queues the shots for fireMode (0 semi, 1 burst, 2 auto). Triggering
+    // while a burst is running restarts the burst count without another
+    // spin-up. arrivedMs is when the request reached the turret, which the
+    // shot history measures the latency from; it can be earlier than now.
+    void trigger(uint8_t fireMode, uint8_t flywheelSpeed, uint32_t now, uint32_t arrivedMs);
+
+    // Stops feeding immediately. The loader retracts and the flywheels drop
+    // to warm idle.
+    void abort(uint32_t now);
+
+    // Advances the state machine. Returns the number of milliseconds until
+    // the next tick is needed, or FIRE_NO_DEADLINE when nothing is pending.
+    uint32_t tick(uint32_t now);
+
+    // Whether both flywheels are at the speed outputs() asks for. Only
+    // consulted with config.speedGate.
+    void setWheelsAtSpeed(bool atSpeed) { wheelsAtSpeed = atSpeed; }
+    uint32_t speedFaults() const { return faults; }
+
+    const FireOutputs &outputs() const { return out; }
+    FireState state() const { return current; }
+    bool busy() const { return current != FIRE_IDLE && current != FIRE_WARM; }
+
+    uint32_t shotCount() const { return shots; }
+    const FireShot &lastShot() const { return history[(shots + FIRE_SHOT_HISTORY - 1) % FIRE_SHOT_HISTORY]; }
+    const FireShot &shot(uint8_t age) const { return history[(shots + FIRE_SHOT_HISTORY - 1 - age) % FIRE_SHOT_HISTORY]; }
+    uint32_t lastTriggerToFeedMs() const { return shots ? lastShot().feedMs - lastShot().triggerMs : 0; }
+
+private:
+    void enter(FireState state, uint32_t now, uint32_t duration);
+    void finishSequence(uint32_t now);
+    bool waitForWheels(uint32_t now, uint32_t &wait);
+
+    FireState current = FIRE_IDLE;
+    FireOutputs out = {0, 0, false};
+    uint32_t stateStart = 0;
+    uint32_t stateDuration = 0;
+    uint8_t remaining = 0;
+    uint8_t firingSpeed = 0;
+    uint8_t shotAngle = 0;
+    uint16_t shotFeedMs = 0;
+    uint16_t shotRetractMs = 0;
+    uint32_t triggerAt = 0;
+    uint32_t shots = 0;
+    bool wheelsAtSpeed = false;
+    uint32_t faults = 0;
+    FireShot history[FIRE_SHOT_HISTORY] = {};
+};
+
+#endif
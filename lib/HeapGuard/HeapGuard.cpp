@@ -0,0 +1,146 @@
+#include "HeapGuard.h"
+
+#if HEAP_GUARD
+
+#include <Arduino.h>
+
+// Per-task state lives in a small table keyed by task handle rather than
+// in thread-local storage, which is not set up for allocations made
+// before the scheduler starts. Nothing is looked up until heapGuardArm(),
+// and each entry's flag is only written by its own task.
+
+namespace
+{
+    struct GuardedTask
+    {
+        TaskHandle_t task;
+        volatile bool inside;
+    };
+
+    GuardedTask tasks[HEAP_GUARD_MAX_TASKS];
+    volatile bool armed = false;
+    volatile uint32_t violations = 0;
+    // Written by whichever task trips the guard; two at once may mix
+    // fields, which is acceptable for a debug aid
+    HeapGuardViolation last = {NULL, NULL, 0};
+
+    GuardedTask *find(TaskHandle_t self)
+    {
+        for (uint8_t i = 0; i < HEAP_GUARD_MAX_TASKS; i++)
+        {
+            if (tasks[i].task == self)
+            {
+                return &tasks[i];
+            }
+        }
+        return NULL;
+    }
+
+    // Finds or claims the calling task's entry
+    GuardedTask *entry()
+    {
+        TaskHandle_t self = xTaskGetCurrentTaskHandle();
+        GuardedTask *found = find(self);
+        for (uint8_t i = 0; found == NULL && i < HEAP_GUARD_MAX_TASKS; i++)
+        {
+            TaskHandle_t expected = NULL;
+            if (__atomic_compare_exchange_n(&tasks[i].task, &expected, self, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                found = &tasks[i];
+            }
+        }
+        return found;
+    }
+
+    void check(size_t size, void *caller)
+    {
+        if (!armed)
+        {
+            return;
+        }
+        GuardedTask *task = find(xTaskGetCurrentTaskHandle());
+        if (task == NULL || !task->inside)
+        {
+            return;
+        }
+        violations++;
+        last.task = pcTaskGetName(NULL);
+        last.caller = caller;
+        last.size = size;
+    }
+}
+
+void heapGuardArm()
+{
+    armed = true;
+}
+
+void heapGuardBegin()
+{
+    GuardedTask *task = entry();
+    if (task != NULL)
+    {
+        task->inside = true;
+    }
+}
+
+void heapGuardEnd()
+{
+    heapGuardSuspend();
+}
+
+bool heapGuardSuspend()
+{
+    GuardedTask *task = find(xTaskGetCurrentTaskHandle());
+    if (task == NULL || !task->inside)
+    {
+        return false;
+    }
+    task->inside = false;
+    return true;
+}
+
+void heapGuardResume(bool guarded)
+{
+    if (guarded)
+    {
+        heapGuardBegin();
+    }
+}
+
+uint32_t heapGuardViolations()
+{
+    return violations;
+}
+
+HeapGuardViolation heapGuardLastViolation()
+{
+    return last;
+}
+
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t count, size_t size);
+    void *__real_realloc(void *ptr, size_t size);
+
+    void *__wrap_malloc(size_t size)
+    {
+        check(size, __builtin_return_address(0));
+        return __real_malloc(size);
+    }
+
+    void *__wrap_calloc(size_t count, size_t size)
+    {
+        check(count * size, __builtin_return_address(0));
+        return __real_calloc(count, size);
+    }
+
+    void *__wrap_realloc(void *ptr, size_t size)
+    {
+        check(size, __builtin_return_address(0));
+        return __real_realloc(ptr, size);
+    }
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Debug check that the control, command and telemetry loops stay off the
+// heap once the turret is up. Each task brackets its loop body with
+// heapGuardBegin()/heapGuardEnd(); after heapGuardArm(), an allocation made
+// by a task between the two is counted and the last one kept for the log.
+//
+// Enabled by building with -DHEAP_GUARD=1 and linking with
+//   -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+// (the esp32dev-heapguard environment), so every malloc in the image,
+// operator new and String included, goes through the check. Otherwise
+// the calls compile to nothing.
+
+#ifndef HEAP_GUARD
+#define HEAP_GUARD 0
+#endif
+
+#define HEAP_GUARD_MAX_TASKS 12
+
+struct HeapGuardViolation
+{
+    const char *task; // NULL - none yet
+    void *caller;     // return address of the malloc/calloc/realloc call
+    size_t size;
+};
+
+#if HEAP_GUARD
+void heapGuardArm();
+void heapGuardBegin();
+void heapGuardEnd();
+// Returns whether the calling task was inside a guarded section and leaves it
+bool heapGuardSuspend();
+void heapGuardResume(bool guarded);
+uint32_t heapGuardViolations();
+HeapGuardViolation heapGuardLastViolation();
+#else
+inline void heapGuardArm() {}
+inline void heapGuardBegin() {}
+inline void heapGuardEnd() {}
+inline bool heapGuardSuspend() { return false; }
+inline void heapGuardResume(bool) {}
+inline uint32_t heapGuardViolations() { return 0; }
+inline HeapGuardViolation heapGuardLastViolation() { return {NULL, NULL, 0}; }
+#endif
+
+// Lifts the guard for a call that allocates by design, like handing a
+// frame to the socket library, which queues it on the heap
+class HeapGuardExempt
+{
+public:
+    HeapGuardExempt() : guarded(heapGuardSuspend()) {}
+    ~HeapGuardExempt() { heapGuardResume(guarded); }
+
+private:
+    bool guarded;
+};
+
+#endif
@@ -0,0 +1,323 @@
+#include "LX824Bus.h"
+#include <string.h>
+
+// Expected reply length field for each read command
+static uint8_t replyLength(uint8_t command)
+{
+    switch (command)
+    {
+    case LX824_CMD_TEMP_READ:
+        return 4;
+    case LX824_CMD_VIN_READ:
+    case LX824_CMD_POS_READ:
+        return 5;
+    default:
+        return 0;
+    }
+}
+
+size_t lx824Encode(uint8_t id, uint8_t command, const uint8_t *params, uint8_t paramCount, uint8_t *out)
+{
+    uint8_t length = paramCount + 3;
+    uint8_t sum = id + length + command;
+
+    out[0] = LX824_HEADER;
+    out[1] = LX824_HEADER;
+    out[2] = id;
+    out[3] = length;
+    out[4] = command;
+    for (uint8_t i = 0; i < paramCount; i++)
+    {
+        out[5 + i] = params[i];
+        sum += params[i];
+    }
+    out[5 + paramCount] = ~sum;
+    return paramCount + 6;
+}
+
+bool LX824Parser::feed(uint8_t byte)
+{
+    switch (state)
+    {
+    case WAIT_HEADER1:
+        if (byte == LX824_HEADER)
+        {
+            state = WAIT_HEADER2;
+        }
+        break;
+    case WAIT_HEADER2:
+        state = byte == LX824_HEADER ? WAIT_ID : WAIT_HEADER1;
+        break;
+    case WAIT_ID:
+        // A third 0x55 is either a real id or a shifted header, stay put
+        // and treat the previous byte as noise
+        if (byte == LX824_HEADER)
+        {
+            break;
+        }
+        current.id = byte;
+        sum = byte;
+        state = WAIT_LENGTH;
+        break;
+    case WAIT_LENGTH:
+        if (byte < 3 || byte > LX824_MAX_PARAMS + 3)
+        {
+            framingErrors++;
+            state = byte == LX824_HEADER ? WAIT_HEADER2 : WAIT_HEADER1;
+            break;
+        }
+        current.length = byte;
+        sum += byte;
+        state = WAIT_COMMAND;
+        break;
+    case WAIT_COMMAND:
+        current.command = byte;
+        sum += byte;
+        paramIndex = 0;
+        state = current.paramCount() ? WAIT_PARAMS : WAIT_CHECKSUM;
+        break;
+    case WAIT_PARAMS:
+        current.params[paramIndex++] = byte;
+        sum += byte;
+        if (paramIndex == current.paramCount())
+        {
+            state = WAIT_CHECKSUM;
+        }
+        break;
+    case WAIT_CHECKSUM:
+        state = WAIT_HEADER1;
+        if ((uint8_t)~sum == byte)
+        {
+            return true;
+        }
+        checksumErrors++;
+        if (byte == LX824_HEADER)
+        {
+            state = WAIT_HEADER2;
+        }
+        break;
+    }
+    return false;
+}
+
+void LX824Bus::begin(LX824Writer writer, void *context)
+{
+    write = writer;
+    writeContext = context;
+}
+
+bool LX824Bus::addServo(uint8_t id)
+{
+    if (servoCount >= LX824_MAX_SERVOS)
+    {
+        return false;
+    }
+    Servo &servo = servos[servoCount++];
+    servo.id = id;
+    servo.move.store(0);
+    servo.movePending.store(false);
+    servo.reading = LX824Reading();
+    servo.published.publish(servo.reading);
+    return true;
+}
+
+int LX824Bus::servoIndex(uint8_t id) const
+{
+    for (uint8_t i = 0; i < servoCount; i++)
+    {
+        if (servos[i].id == id)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void LX824Bus::requestMove(uint8_t id, uint16_t position, uint16_t time)
+{
+    int index = servoIndex(id);
+    if (index < 0)
+    {
+        return;
+    }
+    servos[index].move.store(position | ((uint32_t)time << 16), std::memory_order_relaxed);
+    servos[index].movePending.store(true, std::memory_order_release);
+}
+
+bool LX824Bus::reading(uint8_t id, LX824Reading &out) const
+{
+    int index = servoIndex(id);
+    if (index < 0)
+    {
+        return false;
+    }
+    out = servos[index].published.read();
+    return true;
+}
+
+bool LX824Bus::enqueueRead(uint8_t servo, uint8_t command)
+{
+    if (queueCount >= LX824_QUEUE_SIZE)
+    {
+        return false;
+    }
+    queue[(queueHead + queueCount) % LX824_QUEUE_SIZE] = {servo, command};
+    queueCount++;
+    return true;
+}
+
+void LX824Bus::send(uint8_t id, uint8_t command, const uint8_t *params, uint8_t paramCount)
+{
+    uint8_t frame[LX824_MAX_FRAME];
+    size_t length = lx824Encode(id, command, params, paramCount, frame);
+    if (write)
+    {
+        write(frame, length, writeContext);
+    }
+    framesSent++;
+
+    // Remember it to recognise its echo. Should echoes stop coming back the
+    // oldest entries are overwritten.
+    if (echoCount == LX824_ECHO_DEPTH)
+    {
+        echoHead = (echoHead + 1) % LX824_ECHO_DEPTH;
+        echoCount--;
+    }
+    LX824Frame &echo = echoes[(echoHead + echoCount) % LX824_ECHO_DEPTH];
+    echo.id = id;
+    echo.length = paramCount + 3;
+    echo.command = command;
+    if (paramCount > 0)
+    {
+        memcpy(echo.params, params, paramCount);
+    }
+    echoCount++;
+}
+
+// Whether frame is the echo of one we wrote. Echoes come back in the order
+// the frames went out, so one that was lost on the line is skipped along
+// with the match.
+bool LX824Bus::isEcho(const LX824Frame &frame)
+{
+    for (uint8_t i = 0; i < echoCount; i++)
+    {
+        const LX824Frame &echo = echoes[(echoHead + i) % LX824_ECHO_DEPTH];
+        if (echo.id == frame.id && echo.length == frame.length && echo.command == frame.command &&
+            memcmp(echo.params, frame.params, frame.paramCount()) == 0)
+        {
+            echoHead = (echoHead + i + 1) % LX824_ECHO_DEPTH;
+            echoCount -= i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void LX824Bus::onFrame(const LX824Frame &frame, uint32_t now)
+{
+    // Everything we write echoes back on the shared line
+    if (isEcho(frame))
+    {
+        return;
+    }
+    if (!outstanding.active)
+    {
+        unexpectedFrames++;
+        return;
+    }
+
+    Servo &servo = servos[outstanding.servo];
+    if (frame.id != servo.id || frame.command != outstanding.command || frame.length != replyLength(frame.command))
+    {
+        unexpectedFrames++;
+        return;
+    }
+
+    LX824Reading &reading = servo.reading;
+    switch (frame.command)
+    {
+    case LX824_CMD_POS_READ:
+        reading.position = (int16_t)(frame.params[0] | (frame.params[1] << 8));
+        reading.positionAt = now;
+        break;
+    case LX824_CMD_TEMP_READ:
+        reading.temperature = frame.params[0];
+        reading.temperatureAt = now;
+        break;
+    case LX824_CMD_VIN_READ:
+        reading.voltage = frame.params[0] | (frame.params[1] << 8);
+        reading.voltageAt = now;
+        break;
+    }
+    servo.published.publish(reading);
+    outstanding.active = false;
+    repliesMatched++;
+}
+
+uint32_t LX824Bus::poll(uint32_t now)
+{
+    if (outstanding.active)
+    {
+        uint32_t waited = now - outstanding.sentAt;
+        if (waited < replyTimeoutUs)
+        {
+            return replyTimeoutUs - waited;
+        }
+        Servo &servo = servos[outstanding.servo];
+        servo.reading.timeouts++;
+        servo.published.publish(servo.reading);
+        outstanding.active = false;
+    }
+
+    // Moves go out first, they do not expect a reply so they never hold
+    // the bus
+    for (uint8_t i = 0; i < servoCount; i++)
+    {
+        if (servos[i].movePending.exchange(false, std::memory_order_acquire))
+        {
+            uint32_t move = servos[i].move.load(std::memory_order_relaxed);
+            uint8_t params[4] = {
+                (uint8_t)(move & 0xFF), (uint8_t)((move >> 8) & 0xFF),
+                (uint8_t)((move >> 16) & 0xFF), (uint8_t)((move >> 24) & 0xFF)};
+            send(servos[i].id, LX824_CMD_MOVE_TIME_WRITE, params, sizeof(params));
+        }
+    }
+
+    if (pollPeriodUs > 0 && (!polled || now - lastPoll >= pollPeriodUs))
+    {
+        bool slow = pollCycle % slowPollDivider == 0;
+        for (uint8_t i = 0; i < servoCount; i++)
+        {
+            enqueueRead(i, LX824_CMD_POS_READ);
+            if (slow)
+            {
+                enqueueRead(i, LX824_CMD_TEMP_READ);
+                enqueueRead(i, LX824_CMD_VIN_READ);
+            }
+        }
+        lastPoll = polled ? lastPoll + pollPeriodUs : now;
+        // Do not try to catch up after a long stall
+        if (now - lastPoll >= pollPeriodUs)
+        {
+            lastPoll = now;
+        }
+        polled = true;
+        pollCycle++;
+    }
+
+    if (queueCount > 0)
+    {
+        Request request = queue[queueHead];
+        queueHead = (queueHead + 1) % LX824_QUEUE_SIZE;
+        queueCount--;
+        send(servos[request.servo].id, request.command, nullptr, 0);
+        outstanding = {true, request.servo, request.command, now};
+        return replyTimeoutUs;
+    }
+
+    if (pollPeriodUs == 0)
+    {
+        return 0xFFFFFFFFUL;
+    }
+    return pollPeriodUs - (now - lastPoll);
+}
@@ -0,0 +1,215 @@
+#ifndef LX824_BUS_H
+#define LX824_BUS_H
+
+#include <Snapshot.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Driver for the LX-824 serial bus servos. The protocol is half duplex:
+//
+//   0x55 0x55 id length command params... checksum
+//
+// where length counts itself, the command, the params and the checksum
+// (params + 3) and checksum is ~(id + length + command + params).
+//
+// Nothing in here touches the UART. The firmware feeds received bytes into
+// LX824RxRing from the UART receive callback, drains them through
+// LX824Parser and hands complete frames to LX824Bus, which writes outgoing
+// frames through the writer passed to begin(). That keeps the parser and the
+// scheduler runnable on the host against a scripted byte stream.
+
+#define LX824_HEADER 0x55
+#define LX824_MAX_PARAMS 7
+#define LX824_MAX_FRAME (LX824_MAX_PARAMS + 6)
+#define LX824_MAX_SERVOS 4
+#define LX824_QUEUE_SIZE 8
+#define LX824_ECHO_DEPTH (LX824_MAX_SERVOS + 1) // a poll writes a move per servo and one read
+
+#define LX824_CMD_MOVE_TIME_WRITE 1
+#define LX824_CMD_TEMP_READ 26
+#define LX824_CMD_VIN_READ 27
+#define LX824_CMD_POS_READ 28
+
+struct LX824Frame
+{
+    uint8_t id;
+    uint8_t length;
+    uint8_t command;
+    uint8_t params[LX824_MAX_PARAMS];
+
+    uint8_t paramCount() const { return length - 3; }
+};
+
+// Builds a complete frame into out (at least LX824_MAX_FRAME bytes) and
+// returns its size.
+size_t lx824Encode(uint8_t id, uint8_t command, const uint8_t *params, uint8_t paramCount, uint8_t *out);
+
+// Single producer/single consumer byte ring between the UART receive
+// callback and the bus task. When full new bytes are dropped and counted,
+// the parser resyncs on the next header.
+template <size_t N>
+class LX824RxRing
+{
+public:
+    bool push(uint8_t byte)
+    {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        size_t next = (head + 1) % N;
+        if (next == tailIndex.load(std::memory_order_acquire))
+        {
+            dropped++;
+            return false;
+        }
+        buffer[head] = byte;
+        headIndex.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(uint8_t &byte)
+    {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail == headIndex.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        byte = buffer[tail];
+        tailIndex.store((tail + 1) % N, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t dropped = 0;
+
+private:
+    uint8_t buffer[N];
+    std::atomic<size_t> headIndex{0};
+    std::atomic<size_t> tailIndex{0};
+};
+
+// Byte at a time frame parser. Anything that is not a valid frame is
+// skipped until the next 0x55 0x55 header.
+class LX824Parser
+{
+public:
+    // Returns true when byte completes a frame, which is then available
+    // from frame() until the next call.
+    bool feed(uint8_t byte);
+    const LX824Frame &frame() const { return current; }
+    void reset() { state = WAIT_HEADER1; }
+
+    uint32_t checksumErrors = 0;
+    uint32_t framingErrors = 0;
+
+private:
+    enum State : uint8_t
+    {
+        WAIT_HEADER1,
+        WAIT_HEADER2,
+        WAIT_ID,
+        WAIT_LENGTH,
+        WAIT_COMMAND,
+        WAIT_PARAMS,
+        WAIT_CHECKSUM
+    };
+
+    State state = WAIT_HEADER1;
+    LX824Frame current = {};
+    uint8_t paramIndex = 0;
+    uint8_t sum = 0;
+};
+
+struct LX824Reading
+{
+    int16_t position;
+    uint8_t temperature; // degrees C
+    uint16_t voltage;    // mV
+    uint32_t positionAt; // time of the last good reply for each value
+    uint32_t temperatureAt;
+    uint32_t voltageAt;
+    uint32_t timeouts;
+};
+
+typedef void (*LX824Writer)(const uint8_t *data, size_t length, void *context);
+
+// Transaction scheduler. Moves are latest-wins per servo and may be
+// requested from any task, and readings may be copied out from any task;
+// everything else must be called from the bus task. Reads are issued one at a time, each reply is matched against the
+// outstanding request and abandoned after the reply timeout. The echo of
+// every frame written is recognised and dropped. All times are in
+// microseconds.
+class LX824Bus
+{
+public:
+    void begin(LX824Writer writer, void *context);
+    bool addServo(uint8_t id);
+
+    // Safe from any task: replaces any move for id not yet on the wire.
+    void requestMove(uint8_t id, uint16_t position, uint16_t time);
+
+    // Position is read every poll period, temperature and voltage every
+    // slowPollDivider periods. A period of 0 disables readback.
+    void setPollPeriod(uint32_t periodUs) { pollPeriodUs = periodUs; }
+    uint32_t replyTimeoutUs = 5000;
+    uint8_t slowPollDivider = 10;
+
+    void onFrame(const LX824Frame &frame, uint32_t now);
+
+    // Sends whatever is due. Returns the time until poll() needs calling
+    // again if no bytes arrive in between.
+    uint32_t poll(uint32_t now);
+
+    // Copies the latest reading for id, false if id was never added
+    bool reading(uint8_t id, LX824Reading &out) const;
+    bool awaitingReply() const { return outstanding.active; }
+
+    uint32_t framesSent = 0;
+    uint32_t repliesMatched = 0;
+    uint32_t unexpectedFrames = 0;
+
+private:
+    struct Servo
+    {
+        uint8_t id;
+        std::atomic<uint32_t> move; // position | time << 16
+        std::atomic<bool> movePending;
+        LX824Reading reading;              // bus task's working copy
+        Snapshot<LX824Reading> published; // what reading() hands out
+    };
+
+    struct Request
+    {
+        uint8_t servo;
+        uint8_t command;
+    };
+
+    struct Outstanding
+    {
+        bool active;
+        uint8_t servo;
+        uint8_t command;
+        uint32_t sentAt;
+    };
+
+    bool enqueueRead(uint8_t servo, uint8_t command);
+    bool isEcho(const LX824Frame &frame);
+    void send(uint8_t id, uint8_t command, const uint8_t *params, uint8_t paramCount);
+    int servoIndex(uint8_t id) const;
+
+    LX824Writer write = nullptr;
+    void *writeContext = nullptr;
+    Servo servos[LX824_MAX_SERVOS];
+    uint8_t servoCount = 0;
+    Request queue[LX824_QUEUE_SIZE];
+    uint8_t queueHead = 0;
+    uint8_t queueCount = 0;
+    Outstanding outstanding = {};
+    LX824Frame echoes[LX824_ECHO_DEPTH]; // written frames whose echo has not come back, oldest first
+    uint8_t echoHead = 0;
+    uint8_t echoCount = 0;
+    uint32_t pollPeriodUs = 0;
+    uint32_t lastPoll = 0;
+    bool polled = false;
+    uint32_t pollCycle = 0;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "Metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+namespace
+{
+    // snprintf into a fixed buffer, remembering if anything was cut off
+    struct Writer
+    {
+        char *out;
+        size_t capacity;
+        size_t length;
+
+        void print(const char *format, ...) __attribute__((format(printf, 2, 3)))
+        {
+            if (length >= capacity)
+            {
+                return;
+            }
+            va_list args;
+            va_start(args, format);
+            int written = vsnprintf(out + length, capacity - length, format, args);
+            va_end(args);
+            if (written > 0)
+            {
+                length += written;
+            }
+        }
+
+        size_t finish()
+        {
+            if (length >= capacity)
+            {
+                length = capacity - 1;
+            }
+            return length;
+        }
+    };
+
+    uint32_t mean(const MetricsHistogram &histogram)
+    {
+        uint32_t count = histogram.count();
+        return count ? (uint32_t)(histogram.sum() / count) : 0;
+    }
+}
+
+uint32_t MetricsHistogram::percentile(float p) const
+{
+    uint32_t total = count();
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint32_t rank = (uint32_t)(p * total);
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < METRICS_BUCKETS - 1; i++)
+    {
+        seen += bucket(i);
+        if (seen > rank)
+        {
+            uint32_t limit = bucketLimit(i);
+            return limit < max() ? limit : max();
+        }
+    }
+    return max();
+}
+
+uint16_t metricsBusyShare(const MetricsTaskLoad &task, MetricsWindow &window, size_t index, uint64_t nowUs)
+{
+    uint64_t busyNow = task.busyUs();
+    uint64_t busyInWindow = busyNow - window.busyUs[index];
+    uint64_t length = nowUs - window.startUs;
+    window.busyUs[index] = busyNow;
+    if (length == 0)
+    {
+        return 0;
+    }
+    uint64_t share = busyInWindow * 1000 / length;
+    return share > 1000 ? 1000 : share;
+}
+
+size_t metricsWritePrometheus(char *out, size_t capacity, const MetricsSources &sources, MetricsWindow &window,
+                              uint64_t nowUs)
+{
+    Writer writer = {out, capacity, 0};
+    writer.print("# TYPE turret_uptime_us counter\nturret_uptime_us %llu\n", (unsigned long long)nowUs);
+
+    for (size_t h = 0; h < sources.histogramCount; h++)
+    {
+        const MetricsHistogram &histogram = *sources.histograms[h];
+        writer.print("# TYPE turret_%s histogram\n", histogram.name);
+        uint32_t cumulative = 0;
+        for (uint8_t i = 0; i < METRICS_BUCKETS - 1; i++)
+        {
+            uint32_t inBucket = histogram.bucket(i);
+            cumulative += inBucket;
+            // Skip the empty buckets at either end to keep the page short
+            if (cumulative == 0)
+            {
+                continue;
+            }
+            if (cumulative == histogram.count() && inBucket == 0)
+            {
+                break;
+            }
+            writer.print("turret_%s_bucket{le=\"%u\"} %u\n", histogram.name,
+                         (unsigned)(MetricsHistogram::bucketLimit(i) - 1), (unsigned)cumulative);
+        }
+        writer.print("turret_%s_bucket{le=\"+Inf\"} %u\n", histogram.name, (unsigned)histogram.count());
+        writer.print("turret_%s_sum %llu\n", histogram.name, (unsigned long long)histogram.sum());
+        writer.print("turret_%s_count %u\n", histogram.name, (unsigned)histogram.count());
+    }
+
+    writer.print("# TYPE turret_task_busy_us counter\n");
+    for (size_t t = 0; t < sources.taskCount; t++)
+    {
+        writer.print("turret_task_busy_us{task=\"%s\"} %llu\n", sources.tasks[t].name,
+                     (unsigned long long)sources.tasks[t].busyUs());
+    }
+    // Wall time from wake to block, preemption included, so not CPU share
+    writer.print("# TYPE turret_task_busy_percent gauge\n");
+    for (size_t t = 0; t < sources.taskCount; t++)
+    {
+        uint16_t share = metricsBusyShare(sources.tasks[t], window, t, nowUs);
+        writer.print("turret_task_busy_percent{task=\"%s\"} %u.%u\n", sources.tasks[t].name, share / 10, share % 10);
+    }
+    window.startUs = nowUs;
+    writer.print("# TYPE turret_task_stack_free_bytes gauge\n");
+    for (size_t t = 0; t < sources.taskCount; t++)
+    {
+        writer.print("turret_task_stack_free_bytes{task=\"%s\"} %u\n", sources.tasks[t].name,
+                     (unsigned)sources.tasks[t].stackFreeBytes);
+    }
+    writer.print("# TYPE turret_metrics_record_cycles gauge\nturret_metrics_record_cycles %u\n",
+                 (unsigned)sources.recordCycles);
+    writer.print("# TYPE turret_metrics_load_cycles gauge\nturret_metrics_load_cycles %u\n",
+                 (unsigned)sources.loadCycles);
+    return writer.finish();
+}
+
+size_t metricsWriteJson(char *out, size_t capacity, const MetricsSources &sources, MetricsWindow &window,
+                        uint64_t nowUs)
+{
+    Writer writer = {out, capacity, 0};
+    writer.print("{\"metrics\":{\"uptime_us\":%llu,\"histograms\":{", (unsigned long long)nowUs);
+    for (size_t h = 0; h < sources.histogramCount; h++)
+    {
+        const MetricsHistogram &histogram = *sources.histograms[h];
+        writer.print("%s\"%s\":{\"n\":%u,\"mean\":%u,\"p50\":%u,\"p99\":%u,\"max\":%u}", h ? "," : "",
+                     histogram.name, (unsigned)histogram.count(), (unsigned)mean(histogram),
+                     (unsigned)histogram.percentile(0.5f), (unsigned)histogram.percentile(0.99f),
+                     (unsigned)histogram.max());
+    }
+    writer.print("},\"tasks\":{");
+    for (size_t t = 0; t < sources.taskCount; t++)
+    {
+        uint16_t share = metricsBusyShare(sources.tasks[t], window, t, nowUs);
+        writer.print("%s\"%s\":{\"busy\":%u.%u,\"stack\":%u}", t ? "," : "", sources.tasks[t].name,
+                     share / 10, share % 10, (unsigned)sources.tasks[t].stackFreeBytes);
+    }
+    window.startUs = nowUs;
+    writer.print("},\"overhead\":{\"record_cycles\":%u,\"load_cycles\":%u}}}", (unsigned)sources.recordCycles,
+                 (unsigned)sources.loadCycles);
+    return writer.finish();
+}
@@ -0,0 +1,147 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Snapshot.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Always-on latency and load instrumentation. A histogram is 24 power of
+// two buckets of microseconds (bucket i counts values below 2^i, the last
+// one everything above), so recording is a count-leading-zeros and three
+// relaxed read-modify-write pairs (bucket, count, sum), plus one more when
+// the sum carries and one for a new maximum. The firmware measures what a
+// record and a task's busy()/idle() pair cost at boot and reports it next
+// to the numbers. Each histogram and task load has exactly one writing
+// task; the reports are built by another and may be a sample or two out of
+// step, which is fine for monitoring.
+//
+// Nothing here reads a clock. The firmware takes timestamps with the
+// cycle counter for spans inside one task and micros() for spans that
+// cross tasks (the two cores' cycle counters are not synchronised).
+
+#define METRICS_BUCKETS 24
+#define METRICS_REPORT_SIZE 4096
+#define METRICS_MAX_TASKS 12
+
+class MetricsHistogram
+{
+public:
+    explicit MetricsHistogram(const char *histogramName) : name(histogramName) {}
+
+    void record(uint32_t us)
+    {
+        uint8_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+        if (bucket >= METRICS_BUCKETS)
+        {
+            bucket = METRICS_BUCKETS - 1;
+        }
+        buckets[bucket].store(buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        samples.store(samples.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        uint32_t low = sumLow.load(std::memory_order_relaxed) + us;
+        if (low < us)
+        {
+            sumHigh.store(sumHigh.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        sumLow.store(low, std::memory_order_relaxed);
+        if (us > largest.load(std::memory_order_relaxed))
+        {
+            largest.store(us, std::memory_order_relaxed);
+        }
+    }
+
+    const char *name;
+
+    uint32_t count() const { return samples.load(std::memory_order_relaxed); }
+    uint32_t max() const { return largest.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return (uint64_t)sumHigh.load(std::memory_order_relaxed) << 32 | sumLow.load(std::memory_order_relaxed); }
+    uint32_t bucket(uint8_t index) const { return buckets[index].load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the p-th fraction of samples
+    uint32_t percentile(float p) const;
+
+    // Values in bucket index are below this, the last bucket is open
+    static uint32_t bucketLimit(uint8_t index) { return 1UL << index; }
+
+private:
+    std::atomic<uint32_t> buckets[METRICS_BUCKETS] = {};
+    std::atomic<uint32_t> samples{0};
+    std::atomic<uint32_t> sumLow{0};
+    std::atomic<uint32_t> sumHigh{0};
+    std::atomic<uint32_t> largest{0};
+};
+
+// Busy time of one task loop. The task calls busy() when it wakes and
+// idle() before it blocks. This is wall time between the two, so time the
+// task spent preempted by a higher priority one counts as busy: it says
+// how long the loop takes to get through its work, not its share of the
+// CPU. The total is 64 bits of microseconds and published through a
+// Snapshot, so a reporter on the other core never sees half an update.
+class MetricsTaskLoad
+{
+public:
+    const char *name = "";
+    uint32_t stackFreeBytes = 0; // filled in by the reporter
+
+    void busy(uint32_t nowUs)
+    {
+        since = nowUs;
+        running = true;
+    }
+    void idle(uint32_t nowUs)
+    {
+        if (running)
+        {
+            total += nowUs - since;
+            busyTotal.publish(total);
+            running = false;
+        }
+    }
+
+    uint64_t busyUs() const { return busyTotal.read(); }
+
+private:
+    uint32_t since = 0;
+    bool running = false;
+    uint64_t total = 0; // writer only
+    Snapshot<uint64_t> busyTotal;
+};
+
+// One reporter's window on the task loads: the busy totals at its previous
+// report. Every reporter (the /metrics scraper, each websocket client)
+// keeps its own, so its busy shares cover the time since it last asked
+// whoever else asked in between. A fresh window covers the time since boot.
+struct MetricsWindow
+{
+    uint64_t startUs = 0;
+    uint64_t busyUs[METRICS_MAX_TASKS] = {};
+};
+
+// What a report is built from
+struct MetricsSources
+{
+    MetricsHistogram *const *histograms;
+    size_t histogramCount;
+    MetricsTaskLoad *tasks;
+    size_t taskCount; // at most METRICS_MAX_TASKS
+    uint32_t recordCycles; // one MetricsHistogram::record(), as measured at boot
+    uint32_t loadCycles;   // one busy() and idle() pair
+};
+
+// Busy share of task since the window's previous report, in tenths of a
+// percent. Advances the window for that task only; the writers below
+// advance startUs once they have been through every task.
+uint16_t metricsBusyShare(const MetricsTaskLoad &task, MetricsWindow &window, size_t index, uint64_t nowUs);
+
+// Prometheus text exposition, for GET /metrics. nowUs is the 64 bit uptime.
+size_t metricsWritePrometheus(char *out, size_t capacity, const MetricsSources &sources, MetricsWindow &window,
+                              uint64_t nowUs);
+
+// Compact JSON for the websocket dump:
+//   {"metrics":{"uptime_us":..,"histograms":{"name":{"n":..,"mean":..,
+//    "p50":..,"p99":..,"max":..},..},"tasks":{"name":{"busy":..,"stack":..},..},
+//    "overhead":{"record_cycles":..,"load_cycles":..}}}
+size_t metricsWriteJson(char *out, size_t capacity, const MetricsSources &sources, MetricsWindow &window,
+                        uint64_t nowUs);
+
+#endif
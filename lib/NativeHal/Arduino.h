@@ -0,0 +1,144 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Just enough of the Arduino core for src/main.cpp to build and run on a
+// Linux host. Timing is real time from process start.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <functional>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define PROGMEM
+#define PGM_P const char *
+#define OUTPUT 0x03
+#define INPUT 0x01
+#define HIGH 1
+#define LOW 0
+#define SERIAL_8N1 0x800001c
+#define F_CPU 240000000L
+
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+class String
+{
+public:
+    String() {}
+    String(const char *s) : value(s ? s : "") {}
+    String(const std::string &s) : value(s) {}
+    String(int n) : value(std::to_string(n)) {}
+    String(unsigned int n) : value(std::to_string(n)) {}
+    String(long n) : value(std::to_string(n)) {}
+    String(unsigned long n) : value(std::to_string(n)) {}
+
+    const char *c_str() const { return value.c_str(); }
+    size_t length() const { return value.size(); }
+    char operator[](size_t i) const { return value[i]; }
+    bool operator==(const String &other) const { return value == other.value; }
+    bool operator==(const char *other) const { return value == (other ? other : ""); }
+    bool operator!=(const char *other) const { return !(*this == other); }
+    String &operator+=(const String &other)
+    {
+        value += other.value;
+        return *this;
+    }
+    friend String operator+(const String &a, const String &b) { return String(a.value + b.value); }
+    friend String operator+(const char *a, const String &b) { return String(std::string(a) + b.value); }
+    friend String operator+(const String &a, const char *b) { return String(a.value + b); }
+
+private:
+    std::string value;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t byte) { return write(&byte, 1); }
+    virtual size_t write(const uint8_t *data, size_t length) = 0;
+    size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+
+    size_t print(const char *s) { return write(s); }
+    size_t print(const String &s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n) { return printf("%d", n); }
+    size_t print(unsigned int n) { return printf("%u", n); }
+    size_t print(long n) { return printf("%ld", n); }
+    size_t print(unsigned long n) { return printf("%lu", n); }
+    size_t print(double n) { return printf("%.2f", n); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T &value) { return print(value) + println(); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+typedef std::function<void(void)> OnReceiveCb;
+
+// UART. Port 0 is the console on stdout; other ports talk to whatever
+// device the harness attached, e.g. SimulatedLX824.
+class HardwareSerial : public Print
+{
+public:
+    explicit HardwareSerial(int uartNumber);
+
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+    int available();
+    int read();
+    void onReceive(OnReceiveCb function, bool onlyOnTimeout = false);
+
+    using Print::write;
+    size_t write(const uint8_t *data, size_t length) override;
+
+    // Harness side
+    static HardwareSerial *port(int uartNumber);
+    void attachDevice(std::function<void(const uint8_t *, size_t)> device);
+    void simulateReceive(const uint8_t *data, size_t length);
+    unsigned long baudRate() const { return baud; }
+    static bool consoleMuted;
+
+private:
+    int uart;
+    unsigned long baud = 115200;
+    OnReceiveCb receiveCallback;
+    std::function<void(const uint8_t *, size_t)> deviceWrite;
+    struct RxBuffer;
+    RxBuffer *rx;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    // The device's 320 KB heap minus what the process has allocated
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    uint32_t getHeapSize();
+    uint32_t getCycleCount(); // wall clock scaled to F_CPU, like CCOUNT
+    uint32_t getCpuFreqMHz() { return F_CPU / 1000000; }
+    void restart();
+};
+
+extern EspClass ESP;
+
+void esp_sleep_enable_timer_wakeup(uint64_t timeUs);
+int esp_light_sleep_start();
+
+#endif
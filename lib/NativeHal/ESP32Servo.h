@@ -0,0 +1,28 @@
+#ifndef NATIVE_ESP32_SERVO_H
+#define NATIVE_ESP32_SERVO_H
+
+#include <Arduino.h>
+
+// Records what the firmware asked of a PWM servo or ESC
+class Servo
+{
+public:
+    int attach(int pin, int min = 544, int max = 2400);
+    void detach();
+    bool attached() const { return pin >= 0; }
+    void write(int value);
+    void writeMicroseconds(int value);
+    int read() const { return value; }
+    void setPeriodHertz(int hertz) { periodHertz = hertz; }
+
+    // Harness side
+    uint32_t writes = 0;
+    uint32_t lastWriteUs = 0;
+
+private:
+    int pin = -1;
+    int value = 0;
+    int periodHertz = 50;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef NATIVE_ESP_ASYNC_WEB_SERVER_H
+#define NATIVE_ESP_ASYNC_WEB_SERVER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// ESPAsyncWebServer stand-in. Everything the harness injects, HTTP requests
+// and websocket traffic alike, is handed to one "async_tcp" task that runs
+// the registered callbacks straight away, the way AsyncTCP runs them from
+// its own task as soon as lwIP reports data. The task is created by
+// AsyncWebServer::begin() at AsyncTCP's priority, on
+// CONFIG_ASYNC_TCP_RUNNING_CORE.
+
+#ifndef CONFIG_ASYNC_TCP_RUNNING_CORE
+#define CONFIG_ASYNC_TCP_RUNNING_CORE 0
+#endif
+#define DEFAULT_MAX_WS_CLIENTS 8
+
+class AsyncWebServerRequest;
+class AsyncWebSocket;
+class AsyncWebSocketClient;
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(void)> ArDisconnectHandler;
+
+class AsyncWebHeader
+{
+public:
+    AsyncWebHeader(const String &name, const String &value) : headerName(name), headerValue(value) {}
+    const String &name() const { return headerName; }
+    const String &value() const { return headerValue; }
+
+private:
+    String headerName;
+    String headerValue;
+};
+
+class AsyncWebServerResponse
+{
+public:
+    struct Contents
+    {
+        int code = 0;
+        std::string contentType;
+        std::map<std::string, std::string> headers;
+        std::vector<uint8_t> body;
+    };
+
+    void addHeader(const String &name, const String &value) { contents.headers[name.c_str()] = value.c_str(); }
+
+    Contents contents;
+};
+
+class AsyncWebServerRequest
+{
+public:
+    AsyncWebHeader *getHeader(const String &name);
+    bool hasHeader(const String &name) { return getHeader(name) != NULL; }
+
+    AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String());
+    AsyncWebServerResponse *beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t length);
+    void send(AsyncWebServerResponse *response);
+    void send(int code, const String &contentType = String(), const String &content = String());
+
+    // Runs once the response has gone out and the connection is closed
+    void onDisconnect(ArDisconnectHandler handler) { disconnected = handler; }
+
+private:
+    friend class AsyncWebServer;
+    std::vector<AsyncWebHeader> headers;
+    AsyncWebServerResponse *response = NULL;
+    ArDisconnectHandler disconnected;
+};
+
+class AsyncWebServer
+{
+public:
+    typedef AsyncWebServerResponse::Contents Response;
+
+    explicit AsyncWebServer(uint16_t port);
+
+    void on(const char *uri, ArRequestHandlerFunction handler) { handlers[uri] = handler; }
+    void addHandler(AsyncWebSocket *handler) {}
+    void begin();
+
+    // Harness side. Runs the request on the async_tcp task and waits for
+    // the response.
+    static AsyncWebServer *instance() { return current; }
+    Response request(const char *uri, const std::map<std::string, std::string> &headers = {});
+
+private:
+    static AsyncWebServer *current;
+    std::map<std::string, ArRequestHandlerFunction> handlers;
+};
+
+typedef enum
+{
+    WS_EVT_CONNECT,
+    WS_EVT_DISCONNECT,
+    WS_EVT_PONG,
+    WS_EVT_ERROR,
+    WS_EVT_DATA
+} AwsEventType;
+
+#define WS_CONTINUATION 0x00
+#define WS_TEXT 0x01
+#define WS_BINARY 0x02
+
+typedef struct
+{
+    uint8_t message_opcode;
+    uint32_t num;
+    uint8_t final;
+    uint8_t masked;
+    uint8_t opcode;
+    uint64_t len;
+    uint8_t mask[4];
+    uint64_t index;
+} AwsFrameInfo;
+
+class AsyncWebSocketClient
+{
+public:
+    uint32_t id() const { return clientId; }
+    void close(uint16_t code = 0, const char *message = NULL);
+    void text(const char *message, size_t length);
+    void text(const char *message) { text(message, strlen(message)); }
+    void binary(const uint8_t *message, size_t length);
+    bool canSend() const { return true; }
+
+private:
+    friend class AsyncWebSocket;
+    AsyncWebSocket *server = NULL;
+    uint32_t clientId = 0;
+    uint8_t harnessNum = 0;
+    bool open = false;
+};
+
+class AsyncWebSocket
+{
+public:
+    typedef std::function<void(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t length)> AwsEventHandler;
+    typedef std::function<void(uint8_t num, const uint8_t *payload, size_t length, bool binary)> Sink;
+
+    explicit AsyncWebSocket(const String &url);
+
+    void onEvent(AwsEventHandler handler) { event = handler; }
+    AsyncWebSocketClient *client(uint32_t id);
+    bool availableForWrite(uint32_t id);
+    size_t count() const;
+    void text(uint32_t id, const char *message, size_t length);
+    void text(uint32_t id, const char *message) { text(id, message, strlen(message)); }
+    void binary(uint32_t id, const uint8_t *message, size_t length);
+    void cleanupClients(uint16_t maxClients = DEFAULT_MAX_WS_CLIENTS) {}
+
+    // Harness side. num is the harness's name for a connection, a new
+    // connect() on the same num is a new client with a new id.
+    static AsyncWebSocket *instance() { return current; }
+    void connect(uint8_t num);
+    void disconnect(uint8_t num);
+    void sendText(uint8_t num, const char *payload, size_t length);
+    void sendBinary(uint8_t num, const uint8_t *payload, size_t length);
+    void setSink(Sink sink);
+
+    // CPU time spent in the event handler per data message, in ns
+    uint64_t handlerNs = 0;
+    uint32_t handlerCalls = 0;
+    std::function<void(uint64_t ns)> handlerObserver;
+    // Every data message burns at least this much CPU time on the
+    // async_tcp task, a stand-in for lwIP and frame handling on the device
+    uint32_t handlerPadUs = 0;
+
+private:
+    friend class AsyncWebSocketClient;
+    void deliver(uint8_t num, uint8_t opcode, const std::vector<uint8_t> &payload);
+    void closed(AsyncWebSocketClient *client);
+    bool sinkFor(uint32_t id, Sink &sink, uint8_t &num);
+
+    static AsyncWebSocket *current;
+    AwsEventHandler event;
+    struct Clients;
+    Clients *clients;
+};
+
+#endif
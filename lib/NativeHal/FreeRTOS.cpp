@@ -0,0 +1,385 @@
+#include "NativeHal.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <string.h>
+#include <thread>
+
+// Every task is a detached std::thread. Notifications are a counting
+// semaphore per task, which is what ulTaskNotifyTake/xTaskNotifyGive use.
+// Priority and core are only honoured after nativeEnforceScheduling(),
+// see applyScheduling().
+
+struct NativeTask
+{
+    std::string name;
+    UBaseType_t priority;
+    BaseType_t core;
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notifyCount = 0;
+};
+
+namespace
+{
+    thread_local NativeTask *currentTask = NULL;
+    bool enforceScheduling = false;
+    cpu_set_t processCpus;
+
+    NativeTask *self()
+    {
+        if (currentTask == NULL)
+        {
+            // setup() and loop() run on the process main thread. Not on
+            // the heap, HeapGuard asks for the current task from inside
+            // malloc.
+            static thread_local NativeTask adopted;
+            currentTask = &adopted;
+            currentTask->name = "loopTask";
+            currentTask->priority = 1;
+            currentTask->core = 1;
+        }
+        return currentTask;
+    }
+
+    // FreeRTOS priorities become SCHED_FIFO priorities and core N the Nth
+    // CPU the process may use. Without CAP_SYS_NICE or with a single CPU
+    // the thread silently keeps the default policy or placement.
+    void applyScheduling(NativeTask *task)
+    {
+        if (!enforceScheduling)
+        {
+            return;
+        }
+        sched_param param = {};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO) + (int)task->priority;
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+        if (task->core == tskNO_AFFINITY || CPU_COUNT(&processCpus) < 2)
+        {
+            return;
+        }
+        int seen = 0;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &processCpus) && seen++ == task->core)
+            {
+                cpu_set_t one;
+                CPU_ZERO(&one);
+                CPU_SET(cpu, &one);
+                pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+                return;
+            }
+        }
+    }
+}
+
+bool nativeEnforceScheduling(int cores)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&processCpus);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE && CPU_COUNT(&processCpus) < cores; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                CPU_SET(cpu, &processCpus);
+            }
+        }
+        sched_setaffinity(0, sizeof(processCpus), &processCpus);
+    }
+    enforceScheduling = true;
+
+    // Probe whether real-time priorities are allowed at all
+    sched_param param = {};
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    bool realtime = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    if (realtime)
+    {
+        param.sched_priority = 0;
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    }
+    return realtime;
+}
+
+void nativeRaiseThread()
+{
+    if (!enforceScheduling)
+    {
+        return;
+    }
+    sched_param param = {};
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *created, BaseType_t core)
+{
+    NativeTask *task = new NativeTask();
+    task->name = name;
+    task->priority = priority;
+    task->core = core;
+    // The handle has to be valid before the task runs, tasks often notify
+    // each other straight away
+    if (created != NULL)
+    {
+        *created = task;
+    }
+    std::thread([task, code, parameters]()
+                {
+                    currentTask = task;
+                    applyScheduling(task);
+                    code(parameters);
+                })
+        .detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *created)
+{
+    return xTaskCreatePinnedToCore(code, name, stackDepth, parameters, priority, created, tskNO_AFFINITY);
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return millis();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks == 0)
+    {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *previousWakeTime, TickType_t increment)
+{
+    TickType_t wake = *previousWakeTime + increment;
+    *previousWakeTime = wake;
+    // Sleep to the start of the wake tick rather than a whole number of
+    // ticks from now, or every period picks up the fraction already gone
+    int64_t waitUs = (int64_t)wake * 1000 - (int64_t)micros();
+    if (waitUs <= 0)
+    {
+        return pdFALSE;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(waitUs));
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+    NativeTask *task = self();
+    std::unique_lock<std::mutex> lock(task->lock);
+    if (ticksToWait == portMAX_DELAY)
+    {
+        task->notified.wait(lock, [task]()
+                            { return task->notifyCount > 0; });
+    }
+    else
+    {
+        task->notified.wait_for(lock, std::chrono::milliseconds(ticksToWait), [task]()
+                                { return task->notifyCount > 0; });
+    }
+    uint32_t count = task->notifyCount;
+    if (count > 0)
+    {
+        task->notifyCount = clearCountOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notifyCount++;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return self();
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    return (task != NULL ? task : self())->name.c_str();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    // Host threads have megabytes of stack, there is nothing useful to report
+    return 0;
+}
+
+BaseType_t xPortGetCoreID()
+{
+    BaseType_t core = self()->core;
+    return core == tskNO_AFFINITY ? 0 : core;
+}
+
+struct NativeEventGroup
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate()
+{
+    return new NativeEventGroup();
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    std::lock_guard<std::mutex> guard(group->lock);
+    group->bits |= bits;
+    group->changed.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    std::lock_guard<std::mutex> guard(group->lock);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    std::lock_guard<std::mutex> guard(group->lock);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit, BaseType_t waitForAll, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(group->lock);
+    auto done = [group, bits, waitForAll]()
+    { return waitForAll ? (group->bits & bits) == bits : (group->bits & bits) != 0; };
+    if (ticksToWait == portMAX_DELAY)
+    {
+        group->changed.wait(lock, done);
+    }
+    else
+    {
+        group->changed.wait_for(lock, std::chrono::milliseconds(ticksToWait), done);
+    }
+    EventBits_t result = group->bits;
+    if (clearOnExit && done())
+    {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+struct NativeQueue
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::string> items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    NativeQueue *queue = new NativeQueue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+namespace
+{
+    // Waits on queue->changed until ready() or the timeout, with the lock held
+    template <typename Ready>
+    bool waitQueue(NativeQueue *queue, std::unique_lock<std::mutex> &lock, TickType_t ticksToWait, Ready ready)
+    {
+        if (ticksToWait == portMAX_DELAY)
+        {
+            queue->changed.wait(lock, ready);
+            return true;
+        }
+        return queue->changed.wait_for(lock, std::chrono::milliseconds(ticksToWait), ready);
+    }
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitQueue(queue, lock, ticksToWait, [queue]()
+                   { return queue->items.size() < queue->length; }))
+    {
+        return pdFAIL;
+    }
+    queue->items.emplace_back((const char *)item, queue->itemSize);
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitQueue(queue, lock, ticksToWait, [queue]()
+                   { return !queue->items.empty(); }))
+    {
+        return pdFAIL;
+    }
+    memcpy(buffer, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->length - queue->items.size();
+}
+
+struct NativeMutex
+{
+    std::timed_mutex lock;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new NativeMutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticksToWait)
+{
+    if (ticksToWait == portMAX_DELAY)
+    {
+        mutex->lock.lock();
+        return pdTRUE;
+    }
+    return mutex->lock.try_lock_for(std::chrono::milliseconds(ticksToWait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    mutex->lock.unlock();
+    return pdTRUE;
+}
@@ -0,0 +1,901 @@
+#include "NativeHal.h"
+#include <ESP32Servo.h>
+#include <HeapGuard.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <ESPAsyncWebServer.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <malloc.h>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+namespace
+{
+    const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+    HardwareSerial *ports[3];
+
+    struct Delivery
+    {
+        HardwareSerial *port;
+        uint32_t atUs;
+        std::vector<uint8_t> bytes;
+    };
+
+    std::mutex deliveryLock;
+    std::condition_variable deliveryReady;
+    std::deque<Delivery> deliveries;
+    bool deliveryThreadStarted = false;
+
+    void deliveryLoop()
+    {
+        nativeRaiseThread();
+        std::unique_lock<std::mutex> lock(deliveryLock);
+        for (;;)
+        {
+            if (deliveries.empty())
+            {
+                deliveryReady.wait(lock);
+                continue;
+            }
+            int32_t wait = (int32_t)(deliveries.front().atUs - micros());
+            if (wait > 0)
+            {
+                deliveryReady.wait_for(lock, std::chrono::microseconds(wait));
+                continue;
+            }
+            Delivery next = std::move(deliveries.front());
+            deliveries.pop_front();
+            lock.unlock();
+            next.port->simulateReceive(next.bytes.data(), next.bytes.size());
+            lock.lock();
+        }
+    }
+}
+
+unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+
+uint64_t nativeThreadCpuNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return 0;
+    }
+    return write((const uint8_t *)buffer, (size_t)length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+}
+
+// Serial
+
+struct HardwareSerial::RxBuffer
+{
+    std::mutex lock;
+    std::deque<uint8_t> bytes;
+};
+
+bool HardwareSerial::consoleMuted = false;
+HardwareSerial Serial(0);
+
+HardwareSerial::HardwareSerial(int uartNumber) : uart(uartNumber), rx(new RxBuffer)
+{
+    if (uartNumber >= 0 && uartNumber < 3)
+    {
+        ports[uartNumber] = this;
+    }
+}
+
+HardwareSerial *HardwareSerial::port(int uartNumber)
+{
+    return uartNumber >= 0 && uartNumber < 3 ? ports[uartNumber] : NULL;
+}
+
+void HardwareSerial::begin(unsigned long baudRate, uint32_t config, int8_t rxPin, int8_t txPin)
+{
+    baud = baudRate;
+}
+
+int HardwareSerial::available()
+{
+    std::lock_guard<std::mutex> guard(rx->lock);
+    return rx->bytes.size();
+}
+
+int HardwareSerial::read()
+{
+    std::lock_guard<std::mutex> guard(rx->lock);
+    if (rx->bytes.empty())
+    {
+        return -1;
+    }
+    uint8_t byte = rx->bytes.front();
+    rx->bytes.pop_front();
+    return byte;
+}
+
+void HardwareSerial::onReceive(OnReceiveCb function, bool onlyOnTimeout)
+{
+    receiveCallback = function;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length)
+{
+    if (uart == 0)
+    {
+        if (!consoleMuted)
+        {
+            fwrite(data, 1, length, stdout);
+            fflush(stdout);
+        }
+        return length;
+    }
+    if (deviceWrite)
+    {
+        // The simulated device queues what it receives, the real UART
+        // driver copies into its ring buffer
+        HeapGuardExempt exempt;
+        deviceWrite(data, length);
+    }
+    return length;
+}
+
+void HardwareSerial::attachDevice(std::function<void(const uint8_t *, size_t)> device)
+{
+    deviceWrite = device;
+}
+
+void HardwareSerial::simulateReceive(const uint8_t *data, size_t length)
+{
+    {
+        std::lock_guard<std::mutex> guard(rx->lock);
+        rx->bytes.insert(rx->bytes.end(), data, data + length);
+    }
+    if (receiveCallback)
+    {
+        receiveCallback();
+    }
+}
+
+void nativeDeliverSerial(HardwareSerial &port, const uint8_t *data, size_t length, uint32_t atUs)
+{
+    std::lock_guard<std::mutex> guard(deliveryLock);
+    if (!deliveryThreadStarted)
+    {
+        std::thread(deliveryLoop).detach();
+        deliveryThreadStarted = true;
+    }
+    auto position = deliveries.end();
+    while (position != deliveries.begin() && (int32_t)(std::prev(position)->atUs - atUs) > 0)
+    {
+        --position;
+    }
+    deliveries.insert(position, Delivery{&port, atUs, std::vector<uint8_t>(data, data + length)});
+    deliveryReady.notify_one();
+}
+
+uint32_t nativeWireTimeUs(const HardwareSerial &port, size_t length)
+{
+    return (uint32_t)(length * 10ULL * 1000000ULL / port.baudRate());
+}
+
+// ESP
+
+EspClass ESP;
+
+namespace
+{
+    std::atomic<uint32_t> minFreeHeap{0xFFFFFFFF};
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    size_t used = mallinfo2().uordblks;
+    uint32_t free = used < getHeapSize() ? getHeapSize() - used : 0;
+    uint32_t low = minFreeHeap.load();
+    while (free < low && !minFreeHeap.compare_exchange_weak(low, free))
+    {
+    }
+    return free;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    getFreeHeap();
+    return minFreeHeap.load();
+}
+
+// No fragmentation on the host
+uint32_t EspClass::getMaxAllocHeap() { return getFreeHeap(); }
+uint32_t EspClass::getHeapSize() { return 320000; }
+uint32_t EspClass::getCycleCount()
+{
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - bootTime).count();
+    return (uint32_t)(ns * (F_CPU / 1000000) / 1000);
+}
+void EspClass::restart() { _Exit(0); }
+
+void esp_sleep_enable_timer_wakeup(uint64_t timeUs) {}
+int esp_light_sleep_start() { return 0; }
+
+// Servo
+
+int Servo::attach(int attachPin, int min, int max)
+{
+    pin = attachPin;
+    return 1;
+}
+
+void Servo::detach()
+{
+    pin = -1;
+}
+
+void Servo::write(int newValue)
+{
+    value = newValue;
+    writes++;
+    lastWriteUs = micros();
+}
+
+void Servo::writeMicroseconds(int newValue)
+{
+    write(newValue);
+}
+
+// Preferences
+
+namespace
+{
+    std::mutex nvsLock;
+    std::map<std::string, std::vector<uint8_t>> nvs; // "namespace/key"
+    const char *nvsPath = NULL;
+    bool nvsLoaded = false;
+
+    // One entry per line: key, space, value in hex
+    void loadNvs()
+    {
+        nvsLoaded = true;
+        FILE *file = nvsPath != NULL ? fopen(nvsPath, "r") : NULL;
+        if (file == NULL)
+        {
+            return;
+        }
+        char key[64];
+        char hex[1024];
+        while (fscanf(file, "%63s %1023s", key, hex) == 2)
+        {
+            std::vector<uint8_t> value;
+            for (size_t i = 0; hex[i] != '\0' && hex[i + 1] != '\0'; i += 2)
+            {
+                unsigned byte;
+                sscanf(hex + i, "%2x", &byte);
+                value.push_back(byte);
+            }
+            nvs[key] = value;
+        }
+        fclose(file);
+    }
+
+    void saveNvs()
+    {
+        FILE *file = nvsPath != NULL ? fopen(nvsPath, "w") : NULL;
+        if (file == NULL)
+        {
+            return;
+        }
+        for (const auto &entry : nvs)
+        {
+            fprintf(file, "%s ", entry.first.c_str());
+            for (uint8_t byte : entry.second)
+            {
+                fprintf(file, "%02x", byte);
+            }
+            fprintf(file, "%s\n", entry.second.empty() ? "-" : "");
+        }
+        fclose(file);
+    }
+}
+
+void nativeSetNvsPath(const char *path)
+{
+    std::lock_guard<std::mutex> guard(nvsLock);
+    nvsPath = path;
+    nvsLoaded = false;
+    nvs.clear();
+}
+
+bool Preferences::begin(const char *name, bool readOnlyMode)
+{
+    std::lock_guard<std::mutex> guard(nvsLock);
+    if (!nvsLoaded)
+    {
+        loadNvs();
+    }
+    space = name;
+    readOnly = readOnlyMode;
+    return true;
+}
+
+bool Preferences::clear()
+{
+    std::lock_guard<std::mutex> guard(nvsLock);
+    if (readOnly)
+    {
+        return false;
+    }
+    std::string prefix = space + "/";
+    for (auto entry = nvs.begin(); entry != nvs.end();)
+    {
+        entry = entry->first.compare(0, prefix.size(), prefix) == 0 ? nvs.erase(entry) : std::next(entry);
+    }
+    saveNvs();
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    std::lock_guard<std::mutex> guard(nvsLock);
+    if (readOnly || nvs.erase(space + "/" + key) == 0)
+    {
+        return false;
+    }
+    saveNvs();
+    return true;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    std::lock_guard<std::mutex> guard(nvsLock);
+    return nvs.count(space + "/" + key) != 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    std::lock_guard<std::mutex> guard(nvsLock);
+    if (readOnly)
+    {
+        return 0;
+    }
+    const uint8_t *bytes = (const uint8_t *)value;
+    nvs[space + "/" + key] = std::vector<uint8_t>(bytes, bytes + length);
+    saveNvs();
+    return length;
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t maxLength)
+{
+    std::lock_guard<std::mutex> guard(nvsLock);
+    auto entry = nvs.find(space + "/" + key);
+    if (entry == nvs.end() || entry->second.size() > maxLength)
+    {
+        return 0;
+    }
+    memcpy(buffer, entry->second.data(), entry->second.size());
+    return entry->second.size();
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    std::lock_guard<std::mutex> guard(nvsLock);
+    auto entry = nvs.find(space + "/" + key);
+    return entry == nvs.end() ? 0 : entry->second.size();
+}
+
+// WiFi
+
+WiFiClass WiFi;
+
+String IPAddress::toString() const
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    return String(text);
+}
+
+namespace
+{
+    std::mutex wifiLock;
+
+    // Stands in for the Arduino event task: one thread, events in order
+    std::mutex eventLock;
+    std::condition_variable eventReady;
+    std::deque<std::function<void()>> events;
+    bool eventThreadStarted = false;
+
+    void postEvent(std::function<void()> event)
+    {
+        std::lock_guard<std::mutex> guard(eventLock);
+        if (!eventThreadStarted)
+        {
+            std::thread([]()
+                        {
+                            std::unique_lock<std::mutex> lock(eventLock);
+                            for (;;)
+                            {
+                                eventReady.wait(lock, []()
+                                                { return !events.empty(); });
+                                std::function<void()> next = std::move(events.front());
+                                events.pop_front();
+                                lock.unlock();
+                                next();
+                                lock.lock();
+                            } })
+                .detach();
+            eventThreadStarted = true;
+        }
+        events.push_back(std::move(event));
+        eventReady.notify_one();
+    }
+}
+
+bool WiFiClass::config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns)
+{
+    std::lock_guard<std::mutex> guard(wifiLock);
+    staticAddress = (uint32_t)local != 0;
+    address = staticAddress ? local : IPAddress(192, 168, 1, 55);
+    return true;
+}
+
+int WiFiClass::begin(const char *ssid, const char *passphrase, int32_t channel, const uint8_t *bssid, bool connect)
+{
+    uint32_t mine;
+    uint32_t associateAfter;
+    uint32_t addressAfter;
+    {
+        std::lock_guard<std::mutex> guard(wifiLock);
+        if ((uint32_t)address == 0)
+        {
+            address = IPAddress(192, 168, 1, 55);
+        }
+        mine = ++attempt;
+        bool direct = channel == apChannel && bssid != NULL && memcmp(bssid, apBssid, 6) == 0;
+        associateAfter = direct ? associateMs : scanMs + associateMs;
+        addressAfter = staticAddress ? 0 : dhcpMs;
+    }
+    std::thread([this, mine, associateAfter, addressAfter]()
+                {
+                    delay(associateAfter);
+                    {
+                        std::lock_guard<std::mutex> guard(wifiLock);
+                        if (attempt != mine)
+                        {
+                            return;
+                        }
+                        if ((int32_t)(millis() - outageUntilMs) < 0)
+                        {
+                            attempt++;
+                            emit(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_NO_AP_FOUND);
+                            return;
+                        }
+                        emit(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+                    }
+                    delay(addressAfter);
+                    std::lock_guard<std::mutex> guard(wifiLock);
+                    if (attempt == mine)
+                    {
+                        connected = true;
+                        emit(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+                    }
+                })
+        .detach();
+    return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp)
+{
+    std::lock_guard<std::mutex> guard(wifiLock);
+    attempt++;
+    if (connected)
+    {
+        connected = false;
+        emit(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_ASSOC_LEAVE);
+    }
+    return true;
+}
+
+int WiFiClass::onEvent(EventHandler handler, arduino_event_id_t event)
+{
+    std::lock_guard<std::mutex> guard(wifiLock);
+    if (handlerCount == 4)
+    {
+        return -1;
+    }
+    handlers[handlerCount] = handler;
+    filters[handlerCount] = event;
+    return handlerCount++;
+}
+
+void WiFiClass::simulateOutage(uint32_t outageMs)
+{
+    std::lock_guard<std::mutex> guard(wifiLock);
+    outageUntilMs = millis() + outageMs;
+    attempt++;
+    if (connected)
+    {
+        connected = false;
+        emit(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_BEACON_TIMEOUT);
+    }
+}
+
+// Called with wifiLock held, the handlers run on the event thread
+void WiFiClass::emit(arduino_event_id_t event, uint8_t reason)
+{
+    arduino_event_info_t info = {};
+    info.wifi_sta_disconnected.reason = reason;
+    for (uint8_t i = 0; i < handlerCount; i++)
+    {
+        if (filters[i] == ARDUINO_EVENT_MAX || filters[i] == event)
+        {
+            EventHandler handler = handlers[i];
+            postEvent([handler, event, info]()
+                      { handler(event, info); });
+        }
+    }
+}
+
+// AsyncTCP
+
+namespace
+{
+    std::mutex asyncLock;
+    std::condition_variable asyncReady;
+    std::deque<std::function<void()>> asyncJobs;
+
+    void asyncTcpTask(void *parameters)
+    {
+        std::unique_lock<std::mutex> lock(asyncLock);
+        for (;;)
+        {
+            asyncReady.wait(lock, []()
+                            { return !asyncJobs.empty(); });
+            std::function<void()> job = std::move(asyncJobs.front());
+            asyncJobs.pop_front();
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+
+    void postAsync(std::function<void()> job)
+    {
+        std::lock_guard<std::mutex> guard(asyncLock);
+        asyncJobs.push_back(std::move(job));
+        asyncReady.notify_one();
+    }
+}
+
+// AsyncWebServer
+
+AsyncWebServer *AsyncWebServer::current = NULL;
+
+AsyncWebServer::AsyncWebServer(uint16_t port)
+{
+    current = this;
+}
+
+void AsyncWebServer::begin()
+{
+    // AsyncTCP's defaults: priority 3, 8 KB of stack
+    xTaskCreatePinnedToCore(asyncTcpTask, "async_tcp", 8192, NULL, 3, NULL, CONFIG_ASYNC_TCP_RUNNING_CORE);
+}
+
+AsyncWebServer::Response AsyncWebServer::request(const char *uri, const std::map<std::string, std::string> &headers)
+{
+    std::promise<Response> done;
+    std::string path = uri;
+    postAsync([this, &done, &headers, path]()
+              {
+                  AsyncWebServerRequest request;
+                  for (const auto &header : headers)
+                  {
+                      request.headers.emplace_back(String(header.first), String(header.second));
+                  }
+                  Response response;
+                  response.code = 404;
+                  auto found = handlers.find(path);
+                  if (found != handlers.end())
+                  {
+                      found->second(&request);
+                      response.code = 500; // the handler never answered
+                      if (request.response != NULL)
+                      {
+                          response = request.response->contents;
+                          delete request.response;
+                      }
+                      if (request.disconnected)
+                      {
+                          request.disconnected();
+                      }
+                  }
+                  done.set_value(response); });
+    return done.get_future().get();
+}
+
+AsyncWebHeader *AsyncWebServerRequest::getHeader(const String &name)
+{
+    for (AsyncWebHeader &header : headers)
+    {
+        if (strcasecmp(header.name().c_str(), name.c_str()) == 0)
+        {
+            return &header;
+        }
+    }
+    return NULL;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const String &contentType, const String &content)
+{
+    AsyncWebServerResponse *response = new AsyncWebServerResponse();
+    response->contents.code = code;
+    response->contents.contentType = contentType.c_str();
+    response->contents.body.assign(content.c_str(), content.c_str() + content.length());
+    return response;
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse_P(int code, const String &contentType, const uint8_t *content, size_t length)
+{
+    AsyncWebServerResponse *response = new AsyncWebServerResponse();
+    response->contents.code = code;
+    response->contents.contentType = contentType.c_str();
+    response->contents.body.assign(content, content + length);
+    return response;
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+    delete this->response;
+    this->response = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content)
+{
+    send(beginResponse(code, contentType, content));
+}
+
+// AsyncWebSocket
+
+struct AsyncWebSocket::Clients
+{
+    std::mutex lock;
+    Sink sink;
+    std::map<uint32_t, uint8_t> numById;             // open clients
+    std::map<uint8_t, AsyncWebSocketClient *> byNum; // async_tcp task only
+    uint32_t nextId = 1;                             // async_tcp task only
+};
+
+AsyncWebSocket *AsyncWebSocket::current = NULL;
+
+AsyncWebSocket::AsyncWebSocket(const String &url) : clients(new Clients)
+{
+    current = this;
+}
+
+void AsyncWebSocket::setSink(Sink sink)
+{
+    std::lock_guard<std::mutex> guard(clients->lock);
+    clients->sink = sink;
+}
+
+void AsyncWebSocket::connect(uint8_t num)
+{
+    postAsync([this, num]()
+              {
+                  if (clients->byNum.count(num) != 0)
+                  {
+                      return;
+                  }
+                  AsyncWebSocketClient *client = new AsyncWebSocketClient();
+                  client->server = this;
+                  client->clientId = clients->nextId++;
+                  client->harnessNum = num;
+                  client->open = true;
+                  clients->byNum[num] = client;
+                  {
+                      std::lock_guard<std::mutex> guard(clients->lock);
+                      clients->numById[client->clientId] = num;
+                  }
+                  if (event)
+                  {
+                      event(this, client, WS_EVT_CONNECT, NULL, NULL, 0);
+                  } });
+}
+
+void AsyncWebSocket::disconnect(uint8_t num)
+{
+    postAsync([this, num]()
+              {
+                  auto found = clients->byNum.find(num);
+                  if (found != clients->byNum.end())
+                  {
+                      closed(found->second);
+                  } });
+}
+
+void AsyncWebSocket::sendText(uint8_t num, const char *payload, size_t length)
+{
+    std::vector<uint8_t> bytes(payload, payload + length);
+    postAsync([this, num, bytes]()
+              { deliver(num, WS_TEXT, bytes); });
+}
+
+void AsyncWebSocket::sendBinary(uint8_t num, const uint8_t *payload, size_t length)
+{
+    std::vector<uint8_t> bytes(payload, payload + length);
+    postAsync([this, num, bytes]()
+              { deliver(num, WS_BINARY, bytes); });
+}
+
+// Async_tcp task. Every message arrives as a single final frame.
+void AsyncWebSocket::deliver(uint8_t num, uint8_t opcode, const std::vector<uint8_t> &payload)
+{
+    auto found = clients->byNum.find(num);
+    if (found == clients->byNum.end() || !event)
+    {
+        return;
+    }
+    AwsFrameInfo info = {};
+    info.message_opcode = opcode;
+    info.opcode = opcode;
+    info.final = 1;
+    info.masked = 1;
+    info.len = payload.size();
+
+    // The library NUL terminates text in place, a copy does here
+    std::vector<uint8_t> data = payload;
+    data.push_back(0);
+    uint64_t start = nativeThreadCpuNs();
+    event(this, found->second, WS_EVT_DATA, &info, data.data(), payload.size());
+    uint64_t spent = nativeThreadCpuNs() - start;
+    while (spent < handlerPadUs * 1000ULL)
+    {
+        spent = nativeThreadCpuNs() - start;
+    }
+    handlerNs += spent;
+    handlerCalls++;
+    if (handlerObserver)
+    {
+        handlerObserver(spent);
+    }
+}
+
+// Async_tcp task
+void AsyncWebSocket::closed(AsyncWebSocketClient *client)
+{
+    {
+        std::lock_guard<std::mutex> guard(clients->lock);
+        clients->numById.erase(client->clientId);
+    }
+    clients->byNum.erase(client->harnessNum);
+    client->open = false;
+    if (event)
+    {
+        event(this, client, WS_EVT_DISCONNECT, NULL, NULL, 0);
+    }
+    delete client;
+}
+
+bool AsyncWebSocket::sinkFor(uint32_t id, Sink &sink, uint8_t &num)
+{
+    std::lock_guard<std::mutex> guard(clients->lock);
+    auto found = clients->numById.find(id);
+    if (found == clients->numById.end())
+    {
+        return false;
+    }
+    sink = clients->sink;
+    num = found->second;
+    return true;
+}
+
+AsyncWebSocketClient *AsyncWebSocket::client(uint32_t id)
+{
+    uint8_t num;
+    Sink sink;
+    if (!sinkFor(id, sink, num))
+    {
+        return NULL;
+    }
+    auto found = clients->byNum.find(num);
+    return found == clients->byNum.end() ? NULL : found->second;
+}
+
+bool AsyncWebSocket::availableForWrite(uint32_t id)
+{
+    std::lock_guard<std::mutex> guard(clients->lock);
+    return clients->numById.count(id) != 0;
+}
+
+size_t AsyncWebSocket::count() const
+{
+    std::lock_guard<std::mutex> guard(clients->lock);
+    return clients->numById.size();
+}
+
+void AsyncWebSocket::text(uint32_t id, const char *message, size_t length)
+{
+    Sink sink;
+    uint8_t num;
+    if (sinkFor(id, sink, num) && sink)
+    {
+        sink(num, (const uint8_t *)message, length, false);
+    }
+}
+
+void AsyncWebSocket::binary(uint32_t id, const uint8_t *message, size_t length)
+{
+    Sink sink;
+    uint8_t num;
+    if (sinkFor(id, sink, num) && sink)
+    {
+        sink(num, message, length, true);
+    }
+}
+
+void AsyncWebSocketClient::close(uint16_t code, const char *message)
+{
+    // The close handshake finishes later on the async_tcp task
+    AsyncWebSocket *owner = server;
+    uint8_t num = harnessNum;
+    uint32_t id = clientId;
+    postAsync([owner, num, id]()
+              {
+                  auto found = owner->clients->byNum.find(num);
+                  if (found != owner->clients->byNum.end() && found->second->clientId == id)
+                  {
+                      owner->closed(found->second);
+                  } });
+}
+
+void AsyncWebSocketClient::text(const char *message, size_t length)
+{
+    server->text(clientId, message, length);
+}
+
+void AsyncWebSocketClient::binary(const uint8_t *message, size_t length)
+{
+    server->binary(clientId, message, length);
+}
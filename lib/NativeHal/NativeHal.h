@@ -0,0 +1,34 @@
+#ifndef NATIVE_HAL_H
+#define NATIVE_HAL_H
+
+#include <Arduino.h>
+
+// Harness side of the host build, not visible to the firmware.
+
+// Queues bytes to arrive on a serial port at the given micros() time. A
+// delivery thread pushes them into the port's receive buffer in order and
+// runs its onReceive callback, as the UART driver task would.
+void nativeDeliverSerial(HardwareSerial &port, const uint8_t *data, size_t length, uint32_t atUs);
+
+// Time length bytes take on the wire at the port's baud rate (8N1)
+uint32_t nativeWireTimeUs(const HardwareSerial &port, size_t length);
+
+// CPU time consumed by the calling thread, in nanoseconds
+uint64_t nativeThreadCpuNs();
+
+// Makes tasks created from now on honour their priority (as SCHED_FIFO)
+// and core (as the Nth of the first `cores` CPUs the process may use, the
+// whole process is restricted to those). Returns false if the host does
+// not allow real-time priorities; placement is still applied.
+bool nativeEnforceScheduling(int cores);
+
+// File that Preferences loads at the first begin() and rewrites on every
+// change, NULL (the default) keeps NVS in memory
+void nativeSetNvsPath(const char *path);
+
+// Runs the calling harness thread above every task, the way interrupts
+// and the UART driver preempt tasks on the device. No-op unless
+// scheduling is enforced.
+void nativeRaiseThread();
+
+#endif
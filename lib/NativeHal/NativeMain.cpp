@@ -0,0 +1,776 @@
+// pio test builds the test's own main and none of src/
+#ifndef PIO_UNIT_TESTING
+
+#include "NativeHal.h"
+#include "SimulatedLX824.h"
+#include <ESPAsyncWebServer.h>
+#include <ESP32Servo.h>
+#include <WiFi.h>
+#include <ScanPattern.h>
+#include <TargetPredictor.h>
+#include <TurretProtocol.h>
+#include <TurretState.h>
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <mutex>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+// Entry point of the native build. Without arguments it boots the firmware
+// against simulated servos and runs loop() forever. --bench drives the
+// websocket handler with JSON and binary command streams and reports
+//
+//   cmd->uart   command injected to the first LX-824 move for it on the bus
+//   telemetry   command injected to the first telemetry frame carrying it
+//   handler     CPU time of the websocket callback for one message
+//
+// Options: --samples N (per format, default 100), --budget-us N (exit 1 if
+// the cmd->uart p99 of either format exceeds it), --verbose (keep the
+// firmware's Serial output), --metrics (print the firmware's own /metrics
+// page after the run).
+//
+// --jitter runs a slow pan sweep so the control loop puts a move on the
+// bus every tick, floods the websocket with --rate N (default 2000) JSON
+// commands per second plus 50 Hz telemetry, and reports the intervals
+// between pan moves for --seconds N (default 4). Each message costs at
+// least --handler-us N (default 200) of CPU on the network task, roughly
+// what lwIP and frame handling take on the device. Tasks get their
+// priorities as SCHED_FIFO and their cores as two host CPUs, so the same
+// harness on an older firmware shows what the task layout bought.
+//
+// --scan prints how much of the scan area every sweep pattern covers in a
+// cycle (--fov N degrees around the aim point, default 15) next to the old
+// diagonal sweep, then boots the firmware and times how long a message
+// leaving sweep mode takes to reach the camera servo, over --samples runs
+// interrupted at random points; --budget-us applies to its p99.
+//
+// --boot shows the firmware's boot log, then takes the access point away
+// for --outage-ms N (default 3000) and reports how long after it returns
+// the link is back. --nvs FILE keeps NVS in a file, so the first run boots
+// cold and later ones from the cached access point.
+//
+// --predict FILE replays a track recorded by turret_tracker --record
+// through TargetPredictor without booting the firmware. Observations
+// arrive --latency-ms (default 60) after capture; every control tick the
+// aim point is compared with the track interpolated at that time, for the
+// predictor and for aiming at the last observation as auto mode used to.
+
+void setup();
+void loop();
+
+// The firmware's camera servos, see --scan
+extern Servo cameraServoPan;
+
+#define BENCH_CLIENT 0
+#define BENCH_PAN_SERVO_ID 1
+#define BENCH_PAN_LOW 500
+#define BENCH_PAN_HIGH 508
+#define BENCH_SETTLE_US 30000
+#define BENCH_TIMEOUT_US 1000000
+#define BENCH_CONTROL_PERIOD_US 10000
+
+namespace
+{
+    SimulatedLX824 servos;
+
+    void inject(const char *text)
+    {
+        AsyncWebSocket::instance()->sendText(BENCH_CLIENT, text, strlen(text));
+    }
+
+    std::atomic<uint32_t> lastMoveUs{0};
+    std::atomic<uint32_t> firstMoveUs{0};
+    std::atomic<uint32_t> firstFrameUs{0};
+    std::atomic<int32_t> awaitedPan{-1};
+    uint16_t benchPan = BENCH_PAN_LOW;
+
+    std::mutex handlerLock;
+    std::vector<double> handlerUs;
+
+    std::atomic<uint32_t> busyReplies{0};
+
+    std::mutex moveLock;
+    std::vector<uint32_t> panMoveUs;
+    std::atomic<bool> recordMoves{false};
+
+    struct Stats
+    {
+        const char *name;
+        std::vector<double> samples;
+
+        void print(const char *format) const
+        {
+            if (samples.empty())
+            {
+                printf("%-6s %-10s no samples\n", format, name);
+                return;
+            }
+            std::vector<double> sorted = samples;
+            std::sort(sorted.begin(), sorted.end());
+            double sum = 0;
+            for (double sample : sorted)
+            {
+                sum += sample;
+            }
+            printf("%-6s %-10s n=%-4zu min=%8.1f mean=%8.1f p50=%8.1f p99=%8.1f max=%8.1f us\n",
+                   format, name, sorted.size(), sorted.front(), sum / sorted.size(),
+                   percentile(sorted, 0.5), percentile(sorted, 0.99), sorted.back());
+        }
+
+        static double percentile(const std::vector<double> &sorted, double p)
+        {
+            size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+            return sorted[index];
+        }
+    };
+
+    void onMove(uint8_t id, uint16_t position, uint16_t time, uint32_t atUs)
+    {
+        if (id != BENCH_PAN_SERVO_ID)
+        {
+            return;
+        }
+        lastMoveUs = atUs;
+        if (recordMoves.load())
+        {
+            std::lock_guard<std::mutex> guard(moveLock);
+            panMoveUs.push_back(atUs);
+        }
+        if (awaitedPan.load() >= 0 && firstMoveUs.load() == 0)
+        {
+            firstMoveUs = atUs;
+        }
+    }
+
+    void onFrame(uint8_t num, const uint8_t *payload, size_t length, bool binary)
+    {
+        if (!binary && length == 10 && memcmp(payload, "{\"busy\":1}", 10) == 0)
+        {
+            busyReplies++;
+            return;
+        }
+        int32_t pan = awaitedPan.load();
+        if (binary || pan < 0 || firstFrameUs.load() != 0)
+        {
+            return;
+        }
+        char key[24];
+        int keyLength = snprintf(key, sizeof(key), "\"pan\":%d", (int)pan);
+        std::string frame((const char *)payload, length);
+        size_t found = frame.find(key);
+        if (found != std::string::npos && (frame[found + keyLength] == ',' || frame[found + keyLength] == '}'))
+        {
+            firstFrameUs = micros();
+        }
+    }
+
+    bool waitUntil(std::function<bool()> done, uint32_t timeoutUs)
+    {
+        uint32_t start = micros();
+        while (!done())
+        {
+            if (micros() - start > timeoutUs)
+            {
+                return false;
+            }
+            delayMicroseconds(200);
+        }
+        return true;
+    }
+
+    void send(bool binary, uint16_t seq, uint16_t pan)
+    {
+        AsyncWebSocket *ws = AsyncWebSocket::instance();
+        if (binary)
+        {
+            TurretFrame frame = {TURRET_FRAME_MOVE, 0, seq, (uint32_t)millis(), pan, 400, 0};
+            uint8_t out[TURRET_FRAME_SIZE];
+            size_t length = encodeTurretFrame(frame, out, sizeof(out));
+            ws->sendBinary(BENCH_CLIENT, out, length);
+        }
+        else
+        {
+            char text[48];
+            int length = snprintf(text, sizeof(text), "{\"mode\":0,\"pan\":%u,\"tilt\":400}", pan);
+            ws->sendText(BENCH_CLIENT, text, length);
+        }
+    }
+
+    // Returns false if the firmware never reacted to a command
+    bool runFormat(bool binary, int samples, Stats &toUart)
+    {
+        const char *format = binary ? "binary" : "json";
+        Stats telemetry = {"telemetry"};
+        Stats handler = {"handler"};
+        {
+            std::lock_guard<std::mutex> guard(handlerLock);
+            handlerUs.clear();
+        }
+
+        for (int i = 0; i < samples; i++)
+        {
+            // Start every sample from rest so the first move is caused by
+            // this command and not the tail of the previous profile
+            uint16_t settled = benchPan;
+            if (!waitUntil([settled]()
+                           { return servos.position(BENCH_PAN_SERVO_ID) == settled &&
+                                    micros() - lastMoveUs.load() > BENCH_SETTLE_US; },
+                           BENCH_TIMEOUT_US))
+            {
+                fprintf(stderr, "%s: pan never settled at %u\n", format, settled);
+                return false;
+            }
+
+            benchPan = benchPan == BENCH_PAN_HIGH ? BENCH_PAN_LOW : BENCH_PAN_HIGH;
+            firstMoveUs = 0;
+            firstFrameUs = 0;
+            uint32_t sentUs = micros();
+            awaitedPan = benchPan;
+            send(binary, i, benchPan);
+
+            bool moved = waitUntil([]()
+                                   { return firstMoveUs.load() != 0 && firstFrameUs.load() != 0; },
+                                   BENCH_TIMEOUT_US);
+            awaitedPan = -1;
+            if (firstMoveUs.load() == 0)
+            {
+                fprintf(stderr, "%s: no move on the bus for pan %u\n", format, benchPan);
+                return false;
+            }
+            toUart.samples.push_back(firstMoveUs.load() - sentUs);
+            if (moved)
+            {
+                telemetry.samples.push_back(firstFrameUs.load() - sentUs);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(handlerLock);
+            handler.samples = handlerUs;
+        }
+        toUart.print(format);
+        telemetry.print(format);
+        handler.print(format);
+        return true;
+    }
+
+    int bench(int samples, double budgetUs)
+    {
+        AsyncWebSocket *ws = AsyncWebSocket::instance();
+        ws->setSink(onFrame);
+        ws->handlerObserver = [](uint64_t ns)
+        {
+            std::lock_guard<std::mutex> guard(handlerLock);
+            handlerUs.push_back(ns / 1000.0);
+        };
+        ws->connect(BENCH_CLIENT);
+
+        // Manual mode with a speed limit high enough that the profile is
+        // acceleration bound
+        inject("{\"mode\":0,\"motor_speed\":20000}");
+        send(false, 0, BENCH_PAN_LOW);
+
+        Stats json = {"cmd->uart"};
+        Stats binary = {"cmd->uart"};
+        if (!runFormat(false, samples, json) || !runFormat(true, samples, binary))
+        {
+            return 2;
+        }
+
+        if (budgetUs > 0)
+        {
+            for (Stats *stats : {&json, &binary})
+            {
+                std::sort(stats->samples.begin(), stats->samples.end());
+                double p99 = Stats::percentile(stats->samples, 0.99);
+                if (p99 > budgetUs)
+                {
+                    printf("cmd->uart p99 %.1f us is over the %.1f us budget\n", p99, budgetUs);
+                    return 1;
+                }
+            }
+        }
+        return 0;
+    }
+
+
+    int jitter(double seconds, int rate, uint32_t handlerUs)
+    {
+        AsyncWebSocket *ws = AsyncWebSocket::instance();
+        ws->setSink(onFrame);
+        ws->connect(BENCH_CLIENT);
+        inject("{\"mode\":0,\"motor_speed\":20000,\"pan\":0,\"tilt\":400}");
+        if (!waitUntil([]()
+                       { return servos.position(BENCH_PAN_SERVO_ID) == 0 &&
+                                micros() - lastMoveUs.load() > BENCH_SETTLE_US; },
+                       5 * BENCH_TIMEOUT_US))
+        {
+            fprintf(stderr, "jitter: pan never reached 0\n");
+            return 2;
+        }
+
+        // Two units per tick at 200 units/s, so every tick moves the servo
+        // for the five seconds the sweep takes
+        const char *sweep = "{\"mode\":0,\"motor_speed\":200,\"pan\":1000,\"tilt\":400}";
+        inject("{\"subscribe\":{\"rate\":50}}");
+        inject(sweep);
+        delay(100);
+        recordMoves = true;
+        busyReplies = 0;
+        ws->handlerPadUs = handlerUs;
+
+        // The WiFi stack sits above every task on the device, so does the
+        // thread standing in for it
+        std::atomic<bool> flooding{true};
+        std::thread flood([&flooding, sweep, rate]()
+                          {
+                              nativeRaiseThread();
+                              const uint32_t gapUs = 1000000 / rate;
+                              uint32_t next = micros();
+                              while (flooding.load())
+                              {
+                                  int32_t wait = (int32_t)(next - micros());
+                                  if (wait > 0)
+                                  {
+                                      delayMicroseconds(wait < 1000 ? wait : 1000);
+                                      continue;
+                                  }
+                                  inject(sweep);
+                                  next += gapUs;
+                              } });
+        delay((uint32_t)(seconds * 1000));
+        flooding = false;
+        flood.join();
+        recordMoves = false;
+        ws->handlerPadUs = 0;
+
+        Stats period = {"period"};
+        Stats deviation = {"deviation"};
+        {
+            std::lock_guard<std::mutex> guard(moveLock);
+            for (size_t i = 1; i < panMoveUs.size(); i++)
+            {
+                double interval = panMoveUs[i] - panMoveUs[i - 1];
+                period.samples.push_back(interval);
+                deviation.samples.push_back(fabs(interval - BENCH_CONTROL_PERIOD_US));
+            }
+        }
+        if (period.samples.empty())
+        {
+            fprintf(stderr, "jitter: no pan moves while flooding\n");
+            return 2;
+        }
+        printf("%.1f s at %d msg/s of %u us, %u messages received, %u refused busy, pan at %u\n", seconds, rate,
+               handlerUs, ws->handlerCalls, busyReplies.load(), servos.position(BENCH_PAN_SERVO_ID));
+        period.print("jitter");
+        deviation.print("jitter");
+        return 0;
+    }
+
+}
+
+namespace
+{
+    // Share of the scan area, on a 5 degree grid, within fov degrees of
+    // some aim point, and the largest distance from a grid point to the
+    // nearest aim point
+    void printCoverage(const char *name, const std::vector<ScanPoint> &aims, double seconds, double fov)
+    {
+        int cells = 0;
+        int covered = 0;
+        double worstGap = 0;
+        for (int pan = SCAN_PAN_MIN; pan <= SCAN_PAN_MAX; pan += 5)
+        {
+            for (int tilt = SCAN_TILT_MIN; tilt <= SCAN_TILT_MAX; tilt += 5)
+            {
+                double nearest = 1e9;
+                for (const ScanPoint &aim : aims)
+                {
+                    nearest = std::min(nearest, hypot(aim.pan - pan, aim.tilt - tilt));
+                }
+                cells++;
+                covered += nearest <= fov;
+                worstGap = std::max(worstGap, nearest);
+            }
+        }
+        printf("%-10s cycle=%6.1f s  covered=%5.1f%%  worst gap=%5.1f deg\n", name, seconds,
+               100.0 * covered / cells, worstGap);
+    }
+
+    void scanCoverage(double fov)
+    {
+        const uint32_t tickMs = 30;
+        printf("coverage within %.0f deg, %u ms ticks\n", fov, tickMs);
+
+        // The sweep this replaced: pan and tilt together, 15-165 and back
+        // at a degree per tick
+        std::vector<ScanPoint> diagonal;
+        for (int i = 0; i < 300; i++)
+        {
+            int angle = i < 150 ? 15 + i : 165 - (i - 150);
+            diagonal.push_back({(uint8_t)angle, (uint8_t)angle});
+        }
+        printCoverage("diagonal", diagonal, diagonal.size() * tickMs / 1000.0, fov);
+
+        const char *names[SCAN_PATTERN_COUNT] = {"raster", "lissajous", "spiral"};
+        for (int id = 0; id < SCAN_PATTERN_COUNT; id++)
+        {
+            ScanEngine engine;
+            engine.config.pattern = (ScanPatternId)id;
+            engine.restart();
+            std::vector<ScanPoint> aims = {engine.position()};
+            while (engine.cycles() == 0)
+            {
+                aims.push_back(engine.step(tickMs));
+            }
+            printCoverage(names[id], aims, aims.size() * tickMs / 1000.0, fov);
+        }
+    }
+
+    void sendMode(uint16_t seq, uint8_t mode)
+    {
+        TurretFrame frame = {TURRET_FRAME_MODE, 0, seq, (uint32_t)millis(), 0, 0, mode};
+        uint8_t out[TURRET_FRAME_SIZE];
+        size_t length = encodeTurretFrame(frame, out, sizeof(out));
+        AsyncWebSocket::instance()->sendBinary(BENCH_CLIENT, out, length);
+    }
+
+    // Time from a message leaving sweep mode to the camera servo moving to
+    // the commanded angle, with the scan interrupted at a random point
+    int scanPreemption(int samples, double budgetUs)
+    {
+        const uint8_t parked = 10; // outside the scan area, never a scan position
+        AsyncWebSocket::instance()->connect(BENCH_CLIENT);
+        char park[64];
+        snprintf(park, sizeof(park), "{\"mode\":0,\"camServoPan\":%u,\"camServoTilt\":%u}", parked, parked);
+        inject(park);
+        // That also reported a target, let it expire so sweep mode scans
+        delay(SCAN_TARGET_TIMEOUT_MS + 100);
+
+        Stats preempt = {"preempt"};
+        uint16_t seq = 0;
+        srand(1);
+        for (int i = 0; i < samples; i++)
+        {
+            sendMode(seq++, 1);
+            if (!waitUntil([parked]()
+                           { return cameraServoPan.read() != parked; },
+                           BENCH_TIMEOUT_US))
+            {
+                fprintf(stderr, "scan: sweep never moved the camera\n");
+                return 2;
+            }
+            delay(100 + rand() % 200);
+
+            uint32_t sentUs = micros();
+            sendMode(seq++, 0);
+            if (!waitUntil([parked]()
+                           { return cameraServoPan.read() == parked; },
+                           BENCH_TIMEOUT_US))
+            {
+                fprintf(stderr, "scan: camera never left the sweep\n");
+                return 2;
+            }
+            preempt.samples.push_back(cameraServoPan.lastWriteUs - sentUs);
+        }
+        preempt.print("scan");
+
+        if (budgetUs > 0)
+        {
+            std::sort(preempt.samples.begin(), preempt.samples.end());
+            double p99 = Stats::percentile(preempt.samples, 0.99);
+            if (p99 > budgetUs)
+            {
+                printf("preempt p99 %.1f us is over the %.1f us budget\n", p99, budgetUs);
+                return 1;
+            }
+        }
+        return 0;
+    }
+}
+
+namespace
+{
+    int bootReport(uint32_t outageMs)
+    {
+        printf("setup() returned after %lu ms\n", millis());
+        if (outageMs == 0)
+        {
+            return 0;
+        }
+        WiFi.simulateOutage(outageMs);
+        uint32_t lostMs = millis();
+        if (!waitUntil([]()
+                       { return WiFi.isConnected(); },
+                       outageMs * 1000 + 20 * BENCH_TIMEOUT_US))
+        {
+            fprintf(stderr, "boot: link never came back\n");
+            return 2;
+        }
+        uint32_t backMs = millis();
+        printf("link back %lu ms after the access point returned (outage %u ms)\n",
+               (unsigned long)(backMs - lostMs - outageMs), outageMs);
+        return 0;
+    }
+}
+
+namespace
+{
+    struct TrackPoint
+    {
+        uint32_t ms;
+        float pan;
+        float tilt;
+    };
+
+    struct AimError
+    {
+        const char *name;
+        std::vector<double> samples;
+
+        void print() const
+        {
+            if (samples.empty())
+            {
+                printf("%-10s no samples\n", name);
+                return;
+            }
+            std::vector<double> sorted = samples;
+            std::sort(sorted.begin(), sorted.end());
+            double squares = 0;
+            for (double sample : sorted)
+            {
+                squares += sample * sample;
+            }
+            printf("%-10s n=%-6zu rms=%7.2f p50=%7.2f p95=%7.2f max=%7.2f units\n", name, sorted.size(),
+                   sqrt(squares / sorted.size()), Stats::percentile(sorted, 0.5),
+                   Stats::percentile(sorted, 0.95), sorted.back());
+        }
+    };
+
+    // Track position at ms, linearly interpolated between observations
+    TrackPoint interpolateTrack(const std::vector<TrackPoint> &track, size_t &index, uint32_t ms)
+    {
+        while (index + 2 < track.size() && track[index + 1].ms <= ms)
+        {
+            index++;
+        }
+        const TrackPoint &a = track[index];
+        const TrackPoint &b = track[index + 1];
+        float f = b.ms > a.ms ? (float)(ms - a.ms) / (b.ms - a.ms) : 0.0f;
+        return {ms, a.pan + (b.pan - a.pan) * f, a.tilt + (b.tilt - a.tilt) * f};
+    }
+
+    int evaluatePredictor(const char *path, uint32_t latencyMs)
+    {
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+        {
+            fprintf(stderr, "cannot open %s\n", path);
+            return 2;
+        }
+        std::vector<TrackPoint> track;
+        char line[128];
+        while (fgets(line, sizeof(line), file))
+        {
+            TrackPoint point;
+            unsigned long ms;
+            if (line[0] != '#' && sscanf(line, "%lu,%f,%f", &ms, &point.pan, &point.tilt) == 3)
+            {
+                point.ms = ms;
+                track.push_back(point);
+            }
+        }
+        fclose(file);
+        if (track.size() < 2)
+        {
+            fprintf(stderr, "%s: need at least two observations\n", path);
+            return 2;
+        }
+
+        TargetPredictor predictor;
+        predictor.config.latencyMs = latencyMs;
+        AimError predicted = {"predicted"};
+        AimError held = {"held"};
+
+        // Ticks at the control loop rate from the first arrival to the last
+        // capture, gaps in the track included
+        const uint32_t tickMs = 10;
+        size_t next = 0;
+        size_t segment = 0;
+        TrackPoint last = track[0];
+        for (uint32_t now = track[0].ms + latencyMs; now <= track.back().ms; now += tickMs)
+        {
+            while (next < track.size() && track[next].ms + latencyMs <= now)
+            {
+                last = track[next];
+                predictor.observeTimed(last.pan, last.tilt, last.ms, last.ms + latencyMs);
+                next++;
+            }
+            TrackPoint truth = interpolateTrack(track, segment, now);
+            float pan, tilt;
+            if (predictor.aim(now, pan, tilt))
+            {
+                predicted.samples.push_back(hypot(pan - truth.pan, tilt - truth.tilt));
+            }
+            held.samples.push_back(hypot(last.pan - truth.pan, last.tilt - truth.tilt));
+        }
+
+        printf("%zu observations over %.1f s, %u ms latency, %u tracks, innovation rms %.2f\n",
+               track.size(), (track.back().ms - track[0].ms) / 1000.0, latencyMs,
+               predictor.tracksStarted(), predictor.innovationRms());
+        predicted.print();
+        held.print();
+        return 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool runBench = false;
+    bool runJitter = false;
+    bool runScan = false;
+    bool runBoot = false;
+    uint32_t outageMs = 3000;
+    double fov = 15;
+    double seconds = 4;
+    int rate = 2000;
+    uint32_t handlerUs = 200;
+    bool verbose = false;
+    bool dumpMetrics = false;
+    int samples = 100;
+    double budgetUs = 0;
+    const char *predictPath = NULL;
+    uint32_t latencyMs = PredictorConfig().latencyMs;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bench") == 0)
+        {
+            runBench = true;
+        }
+        else if (strcmp(argv[i], "--jitter") == 0)
+        {
+            runJitter = true;
+        }
+        else if (strcmp(argv[i], "--scan") == 0)
+        {
+            runScan = true;
+        }
+        else if (strcmp(argv[i], "--boot") == 0)
+        {
+            runBoot = true;
+        }
+        else if (strcmp(argv[i], "--outage-ms") == 0 && i + 1 < argc)
+        {
+            outageMs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--nvs") == 0 && i + 1 < argc)
+        {
+            nativeSetNvsPath(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fov") == 0 && i + 1 < argc)
+        {
+            fov = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            seconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+        {
+            rate = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--handler-us") == 0 && i + 1 < argc)
+        {
+            handlerUs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "--metrics") == 0)
+        {
+            dumpMetrics = true;
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+        {
+            samples = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--budget-us") == 0 && i + 1 < argc)
+        {
+            budgetUs = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--predict") == 0 && i + 1 < argc)
+        {
+            predictPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--latency-ms") == 0 && i + 1 < argc)
+        {
+            latencyMs = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--bench] [--samples N] [--budget-us N] [--verbose] [--metrics]\n"
+                            "       %s --jitter [--seconds N] [--rate N] [--handler-us N] [--verbose] [--metrics]\n"
+                            "       %s --scan [--fov N] [--samples N] [--budget-us N]\n"
+                            "       %s --boot [--outage-ms N] [--nvs FILE]\n"
+                            "       %s --predict FILE [--latency-ms N]\n",
+                    argv[0], argv[0], argv[0], argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    if (predictPath != NULL)
+    {
+        return evaluatePredictor(predictPath, latencyMs);
+    }
+
+    if (rate <= 0 || seconds <= 0)
+    {
+        fprintf(stderr, "--rate and --seconds must be positive\n");
+        return 2;
+    }
+    if (runJitter && !nativeEnforceScheduling(2))
+    {
+        fprintf(stderr, "no real-time priorities on this host, task priorities are not enforced\n");
+    }
+
+    if (runScan)
+    {
+        scanCoverage(fov);
+    }
+
+    HardwareSerial::consoleMuted = (runBench || runJitter || runScan) && !verbose;
+    servos.addServo(1);
+    servos.addServo(2, 400);
+    servos.onMove(onMove);
+    servos.attach(*HardwareSerial::port(2));
+
+    setup();
+
+    if (runBench || runJitter || runScan || runBoot)
+    {
+        int status = runBoot     ? bootReport(outageMs)
+                     : runScan   ? scanPreemption(samples, budgetUs)
+                     : runJitter ? jitter(seconds, rate, handlerUs)
+                                 : bench(samples, budgetUs);
+        if (dumpMetrics)
+        {
+            AsyncWebServer::Response page = AsyncWebServer::instance()->request("/metrics");
+            fwrite(page.body.data(), 1, page.body.size(), stdout);
+        }
+        fflush(stdout);
+        // The firmware tasks never return, don't wait for them
+        _Exit(status);
+    }
+
+    for (;;)
+    {
+        loop();
+        delay(1);
+    }
+}
+
+#endif
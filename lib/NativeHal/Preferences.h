@@ -0,0 +1,26 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+#include <Arduino.h>
+
+// NVS key/value store. Kept in memory, or in the file given to
+// nativeSetNvsPath() so a second run boots with what the first one saved.
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end() {}
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+
+    size_t putBytes(const char *key, const void *value, size_t length);
+    size_t getBytes(const char *key, void *buffer, size_t maxLength);
+    size_t getBytesLength(const char *key);
+
+private:
+    std::string space;
+    bool readOnly = false;
+};
+
+#endif
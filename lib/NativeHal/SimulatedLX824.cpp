@@ -0,0 +1,115 @@
+#include "SimulatedLX824.h"
+#include "NativeHal.h"
+
+void SimulatedLX824::attach(HardwareSerial &port)
+{
+    serial = &port;
+    port.attachDevice([this](const uint8_t *data, size_t length)
+                      { receive(data, length); });
+}
+
+void SimulatedLX824::addServo(uint8_t id, uint16_t position)
+{
+    if (servoCount < LX824_MAX_SERVOS)
+    {
+        servos[servoCount++] = {id, position};
+    }
+}
+
+uint16_t SimulatedLX824::position(uint8_t id) const
+{
+    for (uint8_t i = 0; i < servoCount; i++)
+    {
+        if (servos[i].id == id)
+        {
+            return servos[i].position;
+        }
+    }
+    return 0;
+}
+
+SimulatedLX824::Servo *SimulatedLX824::find(uint8_t id)
+{
+    for (uint8_t i = 0; i < servoCount; i++)
+    {
+        if (servos[i].id == id)
+        {
+            return &servos[i];
+        }
+    }
+    return NULL;
+}
+
+void SimulatedLX824::receive(const uint8_t *data, size_t length)
+{
+    uint32_t now = micros();
+    if (echo)
+    {
+        nativeDeliverSerial(*serial, data, length, now + nativeWireTimeUs(*serial, length));
+    }
+    uint32_t errors = parser.checksumErrors + parser.framingErrors;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (parser.feed(data[i]))
+        {
+            handle(parser.frame());
+        }
+    }
+    badFrames += parser.checksumErrors + parser.framingErrors - errors;
+}
+
+void SimulatedLX824::handle(const LX824Frame &frame)
+{
+    Servo *servo = find(frame.id);
+    if (servo == NULL)
+    {
+        return;
+    }
+
+    switch (frame.command)
+    {
+    case LX824_CMD_MOVE_TIME_WRITE:
+        if (frame.paramCount() == 4)
+        {
+            uint16_t position = frame.params[0] | frame.params[1] << 8;
+            uint16_t time = frame.params[2] | frame.params[3] << 8;
+            servo->position = position;
+            moves++;
+            if (moveHook)
+            {
+                moveHook(frame.id, position, time, micros());
+            }
+        }
+        break;
+    case LX824_CMD_POS_READ:
+        if (frame.paramCount() == 0)
+        {
+            uint8_t params[2] = {(uint8_t)servo->position, (uint8_t)(servo->position >> 8)};
+            reply(frame.id, frame.command, params, 2);
+        }
+        break;
+    case LX824_CMD_TEMP_READ:
+        if (frame.paramCount() == 0)
+        {
+            reply(frame.id, frame.command, &temperature, 1);
+        }
+        break;
+    case LX824_CMD_VIN_READ:
+        if (frame.paramCount() == 0)
+        {
+            uint8_t params[2] = {(uint8_t)voltage, (uint8_t)(voltage >> 8)};
+            reply(frame.id, frame.command, params, 2);
+        }
+        break;
+    }
+}
+
+void SimulatedLX824::reply(uint8_t id, uint8_t command, const uint8_t *params, uint8_t count)
+{
+    uint8_t out[LX824_MAX_FRAME];
+    size_t length = lx824Encode(id, command, params, count, out);
+    // The request has to finish arriving before the servo starts answering
+    uint32_t at = micros() + turnaroundUs + nativeWireTimeUs(*serial, length);
+    nativeDeliverSerial(*serial, out, length, at);
+    reads++;
+}
@@ -0,0 +1,52 @@
+#ifndef SIMULATED_LX824_H
+#define SIMULATED_LX824_H
+
+#include <Arduino.h>
+#include <LX824Bus.h>
+#include <functional>
+
+// LX-824 servos on the far end of a HardwareSerial port. Frames the
+// firmware writes are parsed as they arrive; moves are applied (the servo
+// jumps to the target after the move time) and position, temperature and
+// voltage reads are answered after the time the reply takes on the wire.
+class SimulatedLX824
+{
+public:
+    typedef std::function<void(uint8_t id, uint16_t position, uint16_t time, uint32_t atUs)> MoveHook;
+
+    void attach(HardwareSerial &port);
+    void addServo(uint8_t id, uint16_t position = 500);
+
+    // The real bus is half duplex, every byte written is also received
+    bool echo = true;
+    uint32_t turnaroundUs = 200;
+    uint8_t temperature = 38;
+    uint16_t voltage = 7400;
+
+    void onMove(MoveHook hook) { moveHook = hook; }
+    uint16_t position(uint8_t id) const;
+
+    uint32_t moves = 0;
+    uint32_t reads = 0;
+    uint32_t badFrames = 0;
+
+private:
+    struct Servo
+    {
+        uint8_t id;
+        uint16_t position;
+    };
+
+    void receive(const uint8_t *data, size_t length);
+    void handle(const LX824Frame &frame);
+    void reply(uint8_t id, uint8_t command, const uint8_t *params, uint8_t count);
+    Servo *find(uint8_t id);
+
+    HardwareSerial *serial = NULL;
+    LX824Parser parser;
+    Servo servos[LX824_MAX_SERVOS];
+    uint8_t servoCount = 0;
+    MoveHook moveHook;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+#define WIFI_STA 1
+
+#define WIFI_REASON_ASSOC_LEAVE 8
+#define WIFI_REASON_BEACON_TIMEOUT 200
+#define WIFI_REASON_NO_AP_FOUND 201
+
+class IPAddress
+{
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+    IPAddress(uint32_t address) { memcpy(octets, &address, 4); }
+    operator uint32_t() const
+    {
+        uint32_t address;
+        memcpy(&address, octets, 4);
+        return address;
+    }
+    String toString() const;
+    uint8_t operator[](int i) const { return octets[i]; }
+
+private:
+    uint8_t octets[4] = {0, 0, 0, 0};
+};
+
+#define INADDR_NONE IPAddress(0, 0, 0, 0)
+
+typedef enum
+{
+    ARDUINO_EVENT_WIFI_STA_START,
+    ARDUINO_EVENT_WIFI_STA_CONNECTED,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP,
+    ARDUINO_EVENT_MAX
+} arduino_event_id_t;
+
+typedef union
+{
+    struct
+    {
+        uint8_t reason;
+    } wifi_sta_disconnected;
+} arduino_event_info_t;
+
+typedef arduino_event_id_t WiFiEvent_t;
+typedef arduino_event_info_t WiFiEventInfo_t;
+
+// A single simulated access point. Association takes associateMs when
+// begin() is given its BSSID and channel and scanMs longer without them,
+// then DHCP takes dhcpMs unless config() set a static address. Events are
+// delivered from a thread of their own, like the Arduino event task.
+class WiFiClass
+{
+public:
+    typedef std::function<void(arduino_event_id_t event, arduino_event_info_t info)> EventHandler;
+
+    bool mode(int mode) { return true; }
+    void persistent(bool persistent) {}
+    bool setAutoReconnect(bool autoReconnect) { return true; }
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns = INADDR_NONE);
+    int begin(const char *ssid, const char *passphrase = NULL, int32_t channel = 0, const uint8_t *bssid = NULL, bool connect = true);
+    bool disconnect(bool wifiOff = false, bool eraseAp = false);
+    int onEvent(EventHandler handler, arduino_event_id_t event = ARDUINO_EVENT_MAX);
+
+    int status() { return connected ? WL_CONNECTED : WL_DISCONNECTED; }
+    bool isConnected() { return connected; }
+    IPAddress localIP() { return connected ? address : INADDR_NONE; }
+    IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+    IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+    IPAddress dnsIP(uint8_t index = 0) { return IPAddress(192, 168, 1, 1); }
+    uint8_t *BSSID() { return apBssid; }
+    int32_t channel() { return apChannel; }
+
+    // Harness side
+    uint32_t associateMs = 150;
+    uint32_t scanMs = 2000;
+    uint32_t dhcpMs = 400;
+    // The access point stops answering for outageMs; a connected station
+    // sees a beacon timeout
+    void simulateOutage(uint32_t outageMs);
+
+private:
+    void emit(arduino_event_id_t event, uint8_t reason = 0);
+
+    bool connected = false;
+    bool staticAddress = false;
+    IPAddress address;
+    uint32_t attempt = 0;
+    uint32_t outageUntilMs = 0;
+    uint8_t apBssid[6] = {0x02, 0x54, 0x55, 0x52, 0x52, 0x54};
+    int32_t apChannel = 6;
+    EventHandler handlers[4];
+    arduino_event_id_t filters[4];
+    uint8_t handlerCount = 0;
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef NATIVE_ESP_TIMER_H
+#define NATIVE_ESP_TIMER_H
+
+#include <stdint.h>
+
+// Microseconds since boot, 64 bits so it does not wrap like micros()
+int64_t esp_timer_get_time();
+
+#endif
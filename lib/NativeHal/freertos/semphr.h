@@ -0,0 +1,13 @@
+#ifndef NATIVE_FREERTOS_SEMPHR_H
+#define NATIVE_FREERTOS_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+// Mutexes only, no counting or binary semaphores
+typedef struct NativeMutex *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+
+#endif
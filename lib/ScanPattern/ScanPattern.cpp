@@ -0,0 +1,275 @@
+#include "ScanPattern.h"
+#include <math.h>
+
+// Waypoint tables, built by the compiler. The generators only use
+// arithmetic that is constexpr in C++17, hence the hand-rolled sine and
+// square root.
+
+namespace
+{
+    constexpr float SCAN_PI = 3.14159265f;
+    constexpr float PAN_CENTRE = (SCAN_PAN_MIN + SCAN_PAN_MAX) / 2.0f;
+    constexpr float TILT_CENTRE = (SCAN_TILT_MIN + SCAN_TILT_MAX) / 2.0f;
+    constexpr float PAN_HALF = (SCAN_PAN_MAX - SCAN_PAN_MIN) / 2.0f;
+    constexpr float TILT_HALF = (SCAN_TILT_MAX - SCAN_TILT_MIN) / 2.0f;
+
+    constexpr float scanSin(float x)
+    {
+        while (x > SCAN_PI)
+        {
+            x -= 2 * SCAN_PI;
+        }
+        while (x < -SCAN_PI)
+        {
+            x += 2 * SCAN_PI;
+        }
+        // Taylor series to x^11, better than 0.001 over [-pi, pi]
+        float term = x;
+        float sum = x;
+        for (int n = 1; n <= 5; n++)
+        {
+            term *= -x * x / ((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr float scanCos(float x)
+    {
+        return scanSin(x + SCAN_PI / 2);
+    }
+
+    constexpr float scanSqrt(float x)
+    {
+        if (x <= 0)
+        {
+            return 0;
+        }
+        float root = x > 1 ? x : 1;
+        for (int i = 0; i < 20; i++)
+        {
+            root = (root + x / root) / 2;
+        }
+        return root;
+    }
+
+    constexpr uint8_t degrees(float value)
+    {
+        return (uint8_t)(value + 0.5f);
+    }
+
+    // Fills in the segment lengths, the first one closes the loop
+    constexpr ScanTable finish(ScanTable table)
+    {
+        for (int i = 0; i < table.count; i++)
+        {
+            const ScanWaypoint &previous = table.points[(i + table.count - 1) % table.count];
+            float pan = table.points[i].pan - previous.pan;
+            float tilt = table.points[i].tilt - previous.tilt;
+            table.points[i].lengthTenths = (uint16_t)(scanSqrt(pan * pan + tilt * tilt) * 10 + 0.5f);
+        }
+        return table;
+    }
+
+    // Four rows, every row ends in a dwell and so does every fourth point
+    // along it
+    constexpr ScanTable makeRaster()
+    {
+        constexpr int rows = 4;
+        constexpr int columns = 16;
+        ScanTable table = {};
+        table.count = rows * columns;
+        for (int row = 0; row < rows; row++)
+        {
+            for (int column = 0; column < columns; column++)
+            {
+                int x = row % 2 == 0 ? column : columns - 1 - column;
+                ScanWaypoint &point = table.points[row * columns + column];
+                point.pan = degrees(SCAN_PAN_MIN + (float)(SCAN_PAN_MAX - SCAN_PAN_MIN) * x / (columns - 1));
+                point.tilt = degrees(SCAN_TILT_MIN + (float)(SCAN_TILT_MAX - SCAN_TILT_MIN) * row / (rows - 1));
+                point.dwell = column % 4 == 3;
+            }
+        }
+        return finish(table);
+    }
+
+    constexpr ScanTable makeLissajous()
+    {
+        ScanTable table = {};
+        table.count = SCAN_MAX_WAYPOINTS;
+        for (int i = 0; i < table.count; i++)
+        {
+            float t = 2 * SCAN_PI * i / table.count;
+            ScanWaypoint &point = table.points[i];
+            point.pan = degrees(PAN_CENTRE + PAN_HALF * scanSin(3 * t));
+            point.tilt = degrees(TILT_CENTRE + TILT_HALF * scanSin(2 * t));
+            point.dwell = i % 8 == 0;
+        }
+        return finish(table);
+    }
+
+    // Three turns out to the edge of the area and three back, still
+    // turning the same way so the inward pass does not retrace the outward
+    // one
+    constexpr ScanTable makeSpiral()
+    {
+        constexpr float turns = 3;
+        ScanTable table = {};
+        table.count = SCAN_MAX_WAYPOINTS;
+        int half = table.count / 2;
+        for (int i = 0; i < table.count; i++)
+        {
+            float radius = i <= half ? (float)i / half : (float)(table.count - i) / half;
+            float angle = 2 * SCAN_PI * turns * i / half;
+            ScanWaypoint &point = table.points[i];
+            point.pan = degrees(PAN_CENTRE + PAN_HALF * radius * scanCos(angle));
+            point.tilt = degrees(TILT_CENTRE + TILT_HALF * radius * scanSin(angle));
+            point.dwell = i % 8 == 4;
+        }
+        return finish(table);
+    }
+
+    constexpr bool inArea(const ScanTable &table)
+    {
+        for (int i = 0; i < table.count; i++)
+        {
+            const ScanWaypoint &point = table.points[i];
+            if (point.pan < SCAN_PAN_MIN || point.pan > SCAN_PAN_MAX ||
+                point.tilt < SCAN_TILT_MIN || point.tilt > SCAN_TILT_MAX)
+            {
+                return false;
+            }
+        }
+        return table.count > 1;
+    }
+
+    constexpr ScanTable TABLES[SCAN_PATTERN_COUNT] = {makeRaster(), makeLissajous(), makeSpiral()};
+
+    static_assert(inArea(TABLES[SCAN_RASTER]), "raster leaves the scan area");
+    static_assert(inArea(TABLES[SCAN_LISSAJOUS]), "lissajous leaves the scan area");
+    static_assert(inArea(TABLES[SCAN_SPIRAL]), "spiral leaves the scan area");
+}
+
+const ScanTable &scanTable(ScanPatternId pattern)
+{
+    return TABLES[pattern < SCAN_PATTERN_COUNT ? pattern : SCAN_RASTER];
+}
+
+void ScanEngine::restart()
+{
+    pattern = config.pattern < SCAN_PATTERN_COUNT ? config.pattern : SCAN_RASTER;
+    const ScanTable &table = scanTable(pattern);
+    // Start on the first waypoint, heading for the second
+    next = 1;
+    fromPan = table.points[0].pan * 10;
+    fromTilt = table.points[0].tilt * 10;
+    length = table.points[1].lengthTenths;
+    travelled = 0;
+    dwellLeftMs = 0;
+}
+
+void ScanEngine::resumeFrom(ScanPoint current)
+{
+    if (pattern != config.pattern)
+    {
+        restart();
+    }
+    const ScanWaypoint &target = scanTable(pattern).points[next];
+    fromPan = current.pan * 10;
+    fromTilt = current.tilt * 10;
+    float pan = target.pan * 10 - fromPan;
+    float tilt = target.tilt * 10 - fromTilt;
+    length = (uint16_t)lroundf(sqrtf(pan * pan + tilt * tilt));
+    travelled = 0;
+    dwellLeftMs = 0;
+}
+
+ScanPoint ScanEngine::step(uint32_t dtMs)
+{
+    if (pattern >= SCAN_PATTERN_COUNT)
+    {
+        restart();
+    }
+    const ScanTable &table = scanTable(pattern);
+
+    // At most one lap per call, whatever dtMs is
+    for (uint8_t i = 0; i <= table.count && dtMs > 0; i++)
+    {
+        if (dwellLeftMs > 0)
+        {
+            uint32_t wait = dwellLeftMs < dtMs ? dwellLeftMs : dtMs;
+            dwellLeftMs -= wait;
+            dtMs -= wait;
+            continue;
+        }
+        uint32_t remaining = (uint32_t)length * 1000 - travelled;
+        uint32_t distance = (uint32_t)config.speed * 10 * dtMs;
+        if (distance < remaining)
+        {
+            travelled += distance;
+            break;
+        }
+        // Time left over after reaching the waypoint carries on
+        dtMs = config.speed > 0 ? (distance - remaining) / (config.speed * 10) : 0;
+        arrive();
+    }
+    return position();
+}
+
+void ScanEngine::arrive()
+{
+    const ScanTable &table = scanTable(pattern);
+    const ScanWaypoint &reached = table.points[next];
+    fromPan = reached.pan * 10;
+    fromTilt = reached.tilt * 10;
+    dwellLeftMs = reached.dwell ? config.dwellMs : 0;
+    if (next == 0)
+    {
+        completedCycles++;
+    }
+    next = (next + 1) % table.count;
+    length = table.points[next].lengthTenths;
+    travelled = 0;
+}
+
+ScanPoint ScanEngine::position() const
+{
+    if (pattern >= SCAN_PATTERN_COUNT)
+    {
+        return {(uint8_t)PAN_CENTRE, (uint8_t)TILT_CENTRE};
+    }
+    const ScanWaypoint &target = scanTable(pattern).points[next];
+    int32_t pan = fromPan;
+    int32_t tilt = fromTilt;
+    if (length > 0)
+    {
+        uint32_t scale = (uint32_t)length * 1000;
+        pan += ((int32_t)target.pan * 10 - fromPan) * (int64_t)travelled / scale;
+        tilt += ((int32_t)target.tilt * 10 - fromTilt) * (int64_t)travelled / scale;
+    }
+    return {(uint8_t)((pan + 5) / 10), (uint8_t)((tilt + 5) / 10)};
+}
+
+ScanPoint SweepControl::update(bool sweep, bool targetSeen, ScanPoint commanded, ScanPoint current, uint32_t dtMs)
+{
+    if (!sweep)
+    {
+        active = false;
+        return commanded;
+    }
+    if (targetSeen)
+    {
+        active = false;
+        return current;
+    }
+    if (!active)
+    {
+        scan.resumeFrom(current);
+        active = true;
+    }
+    else
+    {
+        scan.step(dtMs);
+    }
+    return scan.position();
+}
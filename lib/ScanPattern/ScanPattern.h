@@ -0,0 +1,128 @@
+#ifndef SCAN_PATTERN_H
+#define SCAN_PATTERN_H
+
+#include <stdint.h>
+
+// Search patterns for the camera servos in sweep mode. Each pattern is a
+// closed loop of waypoints generated at compile time; the engine walks it
+// at a constant angular speed, one step() per camera tick, so a tick costs
+// a table lookup and a linear interpolation and the caller can stop at any
+// tick. Positions are camera servo degrees.
+
+#define SCAN_PAN_MIN 15
+#define SCAN_PAN_MAX 165
+#define SCAN_TILT_MIN 45
+#define SCAN_TILT_MAX 135
+#define SCAN_MAX_WAYPOINTS 96
+
+enum ScanPatternId : uint8_t
+{
+    SCAN_RASTER,    // rows across the pan range, top to bottom
+    SCAN_LISSAJOUS, // 3:2 figure, sweeps the middle often and the corners briefly
+    SCAN_SPIRAL,    // out from the centre and back in
+    SCAN_PATTERN_COUNT
+};
+
+struct ScanPoint
+{
+    uint8_t pan;
+    uint8_t tilt;
+};
+
+struct ScanWaypoint
+{
+    uint8_t pan;
+    uint8_t tilt;
+    bool dwell;            // stop here for ScanConfig::dwellMs
+    uint16_t lengthTenths; // distance from the previous waypoint, 0.1 degree units
+};
+
+struct ScanTable
+{
+    uint8_t count;
+    ScanWaypoint points[SCAN_MAX_WAYPOINTS];
+};
+
+const ScanTable &scanTable(ScanPatternId pattern);
+
+struct ScanConfig
+{
+    ScanPatternId pattern = SCAN_RASTER;
+    uint16_t speed = 33;  // degrees/s, what the old 15-165 sweep ran at
+    uint16_t dwellMs = 0; // pause at the pattern's dwell points, 0 - off
+};
+
+class ScanEngine
+{
+public:
+    ScanConfig config;
+
+    // Back to the first waypoint of the configured pattern
+    void restart();
+
+    // Continues towards the waypoint the scan was heading for when it was
+    // interrupted, starting from where the servos are now. Switches to
+    // config.pattern first if it changed.
+    void resumeFrom(ScanPoint current);
+
+    // Advances the scan by dtMs and returns the new aim point
+    ScanPoint step(uint32_t dtMs);
+
+    ScanPoint position() const;
+    uint8_t waypoint() const { return next; }
+    uint32_t cycles() const { return completedCycles; }
+
+private:
+    void arrive();
+
+    ScanPatternId pattern = SCAN_PATTERN_COUNT;
+    uint8_t next = 0;
+    int16_t fromPan = 0; // 0.1 degree units
+    int16_t fromTilt = 0;
+    uint16_t length = 0;
+    uint32_t travelled = 0; // 0.1 degree units, times 1000 for ms resolution
+    uint32_t dwellLeftMs = 0;
+    uint32_t completedCycles = 0;
+};
+
+// What sweep mode does with the camera on each tick: scan while no target
+// is reported, hold still while one is, pick the scan up where it stopped
+// once the target is gone, and hand the camera back to the commanded
+// angles on the first tick after sweep mode ends, wherever the scan was.
+class SweepControl
+{
+public:
+    ScanEngine scan;
+
+    // current is where the camera is aimed now, dtMs the time since the
+    // previous tick. Returns the new aim point.
+    ScanPoint update(bool sweep, bool targetSeen, ScanPoint commanded, ScanPoint current, uint32_t dtMs);
+
+    bool scanning() const { return active; }
+
+private:
+    bool active = false;
+};
+
+// Whether the tracker has a target, for SweepControl: one is seen for
+// timeoutMs after the latest detection. Only real detections count, not
+// frames in which the tracker reports it sees nothing.
+class TargetWatch
+{
+public:
+    explicit TargetWatch(uint32_t timeout) : timeoutMs(timeout) {}
+
+    void detected(uint32_t nowMs)
+    {
+        lastMs = nowMs;
+        any = true;
+    }
+    bool seen(uint32_t nowMs) const { return any && nowMs - lastMs < timeoutMs; }
+
+private:
+    uint32_t timeoutMs;
+    uint32_t lastMs = 0;
+    bool any = false;
+};
+
+#endif
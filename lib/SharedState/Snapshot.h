@@ -0,0 +1,107 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// Double buffered snapshot of a small plain struct, published by a single
+// writer task and read by any number of tasks without a mutex.
+//
+// The writer always fills the buffer that is not currently published, then
+// bumps the generation so readers switch to it. Each buffer also carries
+// its own sequence number (odd while being written), so a reader that was
+// preempted long enough for the writer to come round to its buffer again
+// notices and retries. A stalled writer never blocks readers: they keep
+// reading the last published buffer.
+//
+// The payload is copied as relaxed atomic words so concurrent access is
+// well defined; T must be trivially copyable.
+
+template <typename T>
+class Snapshot
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshot payload must be trivially copyable");
+
+public:
+    explicit Snapshot(const T &initial = T())
+    {
+        store(0, initial);
+        store(1, initial);
+    }
+
+    // Writer side. Only one task may publish to a given snapshot.
+    void publish(const T &value)
+    {
+        uint32_t next = gen.load(std::memory_order_relaxed) + 1;
+        Buffer &buffer = buffers[next & 1];
+        uint32_t seq = buffer.seq.load(std::memory_order_relaxed);
+        buffer.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        store(next & 1, value);
+        buffer.seq.store(seq + 2, std::memory_order_release);
+        gen.store(next, std::memory_order_release);
+    }
+
+    // Consistent copy of the most recently published value.
+    T read() const
+    {
+        T value;
+        while (!tryRead(value))
+        {
+        }
+        return value;
+    }
+
+    bool tryRead(T &value) const
+    {
+        uint32_t g = gen.load(std::memory_order_acquire);
+        const Buffer &buffer = buffers[g & 1];
+        uint32_t before = buffer.seq.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            return false;
+        }
+        uint32_t words[WORDS];
+        for (size_t i = 0; i < WORDS; i++)
+        {
+            words[i] = buffer.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (buffer.seq.load(std::memory_order_relaxed) != before)
+        {
+            return false;
+        }
+        memcpy(&value, words, sizeof(T));
+        return true;
+    }
+
+    // Number of publishes so far, lets readers skip work when nothing changed
+    uint32_t generation() const { return gen.load(std::memory_order_acquire); }
+
+private:
+    static const size_t WORDS = (sizeof(T) + 3) / 4;
+
+    struct Buffer
+    {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<uint32_t> words[WORDS];
+    };
+
+    void store(int index, const T &value)
+    {
+        uint32_t words[WORDS] = {};
+        memcpy(words, &value, sizeof(T));
+        for (size_t i = 0; i < WORDS; i++)
+        {
+            buffers[index].words[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    Buffer buffers[2];
+    std::atomic<uint32_t> gen{0};
+};
+
+#endif
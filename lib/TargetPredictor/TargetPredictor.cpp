@@ -0,0 +1,148 @@
+#include "TargetPredictor.h"
+#include <math.h>
+
+#define PREDICTOR_ERROR_WEIGHT (1.0f / 32.0f)
+#define PREDICTOR_INTERVAL_WEIGHT (1.0f / 8.0f)
+#define PREDICTOR_TRANSIT_CREEP_MS 10000
+
+void PredictorAxis::reset(float position)
+{
+    pos = position;
+    vel = 0.0f;
+}
+
+float PredictorAxis::update(float measurement, float dt, const PredictorConfig &config)
+{
+    float predicted = pos + vel * dt;
+    float innovation = measurement - predicted;
+    pos = predicted + config.alpha * innovation;
+    // Two observations stamped in the same millisecond say nothing about
+    // velocity
+    if (dt > 0.0005f)
+    {
+        vel += config.beta * innovation / dt;
+        if (vel > config.maxVelocity)
+        {
+            vel = config.maxVelocity;
+        }
+        else if (vel < -config.maxVelocity)
+        {
+            vel = -config.maxVelocity;
+        }
+    }
+    return innovation;
+}
+
+void TargetPredictor::reset()
+{
+    currentState = PREDICTOR_IDLE;
+    transitValid = false;
+    panSquareError = 0.0f;
+    tiltSquareError = 0.0f;
+}
+
+void TargetPredictor::observeTimed(float pan, float tilt, uint32_t sourceMs, uint32_t nowMs)
+{
+    uint32_t transit = nowMs - sourceMs;
+    int32_t late = (int32_t)(transit - minTransit);
+
+    // A tracker restart or a clock jump shows up as a huge change in transit
+    if (!transitValid || late < 0 || (uint32_t)late > config.resetGapMs)
+    {
+        transitValid = true;
+        minTransit = transit;
+        minTransitAt = nowMs;
+        late = 0;
+    }
+    else if (nowMs - minTransitAt > PREDICTOR_TRANSIT_CREEP_MS)
+    {
+        minTransit++;
+        minTransitAt = nowMs;
+    }
+    lastLateMs = late;
+    apply(pan, tilt, nowMs - late - config.latencyMs, nowMs);
+}
+
+void TargetPredictor::observe(float pan, float tilt, uint32_t nowMs)
+{
+    lastLateMs = 0;
+    apply(pan, tilt, nowMs - config.latencyMs, nowMs);
+}
+
+void TargetPredictor::apply(float pan, float tilt, uint32_t capturedMs, uint32_t nowMs)
+{
+    int32_t gap = (int32_t)(capturedMs - lastCapturedMs);
+    observationCount++;
+
+    if (currentState == PREDICTOR_IDLE || currentState == PREDICTOR_HOLDING || gap > (int32_t)config.resetGapMs)
+    {
+        panAxis.reset(pan);
+        tiltAxis.reset(tilt);
+        lastCapturedMs = capturedMs;
+        lastArrivalMs = nowMs;
+        currentState = PREDICTOR_TRACKING;
+        trackCount++;
+        return;
+    }
+    // Overtaken by a newer frame on the way here
+    if (gap < 0)
+    {
+        return;
+    }
+
+    float dt = gap / 1000.0f;
+    float panError = panAxis.update(pan, dt, config);
+    float tiltError = tiltAxis.update(tilt, dt, config);
+    panSquareError += (panError * panError - panSquareError) * PREDICTOR_ERROR_WEIGHT;
+    tiltSquareError += (tiltError * tiltError - tiltSquareError) * PREDICTOR_ERROR_WEIGHT;
+    intervalMs += ((nowMs - lastArrivalMs) - intervalMs) * PREDICTOR_INTERVAL_WEIGHT;
+
+    lastCapturedMs = capturedMs;
+    lastArrivalMs = nowMs;
+    currentState = PREDICTOR_TRACKING;
+}
+
+bool TargetPredictor::aim(uint32_t nowMs, float &pan, float &tilt)
+{
+    if (currentState == PREDICTOR_IDLE)
+    {
+        return false;
+    }
+
+    uint32_t sinceArrival = nowMs - lastArrivalMs;
+    uint32_t ahead = nowMs - lastCapturedMs;
+    if (sinceArrival > config.coastMs)
+    {
+        // Freeze at the end of the coast
+        ahead -= sinceArrival - config.coastMs;
+        currentState = PREDICTOR_HOLDING;
+    }
+    else if (sinceArrival > 2.0f * intervalMs)
+    {
+        currentState = PREDICTOR_COASTING;
+    }
+
+    float dt = ahead / 1000.0f;
+    pan = clamp(panAxis.predict(dt));
+    tilt = clamp(tiltAxis.predict(dt));
+    return true;
+}
+
+float TargetPredictor::clamp(float position) const
+{
+    if (position < config.minPosition)
+    {
+        return config.minPosition;
+    }
+    if (position > config.maxPosition)
+    {
+        return config.maxPosition;
+    }
+    return position;
+}
+
+float TargetPredictor::innovationRms() const
+{
+    float worst = panSquareError > tiltSquareError ? panSquareError : tiltSquareError;
+    return sqrtf(worst);
+}
@@ -0,0 +1,107 @@
+#ifndef TARGET_PREDICTOR_H
+#define TARGET_PREDICTOR_H
+
+#include <stdint.h>
+
+// Aim point prediction for tracker input. Observations arrive at the
+// camera frame rate after a frame of capture and processing plus a network
+// hop; the servo loop asks for an aim point every tick. An alpha-beta
+// filter per axis estimates position and velocity at each observation's
+// capture time and aim() extrapolates that estimate to the current time,
+// so the turret leads the target by the pipeline latency instead of
+// trailing it and moves smoothly between frames.
+//
+// When observations stop the prediction coasts on the last velocity for
+// coastMs and then holds where it ended up. The next observation after a
+// hold, or after more than resetGapMs, starts a fresh track.
+//
+// Floats only, a handful of multiplies per observation and per tick.
+
+struct PredictorConfig
+{
+    float alpha = 0.5f; // position correction gain, 0-1
+    float beta = 0.1f;  // velocity correction gain, 0-2
+    uint32_t latencyMs = 60; // capture to arrival of the fastest frames, not measurable here
+    uint32_t coastMs = 250;
+    uint32_t resetGapMs = 1000;
+    float maxVelocity = 2000.0f; // units/s, bounds the estimate against outliers
+    float minPosition = 0.0f;
+    float maxPosition = 1000.0f;
+};
+
+enum PredictorState : uint8_t
+{
+    PREDICTOR_IDLE,     // never observed anything
+    PREDICTOR_TRACKING, // observations arriving at the usual rate
+    PREDICTOR_COASTING, // overdue, extrapolating on the last velocity
+    PREDICTOR_HOLDING   // coast expired, aim held still
+};
+
+class PredictorAxis
+{
+public:
+    void reset(float position);
+
+    // Folds in a measurement dt seconds after the previous one and returns
+    // the innovation (measurement minus prediction)
+    float update(float measurement, float dt, const PredictorConfig &config);
+    float predict(float dt) const { return pos + vel * dt; }
+
+    float position() const { return pos; }
+    float velocity() const { return vel; }
+
+private:
+    float pos = 0.0f;
+    float vel = 0.0f;
+};
+
+class TargetPredictor
+{
+public:
+    PredictorConfig config;
+
+    // An observation stamped by the tracker's clock at capture time. Only
+    // differences between stamps are used, the two clocks need not agree.
+    void observeTimed(float pan, float tilt, uint32_t sourceMs, uint32_t nowMs);
+
+    // An observation without a usable capture stamp, assumed to have taken
+    // config.latencyMs to arrive
+    void observe(float pan, float tilt, uint32_t nowMs);
+
+    // Aim point for nowMs. Returns false when there is no track.
+    bool aim(uint32_t nowMs, float &pan, float &tilt);
+
+    PredictorState state() const { return currentState; }
+    void reset();
+
+    // Prediction quality: RMS innovation over roughly the last 32
+    // observations, in position units, the worse of the two axes
+    float innovationRms() const;
+    uint32_t observations() const { return observationCount; }
+    uint32_t tracksStarted() const { return trackCount; }
+    uint32_t lateMs() const { return lastLateMs; } // latency above the fastest frame seen
+
+private:
+    void apply(float pan, float tilt, uint32_t capturedMs, uint32_t nowMs);
+    float clamp(float position) const;
+
+    PredictorAxis panAxis;
+    PredictorAxis tiltAxis;
+    PredictorState currentState = PREDICTOR_IDLE;
+    uint32_t lastCapturedMs = 0;
+    uint32_t lastArrivalMs = 0;
+    float intervalMs = 33.0f;    // running mean time between observations
+    float panSquareError = 0.0f; // running means of squared innovations
+    float tiltSquareError = 0.0f;
+    uint32_t observationCount = 0;
+    uint32_t trackCount = 0;
+
+    // Clock offset estimate for timed observations: the smallest arrival
+    // minus source stamp seen, crept upwards so drift cannot wedge it
+    bool transitValid = false;
+    uint32_t minTransit = 0;
+    uint32_t minTransitAt = 0;
+    uint32_t lastLateMs = 0;
+};
+
+#endif
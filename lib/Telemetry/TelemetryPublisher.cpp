@@ -0,0 +1,206 @@
+#include "TelemetryPublisher.h"
+#include <string.h>
+
+#define TELEMETRY_FIELD_NAME(id, name) name,
+static const char *const FIELD_NAMES[TELEMETRY_FIELD_COUNT] = {TELEMETRY_FIELDS(TELEMETRY_FIELD_NAME)};
+#undef TELEMETRY_FIELD_NAME
+
+// Small append-only writer over the frame buffer. Stops writing, and
+// reports overflow, once the buffer is full instead of truncating a frame
+// silently.
+struct FrameWriter
+{
+    char *out;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+
+    void text(const char *s)
+    {
+        while (*s)
+        {
+            if (length + 1 >= capacity)
+            {
+                overflow = true;
+                return;
+            }
+            out[length++] = *s++;
+        }
+    }
+
+    void number(int64_t value)
+    {
+        char digits[21];
+        int n = 0;
+        bool negative = value < 0;
+        uint64_t magnitude = negative ? (uint64_t)(-value) : (uint64_t)value;
+        do
+        {
+            digits[n++] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude);
+        if (negative)
+        {
+            digits[n++] = '-';
+        }
+        if (length + n + 1 >= capacity)
+        {
+            overflow = true;
+            return;
+        }
+        while (n)
+        {
+            out[length++] = digits[--n];
+        }
+    }
+
+    void field(const char *name, int64_t value)
+    {
+        text(",\"");
+        text(name);
+        text("\":");
+        number(value);
+    }
+};
+
+TelemetryPublisher::TelemetryPublisher()
+{
+    for (uint8_t i = 0; i < TELEMETRY_MAX_CLIENTS; i++)
+    {
+        clients[i].appliedGeneration = 0;
+        clients[i].subscription = TelemetrySubscription();
+        clients[i].needKeyframe = true;
+        clients[i].lastSent = 0;
+        clients[i].lastKeyframe = 0;
+        clients[i].seq = 0;
+    }
+}
+
+void TelemetryPublisher::subscribe(uint8_t client, uint16_t periodMs, uint64_t fields, uint16_t keyframeMs)
+{
+    if (client >= TELEMETRY_MAX_CLIENTS)
+    {
+        return;
+    }
+    TelemetrySubscription subscription;
+    subscription.active = true;
+    subscription.periodMs = periodMs < TELEMETRY_MIN_PERIOD_MS ? TELEMETRY_MIN_PERIOD_MS : periodMs;
+    subscription.keyframeMs = keyframeMs;
+    subscription.fields = fields & TELEMETRY_ALL_FIELDS;
+    clients[client].requested.publish(subscription);
+}
+
+void TelemetryPublisher::unsubscribe(uint8_t client)
+{
+    if (client >= TELEMETRY_MAX_CLIENTS)
+    {
+        return;
+    }
+    clients[client].requested.publish(TelemetrySubscription());
+}
+
+uint64_t TelemetryPublisher::fieldMask(const char *name)
+{
+    for (uint8_t i = 0; i < TELEMETRY_FIELD_COUNT; i++)
+    {
+        if (strcmp(name, FIELD_NAMES[i]) == 0)
+        {
+            return 1ULL << i;
+        }
+    }
+    return 0;
+}
+
+const char *TelemetryPublisher::fieldName(uint8_t field)
+{
+    return field < TELEMETRY_FIELD_COUNT ? FIELD_NAMES[field] : "";
+}
+
+size_t TelemetryPublisher::encode(Client &client, uint32_t now, const int32_t *values, bool keyframe)
+{
+    FrameWriter writer = {frame, sizeof(frame), 0, false};
+    writer.text("{\"seq\":");
+    writer.number(client.seq);
+    writer.field("t", now);
+    writer.field("key", keyframe ? 1 : 0);
+
+    bool changed = false;
+    for (uint8_t i = 0; i < TELEMETRY_FIELD_COUNT; i++)
+    {
+        if (!(client.subscription.fields & (1ULL << i)))
+        {
+            continue;
+        }
+        if (keyframe || values[i] != client.last[i])
+        {
+            writer.field(FIELD_NAMES[i], values[i]);
+            changed = true;
+        }
+    }
+    writer.text("}");
+
+    if (writer.overflow || !changed)
+    {
+        return 0;
+    }
+    frame[writer.length] = '\0';
+    return writer.length;
+}
+
+uint32_t TelemetryPublisher::poll(uint32_t now, const int32_t *values, TelemetrySender send, void *context)
+{
+    uint32_t nextDue = TELEMETRY_DEFAULT_KEYFRAME_MS;
+
+    for (uint8_t i = 0; i < TELEMETRY_MAX_CLIENTS; i++)
+    {
+        Client &client = clients[i];
+
+        uint32_t generation = client.requested.generation();
+        if (generation != client.appliedGeneration)
+        {
+            client.appliedGeneration = generation;
+            client.subscription = client.requested.read();
+            client.needKeyframe = true;
+        }
+        if (!client.subscription.active)
+        {
+            continue;
+        }
+
+        uint32_t sinceSent = now - client.lastSent;
+        if (!client.needKeyframe && sinceSent < client.subscription.periodMs)
+        {
+            uint32_t due = client.subscription.periodMs - sinceSent;
+            nextDue = due < nextDue ? due : nextDue;
+            continue;
+        }
+
+        bool keyframe = client.needKeyframe ||
+                        (client.subscription.keyframeMs > 0 && now - client.lastKeyframe >= client.subscription.keyframeMs);
+        size_t length = encode(client, now, values, keyframe);
+        client.lastSent = now;
+        if (length > 0)
+        {
+            // A frame the client could not take leaves last as it was, so
+            // the next one carries the same changes
+            if (!send(i, frame, length, context))
+            {
+                framesDropped++;
+            }
+            else
+            {
+                memcpy(client.last, values, sizeof(client.last));
+                client.seq++;
+                framesSent++;
+                bytesSent += length;
+                if (keyframe)
+                {
+                    client.lastKeyframe = now;
+                    client.needKeyframe = false;
+                }
+            }
+        }
+        nextDue = client.subscription.periodMs < nextDue ? client.subscription.periodMs : nextDue;
+    }
+    return nextDue;
+}
@@ -0,0 +1,145 @@
+#ifndef TELEMETRY_PUBLISHER_H
+#define TELEMETRY_PUBLISHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Snapshot.h>
+
+// Change driven telemetry. Every client has its own rate and field set;
+// on each of its ticks it gets a JSON frame holding only the fields that
+// changed since its last frame, plus a full keyframe every keyframeMs so a
+// late joiner or a dropped frame heals itself:
+//
+//   {"seq":42,"t":123456,"key":0,"pan":512,"tilt":388}
+//
+// seq counts frames per client so gaps are visible, t is the firmware
+// uptime in ms. Frames are built in a buffer owned by the publisher, no
+// heap is touched after construction.
+
+#define TELEMETRY_MAX_CLIENTS 5
+#define TELEMETRY_FRAME_SIZE 1280 // at least TELEMETRY_WORST_FRAME, checked below
+#define TELEMETRY_DEFAULT_PERIOD_MS 100
+#define TELEMETRY_DEFAULT_KEYFRAME_MS 2000
+#define TELEMETRY_MIN_PERIOD_MS 20
+
+// Field order is also the order in keyframes
+#define TELEMETRY_FIELDS(X)                             \
+    X(TELEMETRY_PAN, "pan")                             \
+    X(TELEMETRY_TILT, "tilt")                           \
+    X(TELEMETRY_MOTOR_SPEED, "motor_speed")             \
+    X(TELEMETRY_FLYWHEEL_SPEED, "flywheel_speed")       \
+    X(TELEMETRY_FLYWHEEL_STATUS, "flywheelStatus")      \
+    X(TELEMETRY_FIRE_MODE, "fire_mode")                 \
+    X(TELEMETRY_MAG_COUNT, "magCountValue")             \
+    X(TELEMETRY_MOTOR_STATUS, "motorStatus")            \
+    X(TELEMETRY_CAMERA_STATUS, "camraStatus")           \
+    X(TELEMETRY_MODE, "mode")                           \
+    X(TELEMETRY_CAMERA_PAN, "cameraPan")                \
+    X(TELEMETRY_CAMERA_TILT, "cameraTilt")              \
+    X(TELEMETRY_SHOT_LATENCY, "shot_latency")           \
+    X(TELEMETRY_PAN_FEEDBACK, "pan_feedback")           \
+    X(TELEMETRY_TILT_FEEDBACK, "tilt_feedback")         \
+    X(TELEMETRY_PAN_TEMP, "pan_temp")                   \
+    X(TELEMETRY_TILT_TEMP, "tilt_temp")                 \
+    X(TELEMETRY_PAN_VIN, "pan_vin")                     \
+    X(TELEMETRY_TILT_VIN, "tilt_vin")                   \
+    X(TELEMETRY_BUS_TIMEOUTS, "bus_timeouts")           \
+    X(TELEMETRY_LOOP_JITTER, "loop_jitter_us")          \
+    X(TELEMETRY_LOOP_MAX_JITTER, "loop_max_jitter_us")  \
+    X(TELEMETRY_LOOP_OVERRUNS, "loop_overruns")        \
+    X(TELEMETRY_TRACK_STATE, "track_state")             \
+    X(TELEMETRY_TRACK_RESIDUAL, "track_residual")       \
+    X(TELEMETRY_BOOT_WIFI, "boot_wifi_ms")              \
+    X(TELEMETRY_BOOT_CAMERA, "boot_camera_ms")          \
+    X(TELEMETRY_BOOT_FLYWHEEL, "boot_flywheel_ms")      \
+    X(TELEMETRY_BOOT_READY, "boot_ready_ms")            \
+    X(TELEMETRY_WIFI_RECONNECTS, "wifi_reconnects")     \
+    X(TELEMETRY_WS_CLIENTS, "ws_clients")               \
+    X(TELEMETRY_CMD_REJECTED, "cmd_rejected")           \
+    X(TELEMETRY_CLIENTS_REFUSED, "clients_refused")     \
+    X(TELEMETRY_HEAP_FREE, "heap_free")                 \
+    X(TELEMETRY_HEAP_LARGEST, "heap_largest")           \
+    X(TELEMETRY_HEAP_MIN_FREE, "heap_min_free")         \
+    X(TELEMETRY_HEAP_HOT_ALLOCS, "heap_hot_allocs")     \
+    X(TELEMETRY_LOG_DROPPED, "log_dropped")             \
+    X(TELEMETRY_RPM_LEFT, "rpm_left")                   \
+    X(TELEMETRY_RPM_RIGHT, "rpm_right")                 \
+    X(TELEMETRY_SPEED_FAULTS, "speed_faults")
+
+#define TELEMETRY_FIELD_ENUM(id, name) id,
+enum TelemetryField : uint8_t
+{
+    TELEMETRY_FIELDS(TELEMETRY_FIELD_ENUM)
+    TELEMETRY_FIELD_COUNT
+};
+#undef TELEMETRY_FIELD_ENUM
+
+#define TELEMETRY_ALL_FIELDS ((uint64_t)((1ULL << TELEMETRY_FIELD_COUNT) - 1))
+
+static_assert(TELEMETRY_FIELD_COUNT < 64, "telemetry field mask is 64 bits");
+
+// Longest frame encode() can produce: a keyframe of every field with seq,
+// t and every value at their widest. The header is {"seq":N,"t":N,"key":1
+// with two 10 digit numbers, each field ,"name":-2147483648, then the
+// closing brace and a terminator. A frame that does not fit is never sent
+// and its client never gets the keyframe it waits for, so this has to hold
+// for every field set.
+#define TELEMETRY_FIELD_WORST(id, name) +(sizeof(name) - 1 + 15)
+#define TELEMETRY_WORST_FRAME (40 TELEMETRY_FIELDS(TELEMETRY_FIELD_WORST) + 2)
+static_assert(TELEMETRY_FRAME_SIZE >= TELEMETRY_WORST_FRAME, "TELEMETRY_FRAME_SIZE cannot hold a keyframe of every field");
+
+struct TelemetrySubscription
+{
+    bool active;
+    uint16_t periodMs;
+    uint16_t keyframeMs;
+    uint64_t fields; // bit per TelemetryField
+};
+
+// Returns false when the frame could not be queued for the client, which
+// then gets the same changes again in its next frame
+typedef bool (*TelemetrySender)(uint8_t client, const char *frame, size_t length, void *context);
+
+class TelemetryPublisher
+{
+public:
+    TelemetryPublisher();
+
+    // Called from the websocket task. Changes are picked up on the next
+    // poll(); a new subscription always starts with a keyframe.
+    void subscribe(uint8_t client, uint16_t periodMs, uint64_t fields, uint16_t keyframeMs = TELEMETRY_DEFAULT_KEYFRAME_MS);
+    void unsubscribe(uint8_t client);
+
+    // Mask bit for a field name, 0 if unknown
+    static uint64_t fieldMask(const char *name);
+    static const char *fieldName(uint8_t field);
+
+    // Called from the telemetry task with the current value of every
+    // field. Sends whatever is due and returns the ms until the next
+    // client is due.
+    uint32_t poll(uint32_t now, const int32_t *values, TelemetrySender send, void *context);
+
+    uint32_t framesSent = 0;
+    uint32_t bytesSent = 0;
+    uint32_t framesDropped = 0;
+
+private:
+    struct Client
+    {
+        Snapshot<TelemetrySubscription> requested;
+        uint32_t appliedGeneration;
+        TelemetrySubscription subscription;
+        bool needKeyframe;
+        uint32_t lastSent;
+        uint32_t lastKeyframe;
+        uint32_t seq;
+        int32_t last[TELEMETRY_FIELD_COUNT];
+    };
+
+    size_t encode(Client &client, uint32_t now, const int32_t *values, bool keyframe);
+
+    Client clients[TELEMETRY_MAX_CLIENTS];
+    char frame[TELEMETRY_FRAME_SIZE];
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "Trajectory.h"
+#include <math.h>
+
+void TrajectoryAxis::reset(float position)
+{
+    pos = position;
+    vel = 0.0f;
+    atTarget = true;
+}
+
+float TrajectoryAxis::update(float target, float dt)
+{
+    if (limits.maxVelocity <= 0.0f || limits.maxAcceleration <= 0.0f)
+    {
+        vel = 0.0f;
+        atTarget = pos == target;
+        return pos;
+    }
+
+    float distance = target - pos;
+    float maxDelta = limits.maxAcceleration * dt;
+
+    // Close enough to stop this tick
+    if (fabsf(distance) <= fabsf(vel) * dt + 1e-3f && fabsf(vel) <= maxDelta)
+    {
+        pos = target;
+        vel = 0.0f;
+        atTarget = true;
+        return pos;
+    }
+
+    // Fastest speed v that can be held for this tick and still brake to a
+    // stop on the target afterwards: v*dt + v^2/(2a) <= |distance|. The
+    // continuous sqrt(2a|distance|) ignores the tick and overshoots.
+    float a = limits.maxAcceleration;
+    float brakeVelocity = sqrtf(a * a * dt * dt + 2.0f * a * fabsf(distance)) - a * dt;
+    float desired = brakeVelocity < limits.maxVelocity ? brakeVelocity : limits.maxVelocity;
+    if (distance < 0.0f)
+    {
+        desired = -desired;
+    }
+
+    float change = desired - vel;
+    if (change > maxDelta)
+    {
+        change = maxDelta;
+    }
+    else if (change < -maxDelta)
+    {
+        change = -maxDelta;
+    }
+    vel += change;
+    pos += vel * dt;
+    atTarget = false;
+    return pos;
+}
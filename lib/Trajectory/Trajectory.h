@@ -0,0 +1,42 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stdint.h>
+
+// Online trapezoidal setpoint generator for one servo axis. Each update()
+// moves the setpoint one control tick towards the target without exceeding
+// the velocity and acceleration limits. The braking speed accounts for the
+// tick the new velocity is held for, so for a fixed target the setpoint
+// approaches monotonically and lands on it without overshooting. A target
+// that moves behind a setpoint still travelling the other way is passed by
+// no more than the distance needed to brake. Units are whatever the caller uses for
+// position (LX-824 units here) per second; a non-positive velocity or
+// acceleration limit holds the axis still.
+
+struct TrajectoryLimits
+{
+    float maxVelocity;
+    float maxAcceleration;
+};
+
+class TrajectoryAxis
+{
+public:
+    TrajectoryLimits limits = {1000.0f, 4000.0f};
+
+    void reset(float position);
+
+    // Advances the profile by dt seconds and returns the new setpoint
+    float update(float target, float dt);
+
+    float position() const { return pos; }
+    float velocity() const { return vel; }
+    bool settled() const { return atTarget; }
+
+private:
+    float pos = 0.0f;
+    float vel = 0.0f;
+    bool atTarget = true;
+};
+
+#endif
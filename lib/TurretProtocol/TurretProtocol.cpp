@@ -0,0 +1,117 @@
+#include "TurretProtocol.h"
+
+static uint8_t frameChecksum(const uint8_t *bytes)
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < TURRET_FRAME_SIZE - 1; i++)
+    {
+        sum += bytes[i];
+    }
+    return ~sum;
+}
+
+size_t encodeTurretFrame(const TurretFrame &frame, uint8_t *out, size_t capacity)
+{
+    if (capacity < TURRET_FRAME_SIZE)
+    {
+        return 0;
+    }
+
+    out[0] = TURRET_FRAME_MAGIC;
+    out[1] = TURRET_FRAME_VERSION;
+    out[2] = frame.type;
+    out[3] = frame.flags;
+    out[4] = frame.seq & 0xFF;
+    out[5] = (frame.seq >> 8) & 0xFF;
+    out[6] = frame.timestamp & 0xFF;
+    out[7] = (frame.timestamp >> 8) & 0xFF;
+    out[8] = (frame.timestamp >> 16) & 0xFF;
+    out[9] = (frame.timestamp >> 24) & 0xFF;
+    out[10] = frame.a & 0xFF;
+    out[11] = (frame.a >> 8) & 0xFF;
+    out[12] = frame.b & 0xFF;
+    out[13] = (frame.b >> 8) & 0xFF;
+    out[14] = frame.c;
+    out[15] = frameChecksum(out);
+    return TURRET_FRAME_SIZE;
+}
+
+TurretDecodeResult decodeTurretFrame(const uint8_t *in, size_t length, TurretFrame &frame)
+{
+    if (length < TURRET_FRAME_SIZE)
+    {
+        return TURRET_DECODE_SHORT;
+    }
+    if (in[0] != TURRET_FRAME_MAGIC)
+    {
+        return TURRET_DECODE_MAGIC;
+    }
+    if (in[1] != TURRET_FRAME_VERSION)
+    {
+        return TURRET_DECODE_VERSION;
+    }
+    if (in[15] != frameChecksum(in))
+    {
+        return TURRET_DECODE_CHECKSUM;
+    }
+    if (in[2] < TURRET_FRAME_MOVE || in[2] > TURRET_FRAME_SPEED)
+    {
+        return TURRET_DECODE_TYPE;
+    }
+
+    frame.type = in[2];
+    frame.flags = in[3];
+    frame.seq = in[4] | (in[5] << 8);
+    frame.timestamp = (uint32_t)in[6] | ((uint32_t)in[7] << 8) | ((uint32_t)in[8] << 16) | ((uint32_t)in[9] << 24);
+    frame.a = in[10] | (in[11] << 8);
+    frame.b = in[12] | (in[13] << 8);
+    frame.c = in[14];
+    return TURRET_DECODE_OK;
+}
+
+const char *turretDecodeResultName(TurretDecodeResult result)
+{
+    switch (result)
+    {
+    case TURRET_DECODE_OK:
+        return "ok";
+    case TURRET_DECODE_SHORT:
+        return "short frame";
+    case TURRET_DECODE_MAGIC:
+        return "bad magic";
+    case TURRET_DECODE_VERSION:
+        return "unsupported version";
+    case TURRET_DECODE_CHECKSUM:
+        return "bad checksum";
+    case TURRET_DECODE_TYPE:
+        return "unknown type";
+    }
+    return "unknown";
+}
+
+bool TrackSchedule::due(uint32_t nowMs, bool found, int pan, int tilt) const
+{
+    if (!found)
+    {
+        return anySent && sentFound;
+    }
+    if (!anySent || !sentFound)
+    {
+        return true;
+    }
+    int panMoved = pan > sentPan ? pan - sentPan : sentPan - pan;
+    int tiltMoved = tilt > sentTilt ? tilt - sentTilt : sentTilt - tilt;
+    return panMoved > threshold || tiltMoved > threshold || nowMs - sentMs >= refreshMs;
+}
+
+void TrackSchedule::sent(uint32_t nowMs, bool found, int pan, int tilt)
+{
+    anySent = true;
+    sentFound = found;
+    sentMs = nowMs;
+    if (found)
+    {
+        sentPan = pan;
+        sentTilt = tilt;
+    }
+}
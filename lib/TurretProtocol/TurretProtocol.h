@@ -0,0 +1,111 @@
+#ifndef TURRET_PROTOCOL_H
+#define TURRET_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary command frame sent over the websocket (WStype_BIN) as a cheaper
+// alternative to the JSON text messages. Every frame is a fixed 16 bytes,
+// little-endian:
+//
+//  0      magic (0x54 'T')
+//  1      protocol version
+//  2      frame type (TurretFrameType)
+//  3      flags (TURRET_FLAG_*)
+//  4..5   sequence number, wraps at 65535
+//  6..9   sender timestamp in milliseconds
+//  10..11 argument a
+//  12..13 argument b
+//  14     argument c
+//  15     checksum, ~(sum of bytes 0..14)
+//
+// This file has no Arduino dependencies so the tracker and host tools can
+// share it with the firmware.
+
+#define TURRET_FRAME_MAGIC 0x54
+#define TURRET_FRAME_VERSION 1
+#define TURRET_FRAME_SIZE 16
+
+#define TURRET_FLAG_FIRE 0x01      // fire once the frame has been applied
+#define TURRET_FLAG_ABORT 0x02     // stop a running burst
+#define TURRET_FLAG_NO_TARGET 0x04 // TRACK: the tracker sees no target, a and b are not a detection
+
+// A tracker following a target that holds still repeats it at least this
+// often, so the turret can tell it is still there (sweep mode holds while
+// it hears of a target, see SCAN_TARGET_TIMEOUT_MS)
+#define TURRET_TRACK_REFRESH_MS 250
+
+enum TurretFrameType : uint8_t
+{
+    TURRET_FRAME_MOVE = 1,  // a - pan, b - tilt (manual, mode 0)
+    TURRET_FRAME_TRACK = 2, // a - camera pan, b - camera tilt (tracker, mode 2)
+    TURRET_FRAME_FIRE = 3,  // c - fire mode, 0 semi, 1 burst, 2 auto
+    TURRET_FRAME_MODE = 4,  // c - mode, 0 manual, 1 sweep, 2 auto
+    TURRET_FRAME_SPEED = 5  // a - motor speed, c - flywheel speed
+};
+
+enum TurretDecodeResult : uint8_t
+{
+    TURRET_DECODE_OK = 0,
+    TURRET_DECODE_SHORT,    // fewer than TURRET_FRAME_SIZE bytes
+    TURRET_DECODE_MAGIC,    // not a turret frame
+    TURRET_DECODE_VERSION,  // frame from a newer protocol version
+    TURRET_DECODE_CHECKSUM, // corrupted frame
+    TURRET_DECODE_TYPE      // unknown frame type
+};
+
+struct TurretFrame
+{
+    uint8_t type;
+    uint8_t flags;
+    uint16_t seq;
+    uint32_t timestamp;
+    uint16_t a;
+    uint16_t b;
+    uint8_t c;
+};
+
+// Writes frame into out, returns the number of bytes written or 0 if out is
+// smaller than TURRET_FRAME_SIZE.
+size_t encodeTurretFrame(const TurretFrame &frame, uint8_t *out, size_t capacity);
+
+// Parses the first TURRET_FRAME_SIZE bytes of in. frame is only written when
+// the result is TURRET_DECODE_OK.
+TurretDecodeResult decodeTurretFrame(const uint8_t *in, size_t length, TurretFrame &frame);
+
+// True if seq is newer than last, allowing for the 16 bit wrap.
+inline bool turretSeqNewer(uint16_t seq, uint16_t last)
+{
+    return (int16_t)(seq - last) > 0;
+}
+
+const char *turretDecodeResultName(TurretDecodeResult result);
+
+// Whether frame reports a detected target
+inline bool turretFrameHasTarget(const TurretFrame &frame)
+{
+    return frame.type == TURRET_FRAME_TRACK && !(frame.flags & TURRET_FLAG_NO_TARGET);
+}
+
+// When a tracker sends TRACK frames: when the target moved more than
+// threshold servo units from the last one sent, every refreshMs while it
+// holds still, and once, flagged TURRET_FLAG_NO_TARGET, when it is lost.
+class TrackSchedule
+{
+public:
+    int threshold = 5;
+    uint32_t refreshMs = TURRET_TRACK_REFRESH_MS;
+
+    bool due(uint32_t nowMs, bool found, int pan, int tilt) const;
+    // Once the frame due() asked for has gone out
+    void sent(uint32_t nowMs, bool found, int pan, int tilt);
+
+private:
+    bool anySent = false;
+    bool sentFound = false;
+    int sentPan = 0;
+    int sentTilt = 0;
+    uint32_t sentMs = 0;
+};
+
+#endif
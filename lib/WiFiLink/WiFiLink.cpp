@@ -0,0 +1,73 @@
+#include "WiFiLink.h"
+
+WiFiLinkAction WiFiLink::begin(uint32_t now, bool hasCache)
+{
+    cached = hasCache;
+    linkUp = false;
+    waiting = false;
+    retryMs = config.retryMinMs;
+    return connect(now, cached, WIFI_LINK_CONNECT);
+}
+
+WiFiLinkAction WiFiLink::update(uint32_t now, bool addressed, bool dropped)
+{
+    if (addressed)
+    {
+        // The caller stores the access point, later attempts can go to it
+        // directly
+        linkUp = true;
+        waiting = false;
+        cached = true;
+        retryMs = config.retryMinMs;
+        return WIFI_LINK_ADDRESSED;
+    }
+    if (dropped && linkUp)
+    {
+        linkUp = false;
+        return connect(now, cached, WIFI_LINK_RECONNECT);
+    }
+    if (linkUp)
+    {
+        return WIFI_LINK_NONE;
+    }
+    if (waiting)
+    {
+        if (now - attemptMs < retryMs)
+        {
+            return WIFI_LINK_NONE;
+        }
+        waiting = false;
+        retryMs = retryMs * 2 < config.retryMaxMs ? retryMs * 2 : config.retryMaxMs;
+        return connect(now, cached, WIFI_LINK_CONNECT);
+    }
+    if (!dropped && now - attemptMs < (fastAttempt ? config.fastTimeoutMs : config.scanTimeoutMs))
+    {
+        return WIFI_LINK_NONE;
+    }
+    if (fastAttempt)
+    {
+        // The cached access point is gone or moved, scan right away
+        return connect(now, false, WIFI_LINK_CONNECT);
+    }
+    waiting = true;
+    attemptMs = now;
+    return WIFI_LINK_NONE;
+}
+
+uint32_t WiFiLink::wait(uint32_t now) const
+{
+    if (linkUp)
+    {
+        return WIFI_LINK_NO_DEADLINE;
+    }
+    uint32_t limit = waiting ? retryMs : fastAttempt ? config.fastTimeoutMs : config.scanTimeoutMs;
+    uint32_t elapsed = now - attemptMs;
+    return elapsed < limit ? limit - elapsed : 0;
+}
+
+WiFiLinkAction WiFiLink::connect(uint32_t now, bool fast, WiFiLinkAction action)
+{
+    fastAttempt = fast;
+    attemptMs = now;
+    return action;
+}
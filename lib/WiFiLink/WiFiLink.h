@@ -0,0 +1,69 @@
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <stdint.h>
+
+// Station reconnect policy. It owns no radio: the WiFi task feeds it the
+// GOT_IP and disconnect events it has seen, carries out the returned
+// action and sleeps until wait() or the next event. All times are in
+// milliseconds from the same clock.
+//
+// Boot and every drop start with a fast attempt on the cached access point;
+// if that does not get an address within fastTimeoutMs it falls back to a
+// scan. After a failed scan it pauses, doubling the pause every time up to
+// retryMaxMs, and starts over with a fast attempt, since most outages are
+// the same access point rebooting. Without a cached access point every
+// attempt is a scan.
+
+#define WIFI_LINK_NO_DEADLINE 0xFFFFFFFFUL
+
+enum WiFiLinkAction : uint8_t
+{
+    WIFI_LINK_NONE,
+    WIFI_LINK_ADDRESSED, // got an address, store the access point and lease
+    WIFI_LINK_CONNECT,   // start an attempt, on the cached access point if fast()
+    WIFI_LINK_RECONNECT  // the link dropped, start an attempt as for CONNECT
+};
+
+struct WiFiLinkConfig
+{
+    uint32_t fastTimeoutMs = 2000;  // attempt on the cached BSSID and channel before scanning
+    uint32_t scanTimeoutMs = 10000; // attempt with a full scan
+    uint32_t retryMinMs = 500;      // pause after the first failed scan
+    uint32_t retryMaxMs = 8000;
+};
+
+class WiFiLink
+{
+public:
+    WiFiLinkConfig config;
+
+    // First attempt; cached is whether an access point was stored by an
+    // earlier WIFI_LINK_ADDRESSED. Always returns WIFI_LINK_CONNECT.
+    WiFiLinkAction begin(uint32_t now, bool cached);
+
+    // addressed and dropped are whether a GOT_IP or a disconnect not caused
+    // by us arrived since the last call
+    WiFiLinkAction update(uint32_t now, bool addressed, bool dropped);
+
+    // Milliseconds until update() is due without an event
+    uint32_t wait(uint32_t now) const;
+
+    bool up() const { return linkUp; }
+    bool fast() const { return fastAttempt; }
+    bool pausing() const { return waiting; }
+    uint32_t attemptStart() const { return attemptMs; }
+    uint32_t retryDelay() const { return retryMs; }
+
+private:
+    WiFiLinkAction connect(uint32_t now, bool fast, WiFiLinkAction action);
+
+    bool cached = false;
+    bool linkUp = false;
+    bool fastAttempt = false;
+    bool waiting = false; // pausing before the next attempt
+    uint32_t retryMs = 0;
+    uint32_t attemptMs = 0;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef WS_CLIENT_TABLE_H
+#define WS_CLIENT_TABLE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Websocket connections by slot, for the tasks that send to them.
+//
+// AsyncWebSocket keeps its clients in a list that only the async_tcp task
+// may touch: count(), text(id) and availableForWrite(id) walk it, and a
+// disconnect on async_tcp unlinks and frees the client meanwhile. The
+// table is filled from the WS_EVT_CONNECT and WS_EVT_DISCONNECT callbacks
+// instead, so the count never needs the list, and a send goes straight to
+// the client object under a lock the disconnect callback also takes.
+//
+// That only holds if WS_EVT_DISCONNECT comes before any of the client is
+// freed. Stock 1.2.3 frees the client's message queues first and raises the
+// event after, leaving a window in which a sender can reach the freed
+// queues; scripts/patch_websocket.py moves the event to the top of the
+// destructor at build time and stops the build if it cannot.
+//
+// Client needs id(), canSend() and text(const char *, size_t).
+template <typename Client, uint8_t SLOTS>
+class WsClientTable
+{
+public:
+    // Before the server starts
+    void begin() { lock = xSemaphoreCreateMutex(); }
+
+    // async_tcp task, from WS_EVT_CONNECT. The new slot, or -1 if all are
+    // taken.
+    int8_t add(Client *client)
+    {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        int8_t slot = find(0);
+        if (slot >= 0)
+        {
+            clients[slot] = client;
+            ids[slot] = client->id();
+            connected++;
+        }
+        xSemaphoreGive(lock);
+        return slot;
+    }
+
+    // async_tcp task, from WS_EVT_DISCONNECT. The slot it had, or -1 if it
+    // never got one.
+    int8_t remove(uint32_t id)
+    {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        int8_t slot = find(id);
+        if (slot >= 0)
+        {
+            clients[slot] = NULL;
+            ids[slot] = 0;
+            connected--;
+        }
+        xSemaphoreGive(lock);
+        return slot;
+    }
+
+    // async_tcp task, which is the only writer
+    int8_t slotOf(uint32_t id) const { return find(id); }
+
+    // Any task
+    uint8_t count() const { return connected; }
+
+    // Any task. Sends to the client in slot unless the slot is empty or its
+    // send queue is full; true if the frame was queued.
+    bool text(uint8_t slot, const char *message, size_t length)
+    {
+        bool sent = false;
+        xSemaphoreTake(lock, portMAX_DELAY);
+        Client *client = slot < SLOTS ? clients[slot] : NULL;
+        if (client != NULL && client->canSend())
+        {
+            client->text(message, length);
+            sent = true;
+        }
+        xSemaphoreGive(lock);
+        return sent;
+    }
+
+private:
+    int8_t find(uint32_t id) const
+    {
+        for (uint8_t i = 0; i < SLOTS; i++)
+        {
+            if (ids[i] == id)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    SemaphoreHandle_t lock = NULL;
+    Client *clients[SLOTS] = {};
+    uint32_t ids[SLOTS] = {}; // 0 - free
+    volatile uint8_t connected = 0;
+};
+
+#endif
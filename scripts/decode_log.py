@@ -0,0 +1,114 @@
+# Decodes a serial capture from a firmware built with -DLOG_BINARY=1, where
+# logTask writes each deferred log record as a binary frame (see
+# lib/DeferredLog/DeferredLog.h) instead of formatting it on the turret.
+#
+#   python scripts/decode_log.py capture.bin
+#   python scripts/decode_log.py --level warn - < capture.bin
+#
+# Message formats, levels and categories come from include/LogMessages.h,
+# which has to match the firmware that made the capture. %s and %p
+# arguments are addresses on the turret and are shown as such. Anything
+# between frames (boot and WiFi messages, which are still printed
+# directly) is passed through as text.
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+TABLE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "include", "LogMessages.h")
+SYNC = 0xA5
+HEADER = 8  # sync, id, core/argc, timestamp
+LEVELS = ["debug", "info", "warn", "error"]
+
+ENTRY = re.compile(r'X\((\w+),\s*LOG_(\w+),\s*LOG_CAT_(\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z)?([diuxXcsp%])")
+
+
+def load_table(path):
+    with open(path, encoding="utf-8") as f:
+        source = f.read()
+    body = source[source.index("#define LOG_MESSAGES(X)"):]
+    body = body[:body.index("\n\n")]
+    messages = []
+    for name, level, category, fmt in ENTRY.findall(body):
+        messages.append((name, level.lower(), category.lower(), fmt.encode().decode("unicode_escape")))
+    return messages
+
+
+def render(fmt, args):
+    args = list(args)
+
+    def convert(match):
+        flags, kind = match.groups()
+        if kind == "%":
+            return "%"
+        value = args.pop(0) if args else 0
+        if kind == "d" or kind == "i":
+            return ("%" + flags + "d") % struct.unpack("<i", struct.pack("<I", value))[0]
+        if kind in "uxX":
+            return ("%" + flags + kind.replace("u", "d")) % value
+        if kind == "c":
+            return chr(value & 0xFF)
+        return "<0x%08x>" % value  # %s, %p
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def frames(data):
+    # Yields (record, None) for frames and (None, bytes) for text between them
+    text_start = 0
+    i = 0
+    while i < len(data):
+        if data[i] != SYNC or i + HEADER > len(data):
+            i += 1
+            continue
+        argc = data[i + 3] & 0x0F
+        end = i + HEADER + 4 * argc + 1
+        if end > len(data) or sum(data[i + 1:end - 1]) & 0xFF != data[end - 1]:
+            i += 1
+            continue
+        if i > text_start:
+            yield None, data[text_start:i]
+        message_id, flags, timestamp = struct.unpack_from("<HBI", data, i + 1)
+        args = struct.unpack_from("<%dI" % argc, data, i + HEADER)
+        yield (message_id, flags >> 4, timestamp, args), None
+        i = text_start = end
+    if text_start < len(data):
+        yield None, data[text_start:]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a binary turret log capture")
+    parser.add_argument("capture", help="captured serial output, - for stdin")
+    parser.add_argument("--table", default=TABLE, help="LogMessages.h the firmware was built with")
+    parser.add_argument("--level", choices=LEVELS, default="debug", help="lowest level shown")
+    parser.add_argument("--no-text", action="store_true", help="drop text between frames")
+    options = parser.parse_args()
+
+    messages = load_table(options.table)
+    lowest = LEVELS.index(options.level)
+    if options.capture == "-":
+        data = sys.stdin.buffer.read()
+    else:
+        with open(options.capture, "rb") as f:
+            data = f.read()
+
+    for record, text in frames(data):
+        if text is not None:
+            if not options.no_text:
+                sys.stdout.write(text.decode("utf-8", "replace"))
+            continue
+        message_id, core, timestamp, args = record
+        if message_id >= len(messages):
+            print("%10u c%u ?     %-6s unknown message %u %s" % (timestamp, core, "", message_id, list(args)))
+            continue
+        name, level, category, fmt = messages[message_id]
+        if LEVELS.index(level) < lowest:
+            continue
+        print("%10u c%u %-5s %-6s %s" % (timestamp, core, level, category, render(fmt, args)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,95 @@
+# PlatformIO pre-build script: minifies and gzips src/markup.html and emits
+# it as a flash resident byte array the web server streams as-is.
+#
+#   extra_scripts = pre:scripts/embed_markup.py
+#
+# The generated header lives in the build directory and is regenerated
+# whenever markup.html or this script is newer than it. MARKUP_ETAG is a
+# hash of the compressed page so browsers revalidate with a cheap 304 after
+# a reflash.
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+SOURCE = os.path.join("src", "markup.html")
+# PlatformIO runs this without __file__, so it is found like the page
+SCRIPT = os.path.join("scripts", "embed_markup.py")
+HEADER = "markup_gz.h"
+
+
+def minify(html):
+    # Conservative: comments and indentation only. Newlines stay so JS
+    # statements without semicolons keep working; gzip does the rest.
+    html = re.sub(r"<!--.*?-->", "", html, flags=re.S)
+    html = re.sub(r"/\*.*?\*/", "", html, flags=re.S)
+    lines = []
+    for line in html.splitlines():
+        line = line.strip()
+        if not line or line.startswith("//"):
+            continue
+        lines.append(line)
+    return "\n".join(lines)
+
+
+def render(data, etag, source_length):
+    rows = []
+    for i in range(0, len(data), 16):
+        rows.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "\n".join([
+        "// Generated by scripts/embed_markup.py from %s, do not edit" % SOURCE.replace(os.sep, "/"),
+        "// %d bytes of html, %d bytes gzipped" % (source_length, len(data)),
+        "#ifndef MARKUP_GZ_H",
+        "#define MARKUP_GZ_H",
+        "",
+        "#include <stddef.h>",
+        "#include <stdint.h>",
+        "",
+        "#ifndef PROGMEM",
+        "#define PROGMEM",
+        "#endif",
+        "",
+        "#define MARKUP_ETAG \"\\\"%s\\\"\"" % etag,
+        "",
+        "static const size_t MARKUP_GZ_LENGTH = %d;" % len(data),
+        "static const uint8_t MARKUP_GZ[] PROGMEM = {",
+    ] + rows + [
+        "};",
+        "",
+        "#endif",
+        "",
+    ])
+
+
+def generate(project_dir, out_dir):
+    source = os.path.join(project_dir, SOURCE)
+    header = os.path.join(out_dir, HEADER)
+    # A change to this script changes the output as much as one to the page
+    newest = max(os.path.getmtime(source), os.path.getmtime(os.path.join(project_dir, SCRIPT)))
+    if os.path.exists(header) and os.path.getmtime(header) >= newest:
+        return header
+
+    with open(source, encoding="utf-8") as f:
+        html = f.read()
+    # mtime=0 keeps the output, and so the ETag, stable across builds
+    data = gzip.compress(minify(html).encode("utf-8"), compresslevel=9, mtime=0)
+    etag = hashlib.sha1(data).hexdigest()[:16]
+
+    os.makedirs(out_dir, exist_ok=True)
+    with open(header, "w") as f:
+        f.write(render(data, etag, len(html.encode("utf-8"))))
+    print("embed_markup: %s -> %s (%d -> %d bytes)" % (SOURCE, header, len(html), len(data)))
+    return header
+
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO)
+except NameError:
+    # Run directly: python scripts/embed_markup.py <out dir>
+    generate(os.getcwd(), sys.argv[1] if len(sys.argv) > 1 else ".")
+else:
+    out_dir = os.path.join(env.subst("$BUILD_DIR"), "generated")  # noqa: F821
+    generate(env.subst("$PROJECT_DIR"), out_dir)  # noqa: F821
+    env.Append(CPPPATH=[out_dir])  # noqa: F821
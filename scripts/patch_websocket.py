@@ -0,0 +1,74 @@
+# PlatformIO pre-build script: makes ESPAsyncWebServer raise
+# WS_EVT_DISCONNECT before a websocket client tears itself down.
+#
+#   extra_scripts = pre:scripts/patch_websocket.py
+#
+# In 1.2.3 ~AsyncWebSocketClient() frees the client's message and control
+# queues and only then raises the event. lib/WsClientTable clears the
+# client's slot in that event, under the lock its senders hold while they
+# queue a frame, so until the event returns another task can still be in
+# canSend() or text() on queues that are already gone. Moving the event to
+# the top of the destructor leaves nothing of the client freed before its
+# slot is.
+#
+# The library's AsyncWebSocket.cpp is patched in place in the libdeps
+# directory, so a reinstall is patched again on the next build. A
+# destructor that looks like neither the original nor the patched one
+# stops the build rather than leaving the race open.
+
+import glob
+import os
+import re
+import sys
+
+SOURCE = os.path.join("src", "AsyncWebSocket.cpp")
+LIBRARY = "ESP Async WebServer"
+
+DESTRUCTOR = re.compile(r"(AsyncWebSocketClient::~AsyncWebSocketClient\(\)\s*\{)(.*?)(\n\})", re.S)
+EVENT = re.compile(r"\n([ \t]*)_server->_handleEvent\(this, WS_EVT_DISCONNECT, NULL, NULL, 0\);")
+
+
+def patch_text(text):
+    # Returns the patched source, the same text if it is already patched or
+    # None if the destructor is not the one this was written against
+    destructor = DESTRUCTOR.search(text)
+    if destructor is None:
+        return None
+    body = destructor.group(2)
+    event = EVENT.search(body)
+    if event is None:
+        return None
+    if body[:event.start()].strip() == "":
+        return text
+    body = event.group(0) + body[:event.start()] + body[event.end():]
+    return text[:destructor.start(2)] + body + text[destructor.end(2):]
+
+
+def patch(path):
+    with open(path, encoding="utf-8") as f:
+        text = f.read()
+    patched = patch_text(text)
+    if patched is None:
+        return False
+    if patched != text:
+        with open(path, "w", encoding="utf-8") as f:
+            f.write(patched)
+        print("patch_websocket: WS_EVT_DISCONNECT raised first in %s" % path)
+    return True
+
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO)
+except NameError:
+    # Run directly: python scripts/patch_websocket.py <AsyncWebSocket.cpp>
+    if len(sys.argv) != 2 or not patch(sys.argv[1]):
+        sys.stderr.write("patch_websocket: no ~AsyncWebSocketClient() to patch\n")
+        sys.exit(1)
+else:
+    lib_deps = env.GetProjectOption("lib_deps", [])  # noqa: F821
+    if any(LIBRARY in dep for dep in lib_deps):
+        libdeps = env.subst("$PROJECT_LIBDEPS_DIR/$PIOENV")  # noqa: F821
+        sources = glob.glob(os.path.join(libdeps, "*", SOURCE))
+        if not sources or not all(patch(source) for source in sources):
+            sys.stderr.write("patch_websocket: cannot patch %s in %s, see scripts/patch_websocket.py\n" % (SOURCE, libdeps))
+            env.Exit(1)  # noqa: F821
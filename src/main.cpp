@@ -1,16 +1,69 @@
 #include <Arduino.h>
 #include <ESP32Servo.h>
 #include <WiFi.h>
-#include <WebServer.h>
-#include <WebSocketsServer.h>
+#include <Preferences.h>
+#include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
 #include <freertos/task.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+#include <TurretProtocol.h>
+#include <FireControl.h>
+#include <LX824Bus.h>
+#include <Trajectory.h>
+#include <TargetPredictor.h>
+#include <ScanPattern.h>
+#include <WiFiLink.h>
+#include <Snapshot.h>
+#include <WsClientTable.h>
+#include <TelemetryPublisher.h>
+#include <Metrics.h>
+#include <HeapGuard.h>
+#include "TurretState.h"
+#include "JsonArena.h"
+#include "TaskLayout.h"
+#include "LogMessages.h"
+#include "markup_gz.h" // generated from src/markup.html by scripts/embed_markup.py
+
+#ifndef FLYWHEEL_DSHOT
+#define FLYWHEEL_DSHOT 0 // 0 - PWM through Servo, 300 or 600 - DShot300/600 on the RMT peripheral
+#endif
+#ifndef FLYWHEEL_BIDIRECTIONAL
+#define FLYWHEEL_BIDIRECTIONAL 1 // DShot only: read RPM back, match the wheels and feed only at speed
+#endif
+#if FLYWHEEL_DSHOT
+#include <DShotEsc.h>
+#endif
 
 #define RX_PIN 16
 #define TX_PIN 17
 #define PAN_SERVO_ID 1
 #define TILT_SERVO_ID 2
 #define BAUD_RATE 115200
+#define SERVO_MAX_ACCELERATION 4000 // position units/s^2
+#define SERVO_MIN_VELOCITY 50 // position units/s, floor for motor_speed (the max velocity) so 0 still moves
+#define SERVO_MAX_POSITION 1000 // LX-824 positions run 0-1000
+#define SERVO_FEEDBACK_HZ 25 // position readback rate, temperature/voltage every 10th poll
+#define CAMERA_SETTLE_MS 500 // camera servos reaching centre after power up
+#define LOADER_SETTLE_MS 1000 // loader servo reaching rest after power up
+#define DSHOT_ARM_MS 1500 // stop frames before DShot ESCs accept throttle
+#define DSHOT_FRAME_US 1000 // DShot frame period, the ESCs disarm if frames stop
+#define FLYWHEEL_POLES 14 // motor magnets, eRPM to RPM
+#define FLYWHEEL_MAX_RPM 30000 // RPM held at flywheel_speed 180, proportionally less below
+#define FLYWHEEL_RPM_TOLERANCE 5 // percent under target that still counts as at speed
+#define BOOT_REPORT_TIMEOUT_MS 30000
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 2000 // attempt on the cached BSSID and channel before scanning
+#define WIFI_CONNECT_TIMEOUT_MS 10000 // attempt with a full scan
+#define WIFI_RETRY_MIN_MS 500 // backoff between failed scans, doubles up to WIFI_RETRY_MAX_MS
+#define WIFI_RETRY_MAX_MS 8000
+#ifndef WIFI_STATIC_IP
+#define WIFI_STATIC_IP 0 // 1 - reuse the cached DHCP lease as a static address and skip DHCP
+#endif
+#define WS_MAX_CLIENTS TELEMETRY_MAX_CLIENTS // websocket connections, one telemetry slot each
+#define HTTP_MAX_REQUESTS 4 // HTTP requests in flight, more get a 503
+#define COMMAND_QUEUE_LENGTH 8 // websocket messages waiting for commandTask
 #define ONBOARDLED 2
 #define leftEscPin 23
 #define rightEscPin 22
@@ -22,31 +75,65 @@ const char *ssid PROGMEM = "Jedi Council";
 const char *password PROGMEM = "JTISPCCO";
 const char *controllerAddress PROGMEM= "58:10:31:76:B0:CC";
 
-// Web server and websocket
-WebServer server(80);
-WebSocketsServer webSocket(81);
+// Web server and websocket share one listener on port 80, the websocket
+// lives at /ws. AsyncTCP runs the callbacks on its own task (core 0, see
+// platformio.ini) as soon as lwIP has data, so nothing polls.
+AsyncWebServer server(80);
+AsyncWebSocket webSocket("/ws");
+
+// Websocket traffic for commandTask. The callbacks copy each message in and
+// return; a full queue refuses the message with {"busy":1} rather than
+// stalling the network stack. Connects and disconnects always get through,
+// commands only while more than INBOUND_RESERVE slots are free.
+enum InboundType : uint8_t
+{
+    INBOUND_CONNECT,
+    INBOUND_DISCONNECT,
+    INBOUND_TEXT,
+    INBOUND_BINARY
+};
+struct InboundMessage
+{
+    uint8_t type;
+    uint8_t slot; // wsClients slot
+    uint16_t length;
+    uint32_t receivedUs; // micros() when the callback ran
+    char data[COMMAND_MAX_LENGTH + 1];
+};
+#define INBOUND_RESERVE (2 * WS_MAX_CLIENTS)
+QueueHandle_t inboundQueue;
+WsClientTable<AsyncWebSocketClient, WS_MAX_CLIENTS> wsClients; // filled by the websocket callbacks
+volatile uint32_t inboundRejected = 0; // messages refused as too long or for a full queue
+volatile uint32_t clientsRefused = 0; // connections over WS_MAX_CLIENTS or HTTP_MAX_REQUESTS
+uint8_t httpInFlight = 0; // AsyncTCP task only
+JsonArena<JSON_ARENA_SIZE> commandArena; // commandTask only
 
 // Servo objects
 Servo panServo;
 Servo tiltServo;
+#if FLYWHEEL_DSHOT
+DShotEsc leftFlywheel;
+DShotEsc rightFlywheel;
+DShotEsc *const flywheels[] = {&leftFlywheel, &rightFlywheel};
+#else
 Servo leftFlywheel;
 Servo rightFlywheel;
+#endif
 Servo fireServo;
 Servo cameraServoPan;
 Servo cameraServoTilt;
 
 // Shared variables
-volatile uint16_t currentPan = 500;
-volatile uint16_t currentTilt = 400;
-volatile boolean fireMode = 0;
-volatile uint16_t motorSpeed = 1000;
-volatile uint8_t flywheelSpeed = 60;
-volatile bool fireCommand = false;
+// Commanded state, published by the websocket handler and read by the
+// control tasks as consistent snapshots (see TurretState.h)
+Snapshot<TurretCommand> commandState;
+TurretCommand pendingCommand; // handler's working copy, commandTask only
+Snapshot<TrackObservation> trackState;
+TrackObservation pendingTrack; // commandTask only
+
+// Status, each written by the task that owns it
 volatile uint8_t flywheelStatus = 0; // 0 -initialising, 1 - ready, 2 - busy - 3 - error
 volatile uint8_t motorStatus = 0; // 0 - ready, 1 - busy - 2 - error
-volatile uint8_t cameraPan = 90;
-volatile uint8_t cameraTilt = 90;
-volatile uint8_t mode = 2; // 0 - manual, 1 - sweap, 2 - auto
 volatile uint8_t cameraStatus = 0; // 0 - ready, 1 - busy - 2 - error
 
 // Constants
@@ -54,26 +141,145 @@ uint8_t BULLET_COUNT = 7;
 uint8_t MAX_LOADER_VAL = 50; 
 uint8_t MIN_LOADER_VAL = 0;
 
+// Last binary frame sequence seen from each websocket client, used to drop
+// frames that arrive out of order
+uint16_t lastFrameSeq[WS_MAX_CLIENTS];
+bool frameSeqValid[WS_MAX_CLIENTS];
+uint32_t lastFrameTimestamp = 0;
+
+// Motion control loop statistics
+volatile uint32_t controlLoopJitterUs = 0; // worst period error since the last telemetry poll
+volatile uint32_t controlLoopMaxJitterUs = 0; // worst period error since boot
+volatile uint32_t controlLoopOverruns = 0; // ticks that started after their deadline
+
+// Target prediction in auto mode, run by servoControlTask
+volatile uint8_t predictorState = PREDICTOR_IDLE;
+volatile uint16_t predictorResidual = 0; // RMS innovation, position units
+
+// Per-client delta telemetry, polled by telemetryTask
+TelemetryPublisher telemetry;
+
+// Fire sequencing, driven by flywheelControlTask
+FireControl fireControl;
+
 // UART2 for serial communication
 HardwareSerial SerialUART(2);
 
+// LX-824 bus, owned by uartCommunicationTask
+LX824Bus servoBus;
+LX824Parser servoParser;
+LX824RxRing<256> servoRxRing;
+
+// Boot. Every subsystem comes up in its own task and sets its bit when it
+// is usable; setup() waits for all of them and logs the breakdown.
+enum BootStage : uint8_t
+{
+    BOOT_WIFI,     // associated and addressed
+    BOOT_CAMERA,   // camera servos centred
+    BOOT_FLYWHEEL, // ESCs armed and loader at rest
+    BOOT_STAGE_COUNT
+};
+#define BOOT_ALL_READY ((1 << BOOT_STAGE_COUNT) - 1)
+const char *const BOOT_STAGE_NAMES[BOOT_STAGE_COUNT] = {"wifi", "camera", "flywheel"};
+EventGroupHandle_t bootEvents;
+volatile uint32_t bootStageMs[BOOT_STAGE_COUNT]; // millis() when each stage became ready, 0 - not yet
+volatile uint32_t bootReadyMs = 0; // all stages
+
+// WiFi link, managed by wifiTask. The event handler only counts what
+// happened and wakes the task. The last good BSSID, channel and lease are
+// kept in NVS so the next association skips the scan.
+struct WiFiCache
+{
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+volatile uint32_t wifiAddressed = 0; // GOT_IP events
+volatile uint32_t wifiDropped = 0; // disconnects not caused by us
+volatile uint8_t wifiDropReason = 0;
+volatile uint32_t wifiReconnects = 0;
+
+TaskHandle_t taskHandles[TASK_COUNT];
+
+// Instrumentation, served on /metrics and as a websocket dump. Spans within
+// one task are timed with the cycle counter, spans across tasks with
+// micros().
+#define CPU_MHZ (F_CPU / 1000000)
+MetricsTaskLoad taskLoad[TASK_COUNT];
+MetricsHistogram receiveToDispatch("receive_to_dispatch_us"); // websocket callback to commandState.publish
+MetricsHistogram publishToMove("publish_to_move_us");    // publish to the first moveServo for it
+MetricsHistogram fireToFeed("fire_to_feed_us");          // fire publish to the loader feeding
+MetricsHistogram telemetryBuild("telemetry_build_us");   // one telemetry poll minus socket sends
+MetricsHistogram controlJitter("control_jitter_us");     // servo loop period error, every tick
+MetricsHistogram *const histograms[] = {&receiveToDispatch, &publishToMove, &fireToFeed, &telemetryBuild, &controlJitter};
+char metricsReport[METRICS_REPORT_SIZE]; // under metricsLock, /metrics and commandTask both fill it
+SemaphoreHandle_t metricsLock;
+MetricsWindow scrapeWindow;                  // /metrics, under metricsLock
+MetricsWindow clientWindows[WS_MAX_CLIENTS]; // websocket dumps, commandTask only
+uint32_t metricsRecordCycles = 0;            // measured at boot
+uint32_t metricsLoadCycles = 0;
+static_assert(TASK_COUNT <= METRICS_MAX_TASKS, "raise METRICS_MAX_TASKS");
+uint32_t messageReceivedUs = 0; // commandTask only
+uint32_t telemetrySendCycles = 0; // telemetryTask only
+
 // Function prototypes
-void handleWebSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length);
-void setupWiFi();
+void handleWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t length);
+bool queueInbound(uint8_t type, uint8_t slot, const uint8_t *data, size_t length, uint32_t receivedUs);
+void handleTextCommand(uint8_t num, char *payload, size_t length);
+void handleBinaryCommand(uint8_t num, uint8_t *payload, size_t length);
+void publishCommand(const TurretCommand &command);
+void publishTrack(uint16_t pan, uint16_t tilt, uint32_t sourceMs, bool timed);
+void handleSubscribe(uint8_t num, JsonVariant subscription);
+void wakeTelemetryTask();
+bool sendTelemetry(uint8_t client, const char *frame, size_t length, void *context);
+void bootStageReady(BootStage stage);
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+void connectWiFi(const WiFiCache &cache, bool fast);
 void setupWebServer();
+bool admitRequest(AsyncWebServerRequest *request);
+void handleRoot(AsyncWebServerRequest *request);
+void handleMetrics(AsyncWebServerRequest *request);
+void sendMetrics(uint8_t num);
+size_t collectMetrics(bool prometheus, MetricsWindow &window);
+void measureMetricsOverhead();
 void moveServo(uint8_t id, uint16_t position, uint16_t speed);
-void setupFlywheel();
+void armFlywheels();
+void writeFlywheels(uint8_t speed);
+uint32_t flywheelTargetRpm(uint8_t speed);
+bool flywheelsAtSpeed(uint8_t speed);
 void enterLowPowerMode();
-void setupCamera();
-int getServoPosition(uint8_t id);
+void onServoBusReceive();
+void writeServoBus(const uint8_t *data, size_t length, void *context);
+void writeLogRecord(const LogRecord &record);
 
 // Tasks
-void webServerTask(void *pvParameters);
+void commandTask(void *pvParameters);
 void servoControlTask(void *pvParameters);
 void flywheelControlTask(void *pvParameters);
 void uartCommunicationTask(void *pvParameters);
 void telemetryTask(void *pvParameters);
 void cameraControlTask(void *pvParameters);
+void wifiTask(void *pvParameters);
+void logTask(void *pvParameters);
+
+// Task layout, see TaskLayout.h
+struct TaskSpec
+{
+    TaskFunction_t function;
+    const char *name;
+    uint32_t stackBytes;
+    UBaseType_t priority;
+    BaseType_t core;
+    uint16_t periodMs;
+};
+
+#define TASK_TABLE_SPEC(id, function, name, stack, priority, core, period) {function, name, stack, priority, core, period},
+const TaskSpec TASKS[TASK_COUNT] = {TASK_TABLE(TASK_TABLE_SPEC)};
+#undef TASK_TABLE_SPEC
+
 void setup()
 {
     Serial.begin(115200);
@@ -81,22 +287,62 @@ void setup()
 
     // Initialize UART2
     SerialUART.begin(BAUD_RATE, SERIAL_8N1, RX_PIN, TX_PIN);
+    servoBus.begin(writeServoBus, NULL);
+    servoBus.addServo(PAN_SERVO_ID);
+    servoBus.addServo(TILT_SERVO_ID);
+    servoBus.setPollPeriod(1000000UL / SERVO_FEEDBACK_HZ);
+    SerialUART.onReceive(onServoBusReceive);
 
-    // Initialize WiFi and web server
-    setupWiFi();
+    // The network stack has to be up before the server binds, association
+    // itself happens in wifiTask
+    bootEvents = xEventGroupCreate();
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
+    WiFi.mode(WIFI_STA);
+    WiFi.onEvent(onWiFiEvent);
     setupWebServer();
-    setupFlywheel();
-    Serial.println("bluetooth control Ready.");
+    measureMetricsOverhead();
+
+    // ESC arming, camera centring and association all take a while, each
+    // runs in its own task
+    for (uint8_t i = 0; i < TASK_COUNT; i++)
+    {
+        const TaskSpec &task = TASKS[i];
+        taskLoad[i].name = task.name;
+        xTaskCreatePinnedToCore(task.function, task.name, task.stackBytes, NULL, task.priority, &taskHandles[i], task.core);
+    }
+
+    // loopTask has nothing else to do, report how long boot took
+    EventBits_t ready = xEventGroupWaitBits(bootEvents, BOOT_ALL_READY, pdFALSE, pdTRUE, pdMS_TO_TICKS(BOOT_REPORT_TIMEOUT_MS));
+    if (ready == BOOT_ALL_READY)
+    {
+        bootReadyMs = millis();
+    }
+    Serial.printf("Boot %s after %lu ms:", ready == BOOT_ALL_READY ? "ready" : "incomplete", millis());
+    for (uint8_t i = 0; i < BOOT_STAGE_COUNT; i++)
+    {
+        if (bootStageMs[i] != 0)
+        {
+            Serial.printf(" %s %lu ms", BOOT_STAGE_NAMES[i], (unsigned long)bootStageMs[i]);
+        }
+        else
+        {
+            Serial.printf(" %s pending", BOOT_STAGE_NAMES[i]);
+        }
+    }
+    Serial.println();
 
-    // Initialize the camera servos in setup()
-    setupCamera();
-    // Create FreeRTOS tasks
-    xTaskCreate(webServerTask, "WebServerTask", 4096, NULL, 1, NULL);
-    xTaskCreate(servoControlTask, "ServoControlTask", 2048, NULL, 1, NULL);
-    xTaskCreate(flywheelControlTask, "FlywheelControlTask", 2048, NULL, 1, NULL);
-    xTaskCreate(uartCommunicationTask, "UARTCommunicationTask", 2048, NULL, 1, NULL);
-    xTaskCreate(telemetryTask, "TelemetryTask", 2048, NULL, 1, NULL);
-    xTaskCreate(cameraControlTask, "CameraControlTask", 2048, NULL, 1, NULL);
+    // From here on the task loops must not allocate
+    heapGuardArm();
+}
+
+void bootStageReady(BootStage stage)
+{
+    if (bootStageMs[stage] == 0)
+    {
+        bootStageMs[stage] = millis();
+        xEventGroupSetBits(bootEvents, 1 << stage);
+    }
 }
 
 void loop()
@@ -106,152 +352,516 @@ void loop()
     // enterLowPowerMode();
 }
 
-void initFireServo(){
-  fireServo.attach(fireServoPin, 500, 2500);
-  fireServo.write(0);
-  delay(1000);
-  fireServo.detach();
-}
-
-void fireSemi(){
-  fireServo.write(80);
-  delay(300);
-  fireServo.write(0);
-  BULLET_COUNT--;
-  delay(400);
-}
-void fireBurst(){
-  for(int i = 0; i < 3; i++){
-    fireServo.write(50);
-    delay(500);
-    fireServo.write(0);
-    BULLET_COUNT--;
-    delay(500);
-  }
-}
-void fireAuto(){
-  for(int i = 0; i < 7; i++){
-    fireServo.write(50);
-    delay(500);
-    fireServo.write(0);
-    BULLET_COUNT--;
-    delay(500);
-  }
+// Runs in the Arduino event task
+void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+    {
+        wifiAddressed++;
+    }
+    else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED)
+    {
+        // Our own disconnect before a retry is not news
+        if (info.wifi_sta_disconnected.reason == WIFI_REASON_ASSOC_LEAVE)
+        {
+            return;
+        }
+        wifiDropReason = info.wifi_sta_disconnected.reason;
+        wifiDropped++;
+    }
+    else
+    {
+        return;
+    }
+    if (taskHandles[TASK_WIFI] != NULL)
+    {
+        xTaskNotifyGive(taskHandles[TASK_WIFI]);
+    }
 }
-void fire(){
-  fireServo.attach(fireServoPin, 500, 2500);
-  flywheelStatus = 2;
-  leftFlywheel.write(flywheelSpeed);
-  rightFlywheel.write(flywheelSpeed);
-  delay(1000);
-    switch(fireMode){
-    case 0:
-      fireSemi();
-      break;
-    case 1:
-      fireBurst();
-      break;
-    case 2:
-      fireAuto();
-      break;
-  }
-   leftFlywheel.write(0);
-  rightFlywheel.write(0);
-  fireCommand = false;
-  flywheelStatus = 1;
-  fireServo.detach();
 
-}
-void setupWiFi()
+// Starts an association and returns straight away. A fast attempt goes to
+// the cached access point on its channel, without scanning.
+void connectWiFi(const WiFiCache &cache, bool fast)
 {
-    WiFi.begin(ssid, password);
-    Serial.print("Connecting to WiFi");
-    while (WiFi.status() != WL_CONNECTED)
+    WiFi.disconnect();
+#if WIFI_STATIC_IP
+    if (fast)
+    {
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    }
+    else
+    {
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
+#endif
+    if (fast)
+    {
+        WiFi.begin(ssid, password, cache.channel, cache.bssid);
+    }
+    else
     {
-        delay(1000);
-        Serial.print(".");
+        WiFi.begin(ssid, password);
     }
-    Serial.println("Connected!");
-    Serial.println("IP Address: " + WiFi.localIP().toString());
 }
-void setupFlywheel()
+
+// The original arming sequence for PWM ESCs: low, high, low. DShot ESCs
+// only need a stream of stop frames. It only blocks the fire task,
+// triggers that arrive meanwhile are dropped.
+void armFlywheels()
 {
     flywheelStatus = 0;
+#if FLYWHEEL_DSHOT
+    bool started = leftFlywheel.begin(leftEscPin, RMT_CHANNEL_4, RMT_CHANNEL_5, (DShotRate)FLYWHEEL_DSHOT, FLYWHEEL_BIDIRECTIONAL, FLYWHEEL_POLES) &&
+                   rightFlywheel.begin(rightEscPin, RMT_CHANNEL_6, RMT_CHANNEL_7, (DShotRate)FLYWHEEL_DSHOT, FLYWHEEL_BIDIRECTIONAL, FLYWHEEL_POLES) &&
+                   dshotStart(flywheels, 2, DSHOT_FRAME_US);
+
+    fireServo.attach(fireServoPin, 500, 2500);
+    fireServo.write(0);
+    vTaskDelay(pdMS_TO_TICKS(LOADER_SETTLE_MS));
+    fireServo.detach();
+    vTaskDelay(pdMS_TO_TICKS(DSHOT_ARM_MS - LOADER_SETTLE_MS));
+    flywheelStatus = started ? 1 : 3;
+#else
     leftFlywheel.attach(leftEscPin, 1000, 2500);
     rightFlywheel.attach(rightEscPin, 1000, 2500);
-    
-    Serial.println("Initialising flywheels...");
-    leftFlywheel.write(5); // initialise the esc signal to low level
-    rightFlywheel.write(5); // initialise the esc signal to low level
-    delay(2000); // wait for 2 second
-    leftFlywheel.write(60); // then set it to high level
-    rightFlywheel.write(60); // then set it to high level
-    delay(2000); // then wait again for 2 second
-    leftFlywheel.write(0); // then set it back again to low level
-    rightFlywheel.write(0); // then set it back again to low level
-    delay(1000);// then wait again for 1 second
+
+    // The loader settles at rest while the ESCs see a low signal
+    fireServo.attach(fireServoPin, 500, 2500);
+    fireServo.write(0);
+    leftFlywheel.write(5);
+    rightFlywheel.write(5);
+    vTaskDelay(pdMS_TO_TICKS(LOADER_SETTLE_MS));
+    fireServo.detach();
+    vTaskDelay(pdMS_TO_TICKS(2000 - LOADER_SETTLE_MS));
+
+    leftFlywheel.write(60);
+    rightFlywheel.write(60);
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    leftFlywheel.write(0);
+    rightFlywheel.write(0);
+    vTaskDelay(pdMS_TO_TICKS(1000));
     flywheelStatus = 1;
-    Serial.println("Flywheels ready");
-}
-void setupCamera() {
-  cameraServoPan.attach(cameraServoPanPin, 500, 2500);
-  cameraServoTilt.attach(cameraServoTiltPin, 500, 2500);
-  cameraServoPan.setPeriodHertz(50);
-  cameraServoTilt.setPeriodHertz(50);
-  cameraServoPan.write(90);
-  cameraServoTilt.write(90);
-  delay(500);
-  Serial.println("Camera ready");
+#endif
 }
+
+// Both wheels at a 0-180 speed. With RPM feedback each ESC also trims its
+// throttle to hold flywheelTargetRpm, which keeps the pair matched.
+void writeFlywheels(uint8_t speed)
+{
+#if FLYWHEEL_DSHOT
+    uint16_t throttle = dshotThrottle(speed);
+    leftFlywheel.setThrottle(throttle, flywheelTargetRpm(speed));
+    rightFlywheel.setThrottle(throttle, flywheelTargetRpm(speed));
+#else
+    leftFlywheel.write(speed);
+    rightFlywheel.write(speed);
+#endif
+}
+
+// 0 without RPM feedback
+uint32_t flywheelTargetRpm(uint8_t speed)
+{
+#if FLYWHEEL_DSHOT && FLYWHEEL_BIDIRECTIONAL
+    return (uint32_t)FLYWHEEL_MAX_RPM * (speed > 180 ? 180 : speed) / 180;
+#else
+    return 0;
+#endif
+}
+
+// Both wheels within FLYWHEEL_RPM_TOLERANCE of the target, or no feedback
+// to tell
+bool flywheelsAtSpeed(uint8_t speed)
+{
+#if FLYWHEEL_DSHOT && FLYWHEEL_BIDIRECTIONAL
+    uint32_t least = flywheelTargetRpm(speed) * (100 - FLYWHEEL_RPM_TOLERANCE) / 100;
+    return leftFlywheel.rpm() >= least && rightFlywheel.rpm() >= least;
+#else
+    return true;
+#endif
+}
+
 void setupWebServer()
 {
-    server.on("/", []() {
-      String html PROGMEM = "<!DOCTYPE html><html><head> <title>Auto Sentry</title> <style> html { font-family: Arial, sans-serif; font-size: 16px; color: #333; width: 100%; height: 100%; } body { height: 100vh; width: 100%; margin: 0; background-color: #2d2d2d; } .container { padding: 20px; display: flex; flex-direction: column; align-items: center; width: 100%; height: 100%; } .turret-container { width: 200px; height: 200px; position: relative; } .turret { width: 100%; height: 100%; animation: rotate 5s linear infinite backwards; transition: all 0.5s ease; animation-direction: alternate; } .turret_manual { width: 100%; height: 100%; transition: all 0.s linear; } @keyframes rotate { from { transform: rotate(180deg); } to { transform: rotate(360deg); } } .header { width: 100%; height: 100px; background-color: #f1f1f1; border-radius: 5px; margin-top: 10px; position: relative; padding: 0 20px; } .wrapper { display: flex; justify-content: space-evenly; width: 100%; padding: 60px; height: 100%; } .half { width: 50%; height: 100%; padding: 0px 15px } .first { display: flex; flex-direction: column; align-items: center; } .tracker { width: 100%; min-height: 400px; background-color: #f1f1f1; border: 1px solid #5a5353; border-radius: 5px; position: relative; height: 50%; overflow: hidden; margin-bottom: 20px; } .tracker:hover { cursor: grab; } #setPosition { width: 100%; } .sliderWrap { display: flex; justify-content: space-evenly; width: 100%; margin-top: 10px; } .slider { transition: all 0.5s; } .modeSelector { margin-bottom: 50px; } .toggles { display: flex; justify-content: space-evenly; width: 100%; margin-top: 50px; } .hidden { display: none; } .line { position: absolute; background-color: #000; } .horizontal { top: 50%; left: 0; transform: translateY(-50%); width: 100%; height: 1px; } .vertical { left: 50%; top: 0; transform: translateX(-50%); width: 1px; height: 100%; } .button { border: none; color: white; padding: 15px 32px; text-align: center; text-decoration: none; display: block; font-size: 16px; cursor: pointer; width: 80%; height: 40%; margin: 0 auto; font-size: 2rem; } .controls { display: grid; grid-template-columns: auto auto auto; grid-template-rows: auto auto; grid-gap: 10px; background-color: #A07178; width: 100%; min-height: 300px; height: 50%; } .control-btn { width: 100%; height: 100%; display: flex; justify-content: center; align-items: center; } .green { background-color: #7AE7C7; } .orange { background-color: #FFA500; } .red { background-color: #FF0000; } .purple { background-color: #7D387D; } .blue { background-color: #2BD9FE; } .yellow { background-color: #E1D89F; } .pink { background-color: #FF0F80; } .black-text { color: black; } .telemetry { width: 100%; margin-bottom: 50px; } .telemetry .content { display: flex; } .telemetry .title { font-size: 2em; font-weight: bold; padding: 35px 20px; background-color: lightgray; color: black; } .dataItem { display: flex; font-size: 2rem; width: 50%; } .dataItem .label { padding: 35px 10px; text-align: center; color: white; } .dataItem .value { padding: 35px 10px; text-align: left; } .control-tabs { display: flex; width: 100%; background-color: gray; color: white; } .nav-btn { border: none; text-align: center; text-decoration: none; display: block; font-size: 16px; cursor: pointer; padding: 35px 20px; } .fireBtn { border: none; color: white; padding: 15px 32px; text-align: center; text-decoration: none; display: block; font-size: 16px; cursor: pointer; width: auto; height: 40%; margin: 0 auto; font-size: 2rem; background-color: #FF0000; } .fire_selector.selected { border: 3px solid #7AE7C7; } .speed-selector.selected { background-color: #7AE7C7; } /* media queries for mobile */ @media only screen and (max-width: 768px) { .half { width: 100%; } .wrapper { flex-direction: column; } .dataItem, .telemetry .title { font-size: 1rem; } .button { font-size: 1rem; } } .tracker-indicator { display: flex; justify-content: end; align-items: center; width: 100%; } .indicator { width: 20px; height: 20px; border-radius: 50%; background-color: red; } .tracker-indicator p { margin-right: 20px; } </style></head><body style='background-color: #EEEEEE;'> <div class='header'> <div class='turret-container'> <svg class='turret' xmlns='http://www.w3.org/2000/svg' viewBox='0 0 100 100'> <!-- Base of the turret --> <circle cx='50' cy='50' r='20' fill='#ff9c07' /> <!-- Gun of the turret --> <rect x='20' y='45' width='20' height='5' fill='#ff9c07' /> </svg> </div> </div> <div class='container'> <div class='wrapper'> <div class='half first'> <div class='tracker-indicator'> <p>Double click to activate/deactivate tracker</p> <div class='indicator'></div> </div> <div class='tracker'> <div class='line horizontal'></div> <div class='line vertical'></div> </div> <div class='controls'> <div class='control-btn'> <button class='button purple fire_selector selected' id='semi'> Semi </button> </div> <div class='control-btn'> <button class='button orange fire_selector' id='burst'> Burst </button> </div> <div class='control-btn'> <button class='button red fire_selector' id='auto'> Auto </button> </div> <div class='control-btn black-text'> <button class='button black-text speed-selector selected' id='>'> > </button> </div> <div class='control-btn '> <button class='button black-text speed-selector' id='>>'> >> </button> </div> <div class='control-btn'> <button class='button black-text speed-selector' id='>>>'> >>> </button> </div> </div> </div> <div class='half second'> <div class='control-tabs'> <button id='home' class='nav-btn'> Home </button> <button id='settings' class='nav-btn'> Settings </button> </div> <div class='operation'> <div class='telemetry'> <div class='title'> Position </div> <div class='content'> <div class='dataItem'> <div class='label pink' id='positionXAxisLabel'> X axis: </div> <div class='value' id='positionXAxisValue'> N/A </div> </div> <div class='dataItem'> <div class='label pink' id='positionYAxisLabel'> Y axis: </div> <div class='value' id='positionYAxisValue'> N/A </div> </div> <div class='dataItem'> <div class='label pink' id='motorSpeedLabel'> Speed: </div> <div class='value' id='motorSpeedValue'> N/A </div> </div> </div> </div> <div class='telemetry'> <div class='title'> Magazines </div> <div class='content'> <div class='dataItem'> <div class='label blue' id='flywheelSpeedLabel'> FW </div> <div class='value' id='flywheelSpeedValue'> N/A </div> </div> <div class='dataItem'> <div class='label blue' id='magCountLabel'> Mag </div> <div class='value' id='magCountValue'> N/A </div> </div> <div class='dataItem'> <div class='label blue'> Bat </div> <div class='value'> N/A% </div> </div> </div> </div> <div class='telemetry'> <div class='title'> Status </div> <div class='content'> <div class='dataItem'> <div class='label yellow' id='motorStatusLabel'> Motors </div> <div class='value' id='motorStatusValue'> connecting... </div> </div> <div class='dataItem'> <div class='label yellow' id='flywheelStatustLabel'> Flywheel </div> <div class='value' id='flywheelStatusValue'> connecting... </div> </div> <div class='dataItem'> <div class='label yellow'> reset </div> <div class='value'> <button class='button black-text' id='reset'> Reset </button> </div> </div> </div> </div> <button class='button fireBtn'>Fire</button> </div> <div class='telemetry-wrap hidden'> <div class='telemetry'> <div class='title'> Flywheel Speed 0 - 180 RPM </div> <div class='content'> <div class='dataItem'> <div class='label pink'> Speed: </div> <div class='value'> N/A </div> </div> <div class='dataItem'> <div class='label pink'> Speed: </div> <div class='value'> N/A </div> </div> <div class='dataItem'> <div class='label pink'> Speed: </div> <div class='value'> N/A </div> </div> </div> </div> <div class='telemetry'> <div class='title'> Auto Speed (m/s) & Burst Number </div> <div class='content'> <div class='dataItem'> <div class='label purple'> Speed: </div> <div class='value'> 0 </div> </div> <div class='dataItem'> <div class='label purple'> Burst: </div> <div class='value'> 3 </div> </div> </div> </div> <div class='telemetry'> <div class='title'> Axis Servo Speed </div> <div class='content'> <div class='dataItem'> <div class='label blue'> X axis: </div> <div class='value'> 1000 </div> </div> <div class='dataItem'> <div class='label blue'> Y axis: </div> <div class='value'> 800 </div> </div> </div> </div> <div class='telemetry'> <div class='title'> Rotation Limit </div> <div class='content'> <div class='dataItem'> <div class='label yellow'> X axis: </div> <div class='value'> 800 </div> </div> <div class='dataItem'> <div class='label yellow'> Y axis: </div> <div class='value'> 75 </div> </div> </div> </div> </div> </div> </div></body><script> var Socket; var x = 500; var y = 500; var xPercent; var yPercent; let message = { mode: 0, x: x, y: y, motor_speed: 500, fire_mode: 0, flywheel_speed: 60, fire: 0, reset: 0, }; function getFlywheelStatusFromValue(value) { switch (value) { case 0: return 'initialising'; case 1: return 'ready'; case 2: return 'busy'; case 3: return 'error'; } }; function getMotorStatusFromValue(value) { switch (value) { case 0: return 'ready'; case 1: return 'busy'; case 2: return 'error'; } }; function init() { Socket = new WebSocket('ws://' + window.location.hostname + ':81/'); Socket.onmessage = function (event) { processCommand(event); }; Socket.addEventListener('open', function (event) { console.log('Connected to ESP32'); document.getElementById('motorStatusValue').innerText = 'ready'; document.getElementById('flywheelStatusValue').innerText = getFlywheelStatusFromValue(0); }); Socket.addEventListener('error', function (event) { console.log('Error connecting to ESP32'); console.log(event); ocument.getElementById('flywheelStatusValue').innerText = getFlywheelStatusFromValue(3); }); }; function processCommand(event) { var obj = JSON.parse(event.data); document.getElementById('positionXAxisValue').innerText = obj.pan; document.getElementById('positionYAxisValue').innerText = obj.tilt; document.getElementById('flywheelSpeedValue').innerText = obj.flywheel_speed; document.getElementById('flywheelStatusValue').innerText = getFlywheelStatusFromValue(obj.flywheelStatus); document.getElementById('motorSpeedValue').innerText = obj.motor_speed; document.getElementById('magCountValue').innerText = obj.magCountValue + '/7'; document.getElementById('motorStatusValue').innerText = getMotorStatusFromValue(obj.motorStatus); x = obj.pan; y = obj.tilt; }; window.onload = function (event) { init(); }; function resetMessage() { const prevX = x; const prevY = y; prevFWSpeed = message.flywheel_speed; message = {}; message.mode = 0; message.x = prevX; message.y = prevY; message.flywheel_speed = prevFWSpeed; }; function sendData() { console.log('Sending data to ESP32'); console.log({ message }); const data = { mode: message.mode, pan: message.x, tilt: message.y, motor_speed: message.motor_speed, fire_mode: message.fire_mode, flywheel_speed: message.flywheel_speed, fire: message.fire, reset: message.reset, }; if (Socket && Socket.readyState === 1) { Socket.send(JSON.stringify(data)); }; resetMessage(); }; document.getElementById('reset').addEventListener('click', function (event) { message.reset = 1; sendData(); }); let eventCount = 0; var tracker = document.querySelector('.tracker'); var trackerActive = false; tracker.addEventListener('mousemove', function (event) { if (!trackerActive) { return; } var rawX = event.clientX - tracker.getBoundingClientRect().left; var rawY = event.clientY - tracker.getBoundingClientRect().top; xPercent = Math.round(rawX / tracker.offsetWidth * 100); yPercent = Math.round(rawY / tracker.offsetHeight * 100); x = 1000 - (xPercent / 100 * 1000); y = 1000 - (yPercent / 100 * 1000); console.log(x, y); message.x = x; message.y = y; if (eventCount % 50 === 0 && Socket.readyState === 1) { sendData(); document.getElementById('positionXAxisValue').innerText = x; document.getElementById('positionYAxisValue').innerText = y; } eventCount++; }); tracker.addEventListener('dblclick', function (event) { trackerActive = !trackerActive; if (trackerActive) { document.querySelector('.indicator').style.backgroundColor = 'green'; } else { document.querySelector('.indicator').style.backgroundColor = 'red'; } }); tracker.addEventListener('click', function (event) { if (!trackerActive) { return; } message.fire = 1; sendData(); }); var navBtn = document.querySelectorAll('.nav-btn'); navBtn.forEach(function (btn) { btn.addEventListener('click', function (event) { var id = event.target.id; if (id === 'home') { document.querySelector('.telemetry-wrap').classList.add('hidden'); document.querySelector('.operation').classList.remove('hidden'); } else if (id === 'settings') { document.querySelector('.operation').classList.add('hidden'); document.querySelector('.telemetry-wrap').classList.remove('hidden'); } }); }); var speed_selectors = document.querySelectorAll('.speed-selector'); speed_selectors.forEach(function (selector) { selector.addEventListener('click', function (event) { var id = event.target.id; if (id === '>') { message.flywheel_speed = 60; } else if (id === '>>') { message.flywheel_speed = 90; } else if (id === '>>>') { message.flywheel_speed = 180; } sendData(); document.querySelector('.speed-selector.selected').classList.remove('selected'); event.target.classList.add('selected'); }); }); var fire_selectors = document.querySelectorAll('.fire_selector'); fire_selectors.forEach(function (selector) { selector.addEventListener('click', function (event) { var id = event.target.id; if (id === 'semi') { message.fire_mode = 0; } else if (id === 'burst') { message.fire_mode = 1; } else if (id === 'auto') { message.fire_mode = 2; } sendData(); document.querySelector('.fire_selector.selected').classList.remove('selected'); event.target.classList.add('selected'); }); }); document.querySelector('.fireBtn').addEventListener('click', function (event) { message.fire = 1; sendData(); }); function setLaser(event) { message.laser = Number(event.target.value); sendData(); }; function setSpeed(event) { message.speed = Number(event.target.value); sendData(); }; function setMode(event) { message.mode = Number(event.target.value); sendData(); }; function reverseNumber(num) { sign = num < 0 ? '-' : ''; num = Math.abs(num) + ''; return Number(sign + num.split('').reverse().join('')); }; function map_range(value, low1, high1, low2, high2) { return low2 + (high2 - low2) * (value - low1) / (high1 - low1); };</script></html>";
-        server.send(200, "text/html", html);
-    });
+    inboundQueue = xQueueCreate(COMMAND_QUEUE_LENGTH + INBOUND_RESERVE, sizeof(InboundMessage));
+    metricsLock = xSemaphoreCreateMutex();
+    wsClients.begin();
 
+    server.on("/", handleRoot);
+    server.on("/metrics", handleMetrics);
+    webSocket.onEvent(handleWebSocketEvent);
+    server.addHandler(&webSocket);
     server.begin();
+}
 
-    webSocket.begin();
-    webSocket.onEvent(handleWebSocketEvent);
+// Counts the request against HTTP_MAX_REQUESTS until its connection closes,
+// or answers 503 straight away if there is no room. AsyncTCP task only.
+bool admitRequest(AsyncWebServerRequest *request)
+{
+    if (httpInFlight >= HTTP_MAX_REQUESTS)
+    {
+        clientsRefused++;
+        request->send(503);
+        return false;
+    }
+    httpInFlight++;
+    request->onDisconnect([]()
+                          { httpInFlight--; });
+    return true;
+}
+
+// Streams the prebuilt gzipped page straight from flash. The ETag is a
+// hash of the page so a reload after the first visit is a bodyless 304.
+void handleRoot(AsyncWebServerRequest *request)
+{
+    if (!admitRequest(request))
+    {
+        return;
+    }
+    AsyncWebServerResponse *response;
+    AsyncWebHeader *etag = request->getHeader("If-None-Match");
+    if (etag != NULL && etag->value() == MARKUP_ETAG)
+    {
+        response = request->beginResponse(304);
+    }
+    else
+    {
+        response = request->beginResponse_P(200, "text/html", MARKUP_GZ, MARKUP_GZ_LENGTH);
+        response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", MARKUP_ETAG);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+}
+
+// Fills metricsReport, returns its length. Caller holds metricsLock. The
+// busy shares cover the time since the last report built with window.
+size_t collectMetrics(bool prometheus, MetricsWindow &window)
+{
+    for (uint8_t i = 0; i < TASK_COUNT; i++)
+    {
+        taskLoad[i].stackFreeBytes = uxTaskGetStackHighWaterMark(taskHandles[i]);
+    }
+    MetricsSources sources = {histograms, sizeof(histograms) / sizeof(histograms[0]), taskLoad, TASK_COUNT,
+                              metricsRecordCycles, metricsLoadCycles};
+    uint64_t nowUs = esp_timer_get_time();
+    if (prometheus)
+    {
+        return metricsWritePrometheus(metricsReport, sizeof(metricsReport), sources, window, nowUs);
+    }
+    return metricsWriteJson(metricsReport, sizeof(metricsReport), sources, window, nowUs);
+}
+
+// What leaving the instrumentation on costs: cycles per histogram record
+// and per busy()/idle() pair on scratch copies, best of a few runs so an
+// interrupt does not inflate it. Before the tasks start.
+void measureMetricsOverhead()
+{
+    MetricsHistogram scratch("scratch");
+    MetricsTaskLoad load;
+    metricsRecordCycles = UINT32_MAX;
+    metricsLoadCycles = UINT32_MAX;
+    for (uint8_t run = 0; run < 8; run++)
+    {
+        uint32_t start = ESP.getCycleCount();
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            scratch.record(i * 97);
+        }
+        uint32_t recorded = ESP.getCycleCount();
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            load.busy(i * 10);
+            load.idle(i * 10 + 5);
+        }
+        uint32_t end = ESP.getCycleCount();
+        if ((recorded - start) / 64 < metricsRecordCycles)
+        {
+            metricsRecordCycles = (recorded - start) / 64;
+        }
+        if ((end - recorded) / 64 < metricsLoadCycles)
+        {
+            metricsLoadCycles = (end - recorded) / 64;
+        }
+    }
+}
+
+// The response goes out after the handler returns, so it gets a copy
+void handleMetrics(AsyncWebServerRequest *request)
+{
+    if (!admitRequest(request))
+    {
+        return;
+    }
+    xSemaphoreTake(metricsLock, portMAX_DELAY);
+    collectMetrics(true, scrapeWindow);
+    String report(metricsReport);
+    xSemaphoreGive(metricsLock);
+    request->send(200, "text/plain; version=0.0.4", report);
+}
+
+// {"metrics": 1}
+void sendMetrics(uint8_t num)
+{
+    HeapGuardExempt exempt;
+    xSemaphoreTake(metricsLock, portMAX_DELAY);
+    size_t length = collectMetrics(false, clientWindows[num]);
+    wsClients.text(num, metricsReport, length);
+    xSemaphoreGive(metricsLock);
 }
 
-void webServerTask(void *pvParameters)
+// Single consumer of inboundQueue and the only writer of pendingCommand,
+// pendingTrack and the telemetry subscriptions. Sleeps until a message
+// arrives.
+void commandTask(void *pvParameters)
 {
+    InboundMessage message;
+
     for (;;)
     {
-        server.handleClient();
-        webSocket.loop();
-        vTaskDelay(pdMS_TO_TICKS(10));
+        xQueueReceive(inboundQueue, &message, portMAX_DELAY);
+        taskLoad[TASK_COMMAND].busy(micros());
+        heapGuardBegin();
+        messageReceivedUs = message.receivedUs;
+        switch (message.type)
+        {
+        case INBOUND_CONNECT:
+            LOG(CLIENT_CONNECTED, message.slot);
+            frameSeqValid[message.slot] = false;
+            clientWindows[message.slot] = MetricsWindow();
+            telemetry.subscribe(message.slot, TELEMETRY_DEFAULT_PERIOD_MS, TELEMETRY_ALL_FIELDS);
+            wakeTelemetryTask();
+            break;
+        case INBOUND_DISCONNECT:
+            LOG(CLIENT_DISCONNECTED, message.slot);
+            telemetry.unsubscribe(message.slot);
+            wakeTelemetryTask();
+            break;
+        case INBOUND_TEXT:
+            handleTextCommand(message.slot, message.data, message.length);
+            break;
+        case INBOUND_BINARY:
+            handleBinaryCommand(message.slot, (uint8_t *)message.data, message.length);
+            break;
+        }
+        heapGuardEnd();
+        taskLoad[TASK_COMMAND].idle(micros());
     }
 }
 
+// Rounds a setpoint to a position the servo accepts
+int32_t servoPosition(float setpoint)
+{
+    if (setpoint <= 0.0f)
+    {
+        return 0;
+    }
+    if (setpoint >= SERVO_MAX_POSITION)
+    {
+        return SERVO_MAX_POSITION;
+    }
+    return lroundf(setpoint);
+}
+
 void servoControlTask(void *pvParameters)
 {
+    const TickType_t period = CONTROL_PERIOD_TICKS;
+    const uint32_t periodUs = CONTROL_PERIOD_US;
+    const float dt = periodUs * 1e-6f;
+
+    TrajectoryAxis panAxis;
+    TrajectoryAxis tiltAxis;
+    TurretCommand command = commandState.read();
+    panAxis.reset(servoPosition(command.pan));
+    tiltAxis.reset(servoPosition(command.tilt));
+    int32_t sentPan = -1;
+    int32_t sentTilt = -1;
+
+    TargetPredictor predictor;
+    uint32_t seenTrack = trackState.read().count;
+
+    // Publish time of a command that moved the target and has not reached
+    // the bus yet, 0 when nothing is pending
+    uint32_t seenPublishUs = command.publishedUs;
+    uint32_t movePendingUs = 0;
+
+    TickType_t lastWake = xTaskGetTickCount();
+    uint32_t lastTickUs = micros();
+
     for (;;)
     {
-        // Move servos to the desired positions
-        moveServo(PAN_SERVO_ID, currentPan, motorSpeed);
-        moveServo(TILT_SERVO_ID, currentTilt, motorSpeed);
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        heapGuardEnd();
+        taskLoad[TASK_SERVO].idle(micros());
+        if (xTaskDelayUntil(&lastWake, period) == pdFALSE)
+        {
+            controlLoopOverruns++;
+        }
+
+        uint32_t nowUs = micros();
+        taskLoad[TASK_SERVO].busy(nowUs);
+        heapGuardBegin();
+        uint32_t interval = nowUs - lastTickUs;
+        uint32_t jitter = interval > periodUs ? interval - periodUs : periodUs - interval;
+        lastTickUs = nowUs;
+        if (jitter > controlLoopJitterUs)
+        {
+            controlLoopJitterUs = jitter;
+        }
+        if (jitter > controlLoopMaxJitterUs)
+        {
+            controlLoopMaxJitterUs = jitter;
+        }
+        controlJitter.record(jitter);
+
+        TurretCommand previous = command;
+        command = commandState.read();
+        if (command.publishedUs != seenPublishUs)
+        {
+            seenPublishUs = command.publishedUs;
+            if (command.pan != previous.pan || command.tilt != previous.tilt || command.mode != previous.mode)
+            {
+                movePendingUs = command.publishedUs;
+            }
+        }
+
+        // The tracker is slower than this loop so one observation per tick
+        // is enough; if two land in the same tick the newer one wins
+        uint32_t nowMs = millis();
+        TrackObservation track = trackState.read();
+        if (track.count != seenTrack)
+        {
+            seenTrack = track.count;
+            if (track.timed)
+            {
+                predictor.observeTimed(track.pan, track.tilt, track.sourceMs, track.arrivalMs);
+            }
+            else
+            {
+                predictor.observe(track.pan, track.tilt, track.arrivalMs);
+            }
+        }
+
+        // In auto mode aim where the target is now, not where the last
+        // camera frame saw it
+        float panTarget = command.pan;
+        float tiltTarget = command.tilt;
+        float aimPan, aimTilt;
+        if (command.mode == 2 && predictor.aim(nowMs, aimPan, aimTilt))
+        {
+            panTarget = aimPan;
+            tiltTarget = aimTilt;
+        }
+        predictorState = predictor.state();
+        predictorResidual = lroundf(predictor.innovationRms());
+
+        // motor_speed is the cruise velocity in position units/s
+        float maxVelocity = command.motorSpeed < SERVO_MIN_VELOCITY ? SERVO_MIN_VELOCITY : command.motorSpeed;
+        TrajectoryLimits limits = {maxVelocity, SERVO_MAX_ACCELERATION};
+        panAxis.limits = limits;
+        tiltAxis.limits = limits;
+        int32_t pan = servoPosition(panAxis.update(servoPosition(panTarget), dt));
+        int32_t tilt = servoPosition(tiltAxis.update(servoPosition(tiltTarget), dt));
+
+        // Only put a move on the bus when the setpoint actually changed. The
+        // move time is one tick so the servo interpolates between setpoints.
+        bool moved = pan != sentPan || tilt != sentTilt;
+        if (pan != sentPan)
+        {
+            moveServo(PAN_SERVO_ID, pan, CONTROL_PERIOD_US / 1000);
+            sentPan = pan;
+        }
+        if (tilt != sentTilt)
+        {
+            moveServo(TILT_SERVO_ID, tilt, CONTROL_PERIOD_US / 1000);
+            sentTilt = tilt;
+        }
+        if (moved && movePendingUs != 0)
+        {
+            publishToMove.record(micros() - movePendingUs);
+            movePendingUs = 0;
+        }
     }
 }
 
 void flywheelControlTask(void *pvParameters)
 {
-    initFireServo();
+    armFlywheels();
+    bootStageReady(BOOT_FLYWHEEL);
+    // With RPM feedback the wheels say when a dart can go, not spinUpMs
+    fireControl.config.speedGate = FLYWHEEL_DSHOT && FLYWHEEL_BIDIRECTIONAL;
 
+    uint8_t appliedSpeed = 0;
+    uint8_t appliedAngle = 0;
+    bool loaderAttached = false;
+    TurretCommand command = commandState.read();
+    uint32_t seenFire = command.fireRequests;
+    uint32_t seenAbort = command.abortRequests;
+    uint32_t feedPendingUs = 0; // publish time of a trigger whose first shot has not fed yet
 
     for (;;)
     {
-        if (fireCommand)
+        taskLoad[TASK_FLYWHEEL].busy(micros());
+        heapGuardBegin();
+        uint32_t now = millis();
+        command = commandState.read();
+        fireControl.config.warmSpeed = command.warmIdleSpeed;
+        fireControl.config.warmTimeoutMs = command.warmIdleTimeout;
+
+        if (command.abortRequests != seenAbort)
+        {
+            seenAbort = command.abortRequests;
+            seenFire = command.fireRequests;
+            fireControl.abort(now);
+        }
+        if (command.fireRequests != seenFire)
+        {
+            seenFire = command.fireRequests;
+            fireControl.trigger(command.fireMode, command.flywheelSpeed, now, command.fireArrivalMs);
+            feedPendingUs = command.publishedUs;
+        }
+
+        uint32_t shotsBefore = fireControl.shotCount();
+        fireControl.setWheelsAtSpeed(flywheelsAtSpeed(fireControl.outputs().flywheelSpeed));
+        uint32_t wait = fireControl.tick(now);
+        const FireOutputs &out = fireControl.outputs();
+        BULLET_COUNT -= fireControl.shotCount() - shotsBefore;
+        if (fireControl.shotCount() != shotsBefore && feedPendingUs != 0)
+        {
+            fireToFeed.record(micros() - feedPendingUs);
+            feedPendingUs = 0;
+        }
+
+        // Only touch the hardware when an output actually changes
+        if (out.loaderAttached && !loaderAttached)
+        {
+            fireServo.attach(fireServoPin, 500, 2500);
+            appliedAngle = 0xFF;
+        }
+        if (out.loaderAttached && out.loaderAngle != appliedAngle)
+        {
+            fireServo.write(out.loaderAngle);
+            appliedAngle = out.loaderAngle;
+        }
+        if (!out.loaderAttached && loaderAttached)
+        {
+            fireServo.write(out.loaderAngle);
+            fireServo.detach();
+        }
+        loaderAttached = out.loaderAttached;
+
+        if (out.flywheelSpeed != appliedSpeed)
+        {
+            writeFlywheels(out.flywheelSpeed);
+            appliedSpeed = out.flywheelSpeed;
+        }
+        if (flywheelStatus != 3)
         {
-            flywheelStatus = 2;
-            fire();
-            fireCommand = false;
-            flywheelStatus = 1;
+            flywheelStatus = fireControl.busy() ? 2 : 1;
         }
-        vTaskDelay(pdMS_TO_TICKS(50));
+
+        // Sleep until the next fire state deadline or a new trigger/abort
+        heapGuardEnd();
+        taskLoad[TASK_FLYWHEEL].idle(micros());
+        ulTaskNotifyTake(pdTRUE, wait == FIRE_NO_DEADLINE ? portMAX_DELAY : pdMS_TO_TICKS(wait) + 1);
     }
 }
 
@@ -259,95 +869,349 @@ void uartCommunicationTask(void *pvParameters)
 {
     for (;;)
     {
-        if (SerialUART.available())
+        taskLoad[TASK_UART].busy(micros());
+        heapGuardBegin();
+        uint8_t byte;
+        while (servoRxRing.pop(byte))
         {
-          String data = SerialUART.readStringUntil('\n');
-          Serial.println("UART Received: " + data);
+            if (servoParser.feed(byte))
+            {
+                servoBus.onFrame(servoParser.frame(), micros());
+            }
+        }
 
-          // Print raw data in hexadecimal format
-          Serial.print("Raw Data: ");
-          for (size_t i = 0; i < data.length(); i++)
-          {
-              Serial.printf("%02X ", data[i]);
-          }
-          Serial.println(getServoPosition(1));
+        // Sleep until the next bus deadline, received bytes and new moves
+        // wake the task early
+        uint32_t waitUs = servoBus.poll(micros());
+        TickType_t wait = waitUs == 0xFFFFFFFFUL ? portMAX_DELAY : pdMS_TO_TICKS(waitUs / 1000);
+        heapGuardEnd();
+        taskLoad[TASK_UART].idle(micros());
+        ulTaskNotifyTake(pdTRUE, wait > 0 ? wait : 1);
+    }
+}
 
-          ;
-          getServoPosition(2);
-        }
-        vTaskDelay(pdMS_TO_TICKS(20));
+// Runs in the UART driver's event task whenever bytes arrive
+void onServoBusReceive()
+{
+    while (SerialUART.available())
+    {
+        servoRxRing.push(SerialUART.read());
+    }
+    if (taskHandles[TASK_UART] != NULL)
+    {
+        xTaskNotifyGive(taskHandles[TASK_UART]);
+    }
+}
+
+void writeServoBus(const uint8_t *data, size_t length, void *context)
+{
+    SerialUART.write(data, length);
+    // First 12 bytes, in wire order when printed as hex words
+    uint32_t words[3] = {0, 0, 0};
+    for (size_t i = 0; i < length && i < sizeof(words); i++)
+    {
+        words[i / 4] |= (uint32_t)data[i] << (24 - 8 * (i % 4));
     }
+    LOG(BUS_TX, length, words[0], words[1], words[2]);
 }
+
 void telemetryTask(void *pvParameters)
 {
+    int32_t values[TELEMETRY_FIELD_COUNT];
+    uint32_t reportedViolations = 0;
+
     for (;;)
     {
-        StaticJsonDocument<200> doc;
-        doc["pan"] = currentPan;
-        doc["tilt"] = currentTilt;
-        doc["motor_speed"] = motorSpeed;
-        doc["flywheel_speed"] = flywheelSpeed;
-        doc["flywheelStatus"] = flywheelStatus;
-        doc["fire_mode"] = fireMode;
-        doc["magCountValue"] = BULLET_COUNT;
-        doc["motorStatus"] = motorStatus;
-        doc["camraStatus"] = cameraStatus;
-        doc["mode"] = mode;
-        doc["cameraPan"] = cameraPan;
-        doc["cameraTilt"] = cameraTilt;
+        taskLoad[TASK_TELEMETRY].busy(micros());
+        heapGuardBegin();
+        uint32_t buildStart = ESP.getCycleCount();
+        telemetrySendCycles = 0;
+        TurretCommand command = commandState.read();
+        LX824Reading pan = {}, tilt = {};
+        servoBus.reading(PAN_SERVO_ID, pan);
+        servoBus.reading(TILT_SERVO_ID, tilt);
 
-        String jsonString;
-        serializeJson(doc, jsonString);
+        values[TELEMETRY_PAN] = command.pan;
+        values[TELEMETRY_TILT] = command.tilt;
+        values[TELEMETRY_MOTOR_SPEED] = command.motorSpeed;
+        values[TELEMETRY_FLYWHEEL_SPEED] = command.flywheelSpeed;
+        values[TELEMETRY_FLYWHEEL_STATUS] = flywheelStatus;
+        values[TELEMETRY_FIRE_MODE] = command.fireMode;
+        values[TELEMETRY_MAG_COUNT] = BULLET_COUNT;
+        values[TELEMETRY_MOTOR_STATUS] = motorStatus;
+        values[TELEMETRY_CAMERA_STATUS] = cameraStatus;
+        values[TELEMETRY_MODE] = command.mode;
+        values[TELEMETRY_CAMERA_PAN] = command.cameraPan;
+        values[TELEMETRY_CAMERA_TILT] = command.cameraTilt;
+        values[TELEMETRY_SHOT_LATENCY] = fireControl.lastTriggerToFeedMs();
+        values[TELEMETRY_PAN_FEEDBACK] = pan.position;
+        values[TELEMETRY_TILT_FEEDBACK] = tilt.position;
+        values[TELEMETRY_PAN_TEMP] = pan.temperature;
+        values[TELEMETRY_TILT_TEMP] = tilt.temperature;
+        values[TELEMETRY_PAN_VIN] = pan.voltage;
+        values[TELEMETRY_TILT_VIN] = tilt.voltage;
+        values[TELEMETRY_BUS_TIMEOUTS] = pan.timeouts + tilt.timeouts;
+        values[TELEMETRY_LOOP_JITTER] = controlLoopJitterUs;
+        values[TELEMETRY_LOOP_MAX_JITTER] = controlLoopMaxJitterUs;
+        values[TELEMETRY_LOOP_OVERRUNS] = controlLoopOverruns;
+        values[TELEMETRY_TRACK_STATE] = predictorState;
+        values[TELEMETRY_TRACK_RESIDUAL] = predictorResidual;
+        values[TELEMETRY_BOOT_WIFI] = bootStageMs[BOOT_WIFI];
+        values[TELEMETRY_BOOT_CAMERA] = bootStageMs[BOOT_CAMERA];
+        values[TELEMETRY_BOOT_FLYWHEEL] = bootStageMs[BOOT_FLYWHEEL];
+        values[TELEMETRY_BOOT_READY] = bootReadyMs;
+        values[TELEMETRY_WIFI_RECONNECTS] = wifiReconnects;
+        values[TELEMETRY_WS_CLIENTS] = wsClients.count();
+        values[TELEMETRY_CMD_REJECTED] = inboundRejected;
+        values[TELEMETRY_CLIENTS_REFUSED] = clientsRefused;
+        values[TELEMETRY_HEAP_FREE] = ESP.getFreeHeap();
+        values[TELEMETRY_HEAP_LARGEST] = ESP.getMaxAllocHeap();
+        values[TELEMETRY_HEAP_MIN_FREE] = ESP.getMinFreeHeap();
+        values[TELEMETRY_HEAP_HOT_ALLOCS] = heapGuardViolations();
+        values[TELEMETRY_LOG_DROPPED] = logDropped();
+#if FLYWHEEL_DSHOT
+        values[TELEMETRY_RPM_LEFT] = leftFlywheel.rpm();
+        values[TELEMETRY_RPM_RIGHT] = rightFlywheel.rpm();
+#else
+        values[TELEMETRY_RPM_LEFT] = 0;
+        values[TELEMETRY_RPM_RIGHT] = 0;
+#endif
+        values[TELEMETRY_SPEED_FAULTS] = fireControl.speedFaults();
+        controlLoopJitterUs = 0;
 
-        webSocket.broadcastTXT(jsonString);
-        vTaskDelay(pdMS_TO_TICKS(1000)); // Send telemetry every 100ms
+        // Sleeps until the next subscriber is due or the subscriptions change
+        uint32_t wait = telemetry.poll(millis(), values, sendTelemetry, NULL);
+        uint32_t buildCycles = ESP.getCycleCount() - buildStart - telemetrySendCycles;
+        telemetryBuild.record(buildCycles / CPU_MHZ);
+        heapGuardEnd();
+
+        if (heapGuardViolations() != reportedViolations)
+        {
+            reportedViolations = heapGuardViolations();
+            HeapGuardViolation last = heapGuardLastViolation();
+            LOG(HEAP_ALLOCATION, last.task, last.size, last.caller, reportedViolations);
+        }
+        taskLoad[TASK_TELEMETRY].idle(micros());
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
     }
 }
 
+bool sendTelemetry(uint8_t client, const char *frame, size_t length, void *context)
+{
+    uint32_t start = ESP.getCycleCount();
+    // The library queues the frame on the heap, that is its business
+    HeapGuardExempt exempt;
+    // A client whose send queue is full misses this frame, its next one
+    // carries the same changes
+    bool sent = wsClients.text(client, frame, length);
+    telemetrySendCycles += ESP.getCycleCount() - start;
+    return sent;
+}
+
+// Steps the sweep scan every period and follows the commanded angles
+// otherwise. publishCommand wakes it early on a mode or angle change, so
+// leaving sweep takes effect on the next message rather than the next
+// period. While the tracker is reporting a target the scan holds still and
+// it resumes where it stopped once the tracker has gone
+// SCAN_TARGET_TIMEOUT_MS without detecting one. Frames in which the tracker
+// sees nothing never reach trackState.
 void cameraControlTask(void *pvParameters)
 {
-      
+    const TickType_t period = pdMS_TO_TICKS(TASKS[TASK_CAMERA].periodMs);
+    TickType_t nextStep = xTaskGetTickCount();
+    SweepControl sweep;
+    TargetWatch target(SCAN_TARGET_TIMEOUT_MS);
+    uint32_t seenTrack = trackState.read().count;
+    uint32_t lastMs = millis();
+    ScanPoint aim = sweep.scan.position();
+
+    cameraServoPan.attach(cameraServoPanPin, 500, 2500);
+    cameraServoTilt.attach(cameraServoTiltPin, 500, 2500);
+    cameraServoPan.setPeriodHertz(50);
+    cameraServoTilt.setPeriodHertz(50);
+    cameraServoPan.write(aim.pan);
+    cameraServoTilt.write(aim.tilt);
+    uint32_t centredMs = lastMs + CAMERA_SETTLE_MS;
 
     for (;;)
     {
-      Serial.printf("CameraControlTask - Pan: %d, Tilt: %d\n", cameraPan, cameraTilt);
+        uint32_t nowMs = millis();
+        taskLoad[TASK_CAMERA].busy(micros());
+        heapGuardBegin();
 
-        if(mode == -1){
-            cameraServoPan.write(90);
-            cameraServoTilt.write(90);
+        TurretCommand command = commandState.read();
+        TrackObservation track = trackState.read();
+        if (track.count != seenTrack)
+        {
+            seenTrack = track.count;
+            target.detected(track.arrivalMs);
         }
-        else if (mode == 0 || mode == 2){
-            cameraServoPan.write(cameraPan);
-            cameraServoTilt.write(cameraTilt);
+        bool targetSeen = target.seen(nowMs);
+        if ((int32_t)(nowMs - centredMs) >= 0)
+        {
+            bootStageReady(BOOT_CAMERA);
+        }
+
+        sweep.scan.config.pattern = (ScanPatternId)command.scanPattern;
+        sweep.scan.config.dwellMs = command.scanDwellMs;
+        ScanPoint next = sweep.update(command.mode == 1, targetSeen, {command.cameraPan, command.cameraTilt}, aim, nowMs - lastMs);
+        lastMs = nowMs;
 
+        if (next.pan != aim.pan || next.tilt != aim.tilt)
+        {
+            cameraServoPan.write(next.pan);
+            cameraServoTilt.write(next.tilt);
+            aim = next;
+            if (command.mode != 1)
+            {
+                LOG(CAMERA_MOVE, aim.pan, aim.tilt);
+            }
         }
-        else if (mode == 1){
-          Serial.print("Sweap mode: ");
-          Serial.print(mode);
-            //sweap 
-            for (int i = 15; i < 165; i++){
-                cameraServoPan.write(i);
-                cameraServoTilt.write(i);
-                vTaskDelay(pdMS_TO_TICKS(30));
 
+        heapGuardEnd();
+        taskLoad[TASK_CAMERA].idle(micros());
+        // Like xTaskDelayUntil, but a notification cuts the wait short
+        TickType_t now = xTaskGetTickCount();
+        while ((int32_t)(now - nextStep) >= 0)
+        {
+            nextStep += period;
+        }
+        ulTaskNotifyTake(pdTRUE, nextStep - now);
+    }
+}
+
+// Keeps the station associated without ever blocking on the radio. When
+// to try the cached access point, scan or back off is up to WiFiLink; this
+// task carries it out, stores the access point it got and sleeps until
+// the next event or deadline.
+void wifiTask(void *pvParameters)
+{
+    Preferences nvs;
+    nvs.begin("wifi", false);
+    WiFiCache cache = {};
+    bool cached = nvs.getBytes("link", &cache, sizeof(cache)) == sizeof(cache);
+
+    WiFiLink link;
+    link.config.fastTimeoutMs = WIFI_FAST_CONNECT_TIMEOUT_MS;
+    link.config.scanTimeoutMs = WIFI_CONNECT_TIMEOUT_MS;
+    link.config.retryMinMs = WIFI_RETRY_MIN_MS;
+    link.config.retryMaxMs = WIFI_RETRY_MAX_MS;
+    uint32_t seenAddressed = wifiAddressed;
+    uint32_t seenDropped = wifiDropped;
+    link.begin(millis(), cached);
+    connectWiFi(cache, link.fast());
+
+    for (;;)
+    {
+        taskLoad[TASK_WIFI].busy(micros());
+        uint32_t now = millis();
+        bool addressed = wifiAddressed != seenAddressed;
+        bool dropped = wifiDropped != seenDropped;
+        seenAddressed = wifiAddressed;
+        seenDropped = wifiDropped;
+
+        bool wasUp = link.up();
+        WiFiLinkAction action = link.update(now, addressed && WiFi.isConnected(), dropped);
+        if (action == WIFI_LINK_ADDRESSED)
+        {
+            if (!wasUp)
+            {
+                Serial.printf("WiFi up after %lu ms (%s, channel %ld): %s\n", (unsigned long)(now - link.attemptStart()),
+                              link.fast() ? "cached" : "scanned", (long)WiFi.channel(), WiFi.localIP().toString().c_str());
             }
-            for (int i = 165; i > 15; i--){
-                cameraServoPan.write(i);
-                cameraServoTilt.write(i);
-                vTaskDelay(pdMS_TO_TICKS(30));
+            bootStageReady(BOOT_WIFI);
 
+            WiFiCache current = {};
+            memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+            current.channel = WiFi.channel();
+            current.ip = WiFi.localIP();
+            current.gateway = WiFi.gatewayIP();
+            current.subnet = WiFi.subnetMask();
+            current.dns = WiFi.dnsIP();
+            // Flash writes only when the access point or lease changed
+            if (!cached || memcmp(&current, &cache, sizeof(cache)) != 0)
+            {
+                nvs.putBytes("link", &current, sizeof(current));
+                cache = current;
+                cached = true;
             }
         }
-        else {
-            cameraServoPan.write(cameraPan);
-            cameraServoTilt.write(cameraTilt);
+        else if (action == WIFI_LINK_RECONNECT)
+        {
+            Serial.printf("WiFi lost, reason %u\n", wifiDropReason);
+            wifiReconnects++;
+            connectWiFi(cache, link.fast());
+        }
+        else if (action == WIFI_LINK_CONNECT)
+        {
+            connectWiFi(cache, link.fast());
         }
-       
-        vTaskDelay(pdMS_TO_TICKS(1000));
+
+        // Events wake the task early
+        uint32_t waitMs = link.wait(millis());
+        TickType_t wait = waitMs == WIFI_LINK_NO_DEADLINE ? portMAX_DELAY : pdMS_TO_TICKS(waitMs) + 1;
+        taskLoad[TASK_WIFI].idle(micros());
+        ulTaskNotifyTake(pdTRUE, wait);
     }
 }
 
+// Formats what the other tasks logged and writes it to Serial, oldest
+// first across both cores. Runs at the bottom of core 0 so a slow serial
+// port only ever holds up this task; records that do not fit in the rings
+// meanwhile are dropped and reported here.
+void logTask(void *pvParameters)
+{
+    const TickType_t period = pdMS_TO_TICKS(TASKS[TASK_LOG].periodMs);
+    TickType_t lastWake = xTaskGetTickCount();
+    uint32_t reportedDropped = 0;
+    LogRecord record;
 
+    for (;;)
+    {
+        taskLoad[TASK_LOG].busy(micros());
+        while (logNext(record))
+        {
+            writeLogRecord(record);
+        }
+        uint32_t dropped = logDropped();
+        if (dropped != reportedDropped)
+        {
+            // Written straight out, the rings may still be full
+            record.timestampUs = micros();
+            record.id = LOG_DROPPED;
+            record.argCount = 1;
+            record.core = xPortGetCoreID();
+            record.args[0] = dropped - reportedDropped;
+            writeLogRecord(record);
+            reportedDropped = dropped;
+        }
+        taskLoad[TASK_LOG].idle(micros());
+        vTaskDelayUntil(&lastWake, period);
+    }
+}
+
+// One line of text, "[micros] message", or a binary frame with LOG_BINARY
+void writeLogRecord(const LogRecord &record)
+{
+#if LOG_BINARY
+    uint8_t frame[LOG_FRAME_MAX];
+    Serial.write(frame, logEncodeFrame(record, frame));
+#else
+    char line[160];
+    const uintptr_t *args = record.args;
+    int prefix = snprintf(line, sizeof(line), "[%lu] ", (unsigned long)record.timestampUs);
+    if (record.id < LOG_MESSAGE_COUNT)
+    {
+        // Unused trailing arguments are ignored by the format
+        snprintf(line + prefix, sizeof(line) - prefix, LOG_MESSAGE_FORMATS[record.id], args[0], args[1], args[2], args[3]);
+    }
+    else
+    {
+        snprintf(line + prefix, sizeof(line) - prefix, "Unknown log message %u", record.id);
+    }
+    Serial.println(line);
+#endif
+}
 
 void enterLowPowerMode()
 {
@@ -356,137 +1220,310 @@ void enterLowPowerMode()
     esp_light_sleep_start();
 }
 
-void handleWebSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length)
+// AsyncTCP task. Gives each websocket connection a slot, copies messages
+// into inboundQueue for commandTask and answers straight away when a
+// message cannot be taken.
+void handleWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t length)
 {
+    uint32_t receivedUs = micros();
 
     switch (type)
     {
-    case WStype_DISCONNECTED:
-        Serial.printf("Client %u disconnected.\n", num);
+    case WS_EVT_CONNECT:
+    {
+        int8_t slot = wsClients.add(client);
+        if (slot < 0)
+        {
+            clientsRefused++;
+            client->close(1013, "Too many clients");
+            return;
+        }
+        queueInbound(INBOUND_CONNECT, slot, NULL, 0, receivedUs);
         break;
-    case WStype_CONNECTED:
-        Serial.printf("Client %u connected.\n", num);
+    }
+    case WS_EVT_DISCONNECT:
+    {
+        int8_t slot = wsClients.remove(client->id());
+        if (slot < 0)
+        {
+            return;
+        }
+        queueInbound(INBOUND_DISCONNECT, slot, NULL, 0, receivedUs);
         break;
-    case WStype_TEXT:
+    }
+    case WS_EVT_DATA:
     {
-      // Serial.printf("Received Raw Data: %s\n", payload); // Debug output
-
-        StaticJsonDocument<200> doc;
-        DeserializationError error = deserializeJson(doc, payload);
-
-        if (error)
+        int8_t slot = wsClients.slotOf(client->id());
+        AwsFrameInfo *info = (AwsFrameInfo *)arg;
+        if (slot < 0)
         {
-            Serial.println("Failed to parse JSON");
-            Serial.println(error.c_str());
             return;
         }
-
-        
-        motorSpeed = doc["motor_speed"] | motorSpeed;
-        flywheelSpeed = doc["flywheel_speed"] | flywheelSpeed;
-        fireMode = doc["fire_mode"] | fireMode;
-        fireCommand = doc["fire"] | fireCommand;
-        mode = doc["mode"] | mode;
-        int camServoX = doc["camServoPan"].as<int>();;
-        int camServoY = doc["camServoTilt"].as<int>();;
-        if(mode == 0){
-          currentPan = doc["pan"] | currentPan;
-          currentTilt = doc["tilt"] | currentTilt;
-         
-        }
-        else if(mode == 2){
-          currentPan = camServoX; 
-          currentTilt = camServoY;
-        }
-        else{
-          cameraPan = 90;
-          cameraTilt = 90;
-        }
-        cameraPan = camServoX; 
-        cameraTilt = camServoY;
+        // Commands fit in one frame, anything split up is not one of ours
+        if (!info->final || info->index != 0 || info->len != length || length > COMMAND_MAX_LENGTH)
+        {
+            inboundRejected++;
+            client->text("{\"error\":\"too long\"}");
+            return;
+        }
+        if (uxQueueSpacesAvailable(inboundQueue) <= INBOUND_RESERVE ||
+            !queueInbound(info->opcode == WS_BINARY ? INBOUND_BINARY : INBOUND_TEXT, slot, data, length, receivedUs))
+        {
+            inboundRejected++;
+            client->text("{\"busy\":1}");
+        }
         break;
     }
-    break;
     default:
         break;
     }
 }
 
+bool queueInbound(uint8_t type, uint8_t slot, const uint8_t *data, size_t length, uint32_t receivedUs)
+{
+    InboundMessage message;
+    message.type = type;
+    message.slot = slot;
+    message.length = length;
+    message.receivedUs = receivedUs;
+    if (length > 0)
+    {
+        memcpy(message.data, data, length);
+    }
+    message.data[length] = 0; // text stays printable
+    return xQueueSend(inboundQueue, &message, 0) == pdTRUE;
+}
 
-
-void moveServo(uint8_t id, uint16_t position, uint16_t speed)
+// {"subscribe": ...}, {"metrics": 1} or a command with any of the fields
+// below
+void handleTextCommand(uint8_t num, char *payload, size_t length)
 {
-  motorStatus = 1;
-   // Position and speed are in a range from 0-1023
-  uint8_t posLow = position & 0xFF;
-  uint8_t posHigh = (position >> 8) & 0xFF;
-  uint8_t speedLow = speed & 0xFF;
-  uint8_t speedHigh = (speed >> 8) & 0xFF;
-
-  // LX-824 Command format
-  uint8_t command[] = {
-    0x55, 0x55,               // Header
-    id,                       // Servo ID
-    7,                        // Length of data (excluding header)
-    1,                        // Command type: Move
-    posLow, posHigh,          // Target position
-    speedLow, speedHigh,      // Moving speed
-    0x00                      // Placeholder for checksum
-  };
-
-  // Calculate checksum
-  uint8_t checksum = 0;
-  for (int i = 2; i < 9; i++) {
-    checksum += command[i];
-  }
-  command[9] = ~checksum;     // Bitwise NOT for checksum
+  // Serial.printf("Received Raw Data: %s\n", payload); // Debug output
 
-  // Send command to servo
-  SerialUART.write(command, sizeof(command));
-  Serial.println("Move command sent");
-  motorStatus = 0;
+    commandArena.reset();
+    JsonDocument doc(&commandArena);
+    DeserializationError error = deserializeJson(doc, payload, length);
+
+    if (error)
+    {
+        LOG(JSON_INVALID, error.c_str());
+        return;
+    }
+
+    if (!doc["subscribe"].isNull())
+    {
+        handleSubscribe(num, doc["subscribe"]);
+        return;
+    }
+    if (!doc["metrics"].isNull())
+    {
+        sendMetrics(num);
+        return;
+    }
+
+    TurretCommand command = pendingCommand;
+    command.motorSpeed = doc["motor_speed"] | command.motorSpeed;
+    command.flywheelSpeed = doc["flywheel_speed"] | command.flywheelSpeed;
+    command.fireMode = doc["fire_mode"] | command.fireMode;
+    if (doc["fire"] | false)
+    {
+        command.fireRequests++;
+    }
+    if (doc["abort"] | false)
+    {
+        command.abortRequests++;
+    }
+    command.warmIdleSpeed = doc["warm_speed"] | command.warmIdleSpeed;
+    command.warmIdleTimeout = doc["warm_timeout"] | command.warmIdleTimeout;
+    command.mode = doc["mode"] | command.mode;
+    command.scanPattern = doc["scan_pattern"] | command.scanPattern;
+    command.scanDwellMs = doc["scan_dwell"] | command.scanDwellMs;
+    int camServoX = doc["camServoPan"].as<int>();;
+    int camServoY = doc["camServoTilt"].as<int>();;
+    // "found":0 comes from a tracker that sees no target, its angles are
+    // only where the target was last
+    bool targetFound = doc["found"] | true;
+    if(command.mode == 0){
+      command.pan = doc["pan"] | command.pan;
+      command.tilt = doc["tilt"] | command.tilt;
+     
+    }
+    else if(command.mode == 2 && targetFound){
+      command.pan = camServoX; 
+      command.tilt = camServoY;
+    }
+    if (targetFound)
+    {
+        command.cameraPan = camServoX;
+        command.cameraTilt = camServoY;
+    }
+    publishCommand(command);
+    if (targetFound && !doc["camServoPan"].isNull())
+    {
+        publishTrack(camServoX, camServoY, 0, false);
+    }
 }
 
-int getServoPosition(uint8_t id){
-  uint8_t command[] = {
-    0x55, 0x55,          // Header
-    id,             // Servo ID
-    0x03,                // Length of command packet
-    0x1C,                // Command for position read
-    0x00                         // Placeholder for checksum
-  };
 
-  // Calculate checksum
-  uint8_t checksum = 0;
-  for (int i = 2; i < 6; i++) {
-    checksum += command[i];
-  }
-  command[6] = ~checksum;     // Bitwise NOT for checksum
+void handleBinaryCommand(uint8_t num, uint8_t *payload, size_t length)
+{
+    TurretFrame frame;
+    TurretDecodeResult result = decodeTurretFrame(payload, length, frame);
+    if (result != TURRET_DECODE_OK)
+    {
+        LOG(FRAME_INVALID, turretDecodeResultName(result));
+        return;
+    }
 
-  // Send the read command to the servo
-  SerialUART.write(command, sizeof(command));
+    // Drop frames that were overtaken by a newer one from the same client
+    if (frameSeqValid[num] && !turretSeqNewer(frame.seq, lastFrameSeq[num]))
+    {
+        return;
+    }
+    lastFrameSeq[num] = frame.seq;
+    frameSeqValid[num] = true;
+    lastFrameTimestamp = frame.timestamp;
 
-  // Wait for the response (the response packet size is 7 bytes)
-  delay(10);
-  
-  if (SerialUART.available() >= 7) {
-    uint8_t response[7];
-    for (int i = 0; i < 7; i++) {
-      response[i] = SerialUART.read();
+    TurretCommand command = pendingCommand;
+    switch (frame.type)
+    {
+    case TURRET_FRAME_MOVE:
+        if (command.mode == 0)
+        {
+            command.pan = frame.a;
+            command.tilt = frame.b;
+        }
+        break;
+    case TURRET_FRAME_TRACK:
+        if (!turretFrameHasTarget(frame))
+        {
+            break;
+        }
+        if (command.mode == 2)
+        {
+            command.pan = frame.a;
+            command.tilt = frame.b;
+        }
+        command.cameraPan = frame.a;
+        command.cameraTilt = frame.b;
+        publishTrack(frame.a, frame.b, frame.timestamp, true);
+        break;
+    case TURRET_FRAME_FIRE:
+        command.fireMode = frame.c;
+        command.fireRequests++;
+        break;
+    case TURRET_FRAME_MODE:
+        command.mode = frame.c;
+        break;
+    case TURRET_FRAME_SPEED:
+        command.motorSpeed = frame.a;
+        command.flywheelSpeed = frame.c;
+        break;
+    }
+
+    if (frame.flags & TURRET_FLAG_FIRE)
+    {
+        command.fireRequests++;
+    }
+    if (frame.flags & TURRET_FLAG_ABORT)
+    {
+        command.abortRequests++;
     }
-    
-    // Verify the checksum of the response
-    uint8_t responseChecksum = 0;
-    for (int i = 2; i < 6; i++) {
-      responseChecksum += response[i];
+    publishCommand(command);
+}
+
+// {"subscribe": {"rate": 20, "fields": ["pan", "tilt"], "keyframe": 1000}}
+// rate is in Hz, fields defaults to everything and keyframe (ms between
+// full frames) to TELEMETRY_DEFAULT_KEYFRAME_MS. A rate of 0 unsubscribes.
+void handleSubscribe(uint8_t num, JsonVariant subscription)
+{
+    uint16_t rate = subscription["rate"] | 1000 / TELEMETRY_DEFAULT_PERIOD_MS;
+    if (rate == 0)
+    {
+        telemetry.unsubscribe(num);
+        wakeTelemetryTask();
+        return;
     }
-    responseChecksum = ~responseChecksum;
 
-    if (responseChecksum == response[6]) {
-      return response[5]; // The temperature is stored in response[5]
+    uint64_t fields = TELEMETRY_ALL_FIELDS;
+    JsonArray names = subscription["fields"];
+    if (!names.isNull())
+    {
+        fields = 0;
+        for (JsonVariant name : names)
+        {
+            fields |= TelemetryPublisher::fieldMask(name | "");
+        }
     }
-  
-  }
 
-  return -1; // Return -1 if reading failed
+    uint16_t keyframe = subscription["keyframe"] | TELEMETRY_DEFAULT_KEYFRAME_MS;
+    telemetry.subscribe(num, 1000 / rate, fields, keyframe);
+    wakeTelemetryTask();
+}
+
+// With no subscribers telemetryTask sleeps a whole keyframe period; a new
+// or faster subscription should not wait that out
+void wakeTelemetryTask()
+{
+    if (taskHandles[TASK_TELEMETRY] != NULL)
+    {
+        xTaskNotifyGive(taskHandles[TASK_TELEMETRY]);
+    }
+}
+
+// Publishes a complete command in one step and wakes the fire task if a
+// shot or abort was requested
+void publishCommand(const TurretCommand &command)
+{
+    bool fired = command.fireRequests != pendingCommand.fireRequests;
+    bool wakeFireTask = fired || command.abortRequests != pendingCommand.abortRequests;
+    bool wakeCameraTask = command.mode != pendingCommand.mode ||
+                          command.cameraPan != pendingCommand.cameraPan ||
+                          command.cameraTilt != pendingCommand.cameraTilt;
+    pendingCommand = command;
+    pendingCommand.publishedUs = micros();
+    if (fired)
+    {
+        // Back-dated to the websocket callback so the shot latency includes
+        // the time the message waited in the inbound queue
+        pendingCommand.fireArrivalMs = millis() - (pendingCommand.publishedUs - messageReceivedUs) / 1000;
+    }
+    commandState.publish(pendingCommand);
+    receiveToDispatch.record(pendingCommand.publishedUs - messageReceivedUs);
+    if (wakeFireTask && taskHandles[TASK_FLYWHEEL] != NULL)
+    {
+        xTaskNotifyGive(taskHandles[TASK_FLYWHEEL]);
+    }
+    if (wakeCameraTask && taskHandles[TASK_CAMERA] != NULL)
+    {
+        xTaskNotifyGive(taskHandles[TASK_CAMERA]);
+    }
+}
+
+// Hands a tracker observation to the servo task's predictor, stamped with
+// its arrival time
+void publishTrack(uint16_t pan, uint16_t tilt, uint32_t sourceMs, bool timed)
+{
+    pendingTrack.count++;
+    pendingTrack.pan = pan;
+    pendingTrack.tilt = tilt;
+    pendingTrack.sourceMs = sourceMs;
+    pendingTrack.arrivalMs = millis();
+    pendingTrack.timed = timed;
+    trackState.publish(pendingTrack);
+}
+
+void moveServo(uint8_t id, uint16_t position, uint16_t speed)
+{
+  motorStatus = 1;
+  // Position and speed are in a range from 0-1023. The bus task builds the
+  // LX-824 frame and puts it on the wire; a newer move for the same servo
+  // replaces one that has not been sent yet.
+  servoBus.requestMove(id, position, speed);
+  LOG(SERVO_MOVE, id, position, speed);
+  if (taskHandles[TASK_UART] != NULL)
+  {
+    xTaskNotifyGive(taskHandles[TASK_UART]);
+  }
+  motorStatus = 0;
 }
@@ -0,0 +1,189 @@
+#include <DeferredLog.h>
+#include <LogMessages.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+
+// Binary log frames through scripts/decode_log.py, and how logNext()
+// orders records across the per core rings.
+
+static uint32_t fakeNow;
+static uint32_t fakeClock() { return fakeNow; }
+
+// Stamps with fakeNow, then moves the clock on
+static uint32_t steppingClock() { return fakeNow++; }
+
+void setUp()
+{
+    LogRecord drained;
+    while (logNext(drained))
+    {
+    }
+}
+void tearDown() {}
+
+static LogRecord record(uint16_t id, uint32_t timestampUs, uint8_t core, std::initializer_list<uintptr_t> args)
+{
+    LogRecord r = {};
+    r.id = id;
+    r.timestampUs = timestampUs;
+    r.core = core;
+    for (uintptr_t arg : args)
+    {
+        r.args[r.argCount++] = arg;
+    }
+    return r;
+}
+
+static void append(std::string &capture, const LogRecord &r)
+{
+    uint8_t frame[LOG_FRAME_MAX];
+    size_t length = logEncodeFrame(r, frame);
+    TEST_ASSERT_TRUE(length <= LOG_FRAME_MAX);
+    TEST_ASSERT_EQUAL_UINT32(9 + 4 * r.argCount, length);
+    capture.append((const char *)frame, length);
+}
+
+// Runs the decoder on capture and collects what it printed; false if no
+// Python is to be found
+static bool decode(const std::string &capture, std::string &output)
+{
+    std::string here = __FILE__;
+    std::string root = here.substr(0, here.rfind("test/native/"));
+    std::string path = "deferred_log_capture.bin";
+    FILE *file = fopen(path.c_str(), "wb");
+    TEST_ASSERT_TRUE(file != NULL);
+    fwrite(capture.data(), 1, capture.size(), file);
+    fclose(file);
+
+    for (const char *python : {"python3", "python"})
+    {
+        std::string command = std::string(python) + " \"" + root + "scripts/decode_log.py\" " + path + " 2>&1";
+        FILE *pipe = popen(command.c_str(), "r");
+        if (pipe == NULL)
+        {
+            continue;
+        }
+        output.clear();
+        char buffer[256];
+        size_t got;
+        while ((got = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+        {
+            output.append(buffer, got);
+        }
+        if (pclose(pipe) == 0)
+        {
+            remove(path.c_str());
+            return true;
+        }
+    }
+    remove(path.c_str());
+    return false;
+}
+
+void test_frames_decode_as_logged()
+{
+    std::string capture = "rst:0x1 (POWERON_RESET)\nBooting\n";
+    append(capture, record(LOG_DROPPED, 1234, 0, {5}));
+    append(capture, record(LOG_CAMERA_MOVE, 0xFFFFFFF0UL, 1, {(uintptr_t)-3, 120}));
+    capture += "WiFi up after 812 ms\n";
+    append(capture, record(LOG_BUS_TX, 42, 1, {7, 0xDEADBEEF, 0x01020304, 0}));
+    append(capture, record(LOG_HEAP_ALLOCATION, 4000000000UL, 0, {0x3FFB1234, 48, 0x400D5678, 2}));
+    append(capture, record(LOG_CLIENT_CONNECTED, 7, 0, {3}));
+    // A sync byte in text with no valid frame behind it stays text
+    capture += "ok \xA5 done\n";
+    append(capture, record(200, 5, 1, {1, 2}));
+
+    std::string output;
+    if (!decode(capture, output))
+    {
+        TEST_IGNORE_MESSAGE("no Python to run scripts/decode_log.py with");
+    }
+    const char *expected =
+        "rst:0x1 (POWERON_RESET)\n"
+        "Booting\n"
+        "      1234 c0 warn  system Log overflow, 5 records dropped\n"
+        "4294967280 c1 debug camera CameraControlTask - Pan: -3, Tilt: 120\n"
+        "WiFi up after 812 ms\n"
+        "        42 c1 debug bus    Bus tx 7 bytes: deadbeef 01020304 00000000\n"
+        "4000000000 c0 warn  system Heap allocation in <0x3ffb1234>: 48 bytes from <0x400d5678>, 2 so far\n"
+        "         7 c0 info  net    Client 3 connected.\n"
+        "ok \xEF\xBF\xBD done\n"
+        "         5 c1 ?            unknown message 200 [1, 2]\n";
+    TEST_ASSERT_EQUAL_STRING(expected, output.c_str());
+}
+
+// Arguments wider than 32 bits are cut, the argument count fits its nibble
+void test_frame_layout()
+{
+    uint8_t frame[LOG_FRAME_MAX];
+    LogRecord r = record(0x0102, 0x0A0B0C0D, 1, {(uintptr_t)0xFFFFFFFFUL, 0x11223344, 0, 9});
+    size_t length = logEncodeFrame(r, frame);
+    TEST_ASSERT_EQUAL_UINT32(LOG_FRAME_MAX, length);
+    const uint8_t head[] = {LOG_FRAME_SYNC, 0x02, 0x01, 0x14, 0x0D, 0x0C, 0x0B, 0x0A, 0xFF, 0xFF, 0xFF, 0xFF, 0x44, 0x33, 0x22, 0x11};
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(head, frame, sizeof(head));
+    uint8_t sum = 0;
+    for (size_t i = 1; i < length - 1; i++)
+    {
+        sum += frame[i];
+    }
+    TEST_ASSERT_EQUAL_UINT8(sum, frame[length - 1]);
+}
+
+// Rings in time order merge into one time ordered stream
+void test_next_merges_cores_by_time()
+{
+    const uint32_t stamps[2][4] = {{10, 20, 35, 60}, {5, 25, 30, 70}};
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        for (uint8_t core = 0; core < 2; core++)
+        {
+            fakeNow = stamps[core][i];
+            uintptr_t arg = core * 10 + i;
+            TEST_ASSERT_TRUE(logWrite(core, LOG_CLIENT_CONNECTED, fakeClock, &arg, 1));
+        }
+    }
+    LogRecord r;
+    uint32_t last = 0;
+    uint8_t count = 0;
+    while (logNext(r))
+    {
+        TEST_ASSERT_TRUE(r.timestampUs >= last);
+        TEST_ASSERT_EQUAL_UINT8(r.args[0] / 10, r.core);
+        last = r.timestampUs;
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT8(8, count);
+}
+
+// The clock is read once the cell is claimed, so records in one ring carry
+// the order they were claimed in, and merging near the 32-bit wrap still
+// goes by elapsed time
+void test_stamped_after_claim_and_across_wrap()
+{
+    fakeNow = 0xFFFFFFFEUL;
+    uintptr_t arg = 0;
+    TEST_ASSERT_TRUE(logWrite(0, LOG_DROPPED, steppingClock, &arg, 1)); // 0xFFFFFFFE
+    TEST_ASSERT_TRUE(logWrite(1, LOG_DROPPED, steppingClock, &arg, 1)); // 0xFFFFFFFF
+    TEST_ASSERT_TRUE(logWrite(0, LOG_DROPPED, steppingClock, &arg, 1)); // 0
+    TEST_ASSERT_TRUE(logWrite(1, LOG_DROPPED, steppingClock, &arg, 1)); // 1
+    const uint32_t order[] = {0xFFFFFFFEUL, 0xFFFFFFFFUL, 0, 1};
+    LogRecord r;
+    for (uint32_t expected : order)
+    {
+        TEST_ASSERT_TRUE(logNext(r));
+        TEST_ASSERT_EQUAL_UINT32(expected, r.timestampUs);
+    }
+    TEST_ASSERT_FALSE(logNext(r));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frames_decode_as_logged);
+    RUN_TEST(test_frame_layout);
+    RUN_TEST(test_next_merges_cores_by_time);
+    RUN_TEST(test_stamped_after_claim_and_across_wrap);
+    return UNITY_END();
+}
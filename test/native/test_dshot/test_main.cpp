@@ -0,0 +1,246 @@
+#include <DShot.h>
+#include <unity.h>
+#include <vector>
+
+// DShot framing against the published examples, and replies taken apart
+// the way DShotEsc captures them: line runs to bits, GCR to the period.
+
+#define BIT_TICKS 32 // reply bit at DShot600 in 25 ns RMT ticks, roughly
+
+void setUp() {}
+void tearDown() {}
+
+static const uint8_t GCR[16] = {0x19, 0x1B, 0x12, 0x13, 0x1D, 0x15, 0x16, 0x17,
+                                0x1A, 0x09, 0x0A, 0x0B, 0x1E, 0x0D, 0x0E, 0x0F};
+
+// Line bits for any 16 bit reply, checksum included as given
+static uint32_t lineBits(uint16_t reply)
+{
+    uint32_t gcr = 0;
+    for (int shift = 12; shift >= 0; shift -= 4)
+    {
+        gcr = gcr << 5 | GCR[(reply >> shift) & 0x0F];
+    }
+    uint32_t bits = 0;
+    uint8_t level = 0;
+    for (int i = 19; i >= 0; i--)
+    {
+        level ^= (gcr >> i) & 1;
+        bits = bits << 1 | level;
+    }
+    return bits;
+}
+
+static uint16_t replyChecksum(uint16_t value)
+{
+    return ~(value ^ (value >> 4) ^ (value >> 8)) & 0x0F;
+}
+
+// A period as a reply carries it, cut to a 9 bit mantissa
+static uint32_t carried(uint32_t period)
+{
+    uint8_t exponent = 0;
+    while (period >> exponent > 0x01FF)
+    {
+        exponent++;
+    }
+    return period >> exponent << exponent;
+}
+
+// What the RMT receiver hands over for a reply: idle high, the 21 line
+// bits as runs of one level with each run off by up to jitter ticks, and
+// no run for the high bits at the end, which merge into the idle line
+static std::vector<DShotRun> capture(uint32_t bits, int jitter)
+{
+    std::vector<DShotRun> runs = {{1, 400}};
+    int bit = DSHOT_REPLY_BITS - 1;
+    int n = 0;
+    while (bit >= 0)
+    {
+        uint8_t level = (bits >> bit) & 1;
+        uint16_t length = 0;
+        while (bit >= 0 && ((bits >> bit) & 1) == level)
+        {
+            length++;
+            bit--;
+        }
+        if (bit < 0 && level)
+        {
+            break;
+        }
+        int offset = n++ % 2 ? jitter : -jitter;
+        runs.push_back({level, (uint16_t)(length * BIT_TICKS + offset)});
+    }
+    return runs;
+}
+
+// 1046 without telemetry is the worked example in the DShot write-ups:
+// 10000010110 0 0110, and 1001 with the bidirectional checksum inverted
+void test_frame_checksum()
+{
+    TEST_ASSERT_EQUAL_HEX16(0x82C6, dshotFrame(1046, false, false));
+    TEST_ASSERT_EQUAL_HEX16(0x82C9, dshotFrame(1046, false, true));
+    TEST_ASSERT_EQUAL_HEX16(0x0000, dshotFrame(0, false, false));
+    TEST_ASSERT_EQUAL_HEX16(0x000F, dshotFrame(0, false, true));
+    // Command 13 (extended telemetry enable) needs the telemetry bit
+    TEST_ASSERT_EQUAL_HEX16(0x01BA, dshotFrame(13, true, false));
+    // Values past 11 bits are cut rather than spilling into the checksum
+    TEST_ASSERT_EQUAL_HEX16(dshotFrame(2047, false, false), dshotFrame(0xFFFF, false, false));
+
+    for (uint16_t value = 0; value < 2048; value++)
+    {
+        for (int telemetry = 0; telemetry < 2; telemetry++)
+        {
+            uint16_t normal = dshotFrame(value, telemetry, false);
+            uint16_t inverted = dshotFrame(value, telemetry, true);
+            TEST_ASSERT_EQUAL_HEX16(value << 5 | telemetry << 4, normal & 0xFFF0);
+            TEST_ASSERT_EQUAL_HEX16(normal ^ 0x000F, inverted);
+            uint16_t sum = (normal >> 4 ^ normal >> 8 ^ normal >> 12) & 0x0F;
+            TEST_ASSERT_EQUAL_HEX8(sum, normal & 0x0F);
+        }
+    }
+}
+
+void test_throttle_range()
+{
+    TEST_ASSERT_EQUAL_UINT16(0, dshotThrottle(0));
+    TEST_ASSERT_EQUAL_UINT16(DSHOT_THROTTLE_MIN + 11, dshotThrottle(1));
+    TEST_ASSERT_EQUAL_UINT16(DSHOT_THROTTLE_MAX, dshotThrottle(180));
+    TEST_ASSERT_EQUAL_UINT16(DSHOT_THROTTLE_MAX, dshotThrottle(255));
+}
+
+// Every period a reply can carry comes back exactly; the rest come back
+// rounded down to the 9 bit mantissa
+void test_reply_round_trip()
+{
+    for (uint32_t exponent = 0; exponent < 8; exponent++)
+    {
+        for (uint32_t mantissa = 1; mantissa < 512; mantissa++)
+        {
+            uint32_t period = mantissa << exponent;
+            if ((exponent > 0 && mantissa < 256) || (exponent == 7 && mantissa == 511))
+            {
+                continue; // a smaller exponent carries it, or it is the stopped code
+            }
+            uint32_t bits = dshotEncodeReply(period);
+            TEST_ASSERT_TRUE(bits < (1UL << (DSHOT_REPLY_BITS - 1))); // start bit low
+            uint32_t decoded = 0;
+            TEST_ASSERT_TRUE(dshotDecodeReply(bits, decoded));
+            TEST_ASSERT_EQUAL_UINT32(period, decoded);
+        }
+    }
+    for (uint32_t period = 1; period < 65408; period += 37)
+    {
+        uint32_t decoded = 0;
+        TEST_ASSERT_TRUE(dshotDecodeReply(dshotEncodeReply(period), decoded));
+        TEST_ASSERT_EQUAL_UINT32(carried(period), decoded);
+        TEST_ASSERT_TRUE(period - decoded <= period / 256);
+    }
+}
+
+// The line bits the ESC sends match GCR and NRZI done by hand
+void test_gcr_encoding()
+{
+    for (uint16_t value = 0; value < 0x0FFF; value++)
+    {
+        uint16_t exponent = value >> 9;
+        uint16_t mantissa = value & 0x01FF;
+        uint16_t reply = value << 4 | replyChecksum(value);
+        uint32_t decoded = 0;
+        TEST_ASSERT_TRUE(dshotDecodeReply(lineBits(reply), decoded));
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)mantissa << exponent, decoded);
+        // The encoder uses the smallest exponent that fits
+        if (exponent == 0 || mantissa >= 256)
+        {
+            TEST_ASSERT_EQUAL_HEX32(lineBits(reply), dshotEncodeReply((uint32_t)mantissa << exponent));
+        }
+    }
+}
+
+// A motor at rest answers with the largest period there is
+void test_stopped_reply()
+{
+    uint32_t decoded = 0;
+    TEST_ASSERT_EQUAL_HEX32(lineBits(0xFFF0 | replyChecksum(0x0FFF)), dshotEncodeReply(DSHOT_PERIOD_STOPPED));
+    TEST_ASSERT_TRUE(dshotDecodeReply(dshotEncodeReply(DSHOT_PERIOD_STOPPED), decoded));
+    TEST_ASSERT_EQUAL_UINT32(DSHOT_PERIOD_STOPPED, decoded);
+    TEST_ASSERT_EQUAL_UINT32(0, dshotRpm(decoded, 14));
+    // Periods too long to carry read as stopped too
+    TEST_ASSERT_TRUE(dshotDecodeReply(dshotEncodeReply(70000), decoded));
+    TEST_ASSERT_EQUAL_UINT32(DSHOT_PERIOD_STOPPED, decoded);
+    // 14 poles, 100 us per electrical turn: 85714 RPM
+    TEST_ASSERT_EQUAL_UINT32(85714, dshotRpm(100, 14));
+}
+
+void test_bad_replies_rejected()
+{
+    uint32_t decoded = 1234;
+    // Valid GCR, checksum off by one
+    TEST_ASSERT_FALSE(dshotDecodeReply(lineBits(0x1230 | ((replyChecksum(0x123) + 1) & 0x0F)), decoded));
+    // Line held low: GCR 00000 is not a symbol
+    TEST_ASSERT_FALSE(dshotDecodeReply(0, decoded));
+    TEST_ASSERT_EQUAL_UINT32(1234, decoded);
+
+    // One line bit flipped anywhere in a reply is caught
+    uint32_t bits = dshotEncodeReply(1000);
+    for (int bit = 0; bit < DSHOT_REPLY_BITS - 1; bit++)
+    {
+        TEST_ASSERT_FALSE(dshotDecodeReply(bits ^ (1UL << bit), decoded));
+    }
+}
+
+void test_runs_to_bits()
+{
+    const uint32_t periods[] = {1, 100, 511, 1000, 4321, 65000, DSHOT_PERIOD_STOPPED};
+    for (uint32_t period : periods)
+    {
+        uint32_t bits = dshotEncodeReply(period);
+        for (int jitter : {0, BIT_TICKS / 3, -BIT_TICKS / 3})
+        {
+            std::vector<DShotRun> runs = capture(bits, jitter);
+            uint32_t got = 0;
+            TEST_ASSERT_TRUE(dshotRunsToBits(runs.data(), runs.size(), BIT_TICKS, got));
+            TEST_ASSERT_EQUAL_HEX32(bits, got);
+            uint32_t decoded = 0;
+            TEST_ASSERT_TRUE(dshotDecodeReply(got, decoded));
+            TEST_ASSERT_EQUAL_UINT32(period == DSHOT_PERIOD_STOPPED ? period : carried(period), decoded);
+        }
+    }
+}
+
+// A reply ending in high bits leaves them out of the capture, and a last
+// high run that reaches into the idle line is cut at 21 bits
+void test_runs_with_trailing_idle()
+{
+    // 0 then 20 ones: only the start bit is captured
+    DShotRun startOnly[] = {{1, 500}, {0, BIT_TICKS}};
+    uint32_t bits = 0;
+    TEST_ASSERT_TRUE(dshotRunsToBits(startOnly, 2, BIT_TICKS, bits));
+    TEST_ASSERT_EQUAL_HEX32(0x0FFFFF, bits);
+
+    // The receiver timing out on a long idle: one high run far past the end
+    DShotRun longIdle[] = {{0, 2 * BIT_TICKS}, {1, 3 * BIT_TICKS}, {0, BIT_TICKS}, {1, 400 * BIT_TICKS}};
+    TEST_ASSERT_TRUE(dshotRunsToBits(longIdle, 4, BIT_TICKS, bits));
+    TEST_ASSERT_EQUAL_HEX32(0x077FFF, bits); // 00 111 0, then 15 ones
+
+    // Low bits past the end are not a reply
+    DShotRun tooLong[] = {{0, 2 * BIT_TICKS}, {1, 18 * BIT_TICKS}, {0, 3 * BIT_TICKS}};
+    TEST_ASSERT_FALSE(dshotRunsToBits(tooLong, 3, BIT_TICKS, bits));
+    // Nothing but idle
+    DShotRun idle[] = {{1, 1000}};
+    TEST_ASSERT_FALSE(dshotRunsToBits(idle, 1, BIT_TICKS, bits));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_checksum);
+    RUN_TEST(test_throttle_range);
+    RUN_TEST(test_reply_round_trip);
+    RUN_TEST(test_gcr_encoding);
+    RUN_TEST(test_stopped_reply);
+    RUN_TEST(test_bad_replies_rejected);
+    RUN_TEST(test_runs_to_bits);
+    RUN_TEST(test_runs_with_trailing_idle);
+    return UNITY_END();
+}
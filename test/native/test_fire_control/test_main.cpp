@@ -0,0 +1,184 @@
+#include <FireControl.h>
+#include <unity.h>
+
+// Fire sequencer timing and loader outputs, driven with a fake clock the
+// way the flywheel task drives it.
+
+static FireControl fire;
+
+void setUp()
+{
+    fire = FireControl();
+}
+void tearDown() {}
+
+// Ticks at every deadline until the sequence is idle or warm again,
+// recording the loader angle of each shot. now is left where it came to rest
+static int runToRest(uint32_t &now, uint8_t *angles, int maxShots)
+{
+    int shots = 0;
+    for (int i = 0; i < 1000 && fire.busy(); i++)
+    {
+        uint32_t before = fire.shotCount();
+        uint32_t wait = fire.tick(now);
+        if (fire.shotCount() != before && shots < maxShots)
+        {
+            angles[shots++] = fire.outputs().loaderAngle;
+        }
+        if (wait == FIRE_NO_DEADLINE || !fire.busy())
+        {
+            break;
+        }
+        now += wait;
+    }
+    return shots;
+}
+
+void test_latency_runs_from_arrival()
+{
+    // The fire task woke 40 ms after the request reached the turret
+    uint32_t arrived = 1000;
+    uint32_t now = arrived + 40;
+    fire.trigger(0, 60, now, arrived);
+    uint8_t angles[8];
+    TEST_ASSERT_EQUAL(1, runToRest(now, angles, 8));
+    TEST_ASSERT_EQUAL_UINT32(arrived, fire.lastShot().triggerMs);
+    TEST_ASSERT_EQUAL_UINT32(40 + fire.config.spinUpMs, fire.lastTriggerToFeedMs());
+}
+
+void test_feed_angle_by_mode()
+{
+    uint32_t now = 0;
+    uint8_t angles[8];
+    fire.trigger(0, 60, now, now);
+    TEST_ASSERT_EQUAL(1, runToRest(now, angles, 8));
+    TEST_ASSERT_EQUAL_UINT8(fire.config.feedAngle, angles[0]);
+
+    fire.trigger(1, 60, now, now);
+    TEST_ASSERT_EQUAL(3, runToRest(now, angles, 8));
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(fire.config.burstFeedAngle, angles[i]);
+    }
+
+    fire.trigger(2, 60, now, now);
+    TEST_ASSERT_EQUAL(7, runToRest(now, angles, 8));
+    TEST_ASSERT_EQUAL_UINT8(fire.config.burstFeedAngle, angles[6]);
+    TEST_ASSERT_EQUAL_UINT8(fire.config.restAngle, fire.outputs().loaderAngle);
+}
+
+void test_abort_stops_feeding()
+{
+    uint32_t now = 0;
+    fire.trigger(2, 60, now, now);
+    now += fire.tick(now);
+    now += fire.tick(now); // first dart fed
+    TEST_ASSERT_EQUAL_UINT32(1, fire.shotCount());
+    fire.abort(now);
+    TEST_ASSERT_EQUAL_UINT8(fire.config.restAngle, fire.outputs().loaderAngle);
+    uint8_t angles[8];
+    TEST_ASSERT_EQUAL(0, runToRest(now, angles, 8));
+    TEST_ASSERT_EQUAL_UINT32(1, fire.shotCount());
+}
+
+// Burst and auto cycle a dart a second, semi settles for 400 ms after the push
+void test_loader_timings_by_mode()
+{
+    uint32_t now = 0;
+    fire.trigger(1, 60, now, now);
+    now += fire.tick(now); // spun up
+    TEST_ASSERT_EQUAL_UINT32(fire.config.burstFeedMs, fire.tick(now));
+    uint32_t firstFeed = fire.lastShot().feedMs;
+    uint8_t angles[8];
+    TEST_ASSERT_EQUAL(2, runToRest(now, angles, 8));
+    TEST_ASSERT_EQUAL_UINT32(firstFeed + 2000, fire.lastShot().feedMs);
+    TEST_ASSERT_EQUAL_UINT32(firstFeed + 3000, now);
+
+    fire.trigger(0, 60, now, now);
+    now += fire.tick(now);
+    TEST_ASSERT_EQUAL_UINT32(fire.config.feedMs, fire.tick(now));
+    uint32_t feed = fire.lastShot().feedMs;
+    TEST_ASSERT_EQUAL(0, runToRest(now, angles, 8));
+    TEST_ASSERT_EQUAL_UINT32(feed + 700, now);
+}
+
+// Warm idle holds the wheels after a sequence, then lets them stop
+void test_warm_idle_holds_then_times_out()
+{
+    fire.config.warmSpeed = 20;
+    fire.config.warmTimeoutMs = 5000;
+    uint32_t now = 0;
+    uint8_t angles[8];
+    fire.trigger(0, 60, now, now);
+    TEST_ASSERT_EQUAL(1, runToRest(now, angles, 8));
+    TEST_ASSERT_EQUAL(FIRE_WARM, fire.state());
+    TEST_ASSERT_FALSE(fire.busy());
+    TEST_ASSERT_EQUAL_UINT8(20, fire.outputs().flywheelSpeed);
+    TEST_ASSERT_FALSE(fire.outputs().loaderAttached);
+
+    TEST_ASSERT_EQUAL_UINT32(5000, fire.tick(now));
+    TEST_ASSERT_EQUAL_UINT32(1, fire.tick(now + 4999));
+    TEST_ASSERT_EQUAL(FIRE_WARM, fire.state());
+    TEST_ASSERT_EQUAL_UINT32(FIRE_NO_DEADLINE, fire.tick(now + 5000));
+    TEST_ASSERT_EQUAL(FIRE_IDLE, fire.state());
+    TEST_ASSERT_EQUAL_UINT8(0, fire.outputs().flywheelSpeed);
+}
+
+// From warm idle a trigger only waits the warm spin-up, or none at all when
+// the wheels already turn fast enough
+void test_warm_spin_up()
+{
+    fire.config.warmSpeed = 20;
+    uint32_t now = 0;
+    uint8_t angles[8];
+    fire.trigger(0, 60, now, now);
+    runToRest(now, angles, 8);
+
+    now += 3000;
+    fire.trigger(0, 60, now, now);
+    TEST_ASSERT_EQUAL(FIRE_SPIN_UP, fire.state());
+    TEST_ASSERT_EQUAL_UINT8(60, fire.outputs().flywheelSpeed);
+    TEST_ASSERT_EQUAL_UINT32(fire.config.warmSpinUpMs, fire.tick(now));
+    TEST_ASSERT_EQUAL(1, runToRest(now, angles, 8));
+    TEST_ASSERT_EQUAL_UINT32(fire.config.warmSpinUpMs, fire.lastTriggerToFeedMs());
+
+    fire.trigger(0, 20, now, now);
+    fire.tick(now);
+    TEST_ASSERT_EQUAL(FIRE_FEED, fire.state());
+    TEST_ASSERT_EQUAL_UINT32(0, fire.lastTriggerToFeedMs());
+}
+
+// A trigger mid-burst restarts the count on the running wheels
+void test_retrigger_restarts_burst()
+{
+    uint32_t now = 0;
+    fire.trigger(1, 60, now, now);
+    now += fire.tick(now); // spun up
+    now += fire.tick(now); // first dart fed
+    now += fire.tick(now); // retracted
+    fire.tick(now);        // second dart fed
+    TEST_ASSERT_EQUAL_UINT32(2, fire.shotCount());
+    TEST_ASSERT_EQUAL(FIRE_FEED, fire.state());
+
+    fire.trigger(1, 60, now, now);
+    TEST_ASSERT_EQUAL(FIRE_FEED, fire.state());
+    uint8_t angles[8];
+    TEST_ASSERT_EQUAL(3, runToRest(now, angles, 8));
+    TEST_ASSERT_EQUAL_UINT32(5, fire.shotCount());
+    // No second spin-up: the next dart followed the feed and retract in flight
+    TEST_ASSERT_EQUAL_UINT32(fire.shot(2).feedMs, fire.shot(3).feedMs + 1000);
+    TEST_ASSERT_EQUAL_UINT32(1000, fire.shot(2).feedMs - fire.shot(2).triggerMs);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_latency_runs_from_arrival);
+    RUN_TEST(test_feed_angle_by_mode);
+    RUN_TEST(test_abort_stops_feeding);
+    RUN_TEST(test_loader_timings_by_mode);
+    RUN_TEST(test_warm_idle_holds_then_times_out);
+    RUN_TEST(test_warm_spin_up);
+    RUN_TEST(test_retrigger_restarts_burst);
+    return UNITY_END();
+}
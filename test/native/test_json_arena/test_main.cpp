@@ -0,0 +1,79 @@
+#include <JsonArena.h>
+#include <TelemetryPublisher.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+
+// Every kind of JSON command the websocket accepts, at up to
+// COMMAND_MAX_LENGTH, has to parse inside JSON_ARENA_SIZE. Prints the
+// arena's high water mark over all of them so the size can be checked
+// against the library version in use; JsonArena.h has the figure expected
+// from ArduinoJson 7.2, the subscription below being the largest.
+
+static JsonArena<JSON_ARENA_SIZE> arena;
+static size_t peak;
+
+void setUp()
+{
+    arena.reset();
+}
+void tearDown() {}
+
+static void parse(const std::string &command, const char *field)
+{
+    TEST_ASSERT_TRUE_MESSAGE(command.size() <= COMMAND_MAX_LENGTH, command.c_str());
+    arena.reset();
+    {
+        JsonDocument doc(&arena);
+        DeserializationError error = deserializeJson(doc, command.c_str(), command.size());
+        TEST_ASSERT_FALSE_MESSAGE(error, command.c_str());
+        TEST_ASSERT_FALSE_MESSAGE(doc[field].isNull(), command.c_str());
+    }
+    peak = arena.highWater() > peak ? arena.highWater() : peak;
+}
+
+void test_commands_fit()
+{
+    parse("{\"camServoPan\":512,\"camServoTilt\":300,\"fire\":1}", "camServoPan");
+    parse("{\"mode\":0,\"pan\":1000,\"tilt\":1000,\"motor_speed\":1000,\"fire_mode\":2,\"flywheel_speed\":180,"
+          "\"fire\":1,\"reset\":0,\"warm_speed\":60,\"warm_timeout\":100000,\"scan_pattern\":3,\"scan_dwell\":5000,"
+          "\"abort\":1,\"camServoPan\":1000,\"camServoTilt\":1000}",
+          "scan_dwell");
+    parse("{\"metrics\":1}", "metrics");
+}
+
+// A subscription naming as many fields as fit in one message
+void test_longest_subscription_fits()
+{
+    std::string command = "{\"subscribe\":{\"rate\":50,\"keyframe\":1000,\"fields\":[";
+    for (uint8_t i = 0; i < TELEMETRY_FIELD_COUNT; i++)
+    {
+        std::string name = std::string(i ? "," : "") + "\"" + TelemetryPublisher::fieldName(i) + "\"";
+        if (command.size() + name.size() + 3 > COMMAND_MAX_LENGTH)
+        {
+            break;
+        }
+        command += name;
+    }
+    command += "]}}";
+    parse(command, "subscribe");
+}
+
+void test_report_peak()
+{
+    char report[96];
+    snprintf(report, sizeof(report), "arena peak %zu of %u bytes (%zu-bit)", peak, (unsigned)JSON_ARENA_SIZE,
+             sizeof(void *) * 8);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_TRUE(peak <= JSON_ARENA_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_commands_fit);
+    RUN_TEST(test_longest_subscription_fits);
+    RUN_TEST(test_report_peak);
+    return UNITY_END();
+}
@@ -0,0 +1,269 @@
+#include <LX824Bus.h>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+// LX-824 parser and scheduler against scripted byte streams, the same way
+// uartCommunicationTask drives them but with a fake microsecond clock.
+
+#define PAN 1
+#define TILT 2
+
+static std::vector<std::vector<uint8_t>> sent;
+static LX824Bus bus;
+static LX824Parser parser;
+
+static void capture(const uint8_t *data, size_t length, void *context)
+{
+    sent.push_back(std::vector<uint8_t>(data, data + length));
+}
+
+void setUp()
+{
+    sent.clear();
+    bus.~LX824Bus();
+    new (&bus) LX824Bus();
+    bus.begin(capture, nullptr);
+    bus.addServo(PAN);
+    bus.addServo(TILT);
+    parser = LX824Parser();
+}
+void tearDown() {}
+
+static std::vector<uint8_t> frame(uint8_t id, uint8_t command, std::vector<uint8_t> params)
+{
+    uint8_t bytes[LX824_MAX_FRAME];
+    size_t length = lx824Encode(id, command, params.data(), (uint8_t)params.size(), bytes);
+    return std::vector<uint8_t>(bytes, bytes + length);
+}
+
+// Feeds bytes through the parser into the bus, returns the frames parsed
+static int deliver(const std::vector<uint8_t> &bytes, uint32_t now)
+{
+    int frames = 0;
+    for (uint8_t byte : bytes)
+    {
+        if (parser.feed(byte))
+        {
+            bus.onFrame(parser.frame(), now);
+            frames++;
+        }
+    }
+    return frames;
+}
+
+static std::vector<uint8_t> positionReply(uint8_t id, int16_t position)
+{
+    return frame(id, LX824_CMD_POS_READ, {(uint8_t)(position & 0xFF), (uint8_t)((uint16_t)position >> 8)});
+}
+
+void test_parser_resyncs_after_noise()
+{
+    std::vector<uint8_t> stream = {0x00, 0x55, 0x13, 0x55}; // a lone header byte and junk
+    std::vector<uint8_t> good = positionReply(PAN, 500);
+    std::vector<uint8_t> corrupt = good;
+    corrupt[5] ^= 0x01;                                     // bad checksum
+    std::vector<uint8_t> badLength = {0x55, 0x55, PAN, 0x02}; // length under 3
+    stream.insert(stream.end(), corrupt.begin(), corrupt.end());
+    stream.insert(stream.end(), badLength.begin(), badLength.end());
+    stream.insert(stream.end(), good.begin(), good.end());
+    stream.push_back(0x55); // shifted header in front of the next frame
+    stream.insert(stream.end(), good.begin(), good.end());
+
+    int frames = 0;
+    for (uint8_t byte : stream)
+    {
+        if (parser.feed(byte))
+        {
+            frames++;
+            TEST_ASSERT_EQUAL_UINT8(PAN, parser.frame().id);
+            TEST_ASSERT_EQUAL_UINT8(LX824_CMD_POS_READ, parser.frame().command);
+            TEST_ASSERT_EQUAL_UINT8(500 & 0xFF, parser.frame().params[0]);
+        }
+    }
+    TEST_ASSERT_EQUAL(2, frames);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.checksumErrors);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.framingErrors);
+}
+
+void test_reply_updates_reading()
+{
+    bus.setPollPeriod(40000);
+    bus.poll(0);
+    TEST_ASSERT_TRUE(bus.awaitingReply());
+    TEST_ASSERT_TRUE(sent.back() == frame(PAN, LX824_CMD_POS_READ, {}));
+
+    // The request echoes back on the half duplex line before the reply
+    TEST_ASSERT_EQUAL(1, deliver(sent.back(), 100));
+    TEST_ASSERT_TRUE(bus.awaitingReply());
+    deliver(positionReply(PAN, -12), 900);
+    TEST_ASSERT_FALSE(bus.awaitingReply());
+
+    LX824Reading reading;
+    TEST_ASSERT_TRUE(bus.reading(PAN, reading));
+    TEST_ASSERT_EQUAL_INT16(-12, reading.position);
+    TEST_ASSERT_EQUAL_UINT32(900, reading.positionAt);
+    TEST_ASSERT_EQUAL_UINT32(1, bus.repliesMatched);
+    TEST_ASSERT_FALSE(bus.reading(9, reading));
+
+    // A reply for the wrong servo is not taken as the answer
+    bus.poll(1000);
+    deliver(positionReply(PAN, 7), 1100);
+    TEST_ASSERT_TRUE(bus.awaitingReply());
+    TEST_ASSERT_EQUAL_UINT32(1, bus.unexpectedFrames);
+}
+
+void test_read_times_out()
+{
+    bus.setPollPeriod(40000);
+    bus.replyTimeoutUs = 5000;
+    TEST_ASSERT_EQUAL_UINT32(5000, bus.poll(0));
+    TEST_ASSERT_EQUAL_UINT32(3000, bus.poll(2000));
+    size_t framesBefore = sent.size();
+    bus.poll(5000); // gives up on the position, moves on to the temperature
+    TEST_ASSERT_EQUAL(framesBefore + 1, sent.size());
+    TEST_ASSERT_TRUE(sent.back() == frame(PAN, LX824_CMD_TEMP_READ, {}));
+
+    LX824Reading reading;
+    bus.reading(PAN, reading);
+    TEST_ASSERT_EQUAL_UINT32(1, reading.timeouts);
+    TEST_ASSERT_EQUAL_UINT32(0, reading.positionAt);
+
+    // A late reply to the abandoned read is ignored
+    deliver(positionReply(PAN, 300), 5500);
+    bus.reading(PAN, reading);
+    TEST_ASSERT_EQUAL_UINT32(0, reading.positionAt);
+    TEST_ASSERT_EQUAL_UINT32(1, bus.unexpectedFrames);
+}
+
+void test_moves_are_latest_wins()
+{
+    bus.requestMove(PAN, 100, 10);
+    bus.requestMove(PAN, 200, 20);
+    bus.requestMove(TILT, 300, 30);
+    bus.requestMove(PAN, 400, 40);
+    bus.poll(0);
+    TEST_ASSERT_EQUAL(2, sent.size());
+    TEST_ASSERT_TRUE(sent[0] == frame(PAN, LX824_CMD_MOVE_TIME_WRITE, {400 & 0xFF, 400 >> 8, 40, 0}));
+    TEST_ASSERT_TRUE(sent[1] == frame(TILT, LX824_CMD_MOVE_TIME_WRITE, {300 & 0xFF, 300 >> 8, 30, 0}));
+
+    // Nothing new, nothing sent
+    bus.poll(10);
+    TEST_ASSERT_EQUAL(2, sent.size());
+
+    // A move requested while a read is out waits for the reply (the line is
+    // the servo's until then), then goes ahead of the queued reads
+    bus.setPollPeriod(40000);
+    bus.poll(20);
+    TEST_ASSERT_TRUE(bus.awaitingReply());
+    bus.requestMove(TILT, 500, 50);
+    bus.poll(30);
+    TEST_ASSERT_EQUAL(3, sent.size());
+    deliver(positionReply(PAN, 0), 40);
+    bus.poll(50);
+    TEST_ASSERT_TRUE(sent[3] == frame(TILT, LX824_CMD_MOVE_TIME_WRITE, {500 & 0xFF, 500 >> 8, 50, 0}));
+    TEST_ASSERT_TRUE(sent[4] == frame(PAN, LX824_CMD_TEMP_READ, {}));
+}
+
+// Moves echo back too, and are no more a reply than the read requests are
+void test_echoes_of_moves_are_dropped()
+{
+    bus.setPollPeriod(40000);
+    bus.requestMove(PAN, 100, 10);
+    bus.requestMove(TILT, 200, 20);
+    bus.poll(0);
+    TEST_ASSERT_EQUAL(3, sent.size());
+    TEST_ASSERT_TRUE(bus.awaitingReply());
+
+    std::vector<uint8_t> line;
+    for (const std::vector<uint8_t> &written : sent)
+    {
+        line.insert(line.end(), written.begin(), written.end());
+    }
+    TEST_ASSERT_EQUAL(3, deliver(line, 100));
+    TEST_ASSERT_TRUE(bus.awaitingReply());
+    deliver(positionReply(PAN, 42), 900);
+    TEST_ASSERT_FALSE(bus.awaitingReply());
+    TEST_ASSERT_EQUAL_UINT32(1, bus.repliesMatched);
+    TEST_ASSERT_EQUAL_UINT32(0, bus.unexpectedFrames);
+
+    // An echo that comes back twice, or a move we never wrote, is not ours
+    deliver(sent[0], 1000);
+    deliver(frame(PAN, LX824_CMD_MOVE_TIME_WRITE, {1, 0, 10, 0}), 1000);
+    TEST_ASSERT_EQUAL_UINT32(2, bus.unexpectedFrames);
+
+    // A lost echo does not stop the ones behind it from being recognised
+    bus.requestMove(PAN, 300, 30);
+    bus.requestMove(TILT, 400, 40);
+    bus.poll(2000);
+    deliver(sent[sent.size() - 1], 2100);
+    TEST_ASSERT_EQUAL_UINT32(2, bus.unexpectedFrames);
+    deliver(sent[sent.size() - 2], 2200);
+    TEST_ASSERT_EQUAL_UINT32(3, bus.unexpectedFrames);
+}
+
+// Answers whatever read the bus has outstanding with value
+static void answer(uint32_t now, int16_t value)
+{
+    const std::vector<uint8_t> &request = sent.back();
+    uint8_t id = request[2];
+    uint8_t command = request[4];
+    if (command == LX824_CMD_TEMP_READ)
+    {
+        deliver(frame(id, command, {(uint8_t)value}), now);
+    }
+    else
+    {
+        deliver(frame(id, command, {(uint8_t)(value & 0xFF), (uint8_t)((uint16_t)value >> 8)}), now);
+    }
+}
+
+// The telemetry task copies readings while the bus task updates them; every
+// copy must be one the bus task published
+void test_reading_is_never_torn()
+{
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> copies{0}, torn{0};
+    std::thread reader([&]()
+                       {
+        LX824Reading reading;
+        while (!done.load())
+        {
+            bus.reading(PAN, reading);
+            // Each reply stamps its value times three as the time
+            if (reading.positionAt != (uint32_t)reading.position * 3)
+            {
+                torn++;
+            }
+            copies++;
+        } });
+    bus.setPollPeriod(1);
+    for (int16_t i = 1; i < 30000; i++)
+    {
+        uint32_t now = (uint32_t)i * 3;
+        bus.poll(now);
+        answer(now, i);
+    }
+    done = true;
+    reader.join();
+
+    LX824Reading reading;
+    bus.reading(PAN, reading);
+    TEST_ASSERT_TRUE(reading.position > 10000);
+    TEST_ASSERT_TRUE(copies.load() > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_parser_resyncs_after_noise);
+    RUN_TEST(test_reply_updates_reading);
+    RUN_TEST(test_read_times_out);
+    RUN_TEST(test_moves_are_latest_wins);
+    RUN_TEST(test_echoes_of_moves_are_dropped);
+    RUN_TEST(test_reading_is_never_torn);
+    return UNITY_END();
+}
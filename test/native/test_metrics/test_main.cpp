@@ -0,0 +1,258 @@
+#include <Metrics.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+// Histogram buckets and percentiles, task busy totals past the 32 bit
+// range, a busy window per reporter, the /metrics and websocket reports,
+// and what recording costs on this host.
+
+#define OVERHEAD_SAMPLES 1000000
+
+void setUp() {}
+void tearDown() {}
+
+static double nowNs()
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Value of the sample line starting with prefix as written, "none" if
+// there is no such line
+static std::string sample(const std::string &page, const std::string &prefix)
+{
+    size_t at = page.find("\n" + prefix + " ");
+    if (at == std::string::npos)
+    {
+        return "none";
+    }
+    at += 1 + prefix.size() + 1;
+    return page.substr(at, page.find('\n', at) - at);
+}
+
+void test_values_land_in_power_of_two_buckets()
+{
+    MetricsHistogram histogram("test");
+    for (uint32_t us : {0u, 1u, 2u, 3u, 4u, 1023u, 1024u, 0xFFFFFFFFu})
+    {
+        histogram.record(us);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.bucket(0));  // 0
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.bucket(1));  // 1
+    TEST_ASSERT_EQUAL_UINT32(2, histogram.bucket(2));  // 2, 3
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.bucket(3));  // 4
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.bucket(10)); // 1023
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.bucket(11)); // 1024
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.bucket(METRICS_BUCKETS - 1));
+    TEST_ASSERT_EQUAL_UINT32(8, histogram.count());
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFFu, histogram.max());
+
+    // The sum carries past 32 bits
+    uint64_t expected = 0 + 1 + 2 + 3 + 4 + 1023 + 1024 + 0xFFFFFFFFull;
+    TEST_ASSERT_TRUE(histogram.sum() == expected);
+    histogram.record(0xF0000000u);
+    TEST_ASSERT_TRUE(histogram.sum() == expected + 0xF0000000ull);
+}
+
+void test_percentiles_are_bucket_limits()
+{
+    MetricsHistogram histogram("test");
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.percentile(0.5f));
+    for (int i = 0; i < 90; i++)
+    {
+        histogram.record(10); // bucket 4, below 16
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        histogram.record(700); // bucket 10, below 1024
+    }
+    TEST_ASSERT_EQUAL_UINT32(16, histogram.percentile(0.5f));
+    TEST_ASSERT_EQUAL_UINT32(16, histogram.percentile(0.89f));
+    // Capped at the largest value seen rather than the bucket's limit
+    TEST_ASSERT_EQUAL_UINT32(700, histogram.percentile(0.9f));
+    TEST_ASSERT_EQUAL_UINT32(700, histogram.percentile(0.99f));
+}
+
+// Over 71 minutes of busy time, where a 32 bit microsecond total wraps,
+// measured with a 32 bit clock that wraps too
+void test_busy_total_does_not_wrap()
+{
+    MetricsTaskLoad load;
+    uint32_t clock = 0xFFFFF000u;
+    uint64_t expected = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        load.busy(clock);
+        clock += 1000000000u; // 1000 s busy
+        load.idle(clock);
+        expected += 1000000000u;
+        clock += 500000000u; // and 500 s blocked
+        load.idle(clock);    // idle() without busy() adds nothing
+    }
+    TEST_ASSERT_TRUE(expected > 0xFFFFFFFFull);
+    TEST_ASSERT_TRUE(load.busyUs() == expected);
+}
+
+// /metrics and a websocket client asking at different times each get the
+// share since they last asked
+void test_each_reporter_has_its_own_window()
+{
+    MetricsTaskLoad load;
+    MetricsWindow scrape;
+    MetricsWindow client;
+
+    // Busy half of the first second, all of the second
+    load.busy(0);
+    load.idle(500000);
+    TEST_ASSERT_EQUAL_UINT16(500, metricsBusyShare(load, scrape, 0, 1000000));
+    scrape.startUs = 1000000;
+    load.busy(1000000);
+    load.idle(2000000);
+    TEST_ASSERT_EQUAL_UINT16(750, metricsBusyShare(load, client, 0, 2000000));
+    client.startUs = 2000000;
+    TEST_ASSERT_EQUAL_UINT16(1000, metricsBusyShare(load, scrape, 0, 2000000));
+    scrape.startUs = 2000000;
+
+    // A report with nothing in between is idle, not a division by zero
+    TEST_ASSERT_EQUAL_UINT16(0, metricsBusyShare(load, client, 0, 2000000));
+    TEST_ASSERT_EQUAL_UINT16(0, metricsBusyShare(load, client, 0, 3000000));
+}
+
+struct Fixture
+{
+    MetricsHistogram latency{"latency_us"};
+    MetricsHistogram empty{"empty_us"};
+    MetricsHistogram *histograms[2] = {&latency, &empty};
+    MetricsTaskLoad tasks[2];
+    MetricsSources sources = {histograms, 2, tasks, 2, 42, 17};
+
+    Fixture()
+    {
+        tasks[0].name = "ServoControlTask";
+        tasks[0].stackFreeBytes = 1200;
+        tasks[1].name = "LogTask";
+        tasks[1].stackFreeBytes = 800;
+        for (uint32_t us : {3u, 5u, 6u, 100u, 100u})
+        {
+            latency.record(us);
+        }
+        tasks[0].busy(0);
+        tasks[0].idle(250000);
+    }
+};
+
+void test_prometheus_page()
+{
+    Fixture fixture;
+    MetricsWindow window;
+    char out[METRICS_REPORT_SIZE];
+    uint64_t nowUs = 5000000000ull; // past the 32 bit range
+    size_t length = metricsWritePrometheus(out, sizeof(out), fixture.sources, window, nowUs);
+    TEST_ASSERT_EQUAL_size_t(strlen(out), length);
+    std::string page = std::string("\n") + out;
+
+    TEST_ASSERT_TRUE(page.find("\n# TYPE turret_uptime_us counter\n") != std::string::npos);
+    TEST_ASSERT_EQUAL_STRING("5000000000", sample(page, "turret_uptime_us").c_str());
+
+    // Cumulative buckets from the first one in use to the last, then +Inf
+    TEST_ASSERT_TRUE(page.find("\n# TYPE turret_latency_us histogram\n") != std::string::npos);
+    TEST_ASSERT_EQUAL_STRING("none", sample(page, "turret_latency_us_bucket{le=\"1\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("1", sample(page, "turret_latency_us_bucket{le=\"3\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("3", sample(page, "turret_latency_us_bucket{le=\"7\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("3", sample(page, "turret_latency_us_bucket{le=\"63\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("5", sample(page, "turret_latency_us_bucket{le=\"127\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("none", sample(page, "turret_latency_us_bucket{le=\"255\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("5", sample(page, "turret_latency_us_bucket{le=\"+Inf\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("214", sample(page, "turret_latency_us_sum").c_str());
+    TEST_ASSERT_EQUAL_STRING("5", sample(page, "turret_latency_us_count").c_str());
+    TEST_ASSERT_EQUAL_STRING("0", sample(page, "turret_empty_us_bucket{le=\"+Inf\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("0", sample(page, "turret_empty_us_count").c_str());
+
+    TEST_ASSERT_EQUAL_STRING("250000", sample(page, "turret_task_busy_us{task=\"ServoControlTask\"}").c_str());
+    TEST_ASSERT_TRUE(page.find("\n# TYPE turret_task_busy_percent gauge\n") != std::string::npos);
+    TEST_ASSERT_EQUAL_STRING("0.0", sample(page, "turret_task_busy_percent{task=\"ServoControlTask\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("800", sample(page, "turret_task_stack_free_bytes{task=\"LogTask\"}").c_str());
+    TEST_ASSERT_EQUAL_STRING("42", sample(page, "turret_metrics_record_cycles").c_str());
+    TEST_ASSERT_EQUAL_STRING("17", sample(page, "turret_metrics_load_cycles").c_str());
+    TEST_ASSERT_TRUE(window.startUs == nowUs);
+    TEST_ASSERT_TRUE(page.find("cpu") == std::string::npos);
+
+    // Every line is a comment or a sample
+    size_t start = 1;
+    while (start < page.size())
+    {
+        size_t end = page.find('\n', start);
+        TEST_ASSERT_TRUE(end != std::string::npos);
+        std::string line = page.substr(start, end - start);
+        TEST_ASSERT_TRUE(line.rfind("# TYPE turret_", 0) == 0 || (line.rfind("turret_", 0) == 0 && line.find(' ') != std::string::npos));
+        start = end + 1;
+    }
+
+    // Cut short, not overrun
+    char small[64];
+    memset(small, 'x', sizeof(small));
+    TEST_ASSERT_EQUAL_size_t(sizeof(small) - 1, metricsWritePrometheus(small, sizeof(small), fixture.sources, window, nowUs));
+    TEST_ASSERT_TRUE(small[sizeof(small) - 1] == '\0');
+}
+
+void test_json_dump()
+{
+    Fixture fixture;
+    MetricsWindow window;
+    char out[METRICS_REPORT_SIZE];
+    metricsWriteJson(out, sizeof(out), fixture.sources, window, 1000000);
+    TEST_ASSERT_EQUAL_STRING("{\"metrics\":{\"uptime_us\":1000000,\"histograms\":{"
+                             "\"latency_us\":{\"n\":5,\"mean\":42,\"p50\":8,\"p99\":100,\"max\":100},"
+                             "\"empty_us\":{\"n\":0,\"mean\":0,\"p50\":0,\"p99\":0,\"max\":0}},"
+                             "\"tasks\":{\"ServoControlTask\":{\"busy\":25.0,\"stack\":1200},"
+                             "\"LogTask\":{\"busy\":0.0,\"stack\":800}},"
+                             "\"overhead\":{\"record_cycles\":42,\"load_cycles\":17}}}",
+                             out);
+}
+
+// What the always-on instrumentation costs per call on this host; the
+// firmware measures its own at boot (turret_metrics_record_cycles)
+void test_recording_cost()
+{
+    MetricsHistogram histogram("cost");
+    MetricsTaskLoad load;
+
+    double start = nowNs();
+    for (uint32_t i = 0; i < OVERHEAD_SAMPLES; i++)
+    {
+        histogram.record(i & 0xFFFF);
+    }
+    double recordNs = (nowNs() - start) / OVERHEAD_SAMPLES;
+    start = nowNs();
+    for (uint32_t i = 0; i < OVERHEAD_SAMPLES; i++)
+    {
+        load.busy(i * 2);
+        load.idle(i * 2 + 1);
+    }
+    double loadNs = (nowNs() - start) / OVERHEAD_SAMPLES;
+
+    char report[96];
+    snprintf(report, sizeof(report), "record %.1f ns, busy+idle %.1f ns", recordNs, loadNs);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_EQUAL_UINT32(OVERHEAD_SAMPLES, histogram.count());
+    TEST_ASSERT_TRUE(load.busyUs() == OVERHEAD_SAMPLES);
+    // Generous, this only catches something like a lock sneaking in
+    TEST_ASSERT_TRUE(recordNs < 100);
+    TEST_ASSERT_TRUE(loadNs < 200);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_values_land_in_power_of_two_buckets);
+    RUN_TEST(test_percentiles_are_bucket_limits);
+    RUN_TEST(test_busy_total_does_not_wrap);
+    RUN_TEST(test_each_reporter_has_its_own_window);
+    RUN_TEST(test_prometheus_page);
+    RUN_TEST(test_json_dump);
+    RUN_TEST(test_recording_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,287 @@
+#include <ScanPattern.h>
+#include <TurretProtocol.h>
+#include <TurretState.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unity.h>
+#include <vector>
+
+// Sweep patterns against the area they are meant to search, SweepControl
+// giving the camera back within a tick wherever the scan is, and sweep
+// holding for what the trackers actually send: the Python tracker reports
+// every frame, target or not, and the C++ one only when the target moves.
+
+#define TICK_MS 30 // CAMERA_PERIOD_MS
+#define CAMERA_FOV 15 // degrees around the aim point a face is found in
+#define GRID_STEP 5
+#define TRACKER_FRAME_MS 33 // 30 fps camera on the tracker
+
+void setUp() {}
+void tearDown() {}
+
+static std::vector<ScanPoint> oneCycle(ScanPatternId pattern)
+{
+    ScanEngine engine;
+    engine.config.pattern = pattern;
+    engine.restart();
+    std::vector<ScanPoint> aims = {engine.position()};
+    while (engine.cycles() == 0 && aims.size() < 10000)
+    {
+        aims.push_back(engine.step(TICK_MS));
+    }
+    return aims;
+}
+
+// Share of the scan area, on a 5 degree grid, within CAMERA_FOV of some
+// aim point
+static float coverage(const std::vector<ScanPoint> &aims)
+{
+    int cells = 0;
+    int covered = 0;
+    for (int pan = SCAN_PAN_MIN; pan <= SCAN_PAN_MAX; pan += GRID_STEP)
+    {
+        for (int tilt = SCAN_TILT_MIN; tilt <= SCAN_TILT_MAX; tilt += GRID_STEP)
+        {
+            bool seen = false;
+            for (const ScanPoint &aim : aims)
+            {
+                seen = seen || hypotf(aim.pan - pan, aim.tilt - tilt) <= CAMERA_FOV;
+            }
+            cells++;
+            covered += seen;
+        }
+    }
+    return (float)covered / cells;
+}
+
+static void checkPattern(ScanPatternId pattern, const char *name, float minCoverage)
+{
+    std::vector<ScanPoint> aims = oneCycle(pattern);
+    float seconds = aims.size() * TICK_MS / 1000.0f;
+    float covered = coverage(aims);
+    char report[96];
+    snprintf(report, sizeof(report), "%s: %.1f%% covered in a %.1f s cycle", name, covered * 100, seconds);
+    TEST_MESSAGE(report);
+
+    TEST_ASSERT_TRUE_MESSAGE(aims.size() < 10000, "pattern never completes a cycle");
+    TEST_ASSERT_TRUE_MESSAGE(covered >= minCoverage, report);
+    TEST_ASSERT_TRUE_MESSAGE(seconds < 40, report);
+    for (size_t i = 1; i < aims.size(); i++)
+    {
+        TEST_ASSERT_TRUE(aims[i].pan >= SCAN_PAN_MIN && aims[i].pan <= SCAN_PAN_MAX);
+        TEST_ASSERT_TRUE(aims[i].tilt >= SCAN_TILT_MIN && aims[i].tilt <= SCAN_TILT_MAX);
+        // No jumps: a tick moves the camera about speed * tick, 1 degree
+        TEST_ASSERT_TRUE(abs(aims[i].pan - aims[i - 1].pan) <= 2);
+        TEST_ASSERT_TRUE(abs(aims[i].tilt - aims[i - 1].tilt) <= 2);
+    }
+}
+
+// The 15-165 diagonal sweep these replaced covered 29% of the area
+void test_raster_covers_the_area()
+{
+    checkPattern(SCAN_RASTER, "raster", 1.0f);
+}
+
+void test_lissajous_covers_the_area()
+{
+    checkPattern(SCAN_LISSAJOUS, "lissajous", 0.95f);
+}
+
+void test_spiral_covers_the_area()
+{
+    checkPattern(SCAN_SPIRAL, "spiral", 0.85f);
+}
+
+// Leaving sweep mode takes the commanded angles on the very next tick,
+// whether the scan was moving or dwelling at a waypoint
+void test_leaving_sweep_takes_one_tick()
+{
+    const ScanPoint commanded = {90, 60};
+    for (int pattern = 0; pattern < SCAN_PATTERN_COUNT; pattern++)
+    {
+        for (uint16_t dwellMs : {(uint16_t)0, (uint16_t)5000})
+        {
+            for (int ticks = 1; ticks < 400; ticks += 37)
+            {
+                SweepControl sweep;
+                sweep.scan.config.pattern = (ScanPatternId)pattern;
+                sweep.scan.config.dwellMs = dwellMs;
+                ScanPoint aim = {SCAN_PAN_MIN, SCAN_TILT_MIN};
+                for (int i = 0; i < ticks; i++)
+                {
+                    aim = sweep.update(true, false, commanded, aim, TICK_MS);
+                }
+                TEST_ASSERT_TRUE(sweep.scanning());
+
+                ScanPoint next = sweep.update(false, false, commanded, aim, TICK_MS);
+                TEST_ASSERT_EQUAL_UINT8(commanded.pan, next.pan);
+                TEST_ASSERT_EQUAL_UINT8(commanded.tilt, next.tilt);
+                TEST_ASSERT_FALSE(sweep.scanning());
+            }
+        }
+    }
+}
+
+// A reported target stops the scan where it is on the next tick; once it
+// is gone the scan carries on from there towards the same waypoint
+void test_target_holds_then_resumes()
+{
+    SweepControl sweep;
+    ScanPoint aim = sweep.scan.position();
+    for (int i = 0; i < 50; i++)
+    {
+        aim = sweep.update(true, false, {0, 0}, aim, TICK_MS);
+    }
+    uint8_t heading = sweep.scan.waypoint();
+
+    ScanPoint held = aim;
+    for (int i = 0; i < 20; i++)
+    {
+        aim = sweep.update(true, true, {0, 0}, aim, TICK_MS);
+        TEST_ASSERT_EQUAL_UINT8(held.pan, aim.pan);
+        TEST_ASSERT_EQUAL_UINT8(held.tilt, aim.tilt);
+    }
+
+    ScanPoint resumed = sweep.update(true, false, {0, 0}, aim, TICK_MS);
+    TEST_ASSERT_EQUAL_UINT8(held.pan, resumed.pan);
+    TEST_ASSERT_EQUAL_UINT8(held.tilt, resumed.tilt);
+    TEST_ASSERT_EQUAL_UINT8(heading, sweep.scan.waypoint());
+    ScanPoint moved = sweep.update(true, false, {0, 0}, resumed, TICK_MS);
+    TEST_ASSERT_TRUE(moved.pan != held.pan || moved.tilt != held.tilt);
+}
+
+// Tracker and turret side by side on one millisecond clock. trackerFrame
+// says, for each camera frame, whether a face is in view and where; the
+// tracker encodes what it sends and the turret decodes it, feeds real
+// detections to a TargetWatch and steps sweep mode every camera tick.
+struct SweepRun
+{
+    SweepControl sweep;
+    TargetWatch target{SCAN_TARGET_TIMEOUT_MS};
+    ScanPoint aim = sweep.scan.position();
+    uint32_t nowMs = 0;
+    uint32_t framesSent = 0;
+    uint32_t scanningTicks = 0;
+    uint32_t heldTicks = 0;
+
+    // everyFrame: send every frame like facetracking.py, otherwise when
+    // schedule says so like turret_tracker
+    template <typename Frame>
+    void run(uint32_t durationMs, bool everyFrame, TrackSchedule &schedule, Frame trackerFrame)
+    {
+        scanningTicks = 0;
+        heldTicks = 0;
+        for (uint32_t end = nowMs + durationMs; nowMs < end; nowMs++)
+        {
+            if (nowMs % TRACKER_FRAME_MS == 0)
+            {
+                int pan = 0, tilt = 0;
+                bool found = trackerFrame(nowMs, pan, tilt);
+                if (everyFrame || schedule.due(nowMs, found, pan, tilt))
+                {
+                    deliver(found, pan, tilt);
+                    schedule.sent(nowMs, found, pan, tilt);
+                }
+            }
+            if (nowMs % TICK_MS == 0)
+            {
+                aim = sweep.update(true, target.seen(nowMs), {0, 0}, aim, TICK_MS);
+                sweep.scanning() ? scanningTicks++ : heldTicks++;
+            }
+        }
+    }
+
+    void deliver(bool found, int pan, int tilt)
+    {
+        TurretFrame sent = {TURRET_FRAME_TRACK, (uint8_t)(found ? 0 : TURRET_FLAG_NO_TARGET), (uint16_t)framesSent, nowMs,
+                            (uint16_t)pan, (uint16_t)tilt, 0};
+        uint8_t bytes[TURRET_FRAME_SIZE];
+        TEST_ASSERT_EQUAL(TURRET_FRAME_SIZE, encodeTurretFrame(sent, bytes, sizeof(bytes)));
+        TurretFrame received;
+        TEST_ASSERT_EQUAL(TURRET_DECODE_OK, decodeTurretFrame(bytes, sizeof(bytes), received));
+        if (turretFrameHasTarget(received))
+        {
+            target.detected(nowMs);
+        }
+        framesSent++;
+    }
+};
+
+// Every frame reported, almost all of them without a face: sweep has to
+// keep scanning, hold while there is a face and resume once it is gone
+void test_no_target_frames_do_not_hold_the_sweep()
+{
+    SweepRun run;
+    TrackSchedule unused;
+    auto nobody = [](uint32_t, int &, int &)
+    { return false; };
+    auto face = [](uint32_t, int &pan, int &tilt)
+    {
+        pan = 480;
+        tilt = 520;
+        return true;
+    };
+
+    run.run(10000, true, unused, nobody);
+    TEST_ASSERT_EQUAL_UINT32(10000 / TRACKER_FRAME_MS + 1, run.framesSent);
+    TEST_ASSERT_EQUAL_UINT32(0, run.heldTicks);
+
+    run.run(2000, true, unused, face);
+    TEST_ASSERT_TRUE(run.heldTicks >= 2000 / TICK_MS - 1);
+    TEST_ASSERT_FALSE(run.sweep.scanning());
+
+    // Held until SCAN_TARGET_TIMEOUT_MS after the last face, scanning after
+    run.run(5000, true, unused, nobody);
+    TEST_ASSERT_TRUE(run.heldTicks <= SCAN_TARGET_TIMEOUT_MS / TICK_MS + 1);
+    TEST_ASSERT_TRUE(run.sweep.scanning());
+}
+
+// A face that holds still within the tracker's move threshold: the refresh
+// keeps the sweep held the whole time, at a few frames a second instead of
+// every frame, and losing the face lets it scan again
+void test_stationary_target_keeps_the_sweep_held()
+{
+    auto still = [](uint32_t nowMs, int &pan, int &tilt)
+    {
+        pan = 500 + (int)(nowMs / TRACKER_FRAME_MS % 5) - 2; // detection jitter
+        tilt = 400;
+        return true;
+    };
+    auto nobody = [](uint32_t, int &, int &)
+    { return false; };
+
+    SweepRun run;
+    TrackSchedule schedule;
+    run.run(10000, false, schedule, still);
+    TEST_ASSERT_EQUAL_UINT32(0, run.scanningTicks);
+    TEST_ASSERT_TRUE(run.framesSent <= 10000 / TURRET_TRACK_REFRESH_MS + 1);
+    TEST_ASSERT_TRUE(run.framesSent >= 10000 / (TURRET_TRACK_REFRESH_MS + TRACKER_FRAME_MS));
+
+    uint32_t sent = run.framesSent;
+    run.run(5000, false, schedule, nobody);
+    TEST_ASSERT_EQUAL_UINT32(sent + 1, run.framesSent); // one frame saying it is gone
+    TEST_ASSERT_TRUE(run.heldTicks <= SCAN_TARGET_TIMEOUT_MS / TICK_MS + 1);
+    TEST_ASSERT_TRUE(run.sweep.scanning());
+
+    // Sending on movement alone, the sweep starts again over the face
+    SweepRun unrefreshed;
+    TrackSchedule moveOnly;
+    moveOnly.refreshMs = UINT32_MAX;
+    unrefreshed.run(10000, false, moveOnly, still);
+    TEST_ASSERT_EQUAL_UINT32(1, unrefreshed.framesSent);
+    TEST_ASSERT_TRUE(unrefreshed.scanningTicks > 10000 / TICK_MS / 2);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_raster_covers_the_area);
+    RUN_TEST(test_lissajous_covers_the_area);
+    RUN_TEST(test_spiral_covers_the_area);
+    RUN_TEST(test_leaving_sweep_takes_one_tick);
+    RUN_TEST(test_target_holds_then_resumes);
+    RUN_TEST(test_no_target_frames_do_not_hold_the_sweep);
+    RUN_TEST(test_stationary_target_keeps_the_sweep_held);
+    return UNITY_END();
+}
@@ -0,0 +1,186 @@
+#include <Snapshot.h>
+#include <TurretState.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+// Snapshot under a writer publishing as fast as it can and several readers,
+// checking no reader ever sees a mix of two publishes, and the same traffic
+// through a TurretCommand guarded by a FreeRTOS mutex, the usual way to get
+// the same consistency, for comparison.
+
+#define STRESS_READERS 3
+#define STRESS_MS 300
+#define BENCH_MS 200
+
+void setUp() {}
+void tearDown() {}
+
+// Every field carries the same publish number, so a torn copy shows up as
+// fields that disagree
+static TurretCommand stamped(uint32_t n)
+{
+    TurretCommand command;
+    command.pan = (uint16_t)n;
+    command.tilt = (uint16_t)n;
+    command.motorSpeed = (uint16_t)n;
+    command.mode = (uint8_t)n;
+    command.fireMode = (uint8_t)n;
+    command.scanDwellMs = (uint16_t)n;
+    command.warmIdleTimeout = n;
+    command.fireRequests = n;
+    command.abortRequests = n;
+    command.publishedUs = n;
+    command.fireArrivalMs = n;
+    return command;
+}
+
+static bool consistent(const TurretCommand &c)
+{
+    uint32_t n = c.publishedUs;
+    return c.pan == (uint16_t)n && c.tilt == (uint16_t)n && c.motorSpeed == (uint16_t)n &&
+           c.mode == (uint8_t)n && c.fireMode == (uint8_t)n && c.scanDwellMs == (uint16_t)n &&
+           c.warmIdleTimeout == n && c.fireRequests == n && c.abortRequests == n && c.fireArrivalMs == n;
+}
+
+// Mutex baseline to measure Snapshot against: a lock around a plain copy
+class MutexState
+{
+public:
+    MutexState() : mutex(xSemaphoreCreateMutex()) {}
+
+    void publish(const TurretCommand &value)
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        state = value;
+        xSemaphoreGive(mutex);
+    }
+
+    TurretCommand read()
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        TurretCommand value = state;
+        xSemaphoreGive(mutex);
+        return value;
+    }
+
+private:
+    SemaphoreHandle_t mutex;
+    TurretCommand state = stamped(0);
+};
+
+struct RunResult
+{
+    uint64_t reads;
+    uint64_t publishes;
+    uint64_t torn;
+    uint64_t backwards; // a read older than one already seen by that reader
+};
+
+// One writer publishing back to back, STRESS_READERS readers reading back
+// to back, for ms milliseconds
+template <typename State>
+static RunResult run(State &state, int ms)
+{
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> reads{0}, torn{0}, backwards{0};
+    uint64_t publishes = 0;
+    std::vector<std::thread> readers;
+    for (int r = 0; r < STRESS_READERS; r++)
+    {
+        readers.emplace_back([&]()
+                             {
+            uint64_t count = 0, bad = 0, old = 0;
+            uint32_t last = 0;
+            while (!done.load(std::memory_order_relaxed))
+            {
+                TurretCommand command = state.read();
+                bad += !consistent(command);
+                old += command.publishedUs < last;
+                last = command.publishedUs;
+                count++;
+            }
+            reads += count;
+            torn += bad;
+            backwards += old; });
+    }
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            state.publish(stamped((uint32_t)++publishes));
+        }
+    }
+    done = true;
+    for (std::thread &reader : readers)
+    {
+        reader.join();
+    }
+    return {reads.load(), publishes, torn.load(), backwards.load()};
+}
+
+void test_no_torn_reads()
+{
+    Snapshot<TurretCommand> state(stamped(0));
+    RunResult result = run(state, STRESS_MS);
+    char report[120];
+    snprintf(report, sizeof(report), "%llu reads against %llu publishes",
+             (unsigned long long)result.reads, (unsigned long long)result.publishes);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_TRUE(result.reads > 1000);
+    TEST_ASSERT_TRUE(result.publishes > 1000);
+    TEST_ASSERT_TRUE(result.torn == 0);
+    TEST_ASSERT_TRUE(result.backwards == 0);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)result.publishes, state.generation());
+}
+
+void test_cost_against_mutex()
+{
+    Snapshot<TurretCommand> snapshot(stamped(0));
+    MutexState locked;
+
+    // Uncontended: one task reading, nobody publishing
+    const int single = 2000000;
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < single; i++)
+    {
+        sum += snapshot.read().pan;
+    }
+    double snapshotNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / single;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < single; i++)
+    {
+        sum += locked.read().pan;
+    }
+    double mutexNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / single;
+    TEST_ASSERT_TRUE(sum == 0);
+
+    RunResult snapshotRun = run(snapshot, BENCH_MS);
+    RunResult mutexRun = run(locked, BENCH_MS);
+    TEST_ASSERT_TRUE(mutexRun.torn == 0);
+
+    char report[240];
+    snprintf(report, sizeof(report),
+             "uncontended read: snapshot %.1f ns, mutex %.1f ns; contended (1 writer, %d readers) "
+             "reads/s: snapshot %.2fM, mutex %.2fM; publishes/s: snapshot %.2fM, mutex %.2fM",
+             snapshotNs, mutexNs, STRESS_READERS,
+             snapshotRun.reads / (BENCH_MS * 1e3), mutexRun.reads / (BENCH_MS * 1e3),
+             snapshotRun.publishes / (BENCH_MS * 1e3), mutexRun.publishes / (BENCH_MS * 1e3));
+    TEST_MESSAGE(report);
+    TEST_ASSERT_TRUE_MESSAGE(snapshotNs < mutexNs, "an uncontended snapshot read should be cheaper than taking a mutex");
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_no_torn_reads);
+    RUN_TEST(test_cost_against_mutex);
+    return UNITY_END();
+}
@@ -0,0 +1,187 @@
+#include <TargetPredictor.h>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+// TargetPredictor against a recorded track (turret_tracker --record format,
+// track.csv next to this file): aim error while the target is in view,
+// with and without prediction, and what the aim does while it is hidden.
+
+#define LATENCY_MS 60
+#define TICK_MS 10
+#define IN_VIEW_GAP_MS 150 // observations further apart than this bracket a gap
+#define WARM_UP_MS 200     // first part of each track, before the velocity settles
+
+struct TrackPoint
+{
+    uint32_t ms;
+    float pan;
+    float tilt;
+};
+
+static std::vector<TrackPoint> track;
+
+static void loadTrack()
+{
+    std::string path = __FILE__;
+    path = path.substr(0, path.find_last_of("/\\") + 1) + "track.csv";
+    FILE *file = fopen(path.c_str(), "r");
+    TEST_ASSERT_TRUE_MESSAGE(file != NULL, path.c_str());
+    char line[160];
+    while (fgets(line, sizeof(line), file))
+    {
+        TrackPoint point;
+        unsigned long ms;
+        if (line[0] != '#' && sscanf(line, "%lu,%f,%f", &ms, &point.pan, &point.tilt) == 3)
+        {
+            point.ms = ms;
+            track.push_back(point);
+        }
+    }
+    fclose(file);
+}
+
+void setUp()
+{
+    if (track.empty())
+    {
+        loadTrack();
+    }
+}
+void tearDown() {}
+
+struct Replay
+{
+    TargetPredictor predictor;
+    size_t next = 0;
+    TrackPoint last = {};
+
+    // Delivers every observation that has arrived by now
+    void advance(uint32_t now)
+    {
+        while (next < track.size() && track[next].ms + LATENCY_MS <= now)
+        {
+            last = track[next++];
+            predictor.observeTimed(last.pan, last.tilt, last.ms, last.ms + LATENCY_MS);
+        }
+    }
+};
+
+void test_prediction_beats_last_observation()
+{
+    TEST_ASSERT_TRUE(track.size() > 100);
+    Replay replay;
+    replay.predictor.config.latencyMs = LATENCY_MS;
+    double predictedSquares = 0, heldSquares = 0;
+    int samples = 0;
+    size_t segment = 0;
+    uint32_t trackStart = track[0].ms;
+    for (uint32_t now = track[0].ms + LATENCY_MS; now <= track.back().ms; now += TICK_MS)
+    {
+        replay.advance(now);
+        while (segment + 2 < track.size() && track[segment + 1].ms <= now)
+        {
+            segment++;
+            if (track[segment].ms - track[segment - 1].ms > IN_VIEW_GAP_MS)
+            {
+                trackStart = track[segment].ms;
+            }
+        }
+        const TrackPoint &a = track[segment];
+        const TrackPoint &b = track[segment + 1];
+        if (b.ms - a.ms > IN_VIEW_GAP_MS || now < trackStart + WARM_UP_MS || now < a.ms)
+        {
+            continue;
+        }
+        float f = (float)(now - a.ms) / (b.ms - a.ms);
+        float truthPan = a.pan + (b.pan - a.pan) * f;
+        float truthTilt = a.tilt + (b.tilt - a.tilt) * f;
+        float pan, tilt;
+        TEST_ASSERT_TRUE(replay.predictor.aim(now, pan, tilt));
+        predictedSquares += (pan - truthPan) * (pan - truthPan) + (tilt - truthTilt) * (tilt - truthTilt);
+        heldSquares += (replay.last.pan - truthPan) * (replay.last.pan - truthPan) +
+                       (replay.last.tilt - truthTilt) * (replay.last.tilt - truthTilt);
+        samples++;
+    }
+    double predicted = sqrt(predictedSquares / samples);
+    double held = sqrt(heldSquares / samples);
+
+    char report[120];
+    snprintf(report, sizeof(report), "%d ticks in view: aim rms %.1f units predicted, %.1f aiming at the last observation",
+             samples, predicted, held);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_TRUE(samples > 400);
+    TEST_ASSERT_TRUE_MESSAGE(predicted < 0.85 * held, "prediction should cut the aim error below holding");
+    TEST_ASSERT_TRUE_MESSAGE(predicted < 30.0, "aim error while tracking");
+    TEST_ASSERT_EQUAL_UINT32(2, replay.predictor.tracksStarted());
+}
+
+// The target walks out of view at speed: the aim carries on along its
+// path for coastMs, then stops and stays put until it is seen again, when
+// a new track starts where it reappears
+void test_coast_then_hold_through_occlusion()
+{
+    size_t lastSeen = 0;
+    for (size_t i = 1; i < track.size(); i++)
+    {
+        if (track[i].ms - track[i - 1].ms > IN_VIEW_GAP_MS * 2)
+        {
+            lastSeen = i - 1;
+            break;
+        }
+    }
+    TEST_ASSERT_TRUE(lastSeen > 0);
+    const TrackPoint &seen = track[lastSeen];
+    const TrackPoint &back = track[lastSeen + 1];
+
+    Replay replay;
+    replay.predictor.config.latencyMs = LATENCY_MS;
+    const PredictorConfig &config = replay.predictor.config;
+    uint32_t arrival = seen.ms + LATENCY_MS;
+    float pan = 0, tilt = 0, previousPan = 0;
+    float coastEndPan = 0;
+    for (uint32_t now = track[0].ms + LATENCY_MS; now < back.ms + LATENCY_MS; now += 1)
+    {
+        replay.advance(now);
+        previousPan = pan;
+        TEST_ASSERT_TRUE(replay.predictor.aim(now, pan, tilt));
+        if (now <= arrival)
+        {
+            continue;
+        }
+        TEST_ASSERT_TRUE(pan >= config.minPosition && pan <= config.maxPosition);
+        uint32_t since = now - arrival;
+        if (since <= config.coastMs)
+        {
+            // Still moving right, the way it left
+            TEST_ASSERT_TRUE(pan >= previousPan);
+            TEST_ASSERT_NOT_EQUAL(PREDICTOR_HOLDING, replay.predictor.state());
+            coastEndPan = pan;
+        }
+        else
+        {
+            TEST_ASSERT_EQUAL(PREDICTOR_HOLDING, replay.predictor.state());
+            TEST_ASSERT_EQUAL_FLOAT(coastEndPan, pan);
+        }
+    }
+    TEST_ASSERT_TRUE(coastEndPan > seen.pan + 20);
+    TEST_ASSERT_EQUAL_UINT32(1, replay.predictor.tracksStarted());
+
+    // Seen again: a fresh track at the new position, no lead carried over
+    replay.advance(back.ms + LATENCY_MS);
+    TEST_ASSERT_EQUAL(PREDICTOR_TRACKING, replay.predictor.state());
+    TEST_ASSERT_EQUAL_UINT32(2, replay.predictor.tracksStarted());
+    TEST_ASSERT_TRUE(replay.predictor.aim(back.ms + LATENCY_MS, pan, tilt));
+    TEST_ASSERT_EQUAL_FLOAT(back.pan, pan);
+    TEST_ASSERT_EQUAL_FLOAT(back.tilt, tilt);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_prediction_beats_last_observation);
+    RUN_TEST(test_coast_then_hold_through_occlusion);
+    return UNITY_END();
+}
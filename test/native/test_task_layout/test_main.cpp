@@ -0,0 +1,116 @@
+#include <TaskLayout.h>
+#include <freertos/FreeRTOS.h>
+#include <string.h>
+#include <unity.h>
+
+// The rules the task table in TaskLayout.h is laid out by, so an edit that
+// moves a control loop next to the WiFi driver or under loopTask fails here
+// rather than as jitter on the turret.
+
+struct TaskEntry
+{
+    TaskId id;
+    const char *name;
+    uint32_t stackBytes;
+    UBaseType_t priority;
+    BaseType_t core;
+    uint32_t periodMs;
+};
+
+#define TASK_TABLE_ENTRY(id, function, name, stack, priority, core, period) {id, name, stack, priority, core, period},
+static const TaskEntry tasks[TASK_COUNT] = {TASK_TABLE(TASK_TABLE_ENTRY)};
+#undef TASK_TABLE_ENTRY
+
+void setUp() {}
+void tearDown() {}
+
+static bool isControlTask(TaskId id)
+{
+    return id == TASK_SERVO || id == TASK_FLYWHEEL || id == TASK_UART || id == TASK_CAMERA;
+}
+
+void test_control_and_network_tasks_keep_to_their_cores()
+{
+    for (const TaskEntry &task : tasks)
+    {
+        TEST_ASSERT_EQUAL_MESSAGE(isControlTask(task.id) ? CONTROL_CORE : NETWORK_CORE, task.core, task.name);
+    }
+}
+
+void test_control_tasks_preempt_loop_task()
+{
+    for (const TaskEntry &task : tasks)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(task.priority < configMAX_PRIORITIES, task.name);
+        if (task.core == CONTROL_CORE)
+        {
+            TEST_ASSERT_TRUE_MESSAGE(task.priority > LOOP_TASK_PRIORITY, task.name);
+        }
+    }
+}
+
+// A move queued by the servo loop goes out on the next scheduling point
+void test_bus_task_outranks_everything_on_its_core()
+{
+    for (const TaskEntry &task : tasks)
+    {
+        if (task.core == CONTROL_CORE && task.id != TASK_UART)
+        {
+            TEST_ASSERT_TRUE_MESSAGE(tasks[TASK_UART].priority > task.priority, task.name);
+        }
+    }
+    TEST_ASSERT_TRUE(tasks[TASK_SERVO].priority > tasks[TASK_CAMERA].priority);
+}
+
+// commandTask drains what async_tcp queues before the next frame is parsed;
+// telemetry, link management and logging never hold up either
+void test_network_core_priorities()
+{
+    TEST_ASSERT_TRUE(tasks[TASK_COMMAND].priority > ASYNC_TCP_PRIORITY);
+    TEST_ASSERT_TRUE(tasks[TASK_TELEMETRY].priority < ASYNC_TCP_PRIORITY);
+    TEST_ASSERT_TRUE(tasks[TASK_WIFI].priority < ASYNC_TCP_PRIORITY);
+    TEST_ASSERT_TRUE(tasks[TASK_LOG].priority < ASYNC_TCP_PRIORITY);
+}
+
+// xTaskDelayUntil counts in ticks, a period that is not a whole number of
+// them would run at a different rate than the one reported
+void test_periods_are_whole_ticks()
+{
+    for (const TaskEntry &task : tasks)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(task.periodMs * configTICK_RATE_HZ % 1000 == 0, task.name);
+        if (task.periodMs != 0)
+        {
+            TEST_ASSERT_TRUE_MESSAGE(pdMS_TO_TICKS(task.periodMs) > 0, task.name);
+        }
+    }
+    TEST_ASSERT_TRUE(CONTROL_PERIOD_TICKS > 0);
+    TEST_ASSERT_EQUAL_UINT32(CONTROL_PERIOD_US / 1000, tasks[TASK_SERVO].periodMs);
+    TEST_ASSERT_EQUAL_UINT32(CONTROL_PERIOD_TICKS * 1000 / configTICK_RATE_HZ, tasks[TASK_SERVO].periodMs);
+}
+
+// Names label the per task rows on /metrics
+void test_names_are_unique()
+{
+    for (uint8_t i = 0; i < TASK_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL(i, tasks[i].id);
+        TEST_ASSERT_TRUE(tasks[i].stackBytes > 0);
+        for (uint8_t j = i + 1; j < TASK_COUNT; j++)
+        {
+            TEST_ASSERT_TRUE_MESSAGE(strcmp(tasks[i].name, tasks[j].name) != 0, tasks[i].name);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_control_and_network_tasks_keep_to_their_cores);
+    RUN_TEST(test_control_tasks_preempt_loop_task);
+    RUN_TEST(test_bus_task_outranks_everything_on_its_core);
+    RUN_TEST(test_network_core_priorities);
+    RUN_TEST(test_periods_are_whole_ticks);
+    RUN_TEST(test_names_are_unique);
+    return UNITY_END();
+}
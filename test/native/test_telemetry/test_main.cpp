@@ -0,0 +1,188 @@
+#include <ArduinoJson.h>
+#include <TelemetryPublisher.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+
+// Delta telemetry frames: a worst case keyframe fits, deltas carry only
+// what changed, and what a simulated session costs in bytes and encode
+// time next to broadcasting every field as one JSON document, as
+// telemetryTask did before.
+
+#define SESSION_SECONDS 60
+#define SESSION_RATE_HZ 10
+#define WS_SERVER_OVERHEAD 2 // unmasked server frames under 126 bytes; 4 above
+
+static std::string lastFrame;
+static size_t framesSeen;
+static size_t bytesSeen;
+
+static bool capture(uint8_t client, const char *frame, size_t length, void *context)
+{
+    lastFrame.assign(frame, length);
+    framesSeen++;
+    bytesSeen += length + (length < 126 ? WS_SERVER_OVERHEAD : WS_SERVER_OVERHEAD + 2);
+    return true;
+}
+
+// A client whose send queue is full
+static bool refuse(uint8_t client, const char *frame, size_t length, void *context)
+{
+    return false;
+}
+
+void setUp()
+{
+    lastFrame.clear();
+    framesSeen = 0;
+    bytesSeen = 0;
+}
+void tearDown() {}
+
+static double nowNs()
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void test_worst_case_keyframe_fits()
+{
+    TelemetryPublisher publisher;
+    int32_t values[TELEMETRY_FIELD_COUNT];
+    for (int32_t &value : values)
+    {
+        value = INT32_MIN;
+    }
+    publisher.subscribe(0, 100, TELEMETRY_ALL_FIELDS);
+    publisher.poll(4000000000UL, values, capture, NULL);
+    TEST_ASSERT_EQUAL(1, framesSeen);
+    // seq is still 0, nine digits short of its widest; the rest of the
+    // frame is as long as it gets, so it must match the bound exactly
+    TEST_ASSERT_EQUAL(TELEMETRY_WORST_FRAME - 9 - 1, lastFrame.size());
+    TEST_ASSERT_TRUE(lastFrame.find("\"speed_faults\":-2147483648}") != std::string::npos);
+
+    // Later frames are still sent, nothing latched
+    values[TELEMETRY_PAN] = 1;
+    publisher.poll(4000000100UL, values, capture, NULL);
+    TEST_ASSERT_EQUAL(2, framesSeen);
+}
+
+void test_deltas_carry_changes_only()
+{
+    TelemetryPublisher publisher;
+    int32_t values[TELEMETRY_FIELD_COUNT] = {};
+    publisher.subscribe(0, 100, TelemetryPublisher::fieldMask("pan") | TelemetryPublisher::fieldMask("tilt"), 1000);
+    publisher.poll(0, values, capture, NULL);
+    TEST_ASSERT_EQUAL_STRING("{\"seq\":0,\"t\":0,\"key\":1,\"pan\":0,\"tilt\":0}", lastFrame.c_str());
+
+    values[TELEMETRY_TILT] = 388;
+    values[TELEMETRY_MAG_COUNT] = 3; // not subscribed
+    publisher.poll(100, values, capture, NULL);
+    TEST_ASSERT_EQUAL_STRING("{\"seq\":1,\"t\":100,\"key\":0,\"tilt\":388}", lastFrame.c_str());
+
+    // Nothing changed, nothing sent
+    publisher.poll(200, values, capture, NULL);
+    TEST_ASSERT_EQUAL(2, framesSeen);
+    publisher.poll(1100, values, capture, NULL);
+    TEST_ASSERT_EQUAL_STRING("{\"seq\":2,\"t\":1100,\"key\":1,\"pan\":0,\"tilt\":388}", lastFrame.c_str());
+}
+
+// Changes in a frame the client could not take go out again in the next
+void test_dropped_frame_is_resent()
+{
+    TelemetryPublisher publisher;
+    int32_t values[TELEMETRY_FIELD_COUNT] = {};
+    publisher.subscribe(0, 100, TelemetryPublisher::fieldMask("pan") | TelemetryPublisher::fieldMask("tilt"), 1000);
+    publisher.poll(0, values, capture, NULL);
+
+    values[TELEMETRY_PAN] = 17;
+    publisher.poll(100, values, refuse, NULL);
+    TEST_ASSERT_EQUAL_UINT32(1, publisher.framesDropped);
+    TEST_ASSERT_EQUAL_UINT32(1, publisher.framesSent);
+
+    values[TELEMETRY_TILT] = 5;
+    publisher.poll(200, values, capture, NULL);
+    TEST_ASSERT_EQUAL_STRING("{\"seq\":1,\"t\":200,\"key\":0,\"pan\":17,\"tilt\":5}", lastFrame.c_str());
+
+    // A refused keyframe is still owed
+    publisher.subscribe(0, 100, TelemetryPublisher::fieldMask("pan"), 1000);
+    publisher.poll(300, values, refuse, NULL);
+    publisher.poll(400, values, capture, NULL);
+    TEST_ASSERT_EQUAL_STRING("{\"seq\":2,\"t\":400,\"key\":1,\"pan\":17}", lastFrame.c_str());
+}
+
+// Values for one tick of a turret tracking a target: pan, tilt and their
+// feedback move every tick, the jitter and heap figures every few, the
+// rest hold still
+static void sessionValues(uint32_t tick, int32_t *values)
+{
+    for (int i = 0; i < TELEMETRY_FIELD_COUNT; i++)
+    {
+        values[i] = 100 + i;
+    }
+    values[TELEMETRY_PAN] = 500 + (int32_t)(tick % 200);
+    values[TELEMETRY_TILT] = 400 + (int32_t)(tick % 50);
+    values[TELEMETRY_PAN_FEEDBACK] = values[TELEMETRY_PAN] - 3;
+    values[TELEMETRY_TILT_FEEDBACK] = values[TELEMETRY_TILT] - 2;
+    values[TELEMETRY_CAMERA_PAN] = 90 + (int32_t)(tick % 20);
+    values[TELEMETRY_LOOP_JITTER] = 20 + (int32_t)(tick / 3 % 7);
+    values[TELEMETRY_HEAP_FREE] = 180000 - (int32_t)(tick / 5 % 3) * 64;
+    values[TELEMETRY_PAN_VIN] = 7400 + (int32_t)(tick / 25 % 2) * 10;
+}
+
+void test_session_cost_against_full_json()
+{
+    const uint32_t ticks = SESSION_SECONDS * SESSION_RATE_HZ;
+    const uint32_t periodMs = 1000 / SESSION_RATE_HZ;
+    int32_t values[TELEMETRY_FIELD_COUNT];
+
+    TelemetryPublisher publisher;
+    publisher.subscribe(0, periodMs, TELEMETRY_ALL_FIELDS);
+    double start = nowNs();
+    for (uint32_t tick = 0; tick < ticks; tick++)
+    {
+        sessionValues(tick, values);
+        publisher.poll(tick * periodMs, values, capture, NULL);
+    }
+    double deltaNs = (nowNs() - start) / ticks;
+    size_t deltaBytes = bytesSeen;
+    size_t deltaFrames = framesSeen;
+
+    // Every field every tick through a JsonDocument
+    char buffer[TELEMETRY_FRAME_SIZE];
+    size_t jsonBytes = 0;
+    start = nowNs();
+    for (uint32_t tick = 0; tick < ticks; tick++)
+    {
+        sessionValues(tick, values);
+        JsonDocument doc;
+        for (uint8_t i = 0; i < TELEMETRY_FIELD_COUNT; i++)
+        {
+            doc[TelemetryPublisher::fieldName(i)] = values[i];
+        }
+        size_t length = serializeJson(doc, buffer, sizeof(buffer));
+        jsonBytes += length + (length < 126 ? WS_SERVER_OVERHEAD : WS_SERVER_OVERHEAD + 2);
+    }
+    double jsonNs = (nowNs() - start) / ticks;
+
+    char report[240];
+    snprintf(report, sizeof(report),
+             "%u Hz, %u s: delta frames %zu frames, %.0f B/s, %.0f ns per poll; "
+             "full JSON %u frames, %.0f B/s, %.0f ns per document",
+             SESSION_RATE_HZ, SESSION_SECONDS, deltaFrames, (double)deltaBytes / SESSION_SECONDS, deltaNs,
+             ticks, (double)jsonBytes / SESSION_SECONDS, jsonNs);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_EQUAL(ticks, deltaFrames);
+    TEST_ASSERT_TRUE_MESSAGE(deltaBytes * 3 < jsonBytes, "delta frames should be well under a third of full JSON");
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_worst_case_keyframe_fits);
+    RUN_TEST(test_deltas_carry_changes_only);
+    RUN_TEST(test_dropped_frame_is_resent);
+    RUN_TEST(test_session_cost_against_full_json);
+    return UNITY_END();
+}
@@ -0,0 +1,142 @@
+#include <Trajectory.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+
+// Setpoint profiles for the servo loop: no overshoot or reversal on a
+// fixed target, limits held on every tick, and the cost of one update().
+
+#define BENCH_TICKS 1000000
+#define EPSILON 1e-3f
+
+static const float RATES[] = {50.0f, 100.0f, 200.0f};
+static const float VELOCITIES[] = {50.0f, 300.0f, 1000.0f};
+static const float DISTANCES[] = {0.4f, 3.0f, 17.0f, 250.0f, 1000.0f};
+
+void setUp() {}
+void tearDown() {}
+
+// Runs one axis from start to a fixed target, checking every tick
+static void checkMove(float start, float target, float maxVelocity, float dt)
+{
+    char where[96];
+    snprintf(where, sizeof(where), "%.1f -> %.1f at %.0f units/s, dt %.3f", start, target, maxVelocity, dt);
+    TrajectoryAxis axis;
+    axis.limits = {maxVelocity, 4000.0f};
+    axis.reset(start);
+    float direction = target > start ? 1.0f : -1.0f;
+    float previous = start;
+    float previousVelocity = 0.0f;
+    int ticks = 0;
+    while (!axis.settled() || ticks == 0)
+    {
+        float setpoint = axis.update(target, dt);
+        ticks++;
+        TEST_ASSERT_TRUE_MESSAGE((setpoint - target) * direction <= EPSILON, where);     // no overshoot
+        TEST_ASSERT_TRUE_MESSAGE((setpoint - previous) * direction >= -EPSILON, where);  // no reversal
+        TEST_ASSERT_TRUE_MESSAGE(fabsf(axis.velocity()) <= maxVelocity + EPSILON, where);
+        TEST_ASSERT_TRUE_MESSAGE(fabsf(axis.velocity() - previousVelocity) <= 4000.0f * dt + EPSILON, where);
+        TEST_ASSERT_TRUE_MESSAGE(ticks < 100000, where);
+        previous = setpoint;
+        previousVelocity = axis.velocity();
+    }
+    TEST_ASSERT_EQUAL_FLOAT(target, axis.position());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, axis.velocity());
+
+    // Not much slower than the continuous trapezoid: a tick or two of
+    // rounding at each end
+    float distance = fabsf(target - start);
+    float rampDistance = maxVelocity * maxVelocity / 4000.0f;
+    float ideal = distance > rampDistance ? distance / maxVelocity + maxVelocity / 4000.0f
+                                          : 2.0f * sqrtf(distance / 4000.0f);
+    TEST_ASSERT_TRUE_MESSAGE(ticks * dt <= ideal + 3.0f * dt, where);
+}
+
+void test_fixed_targets_never_overshoot()
+{
+    for (float rate : RATES)
+    {
+        for (float velocity : VELOCITIES)
+        {
+            for (float distance : DISTANCES)
+            {
+                checkMove(500.0f, 500.0f + distance, velocity, 1.0f / rate);
+                checkMove(500.0f, 500.0f - distance, velocity, 1.0f / rate);
+            }
+        }
+    }
+}
+
+// A target reversed mid-move is passed by at most the braking distance,
+// then approached without further oscillation
+void test_reversed_target()
+{
+    const float dt = 0.01f;
+    TrajectoryAxis axis;
+    axis.limits = {1000.0f, 4000.0f};
+    axis.reset(0.0f);
+    for (int i = 0; i < 30; i++)
+    {
+        axis.update(1000.0f, dt);
+    }
+    float velocity = axis.velocity();
+    float turnAt = axis.position();
+    float farthest = turnAt;
+    int reversals = 0;
+    float lastDirection = 1.0f;
+    for (int i = 0; i < 1000 && !axis.settled(); i++)
+    {
+        float before = axis.position();
+        float setpoint = axis.update(turnAt, dt);
+        farthest = fmaxf(farthest, setpoint);
+        float direction = setpoint > before ? 1.0f : setpoint < before ? -1.0f : lastDirection;
+        reversals += direction != lastDirection;
+        lastDirection = direction;
+    }
+    TEST_ASSERT_TRUE(axis.settled());
+    TEST_ASSERT_EQUAL_FLOAT(turnAt, axis.position());
+    TEST_ASSERT_TRUE(farthest - turnAt <= velocity * velocity / (2.0f * 4000.0f) + velocity * dt);
+    TEST_ASSERT_EQUAL(1, reversals);
+}
+
+void test_zero_velocity_holds()
+{
+    TrajectoryAxis axis;
+    axis.limits = {0.0f, 4000.0f};
+    axis.reset(200.0f);
+    TEST_ASSERT_EQUAL_FLOAT(200.0f, axis.update(800.0f, 0.01f));
+    TEST_ASSERT_FALSE(axis.settled());
+}
+
+void test_update_cost()
+{
+    TrajectoryAxis axis;
+    axis.reset(0.0f);
+    float sum = 0.0f;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_TICKS; i++)
+    {
+        // Swap ends every second of simulated time so most ticks move
+        sum += axis.update((i / 100) & 1 ? 0.0f : 1000.0f, 0.01f);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_TICKS;
+    TEST_ASSERT_TRUE(sum > 0.0f);
+
+    char report[80];
+    snprintf(report, sizeof(report), "%.1f ns per update() on the host", ns);
+    TEST_MESSAGE(report);
+    // Two axes run every servo tick; anything near a microsecond on the
+    // host would be tens of microseconds on the ESP32
+    TEST_ASSERT_TRUE_MESSAGE(ns < 1000.0, "update() is too slow for the servo loop");
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fixed_targets_never_overshoot);
+    RUN_TEST(test_reversed_target);
+    RUN_TEST(test_zero_velocity_holds);
+    RUN_TEST(test_update_cost);
+    return UNITY_END();
+}
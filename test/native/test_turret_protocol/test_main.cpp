@@ -0,0 +1,140 @@
+#include <ArduinoJson.h>
+#include <TurretProtocol.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+// Binary command frames against the JSON messages they replace. Besides
+// the round trip checks, test_cost_against_json times decoding both and
+// compares what each puts on the wire for the same tracker command.
+
+#define BENCH_MESSAGES 200000
+// Client to server websocket frames carry a 2 byte header and a 4 byte mask
+// for payloads under 126 bytes
+#define WS_CLIENT_OVERHEAD 6
+
+static const char *TRACK_JSON = "{\"camServoPan\":512,\"camServoTilt\":300,\"fire\":1}";
+
+void setUp() {}
+void tearDown() {}
+
+static TurretFrame trackFrame(uint16_t seq)
+{
+    TurretFrame frame = {};
+    frame.type = TURRET_FRAME_TRACK;
+    frame.flags = TURRET_FLAG_FIRE;
+    frame.seq = seq;
+    frame.timestamp = 0x12345678;
+    frame.a = 512;
+    frame.b = 300;
+    return frame;
+}
+
+static double nowNs()
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void test_round_trip()
+{
+    TurretFrame in = trackFrame(0xBEEF);
+    in.c = 0xA5;
+    uint8_t bytes[TURRET_FRAME_SIZE];
+    TEST_ASSERT_EQUAL(TURRET_FRAME_SIZE, encodeTurretFrame(in, bytes, sizeof(bytes)));
+
+    TurretFrame out = {};
+    TEST_ASSERT_EQUAL(TURRET_DECODE_OK, decodeTurretFrame(bytes, sizeof(bytes), out));
+    TEST_ASSERT_EQUAL_UINT8(in.type, out.type);
+    TEST_ASSERT_EQUAL_UINT8(in.flags, out.flags);
+    TEST_ASSERT_EQUAL_UINT16(in.seq, out.seq);
+    TEST_ASSERT_EQUAL_UINT32(in.timestamp, out.timestamp);
+    TEST_ASSERT_EQUAL_UINT16(in.a, out.a);
+    TEST_ASSERT_EQUAL_UINT16(in.b, out.b);
+    TEST_ASSERT_EQUAL_UINT8(in.c, out.c);
+}
+
+void test_rejects_bad_frames()
+{
+    uint8_t bytes[TURRET_FRAME_SIZE];
+    TurretFrame out;
+    TEST_ASSERT_EQUAL(0, encodeTurretFrame(trackFrame(1), bytes, TURRET_FRAME_SIZE - 1));
+    encodeTurretFrame(trackFrame(1), bytes, sizeof(bytes));
+    TEST_ASSERT_EQUAL(TURRET_DECODE_SHORT, decodeTurretFrame(bytes, TURRET_FRAME_SIZE - 1, out));
+
+    // Every single bit flip is caught
+    for (int bit = 0; bit < TURRET_FRAME_SIZE * 8; bit++)
+    {
+        uint8_t corrupt[TURRET_FRAME_SIZE];
+        memcpy(corrupt, bytes, sizeof(corrupt));
+        corrupt[bit / 8] ^= 1 << (bit % 8);
+        TEST_ASSERT_NOT_EQUAL(TURRET_DECODE_OK, decodeTurretFrame(corrupt, sizeof(corrupt), out));
+    }
+
+    TurretFrame unknown = trackFrame(1);
+    unknown.type = TURRET_FRAME_SPEED + 1;
+    encodeTurretFrame(unknown, bytes, sizeof(bytes));
+    TEST_ASSERT_EQUAL(TURRET_DECODE_TYPE, decodeTurretFrame(bytes, sizeof(bytes), out));
+}
+
+void test_sequence_wraps()
+{
+    TEST_ASSERT_TRUE(turretSeqNewer(1, 0));
+    TEST_ASSERT_TRUE(turretSeqNewer(0, 65535));
+    TEST_ASSERT_FALSE(turretSeqNewer(65535, 0));
+    TEST_ASSERT_FALSE(turretSeqNewer(7, 7));
+}
+
+void test_cost_against_json()
+{
+    uint8_t frames[256][TURRET_FRAME_SIZE];
+    for (int i = 0; i < 256; i++)
+    {
+        encodeTurretFrame(trackFrame(i), frames[i], TURRET_FRAME_SIZE);
+    }
+    uint32_t sum = 0;
+    double start = nowNs();
+    for (int i = 0; i < BENCH_MESSAGES; i++)
+    {
+        TurretFrame frame;
+        if (decodeTurretFrame(frames[i & 255], TURRET_FRAME_SIZE, frame) == TURRET_DECODE_OK)
+        {
+            sum += frame.a + frame.b + (frame.flags & TURRET_FLAG_FIRE);
+        }
+    }
+    double binaryNs = (nowNs() - start) / BENCH_MESSAGES;
+
+    // What the firmware does with a JSON command: parse it, then read the
+    // same fields
+    size_t jsonLength = strlen(TRACK_JSON);
+    start = nowNs();
+    for (int i = 0; i < BENCH_MESSAGES; i++)
+    {
+        JsonDocument doc;
+        if (!deserializeJson(doc, TRACK_JSON, jsonLength))
+        {
+            sum += (doc["camServoPan"] | 0) + (doc["camServoTilt"] | 0) + (doc["fire"] | 0);
+        }
+    }
+    double jsonNs = (nowNs() - start) / BENCH_MESSAGES;
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)BENCH_MESSAGES * 2 * (512 + 300 + 1), sum);
+
+    char report[200];
+    snprintf(report, sizeof(report), "binary %d B payload, %d B on the wire, %.1f ns to decode; "
+                                     "JSON %zu B payload, %zu B on the wire, %.1f ns to parse",
+             TURRET_FRAME_SIZE, TURRET_FRAME_SIZE + WS_CLIENT_OVERHEAD, binaryNs,
+             jsonLength, jsonLength + WS_CLIENT_OVERHEAD, jsonNs);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_TRUE(TURRET_FRAME_SIZE < jsonLength);
+    TEST_ASSERT_TRUE_MESSAGE(binaryNs < jsonNs, "binary frames should decode faster than JSON parses");
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_rejects_bad_frames);
+    RUN_TEST(test_sequence_wraps);
+    RUN_TEST(test_cost_against_json);
+    return UNITY_END();
+}
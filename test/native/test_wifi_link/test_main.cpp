@@ -0,0 +1,149 @@
+#include <WiFiLink.h>
+#include <unity.h>
+
+// WiFiLink's reconnect policy driven through boots and outages: which
+// attempt comes next, when, and how the pause after failed scans grows.
+
+void setUp() {}
+void tearDown() {}
+
+// Runs the link with no events until it asks for something, the way the
+// task sleeps until wait() runs out
+static WiFiLinkAction idleUntilAction(WiFiLink &link, uint32_t &now)
+{
+    for (int i = 0; i < 10; i++)
+    {
+        now += link.wait(now);
+        WiFiLinkAction action = link.update(now, false, false);
+        if (action != WIFI_LINK_NONE)
+        {
+            return action;
+        }
+    }
+    return WIFI_LINK_NONE;
+}
+
+void test_cold_boot_scans_and_backs_off()
+{
+    WiFiLink link;
+    uint32_t now = 1000;
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, link.begin(now, false));
+    TEST_ASSERT_FALSE(link.fast());
+    TEST_ASSERT_EQUAL_UINT32(link.config.scanTimeoutMs, link.wait(now));
+
+    // Nothing cached, so every retry is a scan, after a pause that doubles
+    // up to retryMaxMs
+    const uint32_t pauses[] = {500, 1000, 2000, 4000, 8000, 8000};
+    for (uint32_t pause : pauses)
+    {
+        uint32_t started = now;
+        TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, idleUntilAction(link, now));
+        TEST_ASSERT_FALSE(link.fast());
+        TEST_ASSERT_EQUAL_UINT32(link.config.scanTimeoutMs + pause, now - started);
+    }
+}
+
+void test_cached_boot_falls_back_to_a_scan()
+{
+    WiFiLink link;
+    uint32_t now = 0;
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, link.begin(now, true));
+    TEST_ASSERT_TRUE(link.fast());
+    TEST_ASSERT_EQUAL_UINT32(link.config.fastTimeoutMs, link.wait(now));
+
+    // Not there within fastTimeoutMs: scan straight away
+    TEST_ASSERT_EQUAL(WIFI_LINK_NONE, link.update(now + link.config.fastTimeoutMs - 1, false, false));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, idleUntilAction(link, now));
+    TEST_ASSERT_FALSE(link.fast());
+    TEST_ASSERT_EQUAL_UINT32(link.config.fastTimeoutMs, now);
+
+    // The scan fails too: pause, then the cached access point first again
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, idleUntilAction(link, now));
+    TEST_ASSERT_TRUE(link.fast());
+    TEST_ASSERT_EQUAL_UINT32(link.config.fastTimeoutMs + link.config.scanTimeoutMs + link.config.retryMinMs, now);
+}
+
+// A disconnect during an attempt (wrong channel, access point gone) ends
+// it without waiting for the timeout
+void test_failed_attempt_moves_on_at_once()
+{
+    WiFiLink link;
+    link.begin(0, true);
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, link.update(40, false, true));
+    TEST_ASSERT_FALSE(link.fast());
+    TEST_ASSERT_EQUAL(WIFI_LINK_NONE, link.update(90, false, true));
+    TEST_ASSERT_TRUE(link.pausing());
+    TEST_ASSERT_EQUAL_UINT32(link.config.retryMinMs, link.wait(90));
+    // Drops while pausing do not cut the pause short
+    TEST_ASSERT_EQUAL(WIFI_LINK_NONE, link.update(100, false, true));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, link.update(90 + link.config.retryMinMs, false, false));
+    TEST_ASSERT_TRUE(link.fast());
+}
+
+void test_drop_reconnects_to_the_cached_access_point()
+{
+    WiFiLink link;
+    uint32_t now = 0;
+    link.begin(now, false);
+    TEST_ASSERT_EQUAL(WIFI_LINK_ADDRESSED, link.update(now += 3000, true, false));
+    TEST_ASSERT_TRUE(link.up());
+    TEST_ASSERT_EQUAL_UINT32(WIFI_LINK_NO_DEADLINE, link.wait(now));
+    TEST_ASSERT_EQUAL(WIFI_LINK_NONE, link.update(now += 60000, false, false));
+
+    // The access point it came up on is cached now, even though boot
+    // had none
+    TEST_ASSERT_EQUAL(WIFI_LINK_RECONNECT, link.update(now += 1000, false, true));
+    TEST_ASSERT_FALSE(link.up());
+    TEST_ASSERT_TRUE(link.fast());
+    TEST_ASSERT_EQUAL_UINT32(now, link.attemptStart());
+    TEST_ASSERT_EQUAL(WIFI_LINK_ADDRESSED, link.update(now += 150, true, false));
+}
+
+// A long outage backs off to the maximum; the link coming back resets the
+// pause so the next outage starts from retryMinMs again
+void test_backoff_resets_once_up()
+{
+    WiFiLink link;
+    uint32_t now = 0;
+    link.begin(now, true);
+    link.update(now += 100, true, false);
+    link.update(now += 100, false, true);
+    for (int i = 0; i < 20; i++)
+    {
+        idleUntilAction(link, now);
+    }
+    TEST_ASSERT_EQUAL_UINT32(link.config.retryMaxMs, link.retryDelay());
+
+    TEST_ASSERT_EQUAL(WIFI_LINK_ADDRESSED, link.update(now += 10, true, false));
+    TEST_ASSERT_EQUAL_UINT32(link.config.retryMinMs, link.retryDelay());
+    TEST_ASSERT_EQUAL(WIFI_LINK_RECONNECT, link.update(now += 10, false, true));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, idleUntilAction(link, now));
+    TEST_ASSERT_FALSE(link.fast());
+    uint32_t scanStart = now;
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, idleUntilAction(link, now));
+    TEST_ASSERT_EQUAL_UINT32(link.config.scanTimeoutMs + link.config.retryMinMs, now - scanStart);
+}
+
+// The clock wrapping in the middle of an attempt changes nothing
+void test_deadlines_survive_millis_wrap()
+{
+    WiFiLink link;
+    uint32_t now = 0xFFFFFF00UL;
+    link.begin(now, true);
+    TEST_ASSERT_EQUAL(WIFI_LINK_NONE, link.update(now + 1000, false, false));
+    TEST_ASSERT_EQUAL_UINT32(link.config.fastTimeoutMs - 1000, link.wait(now + 1000));
+    TEST_ASSERT_EQUAL(WIFI_LINK_CONNECT, link.update(now + link.config.fastTimeoutMs, false, false));
+    TEST_ASSERT_FALSE(link.fast());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_cold_boot_scans_and_backs_off);
+    RUN_TEST(test_cached_boot_falls_back_to_a_scan);
+    RUN_TEST(test_failed_attempt_moves_on_at_once);
+    RUN_TEST(test_drop_reconnects_to_the_cached_access_point);
+    RUN_TEST(test_backoff_resets_once_up);
+    RUN_TEST(test_deadlines_survive_millis_wrap);
+    return UNITY_END();
+}
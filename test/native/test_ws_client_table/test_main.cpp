@@ -0,0 +1,274 @@
+#include <WsClientTable.h>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+// WsClientTable slot bookkeeping, and senders on other threads while a
+// stand-in async_tcp thread connects and frees clients as fast as it can:
+// no frame may reach a client after its disconnect callback returned. That
+// needs the library to raise the callback before it frees anything, which
+// scripts/patch_websocket.py sees to; it is run here on the destructor as
+// ESPAsyncWebServer 1.2.3 ships it.
+
+#define SLOTS 5
+#define CHURN_MIN_CONNECTS 1000
+#define CHURN_MIN_FRAMES 2000
+#define CHURN_MAX_MS 5000
+#define SENDERS 2
+
+struct FakeClient
+{
+    uint32_t clientId = 0;
+    std::atomic<bool> alive{false};
+    std::atomic<bool> queueFull{false};
+    std::atomic<uint32_t> frames{0};
+    std::atomic<uint32_t> afterFree{0};
+
+    uint32_t id() const { return clientId; }
+    bool canSend() const { return !queueFull; }
+    void text(const char *message, size_t length)
+    {
+        if (!alive)
+        {
+            afterFree++;
+        }
+        // Roughly what queueing a frame costs, so a disconnect has time to
+        // land in the middle of it
+        std::this_thread::sleep_for(std::chrono::microseconds(5));
+        if (!alive)
+        {
+            afterFree++;
+        }
+        frames++;
+    }
+};
+
+typedef WsClientTable<FakeClient, SLOTS> Table;
+
+void setUp() {}
+void tearDown() {}
+
+void test_slots_follow_connects_and_disconnects()
+{
+    Table table;
+    table.begin();
+    FakeClient clients[SLOTS + 1];
+    for (uint8_t i = 0; i <= SLOTS; i++)
+    {
+        clients[i].clientId = 100 + i;
+        clients[i].alive = true;
+    }
+    for (uint8_t i = 0; i < SLOTS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT8(i, table.add(&clients[i]));
+    }
+    TEST_ASSERT_EQUAL_UINT8(SLOTS, table.count());
+    // Full: refused without disturbing anyone
+    TEST_ASSERT_EQUAL_INT8(-1, table.add(&clients[SLOTS]));
+    TEST_ASSERT_EQUAL_INT8(-1, table.slotOf(100 + SLOTS));
+    TEST_ASSERT_EQUAL_INT8(-1, table.remove(100 + SLOTS));
+    TEST_ASSERT_EQUAL_UINT8(SLOTS, table.count());
+
+    TEST_ASSERT_EQUAL_INT8(2, table.remove(102));
+    TEST_ASSERT_EQUAL_UINT8(SLOTS - 1, table.count());
+    TEST_ASSERT_FALSE(table.text(2, "x", 1));
+    TEST_ASSERT_EQUAL_INT8(2, table.add(&clients[SLOTS]));
+    TEST_ASSERT_EQUAL_INT8(2, table.slotOf(100 + SLOTS));
+    TEST_ASSERT_TRUE(table.text(2, "x", 1));
+    TEST_ASSERT_EQUAL_UINT32(1, clients[SLOTS].frames.load());
+    TEST_ASSERT_EQUAL_UINT32(0, clients[2].frames.load());
+    TEST_ASSERT_FALSE(table.text(SLOTS, "x", 1));
+}
+
+// A client whose send queue is full misses the frame
+void test_full_send_queue_drops_the_frame()
+{
+    Table table;
+    table.begin();
+    FakeClient client;
+    client.clientId = 7;
+    client.alive = true;
+    int8_t slot = table.add(&client);
+    client.queueFull = true;
+    TEST_ASSERT_FALSE(table.text(slot, "x", 1));
+    client.queueFull = false;
+    TEST_ASSERT_TRUE(table.text(slot, "x", 1));
+    TEST_ASSERT_EQUAL_UINT32(1, client.frames.load());
+}
+
+void test_senders_never_reach_a_freed_client()
+{
+    Table table;
+    table.begin();
+    std::vector<FakeClient> pool(SLOTS * 4);
+    std::atomic<bool> stop{false};
+    std::atomic<uint32_t> sent{0};
+    std::atomic<uint32_t> badCount{0};
+
+    std::vector<std::thread> senders;
+    for (int s = 0; s < SENDERS; s++)
+    {
+        senders.emplace_back([&, s]()
+                             {
+                                 uint8_t slot = s;
+                                 while (!stop)
+                                 {
+                                     sent += table.text(slot, "frame", 5);
+                                     if (table.count() > SLOTS)
+                                     {
+                                         badCount++;
+                                     }
+                                     slot = (slot + 1) % SLOTS;
+                                 } });
+    }
+
+    // async_tcp: connect into a free client, then disconnect and free one
+    uint32_t nextId = 1;
+    uint32_t connects = 0;
+    size_t next = 0;
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(CHURN_MAX_MS);
+    while ((connects < CHURN_MIN_CONNECTS || sent < CHURN_MIN_FRAMES) && std::chrono::steady_clock::now() < end)
+    {
+        FakeClient &client = pool[next];
+        next = (next + 1) % pool.size();
+        if (client.alive)
+        {
+            table.remove(client.clientId);
+            client.alive = false; // freed
+            continue;
+        }
+        client.clientId = nextId++;
+        client.alive = true;
+        if (table.add(&client) < 0)
+        {
+            client.alive = false;
+        }
+        else
+        {
+            connects++;
+        }
+    }
+    stop = true;
+    for (std::thread &sender : senders)
+    {
+        sender.join();
+    }
+
+    uint32_t afterFree = 0;
+    uint8_t live = 0;
+    for (FakeClient &client : pool)
+    {
+        afterFree += client.afterFree;
+        live += client.alive;
+    }
+    char report[96];
+    snprintf(report, sizeof(report), "%u connects, %u frames sent", connects, sent.load());
+    TEST_MESSAGE(report);
+    TEST_ASSERT_EQUAL_UINT32(0, afterFree);
+    TEST_ASSERT_TRUE(connects >= CHURN_MIN_CONNECTS);
+    TEST_ASSERT_TRUE(sent >= CHURN_MIN_FRAMES);
+    TEST_ASSERT_EQUAL_UINT32(0, badCount.load());
+    TEST_ASSERT_EQUAL_UINT8(live, table.count());
+}
+
+// ~AsyncWebSocketClient() as in ESPAsyncWebServer 1.2.3
+// src/AsyncWebSocket.cpp, and a function after it the patch must not touch
+static const char *LIBRARY_DESTRUCTOR =
+    "AsyncWebSocketClient::~AsyncWebSocketClient(){\n"
+    "  _messageQueue.free();\n"
+    "  _controlQueue.free();\n"
+    "  _server->_handleEvent(this, WS_EVT_DISCONNECT, NULL, NULL, 0);\n"
+    "}\n"
+    "\n"
+    "void AsyncWebSocketClient::_clearQueue(){\n"
+    "  while(_messageQueue.length() && _messageQueue.front()->finished()){\n"
+    "    _messageQueue.remove(_messageQueue.front());\n"
+    "  }\n"
+    "}\n";
+
+static std::string readFile(const std::string &path)
+{
+    std::string text;
+    FILE *file = fopen(path.c_str(), "rb");
+    TEST_ASSERT_TRUE(file != NULL);
+    char buffer[256];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        text.append(buffer, got);
+    }
+    fclose(file);
+    return text;
+}
+
+static void writeFile(const std::string &path, const std::string &text)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    TEST_ASSERT_TRUE(file != NULL);
+    fwrite(text.data(), 1, text.size(), file);
+    fclose(file);
+}
+
+// Runs scripts/patch_websocket.py on path with whichever Python there is;
+// its exit status, or -1 if there is no Python
+static int patchWebSocket(const std::string &path)
+{
+    std::string here = __FILE__;
+    std::string root = here.substr(0, here.rfind("test/native/"));
+    for (const char *python : {"python3", "python"})
+    {
+        if (system((std::string(python) + " -c pass > /dev/null 2>&1").c_str()) != 0)
+        {
+            continue;
+        }
+        std::string command = std::string(python) + " \"" + root + "scripts/patch_websocket.py\" " + path + " > /dev/null 2>&1";
+        int status = system(command.c_str());
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+    return -1;
+}
+
+void test_library_raises_disconnect_before_freeing()
+{
+    std::string path = "ws_client_destructor.cpp";
+    writeFile(path, LIBRARY_DESTRUCTOR);
+    int status = patchWebSocket(path);
+    if (status < 0)
+    {
+        remove(path.c_str());
+        TEST_IGNORE_MESSAGE("no Python to run scripts/patch_websocket.py with");
+    }
+    TEST_ASSERT_EQUAL_INT(0, status);
+    std::string patched = readFile(path);
+    size_t event = patched.find("_handleEvent(this, WS_EVT_DISCONNECT");
+    TEST_ASSERT_TRUE(event != std::string::npos);
+    TEST_ASSERT_TRUE(event < patched.find("_messageQueue.free()"));
+    TEST_ASSERT_TRUE(event < patched.find("_controlQueue.free()"));
+    TEST_ASSERT_TRUE(patched.find("_handleEvent", event + 1) == std::string::npos);
+    TEST_ASSERT_EQUAL_size_t(std::string(LIBRARY_DESTRUCTOR).size(), patched.size());
+
+    // A second build finds it patched and leaves it
+    TEST_ASSERT_EQUAL_INT(0, patchWebSocket(path));
+    TEST_ASSERT_TRUE(readFile(path) == patched);
+
+    // A release with a different destructor fails the build
+    writeFile(path, "AsyncWebSocketClient::~AsyncWebSocketClient(){\n  _messageQueue.free();\n}\n");
+    TEST_ASSERT_EQUAL_INT(1, patchWebSocket(path));
+    remove(path.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_slots_follow_connects_and_disconnects);
+    RUN_TEST(test_full_send_queue_drops_the_frame);
+    RUN_TEST(test_senders_never_reach_a_freed_client);
+    RUN_TEST(test_library_raises_disconnect_before_freeing);
+    return UNITY_END();
+}
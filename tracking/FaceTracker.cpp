@@ -0,0 +1,112 @@
+#include "FaceTracker.h"
+#include <algorithm>
+
+namespace
+{
+    double overlap(const HaarDetection &a, const HaarDetection &b)
+    {
+        int width = std::min(a.x + a.width, b.x + b.width) - std::max(a.x, b.x);
+        int height = std::min(a.y + a.height, b.y + b.height) - std::max(a.y, b.y);
+        if (width <= 0 || height <= 0)
+        {
+            return 0;
+        }
+        double shared = (double)width * height;
+        return shared / ((double)a.width * a.height + (double)b.width * b.height - shared);
+    }
+
+    int area(const TrackedFace &face)
+    {
+        return face.face.width * face.face.height;
+    }
+}
+
+void FaceTracker::update(const std::vector<HaarDetection> &detections, std::vector<TrackedFace> &faces)
+{
+    struct Pair
+    {
+        double overlap;
+        size_t detection;
+        size_t track;
+    };
+    std::vector<Pair> pairs;
+    for (size_t d = 0; d < detections.size(); d++)
+    {
+        for (size_t t = 0; t < tracks.size(); t++)
+        {
+            double o = overlap(detections[d], tracks[t].face.face);
+            if (o >= minOverlap)
+            {
+                pairs.push_back({o, d, t});
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const Pair &a, const Pair &b)
+              { return a.overlap > b.overlap; });
+
+    std::vector<int> trackOf(detections.size(), -1);
+    std::vector<bool> taken(tracks.size(), false);
+    for (const Pair &pair : pairs)
+    {
+        if (trackOf[pair.detection] < 0 && !taken[pair.track])
+        {
+            trackOf[pair.detection] = (int)pair.track;
+            taken[pair.track] = true;
+        }
+    }
+
+    for (size_t t = 0; t < tracks.size(); t++)
+    {
+        if (!taken[t])
+        {
+            tracks[t].missed++;
+        }
+    }
+    faces.clear();
+    for (size_t d = 0; d < detections.size(); d++)
+    {
+        if (trackOf[d] >= 0)
+        {
+            Track &track = tracks[trackOf[d]];
+            track.face.face = detections[d];
+            track.face.frames++;
+            track.missed = 0;
+            faces.push_back(track.face);
+        }
+        else
+        {
+            Track track = {{nextId++, detections[d], 1}, 0};
+            tracks.push_back(track);
+            faces.push_back(track.face);
+        }
+    }
+    tracks.erase(std::remove_if(tracks.begin(), tracks.end(), [this](const Track &track)
+                                { return track.missed > maxMissed; }),
+                 tracks.end());
+}
+
+const TrackedFace *largestFace(const std::vector<TrackedFace> &faces)
+{
+    const TrackedFace *best = NULL;
+    for (const TrackedFace &face : faces)
+    {
+        if (best == NULL || area(face) > area(*best))
+        {
+            best = &face;
+        }
+    }
+    return best;
+}
+
+const TrackedFace *persistentFace(const std::vector<TrackedFace> &faces)
+{
+    const TrackedFace *best = NULL;
+    for (const TrackedFace &face : faces)
+    {
+        if (best == NULL || face.frames > best->frames || (face.frames == best->frames && area(face) > area(*best)))
+        {
+            best = &face;
+        }
+    }
+    return best;
+}
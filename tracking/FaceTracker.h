@@ -0,0 +1,45 @@
+#ifndef TRACKING_FACE_TRACKER_H
+#define TRACKING_FACE_TRACKER_H
+
+#include "HaarDetector.h"
+#include <stdint.h>
+#include <vector>
+
+// Gives detections identities across frames: each is matched to the
+// track it overlaps most (greedily, best overlap first), and unmatched
+// detections start new tracks. A track survives a few frames without a
+// match so a blink or a missed frame does not renumber a face.
+
+struct TrackedFace
+{
+    uint32_t id;
+    HaarDetection face;
+    uint32_t frames; // frames matched since the track started
+};
+
+class FaceTracker
+{
+public:
+    // faces gets the tracks matched this frame, in detection order
+    void update(const std::vector<HaarDetection> &detections, std::vector<TrackedFace> &faces);
+
+    double minOverlap = 0.3; // intersection over union to count as the same face
+    uint32_t maxMissed = 5;  // frames a track is kept without a match
+
+private:
+    struct Track
+    {
+        TrackedFace face;
+        uint32_t missed;
+    };
+
+    std::vector<Track> tracks;
+    uint32_t nextId = 1;
+};
+
+// Largest face (the closest in practice) or the longest tracked, NULL if
+// there are none
+const TrackedFace *largestFace(const std::vector<TrackedFace> &faces);
+const TrackedFace *persistentFace(const std::vector<TrackedFace> &faces);
+
+#endif
@@ -0,0 +1,214 @@
+#include "HaarCascade.h"
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+
+// Subtracted from every stage threshold, as OpenCV does when it loads a
+// cascade, so detections agree with CascadeClassifier
+#define HAAR_STAGE_THRESHOLD_EPS 1e-5f
+
+namespace
+{
+    // The file is machine written with one known layout, so a scan for the
+    // few elements that matter is enough; nothing here is a general XML
+    // parser. Finds <tag>...</tag> between from and end, returns its text
+    // and moves from past it.
+    bool element(const std::string &xml, const char *tag, size_t &from, size_t end, std::string &text)
+    {
+        std::string open = std::string("<") + tag + ">";
+        std::string close = std::string("</") + tag + ">";
+        size_t start = xml.find(open, from);
+        if (start == std::string::npos || start >= end)
+        {
+            return false;
+        }
+        start += open.size();
+        size_t stop = xml.find(close, start);
+        if (stop == std::string::npos || stop > end)
+        {
+            return false;
+        }
+        text = xml.substr(start, stop - start);
+        from = stop + close.size();
+        return true;
+    }
+
+    // The span between <tag> and </tag>, for tags that only appear once
+    bool section(const std::string &xml, const char *tag, size_t &start, size_t &end)
+    {
+        start = xml.find(std::string("<") + tag + ">");
+        end = xml.find(std::string("</") + tag + ">");
+        return start != std::string::npos && end != std::string::npos && start < end;
+    }
+
+    size_t numbers(const std::string &text, double *out, size_t capacity)
+    {
+        const char *p = text.c_str();
+        size_t count = 0;
+        while (count < capacity)
+        {
+            char *next;
+            double value = strtod(p, &next);
+            if (next == p)
+            {
+                break;
+            }
+            out[count++] = value;
+            p = next;
+        }
+        return count;
+    }
+
+    void stripComments(std::string &xml)
+    {
+        size_t start;
+        while ((start = xml.find("<!--")) != std::string::npos)
+        {
+            size_t stop = xml.find("-->", start);
+            xml.erase(start, stop == std::string::npos ? std::string::npos : stop + 3 - start);
+        }
+    }
+}
+
+bool HaarCascade::load(const std::string &path, std::string &error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string xml = buffer.str();
+    stripComments(xml);
+
+    stages.clear();
+    stumps.clear();
+    features.clear();
+
+    size_t stagesStart, stagesEnd, featuresStart, featuresEnd;
+    if (xml.find("<cascade type_id=\"opencv-cascade-classifier\">") == std::string::npos ||
+        !section(xml, "stages", stagesStart, stagesEnd) || !section(xml, "features", featuresStart, featuresEnd))
+    {
+        error = "not an opencv_traincascade cascade";
+        return false;
+    }
+
+    std::string text;
+    size_t pos = 0;
+    if (!element(xml, "stageType", pos, stagesStart, text) || text.find("BOOST") == std::string::npos)
+    {
+        error = "not a boosted cascade";
+        return false;
+    }
+    pos = 0;
+    if (!element(xml, "featureType", pos, stagesStart, text) || text.find("HAAR") == std::string::npos)
+    {
+        error = "not a Haar cascade";
+        return false;
+    }
+    double value[5];
+    pos = 0;
+    if (!element(xml, "height", pos, stagesStart, text) || numbers(text, value, 1) != 1)
+    {
+        error = "no window height";
+        return false;
+    }
+    windowHeight = (int)value[0];
+    pos = 0;
+    if (!element(xml, "width", pos, stagesStart, text) || numbers(text, value, 1) != 1)
+    {
+        error = "no window width";
+        return false;
+    }
+    windowWidth = (int)value[0];
+
+    // Each stage: <maxWeakCount> then <stageThreshold> then that many
+    // weak classifiers, each <internalNodes>left right feature threshold
+    // and <leafValues>left right. A stump has exactly one node.
+    pos = stagesStart;
+    while (element(xml, "maxWeakCount", pos, stagesEnd, text))
+    {
+        HaarStage stage;
+        stage.firstStump = (int)stumps.size();
+        stage.stumpCount = numbers(text, value, 1) == 1 ? (int)value[0] : 0;
+        if (!element(xml, "stageThreshold", pos, stagesEnd, text) || numbers(text, value, 1) != 1)
+        {
+            error = "stage " + std::to_string(stages.size()) + " has no threshold";
+            return false;
+        }
+        stage.threshold = (float)value[0] - HAAR_STAGE_THRESHOLD_EPS;
+
+        for (int i = 0; i < stage.stumpCount; i++)
+        {
+            double leaves[2];
+            if (!element(xml, "internalNodes", pos, stagesEnd, text) || numbers(text, value, 5) != 4 ||
+                !element(xml, "leafValues", pos, stagesEnd, text) || numbers(text, leaves, 2) != 2)
+            {
+                error = "stage " + std::to_string(stages.size()) + " has a weak classifier that is not a stump";
+                return false;
+            }
+            HaarStump stump;
+            stump.feature = (int)value[2];
+            stump.threshold = (float)value[3];
+            stump.left = (float)leaves[0];
+            stump.right = (float)leaves[1];
+            stumps.push_back(stump);
+        }
+        stages.push_back(stage);
+    }
+
+    pos = featuresStart;
+    while (element(xml, "rects", pos, featuresEnd, text))
+    {
+        HaarFeature feature = {};
+        size_t rectPos = 0;
+        std::string rect;
+        while (element(text, "_", rectPos, text.size(), rect))
+        {
+            if (feature.rectCount == HAAR_MAX_RECTS || numbers(rect, value, 5) != 5)
+            {
+                error = "feature " + std::to_string(features.size()) + " is malformed";
+                return false;
+            }
+            HaarRect &r = feature.rects[feature.rectCount++];
+            r.x = (int)value[0];
+            r.y = (int)value[1];
+            r.width = (int)value[2];
+            r.height = (int)value[3];
+            r.weight = (float)value[4];
+            if (r.x < 0 || r.y < 0 || r.width <= 0 || r.height <= 0 ||
+                r.x + r.width > windowWidth || r.y + r.height > windowHeight)
+            {
+                error = "feature " + std::to_string(features.size()) + " leaves the window";
+                return false;
+            }
+        }
+        features.push_back(feature);
+    }
+    pos = featuresStart;
+    while (element(xml, "tilted", pos, featuresEnd, text))
+    {
+        if (numbers(text, value, 1) == 1 && value[0] != 0)
+        {
+            error = "tilted features are not supported";
+            return false;
+        }
+    }
+
+    if (stages.empty())
+    {
+        error = "no stages";
+        return false;
+    }
+    for (const HaarStump &stump : stumps)
+    {
+        if (stump.feature < 0 || stump.feature >= (int)features.size())
+        {
+            error = "a stump uses a missing feature";
+            return false;
+        }
+    }
+    return true;
+}
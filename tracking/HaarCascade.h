@@ -0,0 +1,56 @@
+#ifndef TRACKING_HAAR_CASCADE_H
+#define TRACKING_HAAR_CASCADE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A boosted cascade of Haar stumps as written by opencv_traincascade, the
+// format of haarcascade_frontalface_default.xml. Only what the detector
+// needs is kept: per stage a threshold and a run of stumps, per stump one
+// feature compared against a threshold and the two leaf values, per
+// feature up to three weighted rectangles in window coordinates. Tilted
+// features and tree (non stump) classifiers are refused.
+
+#define HAAR_MAX_RECTS 3
+
+struct HaarRect
+{
+    int x, y, width, height;
+    float weight;
+};
+
+struct HaarFeature
+{
+    HaarRect rects[HAAR_MAX_RECTS];
+    int rectCount;
+};
+
+struct HaarStump
+{
+    int feature;
+    float threshold;
+    float left;  // added when the feature value is below threshold
+    float right;
+};
+
+struct HaarStage
+{
+    int firstStump;
+    int stumpCount;
+    float threshold; // the stage passes when its stump sum is at least this
+};
+
+class HaarCascade
+{
+public:
+    bool load(const std::string &path, std::string &error);
+
+    int windowWidth = 0;
+    int windowHeight = 0;
+    std::vector<HaarStage> stages;
+    std::vector<HaarStump> stumps;
+    std::vector<HaarFeature> features;
+};
+
+#endif
@@ -0,0 +1,774 @@
+#include "HaarDetector.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAAR_X86 1
+#include <immintrin.h>
+#define HAAR_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Stages run over whole rows before the survivors are gathered. The first
+// two reject most windows and the rest of the row is wasted lanes after
+// that.
+#define HAAR_DENSE_STAGES 2
+// Roughly how many windows one scan job covers
+#define HAAR_BAND_WINDOWS 4096
+// Integral images are read up to this far past a row's last window by the
+// dense loads
+#define HAAR_INTEGRAL_PAD 32
+// Windows whose normalised deviation is below this are skipped unseen
+#define HAAR_MIN_DEVIATION 0.1
+#define HAAR_CANDIDATE 0x7FFF
+
+namespace
+{
+    inline uint32_t rectSum(const uint32_t *p, const HaarDetector::Corners &c)
+    {
+        return p[c.a] - p[c.b] - p[c.c] + p[c.d];
+    }
+
+    // OpenCV's setWindow: the stumps compare features against thresholds
+    // trained on windows scaled to unit deviation. Sums wrap in 32 bits the
+    // same way CascadeClassifier's integral images do.
+    bool varianceNorm(const uint32_t *sum, const uint32_t *squares, const HaarDetector::Corners &norm, double area, float &vnf)
+    {
+        double s = (int32_t)rectSum(sum, norm);
+        double q = (int32_t)rectSum(squares, norm);
+        double nf = area * q - s * s;
+        if (nf <= 0)
+        {
+            return false;
+        }
+        vnf = (float)(1. / sqrt(nf));
+        return area * vnf < HAAR_MIN_DEVIATION;
+    }
+
+    // Stage the window was rejected at, or to if it passed them all
+    int runStages(const HaarStage *stages, const HaarDetector::Weak *weak, int from, int to, const uint32_t *sum, float vnf)
+    {
+        for (int s = from; s < to; s++)
+        {
+            const HaarDetector::Weak *w = weak + stages[s].firstStump;
+            float acc = 0;
+            for (int k = 0; k < stages[s].stumpCount; k++, w++)
+            {
+                float f = w->weight[0] * (float)(int32_t)rectSum(sum, w->corners[0]) +
+                          w->weight[1] * (float)(int32_t)rectSum(sum, w->corners[1]);
+                if (w->rectCount == 3)
+                {
+                    f += w->weight[2] * (float)(int32_t)rectSum(sum, w->corners[2]);
+                }
+                acc += f * vnf < w->threshold ? w->left : w->right;
+            }
+            if (acc < stages[s].threshold)
+            {
+                return s;
+            }
+        }
+        return to;
+    }
+
+    // One row of the integral and squared integral images. above points at
+    // the previous row; every row starts one entry in, after the zero column.
+    void integralRow(const uint8_t *src, int width, const uint32_t *sumAbove, uint32_t *sum,
+                     const uint32_t *squaresAbove, uint32_t *squares)
+    {
+        int x = 0;
+        uint32_t run = 0;
+        uint32_t runSquares = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        __m128i carry = zero;
+        __m128i carrySquares = zero;
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x));
+            __m128i words[2] = {_mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero)};
+            for (int half = 0; half < 2; half++)
+            {
+                // 255 * 255 still fits 16 bits
+                __m128i squared = _mm_mullo_epi16(words[half], words[half]);
+                for (int quarter = 0; quarter < 2; quarter++)
+                {
+                    __m128i v = quarter ? _mm_unpackhi_epi16(words[half], zero) : _mm_unpacklo_epi16(words[half], zero);
+                    __m128i q = quarter ? _mm_unpackhi_epi16(squared, zero) : _mm_unpacklo_epi16(squared, zero);
+                    // Prefix sum of four lanes in two shifted adds
+                    v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+                    v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+                    v = _mm_add_epi32(v, carry);
+                    carry = _mm_shuffle_epi32(v, 0xFF);
+                    q = _mm_add_epi32(q, _mm_slli_si128(q, 4));
+                    q = _mm_add_epi32(q, _mm_slli_si128(q, 8));
+                    q = _mm_add_epi32(q, carrySquares);
+                    carrySquares = _mm_shuffle_epi32(q, 0xFF);
+
+                    int at = x + half * 8 + quarter * 4;
+                    _mm_storeu_si128((__m128i *)(sum + at),
+                                     _mm_add_epi32(v, _mm_loadu_si128((const __m128i *)(sumAbove + at))));
+                    _mm_storeu_si128((__m128i *)(squares + at),
+                                     _mm_add_epi32(q, _mm_loadu_si128((const __m128i *)(squaresAbove + at))));
+                }
+            }
+        }
+        run = (uint32_t)_mm_cvtsi128_si32(carry);
+        runSquares = (uint32_t)_mm_cvtsi128_si32(carrySquares);
+#endif
+        for (; x < width; x++)
+        {
+            run += src[x];
+            runSquares += (uint32_t)src[x] * src[x];
+            sum[x] = sumAbove[x] + run;
+            squares[x] = squaresAbove[x] + runSquares;
+        }
+    }
+
+    // Source index and weight (of 256) of the left or upper tap for each
+    // output pixel, the fixed point bilinear OpenCV's INTER_LINEAR_EXACT
+    // resize uses
+    void resizeTaps(int from, int to, std::vector<int> &index, std::vector<uint16_t> &weight)
+    {
+        index.resize(to);
+        weight.resize(to);
+        double scale = (double)from / to;
+        for (int i = 0; i < to; i++)
+        {
+            double f = (i + 0.5) * scale - 0.5;
+            int s = (int)floor(f);
+            f -= s;
+            if (s < 0)
+            {
+                s = 0;
+                f = 0;
+            }
+            if (s >= from - 1)
+            {
+                s = from - 1;
+                f = 0;
+            }
+            index[i] = s;
+            weight[i] = (uint16_t)(256 - lrint(f * 256));
+        }
+    }
+
+    void resizeBilinear(const uint8_t *src, int width, int height, size_t stride, uint8_t *dst, int toWidth, int toHeight)
+    {
+        if (toWidth == width && toHeight == height)
+        {
+            for (int y = 0; y < height; y++)
+            {
+                memcpy(dst + (size_t)y * toWidth, src + y * stride, width);
+            }
+            return;
+        }
+        std::vector<int> xs, ys;
+        std::vector<uint16_t> xw, yw;
+        resizeTaps(width, toWidth, xs, xw);
+        resizeTaps(height, toHeight, ys, yw);
+
+        // Horizontally filtered source rows, the two the current output
+        // row blends
+        std::vector<uint32_t> rows[2] = {std::vector<uint32_t>(toWidth), std::vector<uint32_t>(toWidth)};
+        int cached[2] = {-1, -1};
+        for (int y = 0; y < toHeight; y++)
+        {
+            const uint32_t *taps[2];
+            for (int t = 0; t < 2; t++)
+            {
+                int sy = std::min(ys[y] + t, height - 1);
+                int slot = sy & 1;
+                if (cached[slot] != sy)
+                {
+                    const uint8_t *row = src + sy * stride;
+                    for (int x = 0; x < toWidth; x++)
+                    {
+                        int sx = xs[x];
+                        int next = std::min(sx + 1, width - 1);
+                        rows[slot][x] = row[sx] * xw[x] + row[next] * (256u - xw[x]);
+                    }
+                    cached[slot] = sy;
+                }
+                taps[t] = rows[slot].data();
+            }
+            uint32_t upper = yw[y];
+            uint32_t lower = 256 - upper;
+            uint8_t *out = dst + (size_t)y * toWidth;
+            for (int x = 0; x < toWidth; x++)
+            {
+                out[x] = (uint8_t)((taps[0][x] * upper + taps[1][x] * lower + (1 << 15)) >> 16);
+            }
+        }
+    }
+
+#if HAAR_X86
+    HAAR_AVX2 inline __m256i bitsToMask(int bits)
+    {
+        const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lanes), lanes);
+    }
+
+    // Eight integral entries one window step apart, step 1 or 2
+    HAAR_AVX2 inline __m256i loadSpaced(const uint32_t *p, int step)
+    {
+        if (step == 1)
+        {
+            return _mm256_loadu_si256((const __m256i *)p);
+        }
+        const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        __m256i low = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)p), evens);
+        __m256i high = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(p + 8)), evens);
+        return _mm256_permute2x128_si256(low, high, 0x20);
+    }
+
+    HAAR_AVX2 inline __m256i rectSumsSpaced(const uint32_t *p, const HaarDetector::Corners &c, int step)
+    {
+        __m256i s = _mm256_sub_epi32(loadSpaced(p + c.a, step), loadSpaced(p + c.b, step));
+        return _mm256_add_epi32(_mm256_sub_epi32(s, loadSpaced(p + c.c, step)), loadSpaced(p + c.d, step));
+    }
+
+    HAAR_AVX2 inline __m256i rectSumsGathered(const uint32_t *p, __m256i offsets, const HaarDetector::Corners &c)
+    {
+        const int *base = (const int *)p;
+        __m256i a = _mm256_i32gather_epi32(base, _mm256_add_epi32(offsets, _mm256_set1_epi32(c.a)), 4);
+        __m256i b = _mm256_i32gather_epi32(base, _mm256_add_epi32(offsets, _mm256_set1_epi32(c.b)), 4);
+        __m256i cc = _mm256_i32gather_epi32(base, _mm256_add_epi32(offsets, _mm256_set1_epi32(c.c)), 4);
+        __m256i d = _mm256_i32gather_epi32(base, _mm256_add_epi32(offsets, _mm256_set1_epi32(c.d)), 4);
+        return _mm256_add_epi32(_mm256_sub_epi32(_mm256_sub_epi32(a, b), cc), d);
+    }
+
+    // varianceNorm for eight windows, in double like the scalar version so
+    // both round the same. Returns the lanes that pass as a bit mask.
+    HAAR_AVX2 inline int varianceNorm8(__m256i sums, __m256i squares, double area, __m256 &vnf)
+    {
+        const __m256d areas = _mm256_set1_pd(area);
+        const __m256d zero = _mm256_setzero_pd();
+        __m128 halves[2];
+        int bits = 0;
+        for (int h = 0; h < 2; h++)
+        {
+            __m128i s32 = h ? _mm256_extracti128_si256(sums, 1) : _mm256_castsi256_si128(sums);
+            __m128i q32 = h ? _mm256_extracti128_si256(squares, 1) : _mm256_castsi256_si128(squares);
+            __m256d s = _mm256_cvtepi32_pd(s32);
+            __m256d nf = _mm256_sub_pd(_mm256_mul_pd(areas, _mm256_cvtepi32_pd(q32)), _mm256_mul_pd(s, s));
+            __m256d positive = _mm256_cmp_pd(nf, zero, _CMP_GT_OQ);
+            halves[h] = _mm256_cvtpd_ps(_mm256_div_pd(_mm256_set1_pd(1.), _mm256_sqrt_pd(nf)));
+            __m256d deviation = _mm256_mul_pd(areas, _mm256_cvtps_pd(halves[h]));
+            __m256d ok = _mm256_and_pd(positive, _mm256_cmp_pd(deviation, _mm256_set1_pd(HAAR_MIN_DEVIATION), _CMP_LT_OQ));
+            bits |= _mm256_movemask_pd(ok) << (4 * h);
+        }
+        vnf = _mm256_set_m128(halves[1], halves[0]);
+        return bits;
+    }
+
+    // Where stage8 reads its rectangle sums: a row of windows one step
+    // apart, or eight windows anywhere
+    struct SpacedSums
+    {
+        const uint32_t *p;
+        int step;
+        HAAR_AVX2 __m256i operator()(const HaarDetector::Corners &c) const { return rectSumsSpaced(p, c, step); }
+    };
+
+    struct GatheredSums
+    {
+        const uint32_t *p;
+        const int32_t *offsets;
+        HAAR_AVX2 __m256i operator()(const HaarDetector::Corners &c) const
+        {
+            return rectSumsGathered(p, _mm256_loadu_si256((const __m256i *)offsets), c);
+        }
+    };
+
+    // One stage for eight windows, rectangle sums from sums(corners).
+    // Returns the lanes that pass as a bit mask.
+    template <typename Sums>
+    HAAR_AVX2 inline int stage8(const HaarStage &stage, const HaarDetector::Weak *weak, __m256 vnf, Sums sums)
+    {
+        __m256 acc = _mm256_setzero_ps();
+        const HaarDetector::Weak *w = weak + stage.firstStump;
+        for (int k = 0; k < stage.stumpCount; k++, w++)
+        {
+            __m256 f = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(w->weight[0]), _mm256_cvtepi32_ps(sums(w->corners[0]))),
+                                     _mm256_mul_ps(_mm256_set1_ps(w->weight[1]), _mm256_cvtepi32_ps(sums(w->corners[1]))));
+            if (w->rectCount == 3)
+            {
+                f = _mm256_add_ps(f, _mm256_mul_ps(_mm256_set1_ps(w->weight[2]), _mm256_cvtepi32_ps(sums(w->corners[2]))));
+            }
+            __m256 below = _mm256_cmp_ps(_mm256_mul_ps(f, vnf), _mm256_set1_ps(w->threshold), _CMP_LT_OQ);
+            acc = _mm256_add_ps(acc, _mm256_blendv_ps(_mm256_set1_ps(w->right), _mm256_set1_ps(w->left), below));
+        }
+        return _mm256_movemask_ps(_mm256_cmp_ps(acc, _mm256_set1_ps(stage.threshold), _CMP_NLT_UQ));
+    }
+
+    // The dense stages over one row of windows: codes[i] is the stage
+    // window i was rejected at, -1 for too flat, HAAR_CANDIDATE if it got
+    // through
+    HAAR_AVX2 void denseRow(const uint32_t *sum, const uint32_t *squares, int rowBase, int cols, int step,
+                            const HaarDetector::Corners &norm, double area, const HaarStage *stages,
+                            const HaarDetector::Weak *weak, int denseStages, int32_t *codes, float *rowVnf)
+    {
+        for (int i = 0; i < cols; i += 8)
+        {
+            const uint32_t *p = sum + rowBase + i * step;
+            const uint32_t *q = squares + rowBase + i * step;
+            int valid = cols - i >= 8 ? 0xFF : (1 << (cols - i)) - 1;
+            __m256 vnf;
+            int active = valid & varianceNorm8(rectSumsSpaced(p, norm, step), rectSumsSpaced(q, norm, step), area, vnf);
+            __m256i code = _mm256_set1_epi32(-1);
+            for (int s = 0; s < denseStages && active; s++)
+            {
+                int passed = stage8(stages[s], weak, vnf, SpacedSums{p, step});
+                code = _mm256_blendv_epi8(code, _mm256_set1_epi32(s), bitsToMask(active & ~passed));
+                active &= passed;
+            }
+            code = _mm256_blendv_epi8(code, _mm256_set1_epi32(HAAR_CANDIDATE), bitsToMask(active));
+            _mm256_storeu_si256((__m256i *)(codes + i), code);
+            _mm256_storeu_ps(rowVnf + i, vnf);
+        }
+    }
+
+    // The remaining stages over the dense survivors, one stage at a time
+    // across all of them so every batch is full; the list is compacted in
+    // place after each stage. Returns how many passed every stage.
+    HAAR_AVX2 int sparseStages(const uint32_t *sum, const HaarStage *stages, const HaarDetector::Weak *weak,
+                               int from, int to, int32_t *offsets, float *vnf, int32_t *positions, int count)
+    {
+        for (int s = from; s < to && count > 0; s++)
+        {
+            int kept = 0;
+            for (int i = 0; i < count; i += 8)
+            {
+                int n = std::min(8, count - i);
+                int32_t batchOffsets[8];
+                float batchVnf[8];
+                for (int k = 0; k < 8; k++)
+                {
+                    // Short batches repeat the first window, ignored below
+                    batchOffsets[k] = offsets[i + (k < n ? k : 0)];
+                    batchVnf[k] = vnf[i + (k < n ? k : 0)];
+                }
+                int passed = stage8(stages[s], weak, _mm256_loadu_ps(batchVnf), GatheredSums{sum, batchOffsets});
+                passed &= (1 << n) - 1;
+                for (int k = 0; k < n; k++)
+                {
+                    if (passed & (1 << k))
+                    {
+                        offsets[kept] = offsets[i + k];
+                        vnf[kept] = vnf[i + k];
+                        positions[kept] = positions[i + k];
+                        kept++;
+                    }
+                }
+            }
+            count = kept;
+        }
+        return count;
+    }
+#endif
+}
+
+HaarDetector::HaarDetector(const HaarCascade &haarCascade, int threads)
+    : cascade(haarCascade), windowWidth(haarCascade.windowWidth), windowHeight(haarCascade.windowHeight)
+{
+    // OpenCV normalises over the window less a one pixel border
+    normArea = (double)(windowWidth - 2) * (windowHeight - 2);
+    if (threads <= 0)
+    {
+        threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    hits.resize(threads);
+    scratch.resize(threads);
+    for (int i = 1; i < threads; i++)
+    {
+        workers.emplace_back(&HaarDetector::workerLoop, this, i);
+    }
+}
+
+HaarDetector::~HaarDetector()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+bool HaarDetector::simdAvailable()
+{
+#if HAAR_X86
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+void HaarDetector::run(int jobs, const Job &job)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current = &job;
+        jobCount = jobs;
+        nextJob = 0;
+        busy = (int)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    // The calling thread is worker 0
+    for (int j; (j = nextJob++) < jobs;)
+    {
+        job(j, 0);
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this]
+              { return busy == 0; });
+    current = nullptr;
+}
+
+void HaarDetector::workerLoop(int worker)
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        wake.wait(guard, [&]
+                  { return stopping || generation != seen; });
+        if (stopping)
+        {
+            return;
+        }
+        seen = generation;
+        const Job *job = current;
+        int jobs = jobCount;
+        guard.unlock();
+
+        for (int j; (j = nextJob++) < jobs;)
+        {
+            (*job)(j, worker);
+        }
+
+        guard.lock();
+        if (--busy == 0)
+        {
+            done.notify_one();
+        }
+    }
+}
+
+void HaarDetector::layout(int stride)
+{
+    integralStride = stride;
+    auto corners = [stride](int x, int y, int width, int height)
+    {
+        Corners c;
+        c.a = y * stride + x;
+        c.b = y * stride + x + width;
+        c.c = (y + height) * stride + x;
+        c.d = (y + height) * stride + x + width;
+        return c;
+    };
+    normCorners = corners(1, 1, windowWidth - 2, windowHeight - 2);
+
+    weak.resize(cascade.stumps.size());
+    for (size_t i = 0; i < cascade.stumps.size(); i++)
+    {
+        const HaarStump &stump = cascade.stumps[i];
+        const HaarFeature &feature = cascade.features[stump.feature];
+        Weak &w = weak[i];
+        w = Weak();
+        w.rectCount = feature.rectCount;
+        for (int r = 0; r < feature.rectCount; r++)
+        {
+            const HaarRect &rect = feature.rects[r];
+            w.corners[r] = corners(rect.x, rect.y, rect.width, rect.height);
+            w.weight[r] = rect.weight;
+        }
+        // A one rectangle feature still evaluates two, the second weighted 0
+        for (int r = feature.rectCount; r < 2; r++)
+        {
+            w.corners[r] = w.corners[0];
+        }
+        w.threshold = stump.threshold;
+        w.left = stump.left;
+        w.right = stump.right;
+    }
+}
+
+void HaarDetector::prepareScale(Scale &scale, const uint8_t *image, int width, int height, size_t stride)
+{
+    scale.image.resize((size_t)scale.width * scale.height);
+    resizeBilinear(image, width, height, stride, scale.image.data(), scale.width, scale.height);
+
+    size_t entries = (size_t)(scale.height + 1) * integralStride + HAAR_INTEGRAL_PAD;
+    scale.sum.assign(entries, 0);
+    scale.squares.assign(entries, 0);
+    for (int y = 0; y < scale.height; y++)
+    {
+        size_t above = (size_t)y * integralStride + 1;
+        size_t row = above + integralStride;
+        integralRow(scale.image.data() + (size_t)y * scale.width, scale.width,
+                    scale.sum.data() + above, scale.sum.data() + row,
+                    scale.squares.data() + above, scale.squares.data() + row);
+    }
+}
+
+void HaarDetector::scanBand(const Scale &scale, int band, int worker, bool simd)
+{
+    int rowsPerBand = (scale.rows + scale.rowBands - 1) / scale.rowBands;
+    int firstRow = band * rowsPerBand;
+    int lastRow = std::min(scale.rows, firstRow + rowsPerBand);
+    const uint32_t *sum = scale.sum.data();
+    const uint32_t *squares = scale.squares.data();
+    const HaarStage *stages = cascade.stages.data();
+    int stageCount = (int)cascade.stages.size();
+    std::vector<HaarDetection> &out = hits[worker];
+
+    auto hit = [&](int x, int y)
+    {
+        out.push_back({(int)lrintf(x * scale.factor), (int)lrintf(y * scale.factor), scale.outWidth, scale.outHeight, 1});
+    };
+
+#if HAAR_X86
+    if (simd)
+    {
+        Scratch &s = scratch[worker];
+        int dense = std::min(HAAR_DENSE_STAGES, stageCount);
+        s.codes.resize(scale.cols + 8);
+        s.rowVnf.resize(scale.cols + 8);
+        s.offsets.clear();
+        s.vnf.clear();
+        s.positions.clear();
+        for (int row = firstRow; row < lastRow; row++)
+        {
+            int y = row * scale.step;
+            int rowBase = y * integralStride;
+            denseRow(sum, squares, rowBase, scale.cols, scale.step, normCorners, normArea, stages, weak.data(),
+                     dense, s.codes.data(), s.rowVnf.data());
+            for (int i = 0; i < scale.cols; i++)
+            {
+                int x = i * scale.step;
+                if (s.codes[i] == HAAR_CANDIDATE)
+                {
+                    s.offsets.push_back(rowBase + x);
+                    s.vnf.push_back(s.rowVnf[i]);
+                    s.positions.push_back(x << 16 | y);
+                }
+                else if (s.codes[i] == 0)
+                {
+                    // OpenCV never looks at the window after a first stage
+                    // reject
+                    i++;
+                }
+            }
+        }
+        int found = sparseStages(sum, stages, weak.data(), dense, stageCount, s.offsets.data(), s.vnf.data(),
+                                 s.positions.data(), (int)s.offsets.size());
+        for (int i = 0; i < found; i++)
+        {
+            hit(s.positions[i] >> 16, s.positions[i] & 0xFFFF);
+        }
+        return;
+    }
+#else
+    (void)simd;
+#endif
+
+    for (int row = firstRow; row < lastRow; row++)
+    {
+        int y = row * scale.step;
+        for (int i = 0; i < scale.cols; i++)
+        {
+            int x = i * scale.step;
+            size_t offset = (size_t)y * integralStride + x;
+            float vnf;
+            if (!varianceNorm(sum + offset, squares + offset, normCorners, normArea, vnf))
+            {
+                continue;
+            }
+            int stage = runStages(stages, weak.data(), 0, stageCount, sum + offset, vnf);
+            if (stage == stageCount)
+            {
+                hit(x, y);
+            }
+            else if (stage == 0)
+            {
+                i++;
+            }
+        }
+    }
+}
+
+void HaarDetector::detect(const uint8_t *image, int width, int height, size_t stride,
+                          const HaarDetectOptions &options, std::vector<HaarDetection> &detections)
+{
+    detections.clear();
+    if (width + 1 != integralStride)
+    {
+        layout(width + 1);
+    }
+
+    // The same pyramid detectMultiScale walks: factors from 1 by
+    // scaleFactor while the window fits, the image shrunk by each
+    int maxSize = options.maxSize > 0 ? options.maxSize : std::max(width, height);
+    int count = 0;
+    int jobs = 0;
+    for (double factor = 1; options.scaleFactor > 1; factor *= options.scaleFactor)
+    {
+        int windowW = (int)lrint(windowWidth * factor);
+        int windowH = (int)lrint(windowHeight * factor);
+        if (windowW > maxSize || windowH > maxSize || windowW > width || windowH > height)
+        {
+            break;
+        }
+        if (windowW < options.minSize || windowH < options.minSize)
+        {
+            continue;
+        }
+        if ((int)scales.size() <= count)
+        {
+            scales.emplace_back();
+        }
+        Scale &scale = scales[count++];
+        scale.factor = (float)factor;
+        scale.width = (int)lrintf(width / scale.factor);
+        scale.height = (int)lrintf(height / scale.factor);
+        scale.step = scale.factor > 2 ? 1 : 2;
+        scale.cols = scale.width < windowWidth ? 0 : (scale.width - windowWidth) / scale.step + 1;
+        scale.rows = scale.height < windowHeight ? 0 : (scale.height - windowHeight) / scale.step + 1;
+        scale.outWidth = (int)lrintf(windowWidth * scale.factor);
+        scale.outHeight = (int)lrintf(windowHeight * scale.factor);
+        scale.rowBands = scale.cols == 0 ? 0 : std::min(scale.rows, (scale.cols * scale.rows + HAAR_BAND_WINDOWS - 1) / HAAR_BAND_WINDOWS);
+        scale.firstJob = jobs;
+        jobs += scale.rowBands;
+    }
+    if (count == 0)
+    {
+        return;
+    }
+
+    bool simd = options.simd && simdAvailable();
+    run(count, [&](int job, int)
+        { prepareScale(scales[job], image, width, height, stride); });
+    for (std::vector<HaarDetection> &list : hits)
+    {
+        list.clear();
+    }
+    run(jobs, [&](int job, int worker)
+        {
+            int s = count - 1;
+            while (scales[s].firstJob > job)
+            {
+                s--;
+            }
+            scanBand(scales[s], job - scales[s].firstJob, worker, simd); });
+
+    for (const std::vector<HaarDetection> &list : hits)
+    {
+        detections.insert(detections.end(), list.begin(), list.end());
+    }
+    groupHaarDetections(detections, options.minNeighbours);
+}
+
+void groupHaarDetections(std::vector<HaarDetection> &windows, int minNeighbours, double eps)
+{
+    if (minNeighbours <= 0 || windows.empty())
+    {
+        return;
+    }
+
+    // Union find over windows that are similar: every edge within eps of
+    // the smaller side. Same classes as cv::partition with SimilarRects.
+    size_t n = windows.size();
+    std::vector<int> parent(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        parent[i] = (int)i;
+    }
+    auto root = [&](int i)
+    {
+        while (parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+    for (size_t i = 0; i < n; i++)
+    {
+        const HaarDetection &a = windows[i];
+        for (size_t j = i + 1; j < n; j++)
+        {
+            const HaarDetection &b = windows[j];
+            double delta = eps * (std::min(a.width, b.width) + std::min(a.height, b.height)) * 0.5;
+            if (fabs((double)a.x - b.x) <= delta && fabs((double)a.y - b.y) <= delta &&
+                fabs((double)a.x + a.width - b.x - b.width) <= delta &&
+                fabs((double)a.y + a.height - b.y - b.height) <= delta)
+            {
+                parent[root((int)i)] = root((int)j);
+            }
+        }
+    }
+
+    // Average each class
+    std::vector<int> label(n, -1);
+    std::vector<HaarDetection> groups;
+    for (size_t i = 0; i < n; i++)
+    {
+        int r = root((int)i);
+        if (label[r] < 0)
+        {
+            label[r] = (int)groups.size();
+            groups.push_back({0, 0, 0, 0, 0});
+        }
+        HaarDetection &g = groups[label[r]];
+        g.x += windows[i].x;
+        g.y += windows[i].y;
+        g.width += windows[i].width;
+        g.height += windows[i].height;
+        g.neighbours++;
+    }
+    for (HaarDetection &g : groups)
+    {
+        float s = 1.f / g.neighbours;
+        g.x = (int)lrintf(g.x * s);
+        g.y = (int)lrintf(g.y * s);
+        g.width = (int)lrintf(g.width * s);
+        g.height = (int)lrintf(g.height * s);
+    }
+
+    // Drop weak groups and ones inside a stronger group
+    windows.clear();
+    for (size_t i = 0; i < groups.size(); i++)
+    {
+        const HaarDetection &r1 = groups[i];
+        if (r1.neighbours <= minNeighbours)
+        {
+            continue;
+        }
+        bool inside = false;
+        for (size_t j = 0; j < groups.size() && !inside; j++)
+        {
+            const HaarDetection &r2 = groups[j];
+            if (j == i || r2.neighbours <= minNeighbours)
+            {
+                continue;
+            }
+            int dx = (int)lrint(r2.width * eps);
+            int dy = (int)lrint(r2.height * eps);
+            inside = r1.x >= r2.x - dx && r1.y >= r2.y - dy &&
+                     r1.x + r1.width <= r2.x + r2.width + dx && r1.y + r1.height <= r2.y + r2.height + dy &&
+                     (r2.neighbours > std::max(3, r1.neighbours) || r1.neighbours < 3);
+        }
+        if (!inside)
+        {
+            windows.push_back(r1);
+        }
+    }
+    std::sort(windows.begin(), windows.end(), [](const HaarDetection &a, const HaarDetection &b)
+              { return a.neighbours != b.neighbours ? a.neighbours > b.neighbours : a.x != b.x ? a.x < b.x : a.y < b.y; });
+}
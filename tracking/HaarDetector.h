@@ -0,0 +1,145 @@
+#ifndef TRACKING_HAAR_DETECTOR_H
+#define TRACKING_HAAR_DETECTOR_H
+
+#include "HaarCascade.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Multi-scale Haar cascade detection without OpenCV, built to give the same
+// answers as CascadeClassifier::detectMultiScale on the same cascade and
+// parameters, only faster:
+//
+//   - the integral and squared integral images are built with SSE2 prefix
+//     sums, 16 pixels at a time
+//   - windows are classified 8 at a time in AVX2 lanes; the first stages,
+//     which reject nearly everything, run over whole rows of windows with
+//     plain loads, and the few survivors are gathered into full batches
+//     for the remaining stages
+//   - every scale, and every band of rows within the large scales, is a
+//     separate job for a pool of worker threads
+//
+// Without AVX2 (checked at run time) or with simd off the same steps run
+// one window at a time; both paths produce identical results.
+
+struct HaarDetection
+{
+    int x, y, width, height;
+    int neighbours; // raw windows merged into this one, the confidence
+};
+
+struct HaarDetectOptions
+{
+    double scaleFactor = 1.1;
+    int minNeighbours = 5;
+    int minSize = 30; // smallest window edge in pixels
+    int maxSize = 0;  // largest, 0 for the image size
+    bool simd = true;
+};
+
+class HaarDetector
+{
+public:
+    // threads 0 uses every core
+    HaarDetector(const HaarCascade &cascade, int threads = 0);
+    ~HaarDetector();
+
+    // image is 8 bit gray, stride bytes per row. Callers usually equalise
+    // the histogram first, as for CascadeClassifier.
+    void detect(const uint8_t *image, int width, int height, size_t stride,
+                const HaarDetectOptions &options, std::vector<HaarDetection> &detections);
+
+    int threads() const { return (int)workers.size() + 1; }
+    // Whether this CPU takes the AVX2 path
+    static bool simdAvailable();
+
+    // Laid out by detect and walked by the kernels in HaarDetector.cpp.
+    // Offsets of one rectangle's corners in an integral image, relative to
+    // the window's top left corner
+    struct Corners
+    {
+        int32_t a, b, c, d; // sum = [a] - [b] - [c] + [d]
+    };
+
+    // A stump with its feature laid out for evaluation
+    struct Weak
+    {
+        Corners corners[HAAR_MAX_RECTS];
+        float weight[HAAR_MAX_RECTS];
+        int rectCount;
+        float threshold;
+        float left;
+        float right;
+    };
+
+    // One level of the pyramid
+    struct Scale
+    {
+        float factor;
+        int width, height; // of the scaled image
+        int step;          // between windows, in both directions
+        int cols, rows;    // windows across and down
+        int outWidth;      // window size in the original image
+        int outHeight;
+        int rowBands;      // jobs the rows are split into
+        int firstJob;
+        std::vector<uint8_t> image;
+        std::vector<uint32_t> sum;
+        std::vector<uint32_t> squares;
+    };
+
+    // Per worker buffers for scanBand
+    struct Scratch
+    {
+        std::vector<int32_t> codes;
+        std::vector<float> rowVnf;
+        std::vector<int32_t> offsets; // survivors of the dense stages
+        std::vector<float> vnf;
+        std::vector<int32_t> positions; // x << 16 | y
+    };
+
+private:
+    typedef std::function<void(int job, int worker)> Job;
+
+    void run(int jobs, const Job &job);
+    void workerLoop(int worker);
+    void prepareScale(Scale &scale, const uint8_t *image, int width, int height, size_t stride);
+    void scanBand(const Scale &scale, int band, int worker, bool simd);
+    void layout(int integralStride);
+
+    const HaarCascade &cascade;
+    int windowWidth;
+    int windowHeight;
+    Corners normCorners;
+    double normArea;
+    int integralStride = 0;
+    std::vector<Weak> weak;
+
+    std::vector<Scale> scales;
+    // Raw window hits per worker, merged after each detect
+    std::vector<std::vector<HaarDetection>> hits;
+    std::vector<Scratch> scratch;
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const Job *current = nullptr;
+    int jobCount = 0;
+    std::atomic<int> nextJob{0};
+    int busy = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
+
+// OpenCV's groupRectangles: windows that overlap within eps are averaged
+// into one, groups of minNeighbours or fewer windows are dropped, as are
+// groups sitting inside a stronger one
+void groupHaarDetections(std::vector<HaarDetection> &windows, int minNeighbours, double eps = 0.2);
+
+#endif
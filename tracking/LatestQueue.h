@@ -0,0 +1,90 @@
+#ifndef LATEST_QUEUE_H
+#define LATEST_QUEUE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <utility>
+
+// Single slot hand-off between two pipeline stages. push() never blocks: a
+// value the consumer has not taken yet is replaced and counted as dropped,
+// so a slow stage always works on the newest frame instead of a backlog.
+template <typename T>
+class LatestQueue
+{
+public:
+    void push(T value)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (full)
+            {
+                dropped++;
+            }
+            slot = std::move(value);
+            full = true;
+            pushed++;
+        }
+        ready.notify_one();
+    }
+
+    // Blocks until a value is available or close() is called. Returns false
+    // once closed and drained.
+    bool pop(T &value)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        ready.wait(guard, [this]()
+                   { return full || closed; });
+        if (!full)
+        {
+            return false;
+        }
+        value = std::move(slot);
+        full = false;
+        return true;
+    }
+
+    bool tryPop(T &value)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!full)
+        {
+            return false;
+        }
+        value = std::move(slot);
+        full = false;
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+    uint64_t droppedCount()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return dropped;
+    }
+
+    uint64_t pushedCount()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return pushed;
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable ready;
+    T slot;
+    bool full = false;
+    bool closed = false;
+    uint64_t dropped = 0;
+    uint64_t pushed = 0;
+};
+
+#endif
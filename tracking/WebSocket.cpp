@@ -0,0 +1,551 @@
+#include "WebSocket.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#define WS_OPCODE_CONTINUATION 0x0
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+#define WS_MAX_MESSAGE (1 << 20)
+
+static const char *WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+namespace
+{
+    bool writeAll(int fd, const uint8_t *data, size_t length)
+    {
+        while (length > 0)
+        {
+            ssize_t written = ::send(fd, data, length, MSG_NOSIGNAL);
+            if (written <= 0)
+            {
+                return false;
+            }
+            data += written;
+            length -= written;
+        }
+        return true;
+    }
+
+    bool readAll(int fd, uint8_t *data, size_t length)
+    {
+        while (length > 0)
+        {
+            ssize_t got = ::recv(fd, data, length, 0);
+            if (got <= 0)
+            {
+                return false;
+            }
+            data += got;
+            length -= got;
+        }
+        return true;
+    }
+
+    // Reads the request or response head up to the blank line
+    bool readHead(int fd, std::string &head)
+    {
+        char c;
+        while (head.size() < 4096)
+        {
+            if (::recv(fd, &c, 1, 0) != 1)
+            {
+                return false;
+            }
+            head += c;
+            if (head.size() >= 4 && head.compare(head.size() - 4, 4, "\r\n\r\n") == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string headerValue(const std::string &head, const char *name)
+    {
+        std::string lower = head;
+        std::string key = std::string("\r\n") + name + ":";
+        for (char &c : lower)
+        {
+            c = tolower(c);
+        }
+        for (char &c : key)
+        {
+            c = tolower(c);
+        }
+        size_t at = lower.find(key);
+        if (at == std::string::npos)
+        {
+            return "";
+        }
+        size_t start = head.find_first_not_of(' ', at + key.size());
+        size_t end = head.find("\r\n", start);
+        return head.substr(start, end - start);
+    }
+
+    std::string base64(const uint8_t *data, size_t length)
+    {
+        static const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string out;
+        for (size_t i = 0; i < length; i += 3)
+        {
+            uint32_t chunk = data[i] << 16;
+            if (i + 1 < length)
+            {
+                chunk |= data[i + 1] << 8;
+            }
+            if (i + 2 < length)
+            {
+                chunk |= data[i + 2];
+            }
+            out += alphabet[(chunk >> 18) & 63];
+            out += alphabet[(chunk >> 12) & 63];
+            out += i + 1 < length ? alphabet[(chunk >> 6) & 63] : '=';
+            out += i + 2 < length ? alphabet[chunk & 63] : '=';
+        }
+        return out;
+    }
+
+    void sha1(const std::string &message, uint8_t digest[20])
+    {
+        uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+        std::vector<uint8_t> data(message.begin(), message.end());
+        uint64_t bits = (uint64_t)data.size() * 8;
+        data.push_back(0x80);
+        while (data.size() % 64 != 56)
+        {
+            data.push_back(0);
+        }
+        for (int i = 7; i >= 0; i--)
+        {
+            data.push_back(bits >> (i * 8));
+        }
+
+        for (size_t block = 0; block < data.size(); block += 64)
+        {
+            uint32_t w[80];
+            for (int i = 0; i < 16; i++)
+            {
+                const uint8_t *p = &data[block + i * 4];
+                w[i] = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+            }
+            for (int i = 16; i < 80; i++)
+            {
+                uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+                w[i] = x << 1 | x >> 31;
+            }
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            for (int i = 0; i < 80; i++)
+            {
+                uint32_t f, k;
+                if (i < 20)
+                {
+                    f = (b & c) | (~b & d);
+                    k = 0x5A827999;
+                }
+                else if (i < 40)
+                {
+                    f = b ^ c ^ d;
+                    k = 0x6ED9EBA1;
+                }
+                else if (i < 60)
+                {
+                    f = (b & c) | (b & d) | (c & d);
+                    k = 0x8F1BBCDC;
+                }
+                else
+                {
+                    f = b ^ c ^ d;
+                    k = 0xCA62C1D6;
+                }
+                uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = b << 30 | b >> 2;
+                b = a;
+                a = t;
+            }
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+        }
+        for (int i = 0; i < 20; i++)
+        {
+            digest[i] = h[i / 4] >> (24 - (i % 4) * 8);
+        }
+    }
+
+    std::string acceptKey(const std::string &key)
+    {
+        uint8_t digest[20];
+        sha1(key + WS_GUID, digest);
+        return base64(digest, sizeof(digest));
+    }
+
+    // Reads one frame, unmasking it if the peer masked it
+    bool readFrame(int fd, uint8_t &opcode, std::vector<uint8_t> &payload)
+    {
+        uint8_t head[2];
+        if (!readAll(fd, head, 2))
+        {
+            return false;
+        }
+        opcode = head[0] & 0x0F;
+        bool masked = head[1] & 0x80;
+        uint64_t length = head[1] & 0x7F;
+        if (length == 126)
+        {
+            uint8_t ext[2];
+            if (!readAll(fd, ext, 2))
+            {
+                return false;
+            }
+            length = ext[0] << 8 | ext[1];
+        }
+        else if (length == 127)
+        {
+            uint8_t ext[8];
+            if (!readAll(fd, ext, 8))
+            {
+                return false;
+            }
+            length = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                length = length << 8 | ext[i];
+            }
+        }
+        if (length > WS_MAX_MESSAGE)
+        {
+            return false;
+        }
+        uint8_t mask[4] = {0, 0, 0, 0};
+        if (masked && !readAll(fd, mask, 4))
+        {
+            return false;
+        }
+        payload.resize(length);
+        if (length > 0 && !readAll(fd, payload.data(), length))
+        {
+            return false;
+        }
+        if (masked)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                payload[i] ^= mask[i % 4];
+            }
+        }
+        return true;
+    }
+
+    // Clients must mask, servers must not
+    bool writeFrame(int fd, uint8_t opcode, const uint8_t *data, size_t length, bool mask)
+    {
+        std::vector<uint8_t> frame;
+        frame.reserve(length + 14);
+        frame.push_back(0x80 | opcode);
+        uint8_t maskBit = mask ? 0x80 : 0;
+        if (length < 126)
+        {
+            frame.push_back(maskBit | length);
+        }
+        else if (length <= 0xFFFF)
+        {
+            frame.push_back(maskBit | 126);
+            frame.push_back(length >> 8);
+            frame.push_back(length);
+        }
+        else
+        {
+            frame.push_back(maskBit | 127);
+            for (int i = 7; i >= 0; i--)
+            {
+                frame.push_back((uint64_t)length >> (i * 8));
+            }
+        }
+        uint8_t key[4] = {0, 0, 0, 0};
+        if (mask)
+        {
+            static thread_local std::mt19937 random(std::random_device{}());
+            uint32_t bits = random();
+            memcpy(key, &bits, 4);
+            frame.insert(frame.end(), key, key + 4);
+        }
+        for (size_t i = 0; i < length; i++)
+        {
+            frame.push_back(data[i] ^ key[i % 4]);
+        }
+        return writeAll(fd, frame.data(), frame.size());
+    }
+}
+
+// Client
+
+WebSocketClient::~WebSocketClient()
+{
+    close();
+}
+
+bool WebSocketClient::connect(const std::string &url, std::string &error)
+{
+    if (url.compare(0, 5, "ws://") != 0)
+    {
+        error = "only ws:// URLs are supported";
+        return false;
+    }
+    std::string rest = url.substr(5);
+    size_t slash = rest.find('/');
+    std::string path = slash == std::string::npos ? "/" : rest.substr(slash);
+    std::string authority = rest.substr(0, slash);
+    size_t colon = authority.find(':');
+    std::string host = authority.substr(0, colon);
+    std::string port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *address = NULL;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0 || address == NULL)
+    {
+        error = "cannot resolve " + host;
+        return false;
+    }
+    fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    bool connectedSocket = fd >= 0 && ::connect(fd, address->ai_addr, address->ai_addrlen) == 0;
+    freeaddrinfo(address);
+    if (!connectedSocket)
+    {
+        error = "cannot connect to " + authority + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    // Commands are tiny and latency matters more than packet count
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    uint8_t nonce[16];
+    std::random_device random;
+    for (uint8_t &byte : nonce)
+    {
+        byte = random();
+    }
+    std::string key = base64(nonce, sizeof(nonce));
+    std::string request = "GET " + path + " HTTP/1.1\r\n"
+                          "Host: " + authority + "\r\n"
+                          "Upgrade: websocket\r\n"
+                          "Connection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: " + key + "\r\n"
+                          "Sec-WebSocket-Version: 13\r\n\r\n";
+    std::string response;
+    if (!writeAll(fd, (const uint8_t *)request.data(), request.size()) || !readHead(fd, response))
+    {
+        error = "handshake failed";
+        close();
+        return false;
+    }
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0 || headerValue(response, "Sec-WebSocket-Accept") != acceptKey(key))
+    {
+        error = "server refused the upgrade: " + response.substr(0, response.find("\r\n"));
+        close();
+        return false;
+    }
+
+    failed = false;
+    reader = std::thread(&WebSocketClient::readLoop, this);
+    return true;
+}
+
+void WebSocketClient::readLoop()
+{
+    uint8_t opcode;
+    std::vector<uint8_t> payload;
+    while (readFrame(fd, opcode, payload))
+    {
+        if (opcode == WS_OPCODE_PING)
+        {
+            send(WS_OPCODE_PONG, payload.data(), payload.size());
+        }
+        else if (opcode == WS_OPCODE_CLOSE)
+        {
+            break;
+        }
+        else if (opcode != WS_OPCODE_PONG)
+        {
+            receivedCount++;
+        }
+    }
+    failed = true;
+}
+
+bool WebSocketClient::send(uint8_t opcode, const uint8_t *data, size_t length)
+{
+    std::lock_guard<std::mutex> guard(sendLock);
+    if (fd < 0 || failed)
+    {
+        return false;
+    }
+    if (!writeFrame(fd, opcode, data, length, true))
+    {
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool WebSocketClient::sendBinary(const uint8_t *data, size_t length)
+{
+    return send(WS_OPCODE_BINARY, data, length);
+}
+
+bool WebSocketClient::sendText(const std::string &text)
+{
+    return send(WS_OPCODE_TEXT, (const uint8_t *)text.data(), text.size());
+}
+
+bool WebSocketClient::ping()
+{
+    return send(WS_OPCODE_PING, NULL, 0);
+}
+
+void WebSocketClient::close()
+{
+    if (fd >= 0)
+    {
+        {
+            std::lock_guard<std::mutex> guard(sendLock);
+            if (!failed)
+            {
+                writeFrame(fd, WS_OPCODE_CLOSE, NULL, 0, true);
+            }
+        }
+        shutdown(fd, SHUT_RDWR);
+    }
+    if (reader.joinable())
+    {
+        reader.join();
+    }
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+// Sink
+
+WebSocketSink::~WebSocketSink()
+{
+    stop();
+}
+
+bool WebSocketSink::start(uint16_t port, Handler messageHandler, std::string &error)
+{
+    handler = messageHandler;
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 1) != 0)
+    {
+        error = "cannot listen on port " + std::to_string(port) + ": " + strerror(errno);
+        stop();
+        return false;
+    }
+    running = true;
+    acceptor = std::thread(&WebSocketSink::acceptLoop, this);
+    return true;
+}
+
+void WebSocketSink::acceptLoop()
+{
+    while (running)
+    {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0)
+        {
+            continue;
+        }
+        int one = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        serve(client);
+        ::close(client);
+    }
+}
+
+void WebSocketSink::serve(int client)
+{
+    std::string request;
+    if (!readHead(client, request))
+    {
+        return;
+    }
+    std::string key = headerValue(request, "Sec-WebSocket-Key");
+    if (key.empty())
+    {
+        const char *refusal = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+        writeAll(client, (const uint8_t *)refusal, strlen(refusal));
+        return;
+    }
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: " + acceptKey(key) + "\r\n\r\n";
+    if (!writeAll(client, (const uint8_t *)response.data(), response.size()))
+    {
+        return;
+    }
+
+    uint8_t opcode;
+    std::vector<uint8_t> payload;
+    while (running && readFrame(client, opcode, payload))
+    {
+        switch (opcode)
+        {
+        case WS_OPCODE_TEXT:
+        case WS_OPCODE_BINARY:
+        case WS_OPCODE_CONTINUATION:
+            if (handler)
+            {
+                handler(payload.data(), payload.size(), opcode == WS_OPCODE_BINARY);
+            }
+            break;
+        case WS_OPCODE_PING:
+            writeFrame(client, WS_OPCODE_PONG, payload.data(), payload.size(), false);
+            break;
+        case WS_OPCODE_CLOSE:
+            writeFrame(client, WS_OPCODE_CLOSE, NULL, 0, false);
+            return;
+        }
+    }
+}
+
+void WebSocketSink::stop()
+{
+    running = false;
+    if (listener >= 0)
+    {
+        shutdown(listener, SHUT_RDWR);
+        ::close(listener);
+        listener = -1;
+    }
+    if (acceptor.joinable())
+    {
+        acceptor.join();
+    }
+}
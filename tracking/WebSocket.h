@@ -0,0 +1,66 @@
+#ifndef TRACKING_WEB_SOCKET_H
+#define TRACKING_WEB_SOCKET_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+// Just enough RFC 6455 for the tracker: a client that sends to the turret
+// and a local sink that stands in for it when benchmarking. POSIX sockets,
+// no TLS, no extensions, no fragmentation on the sending side.
+
+class WebSocketClient
+{
+public:
+    ~WebSocketClient();
+
+    // url is ws://host[:port][/path]
+    bool connect(const std::string &url, std::string &error);
+    bool sendBinary(const uint8_t *data, size_t length);
+    bool sendText(const std::string &text);
+    bool ping();
+    void close();
+    bool connected() const { return fd >= 0 && !failed; }
+
+    // Messages from the server (the turret streams telemetry) are read and
+    // dropped on a background thread so its send buffer never backs up
+    uint64_t received() const { return receivedCount; }
+
+private:
+    bool send(uint8_t opcode, const uint8_t *data, size_t length);
+    void readLoop();
+
+    int fd = -1;
+    std::atomic<bool> failed{false};
+    std::atomic<uint64_t> receivedCount{0};
+    std::mutex sendLock;
+    std::thread reader;
+};
+
+class WebSocketSink
+{
+public:
+    // Called on the sink thread for every complete message
+    typedef std::function<void(const uint8_t *data, size_t length, bool binary)> Handler;
+
+    ~WebSocketSink();
+
+    // Listens on 127.0.0.1:port and serves one client at a time
+    bool start(uint16_t port, Handler handler, std::string &error);
+    void stop();
+
+private:
+    void acceptLoop();
+    void serve(int client);
+
+    int listener = -1;
+    std::atomic<bool> running{false};
+    Handler handler;
+    std::thread acceptor;
+};
+
+#endif
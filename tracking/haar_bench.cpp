@@ -0,0 +1,227 @@
+// Face detector benchmark on recorded footage. Runs HaarDetector and
+// OpenCV's CascadeClassifier over the same frames, prepared the way
+// turret_tracker prepares them, and reports the speed of each and how well
+// their detections agree.
+//
+//   haar_bench --replay FILE [--frames N] [--threads N] [--detect-scale F]
+//              [--cascade FILE] [--scalar]
+//
+// Frames are decoded and prepared up front so only detection is timed.
+// Both engines get the same number of threads. A detection matches one
+// from the other engine when they overlap by at least half (intersection
+// over union); precision is the share of native detections OpenCV also
+// made, recall the share of OpenCV's the native engine found. --scalar
+// turns the AVX2 path off to show what it is worth.
+
+#include "HaarDetector.h"
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/objdetect.hpp>
+#include <opencv2/videoio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifndef TRACKER_CASCADE
+#define TRACKER_CASCADE "haarcascade_frontalface_default.xml"
+#endif
+
+#define MATCH_OVERLAP 0.5
+
+struct Options
+{
+    std::string replay;
+    std::string cascade = TRACKER_CASCADE;
+    int frames = 300;
+    int threads = 0;
+    double detectScale = 0.5;
+    bool scalar = false;
+};
+
+static double nowSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double overlap(const HaarDetection &a, const HaarDetection &b)
+{
+    int width = std::min(a.x + a.width, b.x + b.width) - std::max(a.x, b.x);
+    int height = std::min(a.y + a.height, b.y + b.height) - std::max(a.y, b.y);
+    if (width <= 0 || height <= 0)
+    {
+        return 0;
+    }
+    double shared = (double)width * height;
+    return shared / ((double)a.width * a.height + (double)b.width * b.height - shared);
+}
+
+// Greedy one to one matching, returns how many pairs overlap enough and
+// how many of those are the same rectangle
+static int matchDetections(const std::vector<HaarDetection> &a, const std::vector<HaarDetection> &b, int &identical)
+{
+    std::vector<bool> used(b.size(), false);
+    int matched = 0;
+    for (const HaarDetection &da : a)
+    {
+        int best = -1;
+        double bestOverlap = MATCH_OVERLAP;
+        for (size_t j = 0; j < b.size(); j++)
+        {
+            double o = overlap(da, b[j]);
+            if (!used[j] && o >= bestOverlap)
+            {
+                best = (int)j;
+                bestOverlap = o;
+            }
+        }
+        if (best >= 0)
+        {
+            used[best] = true;
+            matched++;
+            const HaarDetection &db = b[best];
+            if (da.x == db.x && da.y == db.y && da.width == db.width && da.height == db.height)
+            {
+                identical++;
+            }
+        }
+    }
+    return matched;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--replay") == 0 && hasValue)
+            options.replay = argv[++i];
+        else if (strcmp(arg, "--cascade") == 0 && hasValue)
+            options.cascade = argv[++i];
+        else if (strcmp(arg, "--frames") == 0 && hasValue)
+            options.frames = std::max(1, atoi(argv[++i]));
+        else if (strcmp(arg, "--threads") == 0 && hasValue)
+            options.threads = std::max(0, atoi(argv[++i]));
+        else if (strcmp(arg, "--detect-scale") == 0 && hasValue)
+            options.detectScale = std::min(1.0, std::max(0.1, atof(argv[++i])));
+        else if (strcmp(arg, "--scalar") == 0)
+            options.scalar = true;
+        else
+        {
+            options.replay.clear();
+            break;
+        }
+    }
+    if (options.replay.empty())
+    {
+        fprintf(stderr,
+                "usage: %s --replay FILE [--frames N] [--threads N] [--detect-scale F]\n"
+                "       [--cascade FILE] [--scalar]\n",
+                argv[0]);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        return 2;
+    }
+
+    HaarCascade haarCascade;
+    std::string error;
+    cv::CascadeClassifier cascade;
+    if (!haarCascade.load(options.cascade, error) || !cascade.load(options.cascade))
+    {
+        fprintf(stderr, "Cannot load cascade %s%s%s\n", options.cascade.c_str(), error.empty() ? "" : ": ", error.c_str());
+        return 1;
+    }
+    cv::VideoCapture capture(options.replay);
+    if (!capture.isOpened())
+    {
+        fprintf(stderr, "Cannot open %s\n", options.replay.c_str());
+        return 1;
+    }
+
+    std::vector<cv::Mat> frames;
+    cv::Mat image, gray;
+    while ((int)frames.size() < options.frames && capture.read(image) && !image.empty())
+    {
+        cv::Mat small;
+        cv::flip(image, image, 1);
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        cv::resize(gray, small, cv::Size(), options.detectScale, options.detectScale, cv::INTER_AREA);
+        cv::equalizeHist(small, small);
+        frames.push_back(small);
+    }
+    if (frames.empty())
+    {
+        fprintf(stderr, "No frames in %s\n", options.replay.c_str());
+        return 1;
+    }
+
+    HaarDetector detector(haarCascade, options.threads);
+    HaarDetectOptions detectOptions;
+    detectOptions.simd = !options.scalar;
+    int threads = detector.threads();
+    cv::setNumThreads(threads);
+
+    std::vector<std::vector<HaarDetection>> native(frames.size());
+    double start = nowSeconds();
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        const cv::Mat &frame = frames[i];
+        detector.detect(frame.data, frame.cols, frame.rows, frame.step, detectOptions, native[i]);
+    }
+    double nativeSeconds = nowSeconds() - start;
+
+    std::vector<std::vector<HaarDetection>> reference(frames.size());
+    std::vector<cv::Rect> faces;
+    std::vector<int> neighbours;
+    start = nowSeconds();
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        cascade.detectMultiScale(frames[i], faces, neighbours, detectOptions.scaleFactor, detectOptions.minNeighbours, 0,
+                                 cv::Size(detectOptions.minSize, detectOptions.minSize));
+        for (size_t j = 0; j < faces.size(); j++)
+        {
+            reference[i].push_back({faces[j].x, faces[j].y, faces[j].width, faces[j].height, neighbours[j]});
+        }
+    }
+    double opencvSeconds = nowSeconds() - start;
+
+    size_t nativeCount = 0, opencvCount = 0;
+    int matched = 0, identical = 0, sameFrames = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        nativeCount += native[i].size();
+        opencvCount += reference[i].size();
+        int frameIdentical = 0;
+        int frameMatched = matchDetections(native[i], reference[i], frameIdentical);
+        matched += frameMatched;
+        identical += frameIdentical;
+        if (frameIdentical == (int)native[i].size() && frameIdentical == (int)reference[i].size())
+        {
+            sameFrames++;
+        }
+    }
+
+    double nativeFps = frames.size() / nativeSeconds;
+    double opencvFps = frames.size() / opencvSeconds;
+    printf("%zu frames of %dx%d, %d threads, %s\n", frames.size(), frames[0].cols, frames[0].rows, threads,
+           detectOptions.simd && HaarDetector::simdAvailable() ? "AVX2" : "scalar");
+    printf("  native  %8.1f fps  %7.1f fps/core  %zu detections\n", nativeFps, nativeFps / threads, nativeCount);
+    printf("  opencv  %8.1f fps  %7.1f fps/core  %zu detections\n", opencvFps, opencvFps / threads, opencvCount);
+    printf("  speedup %.2fx\n", nativeFps / opencvFps);
+    printf("  agreement: precision %.3f recall %.3f, %d identical rectangles, %d/%zu frames identical\n",
+           nativeCount ? (double)matched / nativeCount : 1.0, opencvCount ? (double)matched / opencvCount : 1.0,
+           identical, sameFrames, frames.size());
+    return 0;
+}
@@ -0,0 +1,194 @@
+// Checks HaarDetector against detections OpenCV made on the same frames,
+// with no OpenCV needed to run it. Both frames were prepared the way
+// turret_tracker prepares its own (gray, equalizeHist) and saved as PGM:
+//
+//   astronaut.pgm  skimage.data.astronaut() at half size, one face
+//   faces.pgm      twelve faces from skimage.data.lfw_subset() scaled to
+//                  80x80 and tiled 4 by 3
+//
+// The expected rectangles and neighbour counts are what
+// CascadeClassifier::detectMultiScale2 of OpenCV 4.11 returned for them
+// with haar_bench's parameters (scale 1.1, 5 neighbours, 30 pixels at
+// least). Every engine setting has to reproduce them exactly.
+
+#include "FaceTracker.h"
+#include "HaarDetector.h"
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#ifndef TRACKER_CASCADE
+#define TRACKER_CASCADE "haarcascade_frontalface_default.xml"
+#endif
+#ifndef TEST_DATA_DIR
+#define TEST_DATA_DIR "test"
+#endif
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (!(condition))                                                      \
+        {                                                                      \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+struct Frame
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Binary 8 bit PGM as written by cv2.imwrite, no comments in the header
+static bool readPgm(const std::string &path, Frame &frame)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    int maxValue = 0;
+    file >> magic >> frame.width >> frame.height >> maxValue;
+    file.get();
+    if (!file || magic != "P5" || maxValue != 255)
+    {
+        return false;
+    }
+    frame.pixels.resize((size_t)frame.width * frame.height);
+    file.read((char *)frame.pixels.data(), frame.pixels.size());
+    return (bool)file;
+}
+
+static bool lessThan(const HaarDetection &a, const HaarDetection &b)
+{
+    return std::tie(a.x, a.y, a.width, a.height) < std::tie(b.x, b.y, b.width, b.height);
+}
+
+static bool same(const HaarDetection &a, const HaarDetection &b)
+{
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height && a.neighbours == b.neighbours;
+}
+
+// Detection order is not part of the contract, OpenCV's differs
+static bool sameDetections(std::vector<HaarDetection> a, std::vector<HaarDetection> b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    std::sort(a.begin(), a.end(), lessThan);
+    std::sort(b.begin(), b.end(), lessThan);
+    return std::equal(a.begin(), a.end(), b.begin(), same);
+}
+
+static void testCascadeLoads(const HaarCascade &cascade)
+{
+    CHECK(cascade.windowWidth == 24);
+    CHECK(cascade.windowHeight == 24);
+    CHECK(cascade.stages.size() == 25);
+    CHECK(cascade.stumps.size() == 2913);
+
+    HaarCascade missing;
+    std::string error;
+    CHECK(!missing.load(TEST_DATA_DIR "/no_such_cascade.xml", error));
+    CHECK(!error.empty());
+}
+
+static void testMatchesOpenCv(const HaarCascade &cascade, const char *name, const std::vector<HaarDetection> &expected)
+{
+    Frame frame;
+    if (!readPgm(std::string(TEST_DATA_DIR "/") + name, frame))
+    {
+        fprintf(stderr, "cannot read %s\n", name);
+        failures++;
+        return;
+    }
+
+    // The scalar path, the AVX2 path where the CPU has it, and the row bands
+    // split across workers all have to land on the same windows
+    for (int threads = 1; threads <= 3; threads += 2)
+    {
+        HaarDetector detector(cascade, threads);
+        for (int simd = 0; simd < 2; simd++)
+        {
+            HaarDetectOptions options;
+            options.simd = simd;
+            std::vector<HaarDetection> detections;
+            detector.detect(frame.pixels.data(), frame.width, frame.height, frame.width, options, detections);
+            if (!sameDetections(detections, expected))
+            {
+                fprintf(stderr, "%s: %zu detections with %d threads, simd %d, OpenCV made %zu\n", name, detections.size(),
+                        threads, simd, expected.size());
+                failures++;
+            }
+        }
+    }
+}
+
+static void testTrackerKeepsIds()
+{
+    FaceTracker tracker;
+    std::vector<TrackedFace> faces;
+    tracker.update({{10, 10, 50, 50, 20}, {200, 40, 60, 60, 30}}, faces);
+    CHECK(faces.size() == 2);
+    CHECK(faces[0].id == 1 && faces[1].id == 2);
+    CHECK(largestFace(faces)->id == 2);
+
+    // Both move a little and the order of detections flips
+    tracker.update({{205, 44, 60, 60, 30}, {14, 12, 50, 50, 20}}, faces);
+    CHECK(faces.size() == 2);
+    CHECK(faces[0].id == 2 && faces[1].id == 1);
+    CHECK(faces[1].frames == 2);
+
+    // A larger newcomer is the largest, but not the persistent target
+    tracker.update({{14, 12, 50, 50, 20}, {120, 100, 90, 90, 40}}, faces);
+    CHECK(faces.size() == 2);
+    CHECK(faces[1].id == 3);
+    CHECK(largestFace(faces)->id == 3);
+    CHECK(persistentFace(faces)->id == 1);
+
+    // Face 2 was missed for a frame and comes back under its own id
+    tracker.update({{206, 45, 60, 60, 30}}, faces);
+    CHECK(faces.size() == 1 && faces[0].id == 2);
+
+    // Gone for longer than maxMissed, it starts over
+    for (uint32_t i = 0; i <= tracker.maxMissed; i++)
+    {
+        tracker.update({}, faces);
+    }
+    tracker.update({{206, 45, 60, 60, 30}}, faces);
+    CHECK(faces.size() == 1 && faces[0].id == 4 && faces[0].frames == 1);
+}
+
+int main()
+{
+    HaarCascade cascade;
+    std::string error;
+    if (!cascade.load(TRACKER_CASCADE, error))
+    {
+        fprintf(stderr, "Cannot load cascade %s: %s\n", TRACKER_CASCADE, error.c_str());
+        return 1;
+    }
+
+    testCascadeLoads(cascade);
+    testMatchesOpenCv(cascade, "astronaut.pgm", {{86, 30, 53, 53, 30}});
+    testMatchesOpenCv(cascade, "faces.pgm",
+                      {{80, 6, 64, 64, 78},
+                       {5, 4, 66, 66, 36},
+                       {75, 75, 74, 74, 57},
+                       {162, 81, 70, 70, 94},
+                       {3, 84, 67, 67, 51},
+                       {2, 161, 66, 66, 17},
+                       {246, 163, 66, 66, 52},
+                       {161, 3, 70, 70, 33},
+                       {235, 5, 70, 70, 54},
+                       {78, 171, 66, 66, 19}});
+    testTrackerKeepsIds();
+
+    printf("%s (AVX2 %s)\n", failures ? "FAILED" : "OK", HaarDetector::simdAvailable() ? "available" : "not available");
+    return failures ? 1 : 0;
+}
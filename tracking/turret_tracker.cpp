@@ -0,0 +1,624 @@
+// Face tracking client for the turret. Capture, detection and transmission
+// run on their own threads and hand frames on through single slot
+// LatestQueues, so a slow detector or a stalled socket drops stale frames
+// instead of delaying the ones behind them.
+//
+//   turret_tracker [--url ws://192.168.1.55/ws] [--camera N | --replay FILE]
+//                  [--headless] [--threshold N] [--json] [--fire] [--fast]
+//                  [--sink PORT] [--report SECONDS] [--cascade FILE]
+//                  [--record FILE] [--engine native|opencv] [--threads N]
+//                  [--target largest|persistent]
+//
+// --replay reads a recorded video instead of the camera, paced at the
+// file's frame rate unless --fast is given. --sink starts a local websocket
+// server on PORT and sends to it instead of the turret, which together with
+// --replay and --headless benchmarks the whole pipeline without hardware.
+// --threshold N skips detections that moved N units or less since the last
+// one sent. The default of 0 sends every change: the turret's target
+// predictor needs observations at the camera's frame rate, and gated ones
+// arrive too rarely on a slow target for it to keep a velocity, so it
+// coasts to a hold between them.
+// --record writes every detection as capture_ms,pan,tilt for evaluating
+// the firmware's target predictor offline (see lib/NativeHal/NativeMain.cpp).
+//
+// Faces are found by HaarDetector on --threads cores (all by default), or
+// by OpenCV's CascadeClassifier with --engine opencv; both run the same
+// cascade. Every face is tracked with an id, and --target picks which one
+// to follow: the largest, the closest in practice, or the one tracked the
+// longest so the turret does not swap between two similar faces.
+
+#include "FaceTracker.h"
+#include "HaarDetector.h"
+#include "LatestQueue.h"
+#include "WebSocket.h"
+#include <TurretProtocol.h>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/objdetect.hpp>
+#include <opencv2/videoio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#ifndef TRACKER_CASCADE
+#define TRACKER_CASCADE "haarcascade_frontalface_default.xml"
+#endif
+
+// Servo limits, the same range the firmware accepts for camServoPan/Tilt
+#define PAN_SERVO_MIN 0
+#define PAN_SERVO_MAX 1000
+#define TILT_SERVO_MIN 0
+#define TILT_SERVO_MAX 1000
+
+#define CAPTURE_WIDTH 1000
+#define CAPTURE_HEIGHT 1000
+#define KEEPALIVE_US 30000000ULL
+#define RECONNECT_US 1000000ULL
+
+struct Options
+{
+    std::string url = "ws://192.168.1.55/ws";
+    int camera = 0;
+    std::string replay;
+    std::string cascade = TRACKER_CASCADE;
+    std::string record;
+    bool headless = false;
+    bool json = false;
+    bool fire = false;
+    bool fast = false;
+    bool opencv = false;
+    bool persistent = false;
+    int detectThreads = 0;
+    int threshold = 0; // pan/tilt units, see --threshold
+    int sinkPort = 0;
+    int reportSeconds = 5;
+    double detectScale = 0.5;
+};
+
+struct Frame
+{
+    cv::Mat image;
+    uint32_t index = 0;
+    uint64_t capturedUs = 0;
+};
+
+struct Detection
+{
+    Frame frame;
+    bool found = false;
+    cv::Rect face; // the target
+    uint32_t targetId = 0;
+    std::vector<TrackedFace> faces; // all of them, in frame coordinates
+    int pan = 0;
+    int tilt = 0;
+    uint64_t detectStartUs = 0;
+    uint64_t detectedUs = 0;
+};
+
+static std::atomic<bool> stopping{false};
+static std::atomic<bool> pipelineDone{false};
+
+static uint64_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void onSignal(int)
+{
+    stopping = true;
+}
+
+// Latency samples for one stage, reported as min/mean/p50/p99/max and
+// cleared on every report
+class StageStats
+{
+public:
+    explicit StageStats(const char *stageName) : name(stageName) {}
+
+    void add(uint64_t us)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        samples.push_back(us / 1000.0);
+    }
+
+    void report(FILE *out)
+    {
+        std::vector<double> sorted;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            sorted.swap(samples);
+        }
+        if (sorted.empty())
+        {
+            fprintf(out, "  %-10s -\n", name);
+            return;
+        }
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (double sample : sorted)
+        {
+            sum += sample;
+        }
+        fprintf(out, "  %-10s n=%-5zu min=%7.2f mean=%7.2f p50=%7.2f p99=%7.2f max=%7.2f ms\n",
+                name, sorted.size(), sorted.front(), sum / sorted.size(),
+                sorted[sorted.size() / 2], sorted[(size_t)(0.99 * (sorted.size() - 1) + 0.5)], sorted.back());
+    }
+
+private:
+    const char *name;
+    std::mutex lock;
+    std::vector<double> samples;
+};
+
+static StageStats queueStats("queue");       // captured -> detect start
+static StageStats detectStats("detect");     // detect start -> result
+static StageStats transmitStats("transmit"); // result -> written to the socket
+static StageStats totalStats("total");       // captured -> written to the socket
+static StageStats sinkStats("sink");         // captured -> received by --sink
+
+static std::atomic<uint64_t> capturedCount{0};
+static std::atomic<uint64_t> detectedCount{0};
+static std::atomic<uint64_t> sentCount{0};
+static std::atomic<uint64_t> sinkCount{0};
+
+// Capture time of each sent command by sequence number, for --sink
+static std::atomic<uint64_t> sentCapturedUs[65536];
+
+static LatestQueue<Frame> captureQueue;
+static LatestQueue<Detection> detectQueue;
+static LatestQueue<Detection> displayQueue;
+
+static int interpolate(int value, int inMax, int outFrom, int outTo)
+{
+    value = std::max(0, std::min(value, inMax));
+    return outFrom + (int)((int64_t)(outTo - outFrom) * value / std::max(inMax, 1));
+}
+
+static void captureStage(cv::VideoCapture &capture, const Options &options)
+{
+    double fps = capture.get(cv::CAP_PROP_FPS);
+    uint64_t frameUs = !options.replay.empty() && !options.fast && fps > 0 ? (uint64_t)(1000000 / fps) : 0;
+    uint64_t nextUs = nowUs();
+    uint32_t index = 0;
+
+    while (!stopping)
+    {
+        Frame frame;
+        if (!capture.read(frame.image) || frame.image.empty())
+        {
+            break;
+        }
+        frame.capturedUs = nowUs();
+        frame.index = index++;
+        cv::flip(frame.image, frame.image, 1);
+        captureQueue.push(std::move(frame));
+        capturedCount++;
+
+        if (frameUs > 0)
+        {
+            nextUs += frameUs;
+            uint64_t now = nowUs();
+            if (nextUs > now)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(nextUs - now));
+            }
+            else
+            {
+                nextUs = now;
+            }
+        }
+    }
+    captureQueue.close();
+}
+
+static void detectStage(cv::CascadeClassifier &cascade, HaarDetector &detector, const Options &options)
+{
+    cv::Mat gray;
+    cv::Mat small;
+    std::vector<cv::Rect> faces;
+    std::vector<int> neighbours;
+    std::vector<HaarDetection> found;
+    HaarDetectOptions detectOptions;
+    FaceTracker tracker;
+    Frame frame;
+
+    while (captureQueue.pop(frame))
+    {
+        Detection detection;
+        detection.detectStartUs = nowUs();
+        queueStats.add(detection.detectStartUs - frame.capturedUs);
+
+        cv::cvtColor(frame.image, gray, cv::COLOR_BGR2GRAY);
+        cv::resize(gray, small, cv::Size(), options.detectScale, options.detectScale, cv::INTER_AREA);
+        cv::equalizeHist(small, small);
+        if (options.opencv)
+        {
+            cascade.detectMultiScale(small, faces, neighbours, detectOptions.scaleFactor, detectOptions.minNeighbours, 0,
+                                     cv::Size(detectOptions.minSize, detectOptions.minSize));
+            found.clear();
+            for (size_t i = 0; i < faces.size(); i++)
+            {
+                found.push_back({faces[i].x, faces[i].y, faces[i].width, faces[i].height, neighbours[i]});
+            }
+        }
+        else
+        {
+            detector.detect(small.data, small.cols, small.rows, small.step, detectOptions, found);
+        }
+        tracker.update(found, detection.faces);
+
+        double scale = 1.0 / options.detectScale;
+        for (TrackedFace &tracked : detection.faces)
+        {
+            HaarDetection &face = tracked.face;
+            face = {(int)(face.x * scale), (int)(face.y * scale), (int)(face.width * scale), (int)(face.height * scale),
+                    face.neighbours};
+        }
+        const TrackedFace *target = options.persistent ? persistentFace(detection.faces) : largestFace(detection.faces);
+        if (target != NULL)
+        {
+            detection.face = cv::Rect(target->face.x, target->face.y, target->face.width, target->face.height);
+            detection.targetId = target->id;
+            int x = detection.face.x + detection.face.width / 2;
+            int y = detection.face.y + detection.face.height / 2;
+            detection.pan = interpolate(x, frame.image.cols, PAN_SERVO_MIN, PAN_SERVO_MAX);
+            detection.tilt = interpolate(y, frame.image.rows, TILT_SERVO_MAX, TILT_SERVO_MIN); // inverted
+            detection.found = true;
+        }
+
+        detection.detectedUs = nowUs();
+        detectStats.add(detection.detectedUs - detection.detectStartUs);
+        detectedCount++;
+
+        detection.frame = std::move(frame);
+        if (!options.headless)
+        {
+            displayQueue.push(detection);
+        }
+        // The transmit stage only needs the timestamps
+        detection.frame.image.release();
+        detectQueue.push(std::move(detection));
+    }
+    detectQueue.close();
+    displayQueue.close();
+}
+
+static bool sendCommand(WebSocketClient &socket, const Options &options, const Detection &detection, uint16_t seq, bool fire)
+{
+    if (options.json)
+    {
+        char text[96];
+        snprintf(text, sizeof(text), "{\"camServoPan\":%d,\"camServoTilt\":%d,\"found\":%d%s}",
+                 detection.pan, detection.tilt, detection.found ? 1 : 0, fire ? ",\"fire\":1" : "");
+        return socket.sendText(text);
+    }
+
+    TurretFrame frame = {};
+    frame.type = TURRET_FRAME_TRACK;
+    frame.flags = (fire ? TURRET_FLAG_FIRE : 0) | (detection.found ? 0 : TURRET_FLAG_NO_TARGET);
+    frame.seq = seq;
+    frame.timestamp = (uint32_t)(detection.frame.capturedUs / 1000);
+    frame.a = detection.pan;
+    frame.b = detection.tilt;
+    uint8_t out[TURRET_FRAME_SIZE];
+    size_t length = encodeTurretFrame(frame, out, sizeof(out));
+    return socket.sendBinary(out, length);
+}
+
+static void transmitStage(WebSocketClient &socket, const std::string &url, const Options &options)
+{
+    FILE *record = NULL;
+    if (!options.record.empty())
+    {
+        record = fopen(options.record.c_str(), "w");
+        if (record == NULL)
+        {
+            fprintf(stderr, "Cannot write %s\n", options.record.c_str());
+        }
+        else
+        {
+            fprintf(record, "# capture_ms,pan,tilt\n");
+        }
+    }
+
+    Detection detection;
+    TrackSchedule schedule;
+    schedule.threshold = options.threshold;
+    uint16_t seq = 0;
+    uint64_t lastSendUs = nowUs();
+    uint64_t lastConnectUs = nowUs(); // main() just tried
+
+    while (detectQueue.pop(detection))
+    {
+        if (record != NULL && detection.found)
+        {
+            fprintf(record, "%llu,%d,%d\n", (unsigned long long)(detection.frame.capturedUs / 1000),
+                    detection.pan, detection.tilt);
+        }
+
+        uint64_t now = nowUs();
+        if (!socket.connected() && now - lastConnectUs > RECONNECT_US)
+        {
+            std::string error;
+            lastConnectUs = now;
+            socket.close();
+            if (!socket.connect(url, error))
+            {
+                fprintf(stderr, "WebSocket connection error: %s\n", error.c_str());
+            }
+        }
+
+        // Send when the target moved far enough to matter, now and then while
+        // it holds still so the turret knows it is still there, and once
+        // when it is lost
+        uint32_t nowMs = (uint32_t)(now / 1000);
+        bool due = schedule.due(nowMs, detection.found, detection.pan, detection.tilt);
+        if (due && socket.connected())
+        {
+            sentCapturedUs[seq].store(detection.frame.capturedUs);
+            if (sendCommand(socket, options, detection, seq, options.fire && detection.found))
+            {
+                uint64_t sentUs = nowUs();
+                transmitStats.add(sentUs - detection.detectedUs);
+                totalStats.add(sentUs - detection.frame.capturedUs);
+                sentCount++;
+                seq++;
+                schedule.sent(nowMs, detection.found, detection.pan, detection.tilt);
+                lastSendUs = sentUs;
+            }
+        }
+        else if (now - lastSendUs > KEEPALIVE_US && socket.connected())
+        {
+            socket.ping();
+            lastSendUs = now;
+        }
+    }
+    if (record != NULL)
+    {
+        fclose(record);
+    }
+    pipelineDone = true;
+}
+
+static void onSinkMessage(const uint8_t *data, size_t length, bool binary)
+{
+    TurretFrame frame;
+    if (!binary || decodeTurretFrame(data, length, frame) != TURRET_DECODE_OK)
+    {
+        sinkCount++;
+        return;
+    }
+    uint64_t captured = sentCapturedUs[frame.seq].load();
+    if (captured != 0)
+    {
+        sinkStats.add(nowUs() - captured);
+    }
+    sinkCount++;
+}
+
+static void report(uint64_t elapsedUs)
+{
+    static uint64_t lastCaptured = 0, lastDetected = 0, lastSent = 0;
+    double seconds = elapsedUs / 1e6;
+    uint64_t captured = capturedCount, detected = detectedCount, sent = sentCount;
+    printf("capture %.1f fps, detect %.1f fps, sent %.1f/s, dropped %llu before detect, %llu before send, sink got %llu\n",
+           (captured - lastCaptured) / seconds, (detected - lastDetected) / seconds, (sent - lastSent) / seconds,
+           (unsigned long long)captureQueue.droppedCount(), (unsigned long long)detectQueue.droppedCount(),
+           (unsigned long long)sinkCount.load());
+    lastCaptured = captured;
+    lastDetected = detected;
+    lastSent = sent;
+    queueStats.report(stdout);
+    detectStats.report(stdout);
+    transmitStats.report(stdout);
+    totalStats.report(stdout);
+    sinkStats.report(stdout);
+    fflush(stdout);
+}
+
+static void draw(Detection &detection)
+{
+    cv::Mat &img = detection.frame.image;
+    int cx = img.cols / 2;
+    int cy = img.rows / 2;
+    for (const TrackedFace &tracked : detection.faces)
+    {
+        const HaarDetection &face = tracked.face;
+        cv::Scalar colour = tracked.id == detection.targetId ? cv::Scalar(0, 0, 255) : cv::Scalar(0, 255, 0);
+        cv::rectangle(img, cv::Rect(face.x, face.y, face.width, face.height), colour, 2);
+        cv::putText(img, "#" + std::to_string(tracked.id) + " n=" + std::to_string(face.neighbours),
+                    cv::Point(face.x, std::max(face.y - 8, 20)), cv::FONT_HERSHEY_PLAIN, 1.5, colour, 2);
+    }
+    if (detection.found)
+    {
+        int fx = detection.face.x + detection.face.width / 2;
+        int fy = detection.face.y + detection.face.height / 2;
+        cv::circle(img, cv::Point(fx, fy), 80, cv::Scalar(0, 0, 255), 2);
+        cv::line(img, cv::Point(0, fy), cv::Point(img.cols, fy), cv::Scalar(0, 0, 0), 2);
+        cv::line(img, cv::Point(fx, img.rows), cv::Point(fx, 0), cv::Scalar(0, 0, 0), 2);
+        cv::circle(img, cv::Point(fx, fy), 15, cv::Scalar(0, 0, 255), cv::FILLED);
+        cv::putText(img, "TARGET LOCKED", cv::Point(50, 200), cv::FONT_HERSHEY_PLAIN, 3, cv::Scalar(255, 0, 255), 3);
+        cv::putText(img, "Servo X: " + std::to_string(detection.pan), cv::Point(50, 50), cv::FONT_HERSHEY_PLAIN, 2, cv::Scalar(255, 0, 0), 2);
+        cv::putText(img, "Servo Y: " + std::to_string(detection.tilt), cv::Point(50, 100), cv::FONT_HERSHEY_PLAIN, 2, cv::Scalar(255, 0, 0), 2);
+    }
+    else
+    {
+        cv::putText(img, "NO TARGET", cv::Point(std::max(img.cols - 400, 0), 50), cv::FONT_HERSHEY_PLAIN, 3, cv::Scalar(0, 0, 255), 3);
+        cv::circle(img, cv::Point(cx, cy), 80, cv::Scalar(0, 0, 255), 2);
+        cv::circle(img, cv::Point(cx, cy), 15, cv::Scalar(0, 0, 255), cv::FILLED);
+        cv::line(img, cv::Point(0, cy), cv::Point(img.cols, cy), cv::Scalar(0, 0, 0), 2);
+        cv::line(img, cv::Point(cx, img.rows), cv::Point(cx, 0), cv::Scalar(0, 0, 0), 2);
+    }
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--url") == 0 && hasValue)
+            options.url = argv[++i];
+        else if (strcmp(arg, "--camera") == 0 && hasValue)
+            options.camera = atoi(argv[++i]);
+        else if (strcmp(arg, "--replay") == 0 && hasValue)
+            options.replay = argv[++i];
+        else if (strcmp(arg, "--cascade") == 0 && hasValue)
+            options.cascade = argv[++i];
+        else if (strcmp(arg, "--record") == 0 && hasValue)
+            options.record = argv[++i];
+        else if (strcmp(arg, "--threshold") == 0 && hasValue)
+            options.threshold = atoi(argv[++i]);
+        else if (strcmp(arg, "--sink") == 0 && hasValue)
+            options.sinkPort = atoi(argv[++i]);
+        else if (strcmp(arg, "--report") == 0 && hasValue)
+            options.reportSeconds = std::max(1, atoi(argv[++i]));
+        else if (strcmp(arg, "--detect-scale") == 0 && hasValue)
+            options.detectScale = std::min(1.0, std::max(0.1, atof(argv[++i])));
+        else if (strcmp(arg, "--threads") == 0 && hasValue)
+            options.detectThreads = std::max(0, atoi(argv[++i]));
+        else if (strcmp(arg, "--engine") == 0 && hasValue && (strcmp(argv[i + 1], "native") == 0 || strcmp(argv[i + 1], "opencv") == 0))
+            options.opencv = strcmp(argv[++i], "opencv") == 0;
+        else if (strcmp(arg, "--target") == 0 && hasValue && (strcmp(argv[i + 1], "largest") == 0 || strcmp(argv[i + 1], "persistent") == 0))
+            options.persistent = strcmp(argv[++i], "persistent") == 0;
+        else if (strcmp(arg, "--headless") == 0)
+            options.headless = true;
+        else if (strcmp(arg, "--json") == 0)
+            options.json = true;
+        else if (strcmp(arg, "--fire") == 0)
+            options.fire = true;
+        else if (strcmp(arg, "--fast") == 0)
+            options.fast = true;
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [--url ws://host/ws] [--camera N | --replay FILE] [--headless]\n"
+                    "       [--threshold N] [--json] [--fire] [--fast] [--sink PORT] [--report SECONDS]\n"
+                    "       [--cascade FILE] [--detect-scale F] [--record FILE]\n"
+                    "       [--engine native|opencv] [--threads N] [--target largest|persistent]\n",
+                    argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        return 2;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    cv::CascadeClassifier cascade;
+    HaarCascade haarCascade;
+    std::string cascadeError;
+    if (options.opencv ? !cascade.load(options.cascade) : !haarCascade.load(options.cascade, cascadeError))
+    {
+        fprintf(stderr, "Cannot load cascade %s%s%s\n", options.cascade.c_str(),
+                cascadeError.empty() ? "" : ": ", cascadeError.c_str());
+        return 1;
+    }
+    HaarDetector detector(haarCascade, options.opencv ? 1 : options.detectThreads);
+
+    cv::VideoCapture capture;
+    if (options.replay.empty())
+    {
+        capture.open(options.camera);
+        capture.set(cv::CAP_PROP_FRAME_WIDTH, CAPTURE_WIDTH);
+        capture.set(cv::CAP_PROP_FRAME_HEIGHT, CAPTURE_HEIGHT);
+    }
+    else
+    {
+        capture.open(options.replay);
+    }
+    if (!capture.isOpened())
+    {
+        fprintf(stderr, "Camera couldn't Access!!!\n");
+        return 1;
+    }
+
+    WebSocketSink sink;
+    std::string url = options.url;
+    if (options.sinkPort > 0)
+    {
+        std::string error;
+        if (!sink.start(options.sinkPort, onSinkMessage, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        url = "ws://127.0.0.1:" + std::to_string(options.sinkPort) + "/";
+    }
+
+    // A turret that is not up yet is no reason to stop: the transmit stage
+    // keeps reconnecting and sends once it answers
+    WebSocketClient socket;
+    std::string error;
+    if (!socket.connect(url, error))
+    {
+        fprintf(stderr, "WebSocket Connection Error: %s, retrying\n", error.c_str());
+    }
+
+    uint64_t startUs = nowUs();
+    std::thread captureThread(captureStage, std::ref(capture), std::cref(options));
+    std::thread detectThread(detectStage, std::ref(cascade), std::ref(detector), std::cref(options));
+    std::thread transmitThread(transmitStage, std::ref(socket), std::cref(url), std::cref(options));
+
+    // The main thread owns the window (highgui is not thread safe) and the
+    // periodic report
+    uint64_t reportUs = (uint64_t)options.reportSeconds * 1000000;
+    uint64_t lastReportUs = startUs;
+    Detection shown;
+    // Replays end on their own, the camera runs until interrupted
+    while (!stopping && !pipelineDone)
+    {
+        if (options.headless)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        else
+        {
+            if (displayQueue.tryPop(shown))
+            {
+                draw(shown);
+                cv::imshow("Image", shown.frame.image);
+            }
+            int key = cv::waitKey(1);
+            if (key == 'q' || key == 27)
+            {
+                stopping = true;
+            }
+        }
+
+        uint64_t now = nowUs();
+        if (now - lastReportUs >= reportUs)
+        {
+            report(now - lastReportUs);
+            lastReportUs = now;
+        }
+    }
+
+    stopping = true;
+    captureThread.join();
+    detectThread.join();
+    transmitThread.join();
+    // Give the sink a moment to take the last frames off the socket
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    report(nowUs() - lastReportUs);
+    socket.close();
+    sink.stop();
+    return 0;
+}